@@ -22,8 +22,16 @@
 #include "apt-cache-file.h"
 
 #include <sstream>
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/stat.h>
 #include <apt-pkg/algorithms.h>
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/configuration.h>
 #include <apt-pkg/progress.h>
 #include <apt-pkg/upgrade.h>
 
@@ -32,6 +40,9 @@
 
 using namespace APT;
 
+// fewer packages than this per worker are not worth starting a thread for
+#define SEARCH_PACKAGES_PER_THREAD 4096
+
 AptCacheFile::AptCacheFile(PkBackendJob *job) :
     m_packageRecords(0),
     m_job(job)
@@ -46,9 +57,24 @@ AptCacheFile::~AptCacheFile()
 bool AptCacheFile::Open(bool withLock)
 {
     OpPackageKitProgress progress(m_job);
+
+    // anything changed after this is seen by isCurrent()
+    m_stamp = AptWarmCache::stamp();
     return pkgCacheFile::Open(&progress, withLock);
 }
 
+bool AptCacheFile::isCurrent() const
+{
+    return !m_stamp.empty() && m_stamp == AptWarmCache::stamp();
+}
+
+bool AptCacheFile::isClean() const
+{
+    return IsDepCacheBuilt() &&
+           DCache->InstCount() == 0 &&
+           DCache->DelCount() == 0;
+}
+
 void AptCacheFile::Close()
 {
     delete m_packageRecords;
@@ -462,7 +488,15 @@ std::string AptCacheFile::getShortDescription(const pkgCache::VerIterator &ver)
 
 std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver)
 {
-    if (ver.end() || ver.FileList().end() || GetPkgRecords() == 0) {
+    if (GetPkgRecords() == 0) {
+        return string();
+    }
+    return getLongDescription(ver, *m_packageRecords);
+}
+
+std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver, pkgRecords &records)
+{
+    if (ver.end() || ver.FileList().end()) {
         return string();
     }
 
@@ -475,7 +509,7 @@ std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver)
     if (df.end()) {
         return string();
     } else {
-        return m_packageRecords->Lookup(df).LongDesc();
+        return records.Lookup(df).LongDesc();
     }
 }
 
@@ -484,6 +518,149 @@ std::string AptCacheFile::getLongDescriptionParsed(const pkgCache::VerIterator &
     return debParser(getLongDescription(ver));
 }
 
+// Case insensitive "string.contains", without copying either string
+static bool matchesQueries(const std::vector<std::string> &queries, const char *s)
+{
+    for (const std::string &query : queries) {
+        if (strcasestr(s, query.c_str()) != nullptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PkgList AptCacheFile::searchPackages(const std::vector<std::string> &queries, bool details,
+                                     const std::atomic<bool> &cancel, unsigned int threads)
+{
+    if (GetDepCache() == nullptr) {
+        return PkgList();
+    }
+
+    // ordered by ID, so each worker gets a contiguous range
+    return searchParallel(queries, details, cancel, packagesById(), threads);
+}
+
+PkgList AptCacheFile::searchCandidates(const std::vector<std::string> &queries, bool details,
+                                       const std::atomic<bool> &cancel, const std::vector<uint32_t> &ids)
+{
+    std::vector<pkgCache::PkgIterator> pkgs;
+
+    if (GetDepCache() == nullptr) {
+        return PkgList();
+    }
+
+    const std::vector<pkgCache::PkgIterator> all = packagesById();
+    pkgs.reserve(ids.size());
+    for (uint32_t id : ids) {
+        if (id < all.size()) {
+            pkgs.push_back(all[id]);
+        }
+    }
+    return searchParallel(queries, details, cancel, pkgs, 0);
+}
+
+PkgList AptCacheFile::searchParallel(const std::vector<std::string> &queries, bool details,
+                                     const std::atomic<bool> &cancel, const std::vector<pkgCache::PkgIterator> &pkgs,
+                                     unsigned int threads)
+{
+    PkgList output;
+
+    // the workers only read the cache, so everything they use is built first
+    APT::Configuration::getLanguages();
+
+    // a worker per core, as long as each one has enough packages to scan
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min<size_t>(threads, pkgs.size() / SEARCH_PACKAGES_PER_THREAD + 1);
+
+    std::vector<PkgList> results(threads);
+    std::vector<std::thread> workers;
+    const size_t range = (pkgs.size() + threads - 1) / threads;
+    for (unsigned int i = 0; i < threads; ++i) {
+        const pkgCache::PkgIterator *begin = pkgs.data() + std::min(pkgs.size(), i * range);
+        const pkgCache::PkgIterator *end = pkgs.data() + std::min(pkgs.size(), (i + 1) * range);
+        if (i == threads - 1) {
+            // the calling thread scans the last range itself
+            searchRange(queries, details, cancel, begin, end, results[i]);
+        } else {
+            workers.emplace_back(&AptCacheFile::searchRange, this,
+                                 std::cref(queries), details, std::cref(cancel),
+                                 begin, end, std::ref(results[i]));
+        }
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for (const PkgList &result : results) {
+        output.insert(output.end(), result.begin(), result.end());
+    }
+    return output;
+}
+
+std::vector<pkgCache::PkgIterator> AptCacheFile::packagesById()
+{
+    pkgCache *cache = GetPkgCache();
+    std::vector<pkgCache::PkgIterator> pkgs(cache->Head().PackageCount);
+
+    for (pkgCache::PkgIterator pkg = cache->PkgBegin(); !pkg.end(); ++pkg) {
+        pkgs[pkg->ID] = pkg;
+    }
+    return pkgs;
+}
+
+void AptCacheFile::searchRange(const std::vector<std::string> &queries, bool details, const std::atomic<bool> &cancel,
+                               const pkgCache::PkgIterator *begin, const pkgCache::PkgIterator *end,
+                               PkgList &output)
+{
+    // the shared records keep the last file they read, so each worker has its own
+    std::unique_ptr<pkgRecords> records;
+    if (details) {
+        records.reset(new pkgRecords(*GetPkgCache()));
+    }
+
+    for (const pkgCache::PkgIterator *it = begin; it != end; ++it) {
+        const pkgCache::PkgIterator &pkg = *it;
+        if (cancel) {
+            break;
+        }
+        // Ignore packages that exist only due to dependencies.
+        if (pkg.end() || (pkg.VersionList().end() && pkg.ProvidesList().end())) {
+            continue;
+        }
+
+        const bool nameMatches = matchesQueries(queries, pkg.Name());
+        if (!nameMatches && !details) {
+            continue;
+        }
+
+        const pkgCache::VerIterator &ver = findVer(pkg);
+        if (ver.end() == false) {
+            if (nameMatches ||
+                    matchesQueries(queries, getLongDescription(ver, *records).c_str())) {
+                // The package matched
+                output.append(ver);
+            }
+        } else if (nameMatches) {
+            // The package is virtual and MATCHED the name
+            // Don't insert virtual packages instead add what it provides
+
+            // iterate over the provides list
+            for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
+                const pkgCache::VerIterator &ownerVer = findVer(Prv.OwnerPkg());
+
+                // check to see if the provided package isn't virtual too
+                if (ownerVer.end() == false) {
+                    // we add the package now because we will need to
+                    // remove duplicates later anyway
+                    output.append(ownerVer);
+                }
+            }
+        }
+    }
+}
+
 bool AptCacheFile::tryToInstall(pkgProblemResolver &Fix,
                                 const PkgInfo &pki,
                                 bool autoInst,
@@ -617,6 +794,11 @@ std::string AptCacheFile::debParser(std::string descr)
 OpPackageKitProgress::OpPackageKitProgress(PkBackendJob *job) :
     m_job(job)
 {
+    // a cache opened without a job, such as by the tests, reports nothing
+    if (m_job == nullptr) {
+        return;
+    }
+
     // Set PackageKit status
     pk_backend_job_set_status(m_job, PK_STATUS_ENUM_LOADING_CACHE);
 }
@@ -628,12 +810,15 @@ OpPackageKitProgress::~OpPackageKitProgress()
 
 void OpPackageKitProgress::Done()
 {
+    if (m_job == nullptr) {
+        return;
+    }
     pk_backend_job_set_percentage(m_job, 100);
 }
 
 void OpPackageKitProgress::Update()
 {
-    if (CheckChange() == false) {
+    if (m_job == nullptr || CheckChange() == false) {
         // No change has happened skip
         return;
     }
@@ -641,3 +826,75 @@ void OpPackageKitProgress::Update()
     // Set the new percent
     pk_backend_job_set_percentage(m_job, static_cast<unsigned int>(Percent));
 }
+
+static std::mutex warmCacheMutex;
+static AptCacheFile *warmCache = nullptr;
+
+AptCacheFile *AptWarmCache::take(PkBackendJob *job)
+{
+    AptCacheFile *cache;
+    {
+        std::lock_guard<std::mutex> lock(warmCacheMutex);
+        cache = warmCache;
+        warmCache = nullptr;
+    }
+    if (cache == nullptr)
+        return nullptr;
+
+    if (!cache->isCurrent()) {
+        g_debug("system changed, not using the warm cache");
+        delete cache;
+        return nullptr;
+    }
+    cache->setJob(job);
+    return cache;
+}
+
+void AptWarmCache::give(AptCacheFile *cache)
+{
+    if (cache == nullptr)
+        return;
+
+    // a job that marked packages or saw the system change can't hand on
+    // its cache, as the next job would see its changes
+    if (_error->PendingError() || !cache->isClean() || !cache->isCurrent()) {
+        delete cache;
+        return;
+    }
+    cache->setJob(nullptr);
+
+    std::lock_guard<std::mutex> lock(warmCacheMutex);
+    delete warmCache;
+    warmCache = cache;
+}
+
+void AptWarmCache::clear()
+{
+    std::lock_guard<std::mutex> lock(warmCacheMutex);
+    delete warmCache;
+    warmCache = nullptr;
+}
+
+std::string AptWarmCache::stamp()
+{
+    const std::string paths[] = {
+        _config->FindFile("Dir::State::status"),
+        _config->FindFile("Dir::State::extended_states"),
+        _config->FindDir("Dir::State::lists"),
+        _config->FindFile("Dir::Etc::sourcelist"),
+        _config->FindDir("Dir::Etc::sourceparts"),
+        _config->FindFile("Dir::Etc::preferences"),
+        _config->FindDir("Dir::Etc::preferencesparts"),
+    };
+    std::stringstream out;
+
+    for (const std::string &path : paths) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            out << "-;";
+            continue;
+        }
+        out << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec << ':' << st.st_size << ';';
+    }
+    return out.str();
+}
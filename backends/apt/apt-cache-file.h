@@ -22,6 +22,9 @@
 #ifndef APT_CACHE_FILE_H
 #define APT_CACHE_FILE_H
 
+#include <atomic>
+#include <string>
+
 #include <apt-pkg/cachefile.h>
 #include <apt-pkg/pkgrecords.h>
 #include <apt-pkg/progress.h>
@@ -46,6 +49,28 @@ public:
       */
     void Close();
 
+    /**
+      * Sets the job that progress and errors are reported to, when the
+      * cache is used again for another job
+      */
+    inline void setJob(PkBackendJob *job) { m_job = job; }
+
+    /**
+      * Returns true if the system has not changed since the cache was opened
+      */
+    bool isCurrent() const;
+
+    /**
+      * Returns the stamp of the files the cache was opened from
+      */
+    inline const std::string &stamp() const { return m_stamp; }
+
+    /**
+      * Returns true if the dependency cache was built and no package was
+      * marked to be installed or removed
+      */
+    bool isClean() const;
+
     /**
       * Build caches
       */
@@ -138,11 +163,37 @@ public:
      */
     std::string getLongDescription(const pkgCache::VerIterator &ver);
 
+    /** \return the long description using the given records, as the
+     *  shared ones must not be used from more than one thread.
+     */
+    std::string getLongDescription(const pkgCache::VerIterator &ver, pkgRecords &records);
+
     /** \return a short description string corresponding to the given
      *  version.
      */
     std::string getLongDescriptionParsed(const pkgCache::VerIterator &ver);
 
+    /**
+      * Returns the packages whose name, or also their long description if
+      * details is set, contains any of the queries ignoring case. The cache
+      * is split into package ID ranges that are scanned by up to threads
+      * workers, or one per core if it is 0. Stops early once cancel is set.
+      */
+    PkgList searchPackages(const std::vector<std::string> &queries, bool details,
+                           const std::atomic<bool> &cancel, unsigned int threads = 0);
+
+    /**
+      * Like searchPackages(), but only matches the packages with the given
+      * sorted IDs, such as the candidates from the search index
+      */
+    PkgList searchCandidates(const std::vector<std::string> &queries, bool details,
+                             const std::atomic<bool> &cancel, const std::vector<uint32_t> &ids);
+
+    /**
+      * Returns the packages of the cache, each at the position of its ID
+      */
+    std::vector<pkgCache::PkgIterator> packagesById();
+
     bool tryToInstall(pkgProblemResolver &Fix,
                       const PkgInfo &pki,
                       bool autoInst,
@@ -153,11 +204,53 @@ public:
                      const PkgInfo &pki);
 
 private:
+    PkgList searchParallel(const std::vector<std::string> &queries, bool details,
+                           const std::atomic<bool> &cancel, const std::vector<pkgCache::PkgIterator> &pkgs,
+                           unsigned int threads);
+    void searchRange(const std::vector<std::string> &queries, bool details, const std::atomic<bool> &cancel,
+                     const pkgCache::PkgIterator *begin, const pkgCache::PkgIterator *end,
+                     PkgList &output);
     void buildPkgRecords();
     static std::string debParser(std::string descr);
 
     pkgRecords *m_packageRecords;
     PkBackendJob *m_job;
+    std::string m_stamp;
+};
+
+/**
+ * Keeps one opened cache between read-only jobs, so that each of them
+ * does not have to map pkgcache.bin and build the policy and the
+ * dependency cache again. Read-only jobs can run at the same time, but
+ * only one of them takes the cache, and has it to itself until it gives
+ * it back; the others open their own.
+ */
+class AptWarmCache
+{
+public:
+    /**
+      * Returns the kept cache for the job, or nullptr if there is none
+      * or the dpkg status, package lists or sources changed since it
+      * was opened
+      */
+    static AptCacheFile *take(PkBackendJob *job);
+
+    /**
+      * Keeps the cache for the next job if it is still current and
+      * unmarked, otherwise deletes it
+      */
+    static void give(AptCacheFile *cache);
+
+    /**
+      * Deletes the kept cache
+      */
+    static void clear();
+
+    /**
+      * Returns a string that changes whenever the files the cache is
+      * built from change
+      */
+    static std::string stamp();
 };
 
 /**
@@ -0,0 +1,990 @@
+/* apt-file-index.cpp - Indexes of the files in packages
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "apt-file-index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/indexfile.h>
+#include <apt-pkg/metaindex.h>
+#include <apt-pkg/sourcelist.h>
+#include <apt-pkg/strutl.h>
+
+#define FILE_INDEX_MAGIC "PKFILEX"
+#define FILE_INDEX_VERSION 1
+
+// every this many paths one is stored whole, so the table can be bisected
+#define FILE_INDEX_RESTART_INTERVAL 16
+
+#define FILE_INDEX_FLAG_DESKTOP 1
+
+// how much of the index is written, or of a run read, at a time
+#define FILE_INDEX_BUFFER_SIZE (1 << 20)
+#define FILE_INDEX_RUN_BUFFER_SIZE (64 << 10)
+
+// the paths of the Contents files are sorted in runs of this many bytes
+#define CONTENTS_RUN_SIZE (32 << 20)
+
+/*
+ * The file starts with this header, followed by the packages sorted by
+ * name and their names. Each of the two path tables starts with the
+ * number of paths and of restart points, then the offsets of the restart
+ * points. Every path is stored as the length it shares with the one
+ * before, the rest of it and the package, all but the rest as varints.
+ */
+struct FileIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t packageCount;
+    int64_t stamp;
+    uint32_t packages;
+    uint32_t paths;
+    uint32_t suffixes;
+    uint32_t padding;
+};
+
+struct AptPathIndex::Package
+{
+    int64_t mtime;
+    uint64_t size;
+    uint32_t name;
+    uint32_t flags;
+};
+
+static int64_t mtimeOf(const struct stat &st)
+{
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static bool readVarint(const unsigned char *&p, const unsigned char *end, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; p < end && shift < 32; shift += 7) {
+        value |= static_cast<uint32_t>(*p & 0x7f) << shift;
+        if ((*p++ & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// writes the index so a search never maps a partial one
+static void save(const std::string &fileName, const std::string &file)
+{
+    g_autoptr(GError) error = nullptr;
+
+    if (!g_file_set_contents(fileName.c_str(), file.data(), file.size(), &error)) {
+        g_debug("failed to write %s: %s", fileName.c_str(), error->message);
+    }
+}
+
+AptPathIndex::AptPathIndex() :
+    m_data(nullptr),
+    m_size(0),
+    m_mapped(false),
+    m_written(0)
+{
+}
+
+AptPathIndex::~AptPathIndex()
+{
+    close();
+}
+
+void AptPathIndex::close()
+{
+    if (m_mapped) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_written = 0;
+    m_buffer.clear();
+}
+
+void AptPathIndex::use(std::string &&file)
+{
+    close();
+    m_buffer = std::move(file);
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+int64_t AptPathIndex::stamp() const
+{
+    return reinterpret_cast<const FileIndexHeader *>(m_data)->stamp;
+}
+
+bool AptPathIndex::map(const std::string &fileName)
+{
+    struct stat st;
+    FileIndexHeader header;
+
+    int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(header)) {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const char *>(data);
+    m_size = st.st_size;
+    m_mapped = true;
+    m_written = mtimeOf(st);
+
+    memcpy(&header, m_data, sizeof(header));
+    bool valid = memcmp(header.magic, FILE_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == FILE_INDEX_VERSION &&
+                 header.packages % alignof(Package) == 0 &&
+                 header.packages <= m_size &&
+                 header.packageCount <= (m_size - header.packages) / sizeof(Package);
+    for (uint32_t table : { header.paths, header.suffixes }) {
+        valid = valid &&
+                table % 4 == 0 &&
+                table <= m_size - 2 * sizeof(uint32_t) &&
+                reinterpret_cast<const uint32_t *>(m_data + table)[1] <=
+                    (m_size - table) / sizeof(uint32_t) - 2;
+    }
+    if (!valid) {
+        close();
+    }
+    return valid;
+}
+
+const AptPathIndex::Package *AptPathIndex::findPackage(const std::string &name) const
+{
+    const FileIndexHeader *header = reinterpret_cast<const FileIndexHeader *>(m_data);
+    const Package *begin = reinterpret_cast<const Package *>(m_data + header->packages);
+    const Package *end = begin + header->packageCount;
+
+    const Package *package = std::lower_bound(begin, end, name,
+                                              [this](const Package &p, const std::string &n) {
+        return p.name < m_size && n.compare(m_data + p.name) > 0;
+    });
+    if (package == end || package->name >= m_size || name.compare(m_data + package->name) != 0) {
+        return nullptr;
+    }
+    return package;
+}
+
+// calls f with every path from the first one not before from, until it returns false
+template<typename F>
+void AptPathIndex::scan(bool suffixes, const std::string &from, F f) const
+{
+    const FileIndexHeader *header = reinterpret_cast<const FileIndexHeader *>(m_data);
+    const uint32_t *head = reinterpret_cast<const uint32_t *>(m_data + (suffixes ? header->suffixes : header->paths));
+    const uint32_t count = head[0];
+    const uint32_t restartCount = head[1];
+    const uint32_t *restarts = head + 2;
+    const unsigned char *end = reinterpret_cast<const unsigned char *>(m_data) + m_size;
+    uint32_t shared;
+    uint32_t length;
+    uint32_t pkg;
+    std::string path;
+
+    // find the first restart point not before from, the paths equal to
+    // it can start in the block before
+    uint32_t lo = 0;
+    uint32_t hi = restartCount;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(m_data) + restarts[mid];
+        if (restarts[mid] >= m_size ||
+                !readVarint(p, end, shared) || !readVarint(p, end, length) ||
+                length > static_cast<size_t>(end - p)) {
+            return;
+        }
+        if (from.compare(0, std::string::npos, reinterpret_cast<const char *>(p), length) > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    const uint32_t block = lo > 0 ? lo - 1 : 0;
+    if (block >= restartCount || restarts[block] >= m_size) {
+        return;
+    }
+
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(m_data) + restarts[block];
+    for (uint32_t i = block * FILE_INDEX_RESTART_INTERVAL; i < count; ++i) {
+        if (!readVarint(p, end, shared) || !readVarint(p, end, length) ||
+                shared > path.size() || length > static_cast<size_t>(end - p)) {
+            return;
+        }
+        path.resize(shared);
+        path.append(reinterpret_cast<const char *>(p), length);
+        p += length;
+        if (!readVarint(p, end, pkg)) {
+            return;
+        }
+        if (path.compare(from) < 0) {
+            continue;
+        }
+        if (!f(path, pkg)) {
+            return;
+        }
+    }
+}
+
+void AptPathIndex::find(const std::string &path, bool suffix, std::vector<std::string> &packages) const
+{
+    if (m_data == nullptr || path.empty()) {
+        return;
+    }
+
+    const FileIndexHeader *header = reinterpret_cast<const FileIndexHeader *>(m_data);
+    const Package *first = reinterpret_cast<const Package *>(m_data + header->packages);
+    auto add = [&](uint32_t pkg) {
+        if (pkg < header->packageCount && first[pkg].name < m_size) {
+            packages.push_back(m_data + first[pkg].name);
+        }
+    };
+
+    if (suffix) {
+        // a path ending with it is a reversed path starting with it reversed
+        const std::string reversed(path.rbegin(), path.rend());
+        scan(true, reversed, [&](const std::string &key, uint32_t pkg) {
+            if (key.compare(0, reversed.size(), reversed) != 0) {
+                return false;
+            }
+            add(pkg);
+            return true;
+        });
+    } else {
+        scan(false, path, [&](const std::string &key, uint32_t pkg) {
+            if (key != path) {
+                return false;
+            }
+            add(pkg);
+            return true;
+        });
+    }
+}
+
+bool AptPathIndex::contains(const std::string &package) const
+{
+    return m_data != nullptr && findPackage(package) != nullptr;
+}
+
+// the index as it is laid out, kept in memory or, given a file, written
+// to it whenever a buffer's worth is ready
+class AptPathIndexWriter::Output
+{
+public:
+    explicit Output(int fd = -1) :
+        m_fd(fd),
+        m_written(0),
+        m_failed(false)
+    {
+    }
+
+    uint64_t size() const { return m_written + m_data.size(); }
+    std::string &data() { return m_data; }
+
+    void append(const char *data, size_t length)
+    {
+        m_data.append(data, length);
+        if (m_fd >= 0 && m_data.size() >= FILE_INDEX_BUFFER_SIZE) {
+            flush();
+        }
+    }
+
+    void appendZeros(size_t length)
+    {
+        m_data.append(length, '\0');
+    }
+
+    void appendU32(uint32_t value)
+    {
+        append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void appendVarint(uint32_t value)
+    {
+        char buffer[5];
+        size_t length = 0;
+        while (value >= 0x80) {
+            buffer[length++] = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        buffer[length++] = static_cast<char>(value);
+        append(buffer, length);
+    }
+
+    void align(size_t alignment)
+    {
+        appendZeros((alignment - size() % alignment) % alignment);
+    }
+
+    // overwrites what was appended at offset
+    void patch(uint64_t offset, const void *data, size_t length)
+    {
+        if (offset >= m_written) {
+            memcpy(&m_data[offset - m_written], data, length);
+        } else if (!flush() || pwrite(m_fd, data, length, offset) != (ssize_t) length) {
+            m_failed = true;
+        }
+    }
+
+    // writes out what is buffered, returning false if anything could not be
+    bool flush()
+    {
+        const char *data = m_data.data();
+        size_t left = m_data.size();
+        while (left > 0 && !m_failed) {
+            const ssize_t written = ::write(m_fd, data, left);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                m_failed = true;
+                break;
+            }
+            data += written;
+            left -= written;
+        }
+        m_written += m_data.size();
+        m_data.clear();
+        return !m_failed;
+    }
+
+private:
+    int m_fd;
+    uint64_t m_written;
+    bool m_failed;
+    std::string m_data;
+};
+
+// paths sorted by spill() into a temporary file, read back one at a time
+class AptPathIndexWriter::Run
+{
+public:
+    explicit Run(int fd) :
+        package(0),
+        m_fd(fd),
+        m_start(0)
+    {
+    }
+
+    ~Run()
+    {
+        ::close(m_fd);
+    }
+
+    // reads the next path, returning false at the end
+    bool next()
+    {
+        uint32_t length;
+        if (!nextVarint(length) || !fill(length)) {
+            return false;
+        }
+        path.assign(m_buffer, m_start, length);
+        m_start += length;
+        return nextVarint(package);
+    }
+
+    std::string path;
+    uint32_t package;
+
+private:
+    // makes sure the next length bytes are buffered
+    bool fill(size_t length)
+    {
+        if (m_buffer.size() - m_start >= length) {
+            return true;
+        }
+        m_buffer.erase(0, m_start);
+        m_start = 0;
+
+        size_t have = m_buffer.size();
+        m_buffer.resize(std::max<size_t>(length, FILE_INDEX_RUN_BUFFER_SIZE));
+        while (have < length) {
+            const ssize_t got = ::read(m_fd, &m_buffer[have], m_buffer.size() - have);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                break;
+            }
+            have += got;
+        }
+        m_buffer.resize(have);
+        return have >= length;
+    }
+
+    bool nextVarint(uint32_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 32 && fill(1); shift += 7) {
+            const unsigned char c = m_buffer[m_start++];
+            value |= static_cast<uint32_t>(c & 0x7f) << shift;
+            if ((c & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int m_fd;
+    std::string m_buffer;
+    size_t m_start;
+};
+
+AptPathIndexWriter::AptPathIndexWriter(const std::string &runDir, size_t runSize) :
+    m_pathCount(0),
+    m_runDir(runDir),
+    m_runSize(runDir.empty() ? 0 : runSize),
+    m_failed(false)
+{
+}
+
+AptPathIndexWriter::~AptPathIndexWriter()
+{
+}
+
+uint32_t AptPathIndexWriter::addPackage(const std::string &name, int64_t mtime, uint64_t size,
+                                        uint32_t flags)
+{
+    m_packages.push_back({ name, mtime, size, flags });
+    return m_packages.size() - 1;
+}
+
+void AptPathIndexWriter::addPath(const char *path, size_t length, uint32_t package)
+{
+    if (m_failed) {
+        return;
+    }
+    m_entries.push_back({ m_paths.size(), static_cast<uint32_t>(length), package });
+    m_paths.append(path, length);
+    m_pathCount++;
+
+    if (m_runSize > 0 && m_paths.size() >= m_runSize) {
+        spill();
+    }
+}
+
+void AptPathIndexWriter::sortEntries(bool reversed)
+{
+    // the paths are compared as bytes, like std::string does when reading
+    const unsigned char *paths = reinterpret_cast<const unsigned char *>(m_paths.data());
+    if (!reversed) {
+        std::sort(m_entries.begin(), m_entries.end(), [paths](const Entry &a, const Entry &b) {
+            const int cmp = memcmp(paths + a.offset, paths + b.offset, std::min(a.length, b.length));
+            if (cmp != 0) {
+                return cmp < 0;
+            }
+            return a.length != b.length ? a.length < b.length : a.package < b.package;
+        });
+        return;
+    }
+
+    std::sort(m_entries.begin(), m_entries.end(), [paths](const Entry &a, const Entry &b) {
+        const bool less = std::lexicographical_compare(
+            std::make_reverse_iterator(paths + a.offset + a.length),
+            std::make_reverse_iterator(paths + a.offset),
+            std::make_reverse_iterator(paths + b.offset + b.length),
+            std::make_reverse_iterator(paths + b.offset));
+        const bool greater = std::lexicographical_compare(
+            std::make_reverse_iterator(paths + b.offset + b.length),
+            std::make_reverse_iterator(paths + b.offset),
+            std::make_reverse_iterator(paths + a.offset + a.length),
+            std::make_reverse_iterator(paths + a.offset));
+        return less || (!greater && a.package < b.package);
+    });
+}
+
+// sorts the paths collected so far into a run for each table, and forgets them
+void AptPathIndexWriter::spill()
+{
+    std::string path;
+
+    for (bool reversed : { false, true }) {
+        std::string fileName = m_runDir + "packagekit-sort-XXXXXX";
+        const int fd = g_mkstemp(&fileName[0]);
+        if (fd < 0) {
+            g_debug("failed to create %s: %s", fileName.c_str(), g_strerror(errno));
+            m_failed = true;
+            break;
+        }
+        // nothing is left behind, whatever happens to the daemon
+        g_unlink(fileName.c_str());
+        m_runs[reversed].emplace_back(new Run(fd));
+
+        sortEntries(reversed);
+        Output out(fd);
+        for (const Entry &entry : m_entries) {
+            path.assign(m_paths, entry.offset, entry.length);
+            if (reversed) {
+                std::reverse(path.begin(), path.end());
+            }
+            out.appendVarint(path.size());
+            out.append(path.data(), path.size());
+            out.appendVarint(entry.package);
+        }
+        if (!out.flush() || lseek(fd, 0, SEEK_SET) != 0) {
+            g_debug("failed to write a run to %s", m_runDir.c_str());
+            m_failed = true;
+            break;
+        }
+    }
+
+    m_entries.clear();
+    m_paths.clear();
+}
+
+// appends the paths next returns, which have to be sorted, as a table
+template<typename F>
+bool AptPathIndexWriter::appendTable(Output &out, const std::vector<uint32_t> &ids,
+                                     uint32_t &table, F next) const
+{
+    const uint32_t restartCount = (m_pathCount + FILE_INDEX_RESTART_INTERVAL - 1) /
+                                  FILE_INDEX_RESTART_INTERVAL;
+    std::vector<uint32_t> restarts(restartCount);
+    std::string previous;
+    std::string path;
+    uint32_t package;
+    size_t count = 0;
+
+    out.align(4);
+    if (out.size() > UINT32_MAX || m_pathCount > UINT32_MAX) {
+        return false;
+    }
+    table = out.size();
+    out.appendU32(m_pathCount);
+    out.appendU32(restartCount);
+    const uint64_t restartsOffset = out.size();
+    out.appendZeros(restarts.size() * sizeof(uint32_t));
+
+    for (; next(path, package); ++count) {
+        size_t shared = 0;
+
+        if (count >= m_pathCount) {
+            return false;
+        }
+        if (count % FILE_INDEX_RESTART_INTERVAL == 0) {
+            // later offsets could not be stored
+            if (out.size() > UINT32_MAX) {
+                return false;
+            }
+            restarts[count / FILE_INDEX_RESTART_INTERVAL] = out.size();
+        } else {
+            while (shared < previous.size() && shared < path.size() &&
+                   previous[shared] == path[shared]) {
+                shared++;
+            }
+        }
+        out.appendVarint(shared);
+        out.appendVarint(path.size() - shared);
+        out.append(path.data() + shared, path.size() - shared);
+        out.appendVarint(ids[package]);
+        previous.swap(path);
+    }
+
+    // a run that could not be read back is missing paths
+    if (count != m_pathCount) {
+        return false;
+    }
+    out.patch(restartsOffset, restarts.data(), restarts.size() * sizeof(uint32_t));
+    return true;
+}
+
+bool AptPathIndexWriter::layOut(Output &out, int64_t stamp)
+{
+    // the rest is sorted like the paths before it
+    if (!m_runs[0].empty() && !m_entries.empty()) {
+        spill();
+    }
+    if (m_failed) {
+        return false;
+    }
+
+    // the packages are sorted by name, so they can be bisected
+    std::vector<uint32_t> order(m_packages.size());
+    std::vector<uint32_t> ids(m_packages.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return m_packages[a].name < m_packages[b].name;
+    });
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        ids[order[i]] = i;
+    }
+
+    FileIndexHeader header = {};
+    memcpy(header.magic, FILE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = FILE_INDEX_VERSION;
+    header.packageCount = m_packages.size();
+    header.stamp = stamp;
+
+    out.appendZeros(sizeof(header));
+    out.align(alignof(AptPathIndex::Package));
+    header.packages = out.size();
+    std::vector<AptPathIndex::Package> packages(m_packages.size());
+    out.appendZeros(packages.size() * sizeof(AptPathIndex::Package));
+    for (size_t i = 0; i < order.size(); ++i) {
+        const PackageInfo &info = m_packages[order[i]];
+        packages[i] = { info.mtime, info.size, static_cast<uint32_t>(out.size()), info.flags };
+        out.append(info.name.c_str(), info.name.size() + 1);
+    }
+    out.patch(header.packages, packages.data(), packages.size() * sizeof(AptPathIndex::Package));
+
+    for (bool reversed : { false, true }) {
+        uint32_t &table = reversed ? header.suffixes : header.paths;
+        bool laidOut;
+
+        if (m_runs[reversed].empty()) {
+            size_t i = 0;
+            sortEntries(reversed);
+            laidOut = appendTable(out, ids, table, [&](std::string &path, uint32_t &package) {
+                if (i == m_entries.size()) {
+                    return false;
+                }
+                const Entry &entry = m_entries[i++];
+                path.assign(m_paths, entry.offset, entry.length);
+                if (reversed) {
+                    std::reverse(path.begin(), path.end());
+                }
+                package = entry.package;
+                return true;
+            });
+        } else {
+            // the runs are merged, taking the first path of any of them
+            auto after = [](const Run *a, const Run *b) {
+                const int cmp = a->path.compare(b->path);
+                return cmp != 0 ? cmp > 0 : a->package > b->package;
+            };
+            std::priority_queue<Run *, std::vector<Run *>, decltype(after)> runs(after);
+            for (const std::unique_ptr<Run> &run : m_runs[reversed]) {
+                if (run->next()) {
+                    runs.push(run.get());
+                }
+            }
+            laidOut = appendTable(out, ids, table, [&](std::string &path, uint32_t &package) {
+                if (runs.empty()) {
+                    return false;
+                }
+                Run *run = runs.top();
+                runs.pop();
+                path.swap(run->path);
+                package = run->package;
+                if (run->next()) {
+                    runs.push(run);
+                }
+                return true;
+            });
+        }
+        if (!laidOut) {
+            return false;
+        }
+    }
+
+    if (out.size() > UINT32_MAX) {
+        return false;
+    }
+    out.patch(0, &header, sizeof(header));
+    return true;
+}
+
+std::string AptPathIndexWriter::finish(int64_t stamp)
+{
+    Output out;
+    if (!layOut(out, stamp)) {
+        g_warning("file index is too large");
+        return std::string();
+    }
+    return std::move(out.data());
+}
+
+bool AptPathIndexWriter::write(const std::string &fileName, int64_t stamp)
+{
+    // written next to it and renamed over it, so a search never maps a partial one
+    std::string tmpName = fileName + ".XXXXXX";
+    const int fd = g_mkstemp(&tmpName[0]);
+    if (fd < 0) {
+        g_debug("failed to create %s: %s", tmpName.c_str(), g_strerror(errno));
+        return false;
+    }
+    Output out(fd);
+    if (!layOut(out, stamp)) {
+        g_warning("%s could not be laid out, it may be too large", fileName.c_str());
+        ::close(fd);
+        g_unlink(tmpName.c_str());
+        return false;
+    }
+    const bool written = out.flush() && fchmod(fd, 0644) == 0 && fsync(fd) == 0;
+    ::close(fd);
+    if (!written || g_rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        g_debug("failed to write %s", fileName.c_str());
+        g_unlink(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string DpkgFileIndex::path()
+{
+    return _config->FindDir("Dir::Cache") + "packagekit-files.bin";
+}
+
+std::string DpkgFileIndex::infoDir()
+{
+    return flNotFile(_config->FindFile("Dir::State::status")) + "info/";
+}
+
+bool DpkgFileIndex::open()
+{
+    struct stat st;
+
+    if (m_data != nullptr) {
+        return true;
+    }
+
+    // dpkg replaces the *.list files, which changes the directory
+    if (stat(infoDir().c_str(), &st) != 0) {
+        return false;
+    }
+    const int64_t dirStamp = mtimeOf(st);
+
+    // a change in the same timestamp tick as the scan does not move the
+    // mtime, so an index written no later than what it saw is rescanned
+    if (map(path()) && stamp() == dirStamp && dirStamp < m_written) {
+        return true;
+    }
+    return update(dirStamp);
+}
+
+bool DpkgFileIndex::update(int64_t dirStamp)
+{
+    AptPathIndexWriter writer;
+    std::vector<std::vector<std::string>> previous;
+    const std::string dir = infoDir();
+    guint reread = 0;
+
+    DIR *dp = opendir(dir.c_str());
+    if (dp == nullptr) {
+        g_debug("Error opening %s", dir.c_str());
+        close();
+        return false;
+    }
+
+    // the old index has the paths of every list that did not change
+    if (m_data != nullptr) {
+        previous.resize(reinterpret_cast<const FileIndexHeader *>(m_data)->packageCount);
+        scan(false, std::string(), [&](const std::string &path, uint32_t pkg) {
+            if (pkg < previous.size()) {
+                previous[pkg].push_back(path);
+            }
+            return true;
+        });
+    }
+
+    for (struct dirent *dirp = readdir(dp); dirp != nullptr; dirp = readdir(dp)) {
+        struct stat st;
+        if (!g_str_has_suffix(dirp->d_name, ".list") ||
+                fstatat(dirfd(dp), dirp->d_name, &st, 0) != 0) {
+            continue;
+        }
+        const std::string name(dirp->d_name, strlen(dirp->d_name) - 5);
+
+        const Package *old = m_data != nullptr ? findPackage(name) : nullptr;
+        if (old != nullptr && old->mtime == mtimeOf(st) && old->size == (uint64_t) st.st_size &&
+                old->mtime < m_written) {
+            const Package *first = reinterpret_cast<const Package *>(
+                m_data + reinterpret_cast<const FileIndexHeader *>(m_data)->packages);
+            const uint32_t package = writer.addPackage(name, old->mtime, old->size, old->flags);
+            for (const std::string &path : previous[old - first]) {
+                writer.addPath(path.data(), path.size(), package);
+            }
+            continue;
+        }
+
+        // reads the files the package installed from its *.list file
+        g_autofree gchar *contents = nullptr;
+        gsize length;
+        if (!g_file_get_contents((dir + dirp->d_name).c_str(), &contents, &length, nullptr)) {
+            continue;
+        }
+        uint32_t flags = 0;
+        std::vector<std::pair<const gchar *, size_t>> lines;
+        for (const gchar *line = contents; line < contents + length; ) {
+            const gchar *eol = static_cast<const gchar *>(memchr(line, '\n', contents + length - line));
+            if (eol == nullptr) {
+                eol = contents + length;
+            }
+            if (eol > line) {
+                lines.emplace_back(line, eol - line);
+                if (eol - line >= 8 && memcmp(eol - 8, ".desktop", 8) == 0) {
+                    flags |= FILE_INDEX_FLAG_DESKTOP;
+                }
+            }
+            line = eol + 1;
+        }
+        const uint32_t package = writer.addPackage(name, mtimeOf(st), st.st_size, flags);
+        for (const auto &line : lines) {
+            writer.addPath(line.first, line.second, package);
+        }
+        reread++;
+    }
+    closedir(dp);
+
+    std::string file = writer.finish(dirStamp);
+    if (file.empty()) {
+        close();
+        return false;
+    }
+
+    // the next job maps it, even if this one could not write it
+    save(path(), file);
+    g_debug("file index has %zu paths of %zu packages, read %u lists, %zu bytes",
+            writer.pathCount(), writer.packageCount(), reread, file.size());
+    use(std::move(file));
+    return true;
+}
+
+bool DpkgFileIndex::hasDesktopFile(const std::string &package) const
+{
+    const Package *found = m_data != nullptr ? findPackage(package) : nullptr;
+    return found != nullptr && (found->flags & FILE_INDEX_FLAG_DESKTOP);
+}
+
+std::string AptContentsIndex::path()
+{
+    return _config->FindDir("Dir::Cache") + "packagekit-contents.bin";
+}
+
+bool AptContentsIndex::open()
+{
+    return m_data != nullptr || map(path());
+}
+
+// reads a whole line, however long
+static bool readLine(FileFd &fd, std::string &line)
+{
+    char buffer[4096];
+
+    line.clear();
+    while (fd.ReadLine(buffer, sizeof(buffer)) != nullptr) {
+        line.append(buffer);
+        if (!line.empty() && line.back() == '\n') {
+            return true;
+        }
+    }
+    return !line.empty();
+}
+
+bool AptContentsIndex::build(pkgSourceList &sources)
+{
+    // the Contents files have millions of paths, which are sorted on disk
+    AptPathIndexWriter writer(_config->FindDir("Dir::Cache"), CONTENTS_RUN_SIZE);
+    std::unordered_map<std::string, uint32_t> packages;
+    std::string package;
+    std::string buffer;
+    guint files = 0;
+
+    for (pkgSourceList::const_iterator it = sources.begin(); it != sources.end(); ++it) {
+        for (const IndexTarget &target : (*it)->GetIndexTargets()) {
+            // only there if the Contents-deb targets are enabled, as for apt-file
+            if (!APT::String::Startswith(target.Option(IndexTarget::CREATED_BY), "Contents-deb")) {
+                continue;
+            }
+            const std::string fileName = target.Option(IndexTarget::EXISTING_FILENAME);
+            const std::string arch = target.Option(IndexTarget::ARCHITECTURE);
+            FileFd fd;
+            if (fileName.empty() || !fd.Open(fileName, FileFd::ReadOnly, FileFd::Extension)) {
+                continue;
+            }
+            files++;
+
+            // every line is a path without the leading slash, then the
+            // packages shipping it as section/name separated by commas
+            while (readLine(fd, buffer)) {
+                const char *line = buffer.c_str();
+                size_t length = buffer.size();
+                while (length > 0 && g_ascii_isspace(line[length - 1])) {
+                    length--;
+                }
+                size_t location = length;
+                while (location > 0 && !g_ascii_isspace(line[location - 1])) {
+                    location--;
+                }
+                size_t end = location;
+                while (end > 0 && g_ascii_isspace(line[end - 1])) {
+                    end--;
+                }
+                // skips the prose before the paths in older files
+                if (end == 0 || memchr(line + location, '/', length - location) == nullptr) {
+                    continue;
+                }
+
+                const std::string path = std::string("/") + std::string(line, end);
+                for (size_t i = location; i < length; ) {
+                    const char *comma = static_cast<const char *>(memchr(line + i, ',', length - i));
+                    const size_t next = comma != nullptr ? comma - line : length;
+                    const char *name = static_cast<const char *>(memrchr(line + i, '/', next - i));
+                    name = name != nullptr ? name + 1 : line + i;
+                    package.assign(name, line + next - name);
+                    package.append(":").append(arch);
+
+                    auto found = packages.find(package);
+                    if (found == packages.end()) {
+                        found = packages.emplace(package, writer.addPackage(package)).first;
+                    }
+                    writer.addPath(path.data(), path.size(), found->second);
+                    i = next + 1;
+                }
+            }
+        }
+    }
+
+    // don't leave the files of repositories that are gone behind
+    if (files == 0) {
+        g_unlink(path().c_str());
+        return false;
+    }
+
+    // it is rebuilt on every refresh, so there is nothing to compare with,
+    // and one that could not be replaced would be for other repositories
+    if (!writer.write(path(), 0)) {
+        g_unlink(path().c_str());
+        return false;
+    }
+    g_debug("contents index has %zu paths of %zu packages from %u files",
+            writer.pathCount(), writer.packageCount(), files);
+    return true;
+}
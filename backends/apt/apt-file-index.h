@@ -0,0 +1,191 @@
+/* apt-file-index.h - Indexes of the files in packages
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef APT_FILE_INDEX_H
+#define APT_FILE_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class pkgSourceList;
+
+/**
+ * An on-disk index of paths, mapped to the packages that own them. The
+ * paths are kept sorted both as they are and reversed, so exact paths
+ * and path suffixes are binary searches.
+ */
+class AptPathIndex
+{
+public:
+    struct Package;
+
+    AptPathIndex();
+    ~AptPathIndex();
+
+    /**
+      * Adds the packages owning path to packages, or, if suffix is set,
+      * those owning any path ending with it
+      */
+    void find(const std::string &path, bool suffix, std::vector<std::string> &packages) const;
+
+    /**
+      * Returns true if the index has paths of the package
+      */
+    bool contains(const std::string &package) const;
+
+protected:
+    bool map(const std::string &fileName);
+    void use(std::string &&file);
+    void close();
+    int64_t stamp() const;
+    const Package *findPackage(const std::string &name) const;
+    template<typename F> void scan(bool suffixes, const std::string &from, F f) const;
+
+    const char *m_data;
+    size_t m_size;
+    bool m_mapped;
+    std::string m_buffer;
+    // when the mapped file was written, in ns
+    int64_t m_written;
+};
+
+/**
+ * Collects the paths of packages and lays them out as an AptPathIndex.
+ * Given a directory, it does not keep them all in memory: whenever
+ * runSize bytes of paths were added, it sorts them into temporary files
+ * there, which write() merges.
+ */
+class AptPathIndexWriter
+{
+public:
+    explicit AptPathIndexWriter(const std::string &runDir = std::string(), size_t runSize = 0);
+    ~AptPathIndexWriter();
+
+    /**
+      * Adds a package, returning the number its paths are added with
+      */
+    uint32_t addPackage(const std::string &name, int64_t mtime = 0, uint64_t size = 0,
+                        uint32_t flags = 0);
+
+    void addPath(const char *path, size_t length, uint32_t package);
+
+    /**
+      * Returns the contents of the index file, or an empty string if
+      * it would be too large
+      */
+    std::string finish(int64_t stamp);
+
+    /**
+      * Replaces fileName with the index, returning false if it would be
+      * too large or could not be written
+      */
+    bool write(const std::string &fileName, int64_t stamp);
+
+    size_t pathCount() const { return m_pathCount; }
+    size_t packageCount() const { return m_packages.size(); }
+
+private:
+    class Output;
+    class Run;
+    struct PackageInfo
+    {
+        std::string name;
+        int64_t mtime;
+        uint64_t size;
+        uint32_t flags;
+    };
+    struct Entry
+    {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t package;
+    };
+
+    void sortEntries(bool reversed);
+    void spill();
+    bool layOut(Output &out, int64_t stamp);
+    template<typename F> bool appendTable(Output &out, const std::vector<uint32_t> &ids,
+                                          uint32_t &table, F next) const;
+
+    std::vector<PackageInfo> m_packages;
+    std::vector<Entry> m_entries;
+    std::string m_paths;
+    size_t m_pathCount;
+    std::string m_runDir;
+    size_t m_runSize;
+    std::vector<std::unique_ptr<Run>> m_runs[2];
+    bool m_failed;
+};
+
+/**
+ * The index of the files installed by dpkg, from its *.list files. Only
+ * the *.list files that changed since the last update are read again.
+ */
+class DpkgFileIndex : public AptPathIndex
+{
+public:
+    /**
+      * Maps the index, updating it first if dpkg's info directory changed
+      */
+    bool open();
+
+    /**
+      * Returns true if the package installed a .desktop file
+      */
+    bool hasDesktopFile(const std::string &package) const;
+
+    /**
+      * Returns where the index is stored, next to the apt caches
+      */
+    static std::string path();
+
+    /**
+      * Returns dpkg's info directory, where the *.list files are
+      */
+    static std::string infoDir();
+
+private:
+    bool update(int64_t stamp);
+};
+
+/**
+ * The index of the files in the available packages, from the Contents
+ * files of the repositories. The packages are named "name:arch".
+ */
+class AptContentsIndex : public AptPathIndex
+{
+public:
+    /**
+      * Maps the index, returning false if no repository has Contents files
+      */
+    bool open();
+
+    /**
+      * Indexes the Contents files apt downloaded for the sources
+      */
+    static bool build(pkgSourceList &sources);
+
+    /**
+      * Returns where the index is stored, next to the apt caches
+      */
+    static std::string path();
+};
+
+#endif // APT_FILE_INDEX_H
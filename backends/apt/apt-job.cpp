@@ -45,12 +45,13 @@
 #include <pty.h>
 
 #include <iostream>
+#include <algorithm>
 #include <sstream>
 #include <memory>
 #include <fstream>
-#include <dirent.h>
 
 #include "apt-cache-file.h"
+#include "apt-search-index.h"
 #include "apt-utils.h"
 #include "gst-matcher.h"
 #include "apt-messages.h"
@@ -61,9 +62,13 @@ using namespace APT;
 
 #define RAMFS_MAGIC     0x858458f6
 
+// jobs are only created and destroyed on the main thread
+static guint runningJobs = 0;
+
 AptJob::AptJob(PkBackendJob *job) :
     m_cache(nullptr),
     m_job(job),
+    m_warmCache(false),
     m_cancel(false),
     m_lastSubProgress(0),
     m_terminalTimeout(120)
@@ -71,14 +76,24 @@ AptJob::AptJob(PkBackendJob *job) :
     const gchar *http_proxy;
     const gchar *ftp_proxy;
 
-    // set locale
+    // read-only jobs can start while others are running, and must not
+    // change the environment or the locale under them; the scheduler only
+    // lets them join jobs of the same locale, and they don't download
+    if (runningJobs++ > 0)
+        return;
+
+    // set locale, and let APT pick the description languages for it again
+    // while no other job could be reading them
     setEnvLocaleFromJob();
+    APT::Configuration::getLanguages(false, false);
 
-    // set http proxy
+    // set http proxy, or drop the one of an earlier job
     http_proxy = pk_backend_job_get_proxy_http(m_job);
     if (http_proxy != NULL) {
         g_autofree gchar *uri = pk_backend_convert_uri(http_proxy);
         g_setenv("http_proxy", uri, TRUE);
+    } else {
+        g_unsetenv("http_proxy");
     }
 
     // set ftp proxy
@@ -86,15 +101,20 @@ AptJob::AptJob(PkBackendJob *job) :
     if (ftp_proxy != NULL) {
         g_autofree gchar *uri = pk_backend_convert_uri(ftp_proxy);
         g_setenv("ftp_proxy", uri, TRUE);
+    } else {
+        g_unsetenv("ftp_proxy");
     }
-
-    // default settings
-    _config->CndSet("APT::Get::AutomaticRemove::Kernels", _config->FindB("APT::Get::AutomaticRemove", true));
 }
 
 AptJob::~AptJob()
 {
-    delete m_cache;
+    runningJobs--;
+
+    // keep the cache for the next read-only job
+    if (m_warmCache)
+        AptWarmCache::give(m_cache);
+    else
+        delete m_cache;
 }
 
 bool AptJob::init(gchar **localDebs)
@@ -129,42 +149,55 @@ bool AptJob::init(gchar **localDebs)
         withLock = !simulate;
     }
 
-    // Create the AptCacheFile class to search for packages
-    m_cache = new AptCacheFile(m_job);
-    if (localDebs) {
-        PkBitfield flags = pk_backend_job_get_transaction_flags(m_job);
-        if (pk_bitfield_contain(flags, PK_TRANSACTION_FLAG_ENUM_ONLY_TRUSTED)) {
-            // We are NOT simulating and have untrusted packages
-            // fail the transaction.
-            pk_backend_job_error_code(m_job,
-                                  PK_ERROR_ENUM_CANNOT_INSTALL_REPO_UNSIGNED,
-                                  "Local packages cannot be authenticated");
-            return false;
-        }
+    // Jobs that don't change the system can use the cache of the last one,
+    // and a job that does makes it out of date
+    m_warmCache = !withLock && !simulate && !AllowBroken && localDebs == nullptr;
+    if (m_warmCache)
+        m_cache = AptWarmCache::take(m_job);
+    else
+        AptWarmCache::clear();
 
-        for (guint i = 0; i < g_strv_length(localDebs); ++i)
-            markFileForInstall(localDebs[i]);
-    }
+    if (m_cache != nullptr) {
+        g_debug("using the warm cache");
+    } else {
+        // Create the AptCacheFile class to search for packages
+        m_cache = new AptCacheFile(m_job);
+        if (localDebs) {
+            PkBitfield flags = pk_backend_job_get_transaction_flags(m_job);
+            if (pk_bitfield_contain(flags, PK_TRANSACTION_FLAG_ENUM_ONLY_TRUSTED)) {
+                // We are NOT simulating and have untrusted packages
+                // fail the transaction.
+                pk_backend_job_error_code(m_job,
+                                      PK_ERROR_ENUM_CANNOT_INSTALL_REPO_UNSIGNED,
+                                      "Local packages cannot be authenticated");
+                return false;
+            }
 
-    int timeout = 10;
-    // TODO test this
-    while (m_cache->Open(withLock) == false) {
-        if (withLock == false || (timeout <= 0)) {
-            show_errors(m_job, PK_ERROR_ENUM_CANNOT_GET_LOCK);
-            return false;
-        } else {
-            _error->Discard();
-            pk_backend_job_set_status(m_job, PK_STATUS_ENUM_WAITING_FOR_LOCK);
-            sleep(1);
-            timeout--;
+            for (guint i = 0; i < g_strv_length(localDebs); ++i)
+                markFileForInstall(localDebs[i]);
         }
 
-        // Close the cache if we are going to try again
-        m_cache->Close();
+        int timeout = 10;
+        // TODO test this
+        while (m_cache->Open(withLock) == false) {
+            if (withLock == false || (timeout <= 0)) {
+                show_errors(m_job, PK_ERROR_ENUM_CANNOT_GET_LOCK);
+                return false;
+            } else {
+                _error->Discard();
+                pk_backend_job_set_status(m_job, PK_STATUS_ENUM_WAITING_FOR_LOCK);
+                sleep(1);
+                timeout--;
+            }
+
+            // Close the cache if we are going to try again
+            m_cache->Close();
+        }
     }
 
+    // only jobs that run on their own can change the configuration
     m_interactive = pk_backend_job_get_interactive(m_job);
-    if (!m_interactive) {
+    if (!m_interactive && !pk_backend_role_is_read_only(role)) {
         // Do not ask about config updates if we are not interactive
         if (!dpkgHasForceConfFileSet()) {
             _config->Set("Dpkg::Options::", "--force-confdef");
@@ -638,6 +671,28 @@ void AptJob::providesCodec(PkgList &output, gchar **values)
     }
 }
 
+// search packages, installed or available, which provide the absolute paths in "values"
+void AptJob::providesFile(PkgList &output, gchar **values)
+{
+    g_autoptr(GPtrArray) paths = g_ptr_array_new();
+
+    for (uint i = 0; i < g_strv_length(values); i++) {
+        if (values[i][0] == '/') {
+            g_ptr_array_add(paths, values[i]);
+        }
+    }
+    if (paths->len == 0) {
+        return;
+    }
+    g_ptr_array_add(paths, NULL);
+
+    // dpkg also knows local and obsolete packages, which no Contents file has
+    const PkgList installed = searchPackageFiles((gchar **) paths->pdata);
+    const PkgList available = searchContentsFiles((gchar **) paths->pdata);
+    output.insert(output.end(), installed.begin(), installed.end());
+    output.insert(output.end(), available.begin(), available.end());
+}
+
 // search packages which provide the libraries specified in "values"
 void AptJob::providesLibrary(PkgList &output, gchar **values)
 {
@@ -1167,166 +1222,49 @@ PkgList AptJob::getPackagesFromGroup(gchar **values)
     return output;
 }
 
-bool AptJob::matchesQueries(const vector<string> &queries, string s) {
-    for (string query : queries) {
-        // Case insensitive "string.contains"
-        auto it = std::search(
-            s.begin(), s.end(),
-            query.begin(), query.end(),
-            [](unsigned char ch1, unsigned char ch2) {
-                return std::tolower(ch1) == std::tolower(ch2);
-            }
-        );
-
-        if (it != s.end()) {
-            return true;
-        }
-    }
-    return false;
-}
-
 PkgList AptJob::searchPackageName(const vector<string> &queries)
 {
-    PkgList output;
-
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
-        // Ignore packages that exist only due to dependencies.
-        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
-        }
-
-        if (matchesQueries(queries, pkg.Name())) {
-            // Don't insert virtual packages instead add what it provides
-            const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
-            if (ver.end() == false) {
-                output.append(ver);
-            } else {
-                // iterate over the provides list
-                for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
-                    const pkgCache::VerIterator &ownerVer = m_cache->findVer(Prv.OwnerPkg());
-
-                    // check to see if the provided package isn't virtual too
-                    if (ownerVer.end() == false) {
-                        // we add the package now because we will need to
-                        // remove duplicates later anyway
-                        output.append(ownerVer);
-                    }
-                }
-            }
-        }
-    }
-    return output;
+    return searchPackages(queries, false);
 }
 
 PkgList AptJob::searchPackageDetails(const vector<string> &queries)
 {
-    PkgList output;
-
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
-        // Ignore packages that exist only due to dependencies.
-        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
-        }
-
-        const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
-        if (ver.end() == false) {
-            if (matchesQueries(queries, pkg.Name()) ||
-                    matchesQueries(queries, (*m_cache).getLongDescription(ver))) {
-                // The package matched
-                output.append(ver);
-            }
-        } else if (matchesQueries(queries, pkg.Name())) {
-            // The package is virtual and MATCHED the name
-            // Don't insert virtual packages instead add what it provides
+    return searchPackages(queries, true);
+}
 
-            // iterate over the provides list
-            for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
-                const pkgCache::VerIterator &ownerVer = m_cache->findVer(Prv.OwnerPkg());
+PkgList AptJob::searchPackages(const vector<string> &queries, bool details)
+{
+    AptSearchIndex index;
+    vector<uint32_t> ids;
 
-                // check to see if the provided package isn't virtual too
-                if (ownerVer.end() == false) {
-                    // we add the package now because we will need to
-                    // remove duplicates later anyway
-                    output.append(ownerVer);
-                }
-            }
-        }
+    // the index narrows it down to the packages containing every trigram of a query
+    if (index.open(*m_cache) && index.lookup(queries, details, ids)) {
+        return m_cache->searchCandidates(queries, details, m_cancel, ids);
     }
-    return output;
+    return m_cache->searchPackages(queries, details, m_cancel);
 }
 
-// used to return files it reads, using the info from the files in /var/lib/dpkg/info/
+// used to return files it reads, using the index of the files in /var/lib/dpkg/info/
 PkgList AptJob::searchPackageFiles(gchar **values)
 {
     PkgList output;
     vector<string> packages;
-    string search;
-    regex_t re;
 
+    if (!m_fileIndex.open()) {
+        g_debug("Error opening the index of %s", DpkgFileIndex::infoDir().c_str());
+        return output;
+    }
+
+    // absolute paths have to match exactly, anything else the end of a path
     for (uint i = 0; i < g_strv_length(values); ++i) {
         gchar *value = values[i];
         if (strlen(value) < 1) {
             continue;
         }
-
-        if (!search.empty()) {
-            search.append("\\|");
-        }
-
-        if (value[0] == '/') {
-            search.append("^");
-            search.append(value);
-            search.append("$");
-        } else {
-            search.append(value);
-            search.append("$");
-        }
-    }
-
-    if(regcomp(&re, search.c_str(), REG_NOSUB) != 0) {
-        g_debug("Regex compilation error");
-        return output;
-    }
-
-    DIR *dp;
-    struct dirent *dirp;
-    if (!(dp = opendir("/var/lib/dpkg/info/"))) {
-        g_debug ("Error opening /var/lib/dpkg/info/\n");
-        regfree(&re);
-        return output;
-    }
-
-    string line;
-    while ((dirp = readdir(dp)) != NULL) {
-        if (m_cancel) {
-            break;
-        }
-
-        if (ends_with(dirp->d_name, ".list")) {
-            string file(dirp->d_name);
-            string f = "/var/lib/dpkg/info/" + file;
-            ifstream in(f.c_str());
-            if (!in != 0) {
-                continue;
-            }
-
-            while (!in.eof()) {
-                getline(in, line);
-                if (regexec(&re, line.c_str(), (size_t)0, NULL, 0) == 0) {
-                    packages.push_back(file.erase(file.size() - 5, file.size()));
-                    break;
-                }
-            }
-        }
+        m_fileIndex.find(value, value[0] != '/', packages);
     }
-    closedir(dp);
-    regfree(&re);
+    std::sort(packages.begin(), packages.end());
+    packages.erase(std::unique(packages.begin(), packages.end()), packages.end());
 
     // Resolve the package names now
     for (const string &name : packages) {
@@ -1363,6 +1301,49 @@ PkgList AptJob::searchPackageFiles(gchar **values)
     return output;
 }
 
+// used to return the packages in the repositories shipping the files, from their Contents files
+PkgList AptJob::searchContentsFiles(gchar **values)
+{
+    PkgList output;
+    vector<string> packages;
+    AptContentsIndex index;
+
+    if (!index.open()) {
+        g_debug("No index of the Contents files, enable them for apt-file");
+        return output;
+    }
+
+    // absolute paths have to match exactly, anything else the end of a path
+    for (uint i = 0; i < g_strv_length(values); ++i) {
+        gchar *value = values[i];
+        if (strlen(value) < 1) {
+            continue;
+        }
+        index.find(value, value[0] != '/', packages);
+    }
+    std::sort(packages.begin(), packages.end());
+    packages.erase(std::unique(packages.begin(), packages.end()), packages.end());
+
+    // the packages are named with the architecture of their Contents file
+    for (const string &name : packages) {
+        if (m_cancel) {
+            break;
+        }
+
+        const pkgCache::PkgIterator &pkg = (*m_cache)->FindPkg(name);
+        if (pkg.end()) {
+            continue;
+        }
+        const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
+        if (ver.end()) {
+            continue;
+        }
+        output.append(ver);
+    }
+
+    return output;
+}
+
 PkgList AptJob::getUpdates(PkgList &blocked, PkgList &downgrades, PkgList &installs, PkgList &removals, PkgList &obsoleted)
 {
     PkgList updates;
@@ -1506,38 +1487,16 @@ void AptJob::providesMimeType(PkgList &output, gchar **values)
 
 bool AptJob::isApplication(const pkgCache::VerIterator &ver)
 {
-    bool ret = false;
-    gchar *fileName;
-    string line;
-
-    fileName = g_strdup_printf("/var/lib/dpkg/info/%s:%s.list",
-                               ver.ParentPkg().Name(),
-                               ver.Arch());
-    if (!FileExists(fileName)) {
-        g_free(fileName);
-        // if the file was not found try without the arch field
-        fileName = g_strdup_printf("/var/lib/dpkg/info/%s.list",
-                                   ver.ParentPkg().Name());
+    if (!m_fileIndex.open()) {
+        return false;
     }
 
-    if (FileExists(fileName)) {
-        ifstream in(fileName);
-        if (!in != 0) {
-            g_free(fileName);
-            return false;
-        }
-
-        while (in.eof() == false) {
-            getline(in, line);
-            if (ends_with(line, ".desktop")) {
-                ret = true;
-                break;
-            }
-        }
+    string name = string(ver.ParentPkg().Name()) + ":" + ver.Arch();
+    if (!m_fileIndex.contains(name)) {
+        // if the file was not found try without the arch field
+        name = ver.ParentPkg().Name();
     }
-
-    g_free(fileName);
-    return ret;
+    return m_fileIndex.hasDesktopFile(name);
 }
 
 // used to emit files it reads the info directly from the files
@@ -2218,6 +2177,13 @@ void AptJob::refreshCache()
     if (m_cache->BuildCaches() == false) {
         return;
     }
+
+    // index the new lists, so the next search doesn't have to
+    AptCacheFile cache(m_job);
+    if (cache.Open()) {
+        AptSearchIndex::build(cache);
+    }
+    AptContentsIndex::build(*m_cache->GetSourceList());
 }
 
 void AptJob::markAutoInstalled(const PkgList &pkgs)
@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <glib.h>
 #include <glib/gstdio.h>
 
@@ -32,6 +34,7 @@
 #include <pk-backend.h>
 
 #include "pkg-list.h"
+#include "apt-file-index.h"
 #include "apt-sourceslist.h"
 
 #define REBOOT_REQUIRED_FILE    "/run/reboot-required"
@@ -146,6 +149,12 @@ public:
       */
     PkgList searchPackageFiles(gchar **values);
 
+    /**
+      * Returns a list of all packages in the repositories that contain the
+      * given files, if apt downloads the Contents files
+      */
+    PkgList searchContentsFiles(gchar **values);
+
     /**
       * Returns a list of all packages that can be updated
       * Pass a PkgList to get the blocked updates as well
@@ -223,6 +232,11 @@ public:
      */
     void providesCodec(PkgList &output, gchar **values);
 
+    /**
+     *  Check which package provides a file, given by its absolute path
+     */
+    void providesFile(PkgList &output, gchar **values);
+
     /**
      *  Check which package provides a shared library
      */
@@ -246,7 +260,7 @@ private:
     bool checkTrusted(pkgAcquire &fetcher, PkBitfield flags);
     bool packageIsSupported(const pkgCache::VerIterator &verIter, string component);
     bool isApplication(const pkgCache::VerIterator &verIter);
-    bool matchesQueries(const vector<string> &queries, string s);
+    PkgList searchPackages(const vector<string> &queries, bool details);
     bool dpkgHasForceConfFileSet();
     PkInfoEnum packageStateFromVer(const pkgCache::VerIterator &ver) const;
     void stagePackageForEmit(GPtrArray *array, const pkgCache::VerIterator &ver,
@@ -263,8 +277,11 @@ private:
 
     AptCacheFile *m_cache;
     PkBackendJob *m_job;
-    bool       m_cancel;
+    bool       m_warmCache;
+    // also read by the search workers
+    std::atomic<bool> m_cancel;
     struct stat m_restartStat;
+    DpkgFileIndex m_fileIndex;
 
     bool m_isMultiArch;
     PkgList m_pkgs;
@@ -0,0 +1,366 @@
+/* apt-search-index.cpp - Trigram index for package searches
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "apt-search-index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib.h>
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/configuration.h>
+
+#include "apt-cache-file.h"
+
+#define SEARCH_INDEX_MAGIC "PKAPTIX"
+#define SEARCH_INDEX_VERSION 2
+
+/*
+ * The file starts with this header and the stamp of the cache and the
+ * description languages it was built from. Then, for the names and the details, there is a table of
+ * entries sorted by trigram, each pointing to the IDs of the packages
+ * containing it. The IDs are stored in ascending order as varint deltas.
+ */
+struct IndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t packageCount;
+    uint32_t stampSize;
+    uint32_t entries[2];
+    uint32_t entryCount[2];
+};
+
+struct AptSearchIndex::Entry
+{
+    uint32_t trigram;
+    uint32_t count;
+    uint32_t offset;
+};
+
+namespace {
+
+struct Postings
+{
+    std::string data;
+    uint32_t count = 0;
+    uint32_t last = 0;
+
+    void add(uint32_t id)
+    {
+        uint32_t delta = id - last;
+        while (delta >= 0x80) {
+            data.push_back(static_cast<char>(delta | 0x80));
+            delta >>= 7;
+        }
+        data.push_back(static_cast<char>(delta));
+        last = id;
+        count++;
+    }
+};
+
+typedef std::unordered_map<uint32_t, Postings> PostingsMap;
+
+}
+
+// the case folded trigrams of s, sorted and without duplicates
+static void trigrams(const char *s, size_t length, std::vector<uint32_t> &out)
+{
+    for (size_t i = 0; i + 3 <= length; ++i) {
+        out.push_back(static_cast<uint32_t>(g_ascii_tolower(s[i])) << 16 |
+                      static_cast<uint32_t>(g_ascii_tolower(s[i + 1])) << 8 |
+                      static_cast<uint32_t>(g_ascii_tolower(s[i + 2])));
+    }
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+// the descriptions are read in the first of these that has a translation,
+// so the details trigrams are only valid for the same languages
+static std::string indexStamp(const AptCacheFile &cache)
+{
+    std::string stamp = cache.stamp();
+    for (const std::string &language : APT::Configuration::getLanguages()) {
+        stamp += language;
+        stamp += ',';
+    }
+    return stamp;
+}
+
+static bool appendSection(std::string &file, const PostingsMap &postings,
+                          uint32_t &entries, uint32_t &entryCount)
+{
+    std::vector<AptSearchIndex::Entry> table;
+    std::vector<uint32_t> keys;
+
+    keys.reserve(postings.size());
+    for (const auto &it : postings) {
+        keys.push_back(it.first);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // the IDs follow the table
+    size_t offset = file.size() + keys.size() * sizeof(AptSearchIndex::Entry);
+    for (uint32_t key : keys) {
+        const Postings &list = postings.at(key);
+        if (offset > UINT32_MAX) {
+            return false;
+        }
+        table.push_back({ key, list.count, static_cast<uint32_t>(offset) });
+        offset += list.data.size();
+    }
+
+    entries = file.size();
+    entryCount = table.size();
+    file.append(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(AptSearchIndex::Entry));
+    for (uint32_t key : keys) {
+        file.append(postings.at(key).data);
+    }
+
+    // keep the next table aligned
+    file.resize((file.size() + 3) & ~3);
+    return file.size() <= UINT32_MAX;
+}
+
+AptSearchIndex::AptSearchIndex() :
+    m_data(nullptr),
+    m_size(0)
+{
+}
+
+AptSearchIndex::~AptSearchIndex()
+{
+    if (m_data != nullptr) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+}
+
+std::string AptSearchIndex::path()
+{
+    return _config->FindDir("Dir::Cache") + "packagekit-search.bin";
+}
+
+bool AptSearchIndex::build(AptCacheFile &cache)
+{
+    PostingsMap names;
+    PostingsMap details;
+    std::vector<uint32_t> found;
+    g_autoptr(GError) error = nullptr;
+
+    // only refreshing the cache builds it, which takes the lock, and a
+    // cache that could not be indexed is not tried again on every refresh
+    static std::string failedStamp;
+    const std::string stamp = indexStamp(cache);
+    if (cache.stamp().empty() || stamp == failedStamp || cache.GetDepCache() == nullptr) {
+        return false;
+    }
+
+    // the packages are added in ID order, so every list stays sorted
+    for (const pkgCache::PkgIterator &pkg : cache.packagesById()) {
+        // Ignore packages that exist only due to dependencies.
+        if (pkg.end() || (pkg.VersionList().end() && pkg.ProvidesList().end())) {
+            continue;
+        }
+
+        found.clear();
+        trigrams(pkg.Name(), strlen(pkg.Name()), found);
+        for (uint32_t trigram : found) {
+            names[trigram].add(pkg->ID);
+        }
+
+        // virtual packages are only ever matched by their name
+        const pkgCache::VerIterator &ver = cache.findVer(pkg);
+        if (ver.end() == false) {
+            const std::string description = cache.getLongDescription(ver);
+            trigrams(description.c_str(), description.size(), found);
+        }
+        for (uint32_t trigram : found) {
+            details[trigram].add(pkg->ID);
+        }
+    }
+
+    IndexHeader header = {};
+    memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SEARCH_INDEX_VERSION;
+    header.packageCount = cache.GetPkgCache()->Head().PackageCount;
+    header.stampSize = stamp.size();
+
+    std::string file(sizeof(header), '\0');
+    file.append(stamp);
+    file.resize((file.size() + 3) & ~3);
+    if (!appendSection(file, names, header.entries[0], header.entryCount[0]) ||
+            !appendSection(file, details, header.entries[1], header.entryCount[1])) {
+        g_warning("search index is too large");
+        failedStamp = stamp;
+        return false;
+    }
+    memcpy(&file[0], &header, sizeof(header));
+
+    // replaced atomically, so a search never maps a partial index
+    if (!g_file_set_contents(path().c_str(), file.data(), file.size(), &error)) {
+        g_debug("failed to write search index: %s", error->message);
+        failedStamp = stamp;
+        return false;
+    }
+    g_debug("wrote search index with %u name and %u details trigrams, %zu bytes",
+            header.entryCount[0], header.entryCount[1], file.size());
+    return true;
+}
+
+bool AptSearchIndex::open(AptCacheFile &cache)
+{
+    struct stat st;
+    IndexHeader header;
+
+    if (m_data != nullptr || cache.stamp().empty() || cache.GetPkgCache() == nullptr) {
+        return false;
+    }
+
+    int fd = ::open(path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(header)) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const char *>(data);
+    m_size = st.st_size;
+
+    // only use it for the cache and languages it was built from
+    const std::string stamp = indexStamp(cache);
+    memcpy(&header, m_data, sizeof(header));
+    bool valid = memcmp(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == SEARCH_INDEX_VERSION &&
+                 header.packageCount == cache.GetPkgCache()->Head().PackageCount &&
+                 header.stampSize == stamp.size() &&
+                 sizeof(header) + header.stampSize <= m_size &&
+                 stamp.compare(0, std::string::npos,
+                                       m_data + sizeof(header), header.stampSize) == 0;
+    for (int i = 0; valid && i < 2; ++i) {
+        valid = header.entries[i] % alignof(Entry) == 0 &&
+                header.entries[i] <= m_size &&
+                header.entryCount[i] <= (m_size - header.entries[i]) / sizeof(Entry);
+    }
+    if (!valid) {
+        munmap(data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+    return valid;
+}
+
+const AptSearchIndex::Entry *AptSearchIndex::find(bool details, uint32_t trigram) const
+{
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(m_data);
+    const Entry *begin = reinterpret_cast<const Entry *>(m_data + header->entries[details]);
+    const Entry *end = begin + header->entryCount[details];
+
+    const Entry *entry = std::lower_bound(begin, end, trigram,
+                                          [](const Entry &e, uint32_t t) { return e.trigram < t; });
+    if (entry == end || entry->trigram != trigram) {
+        return nullptr;
+    }
+    return entry;
+}
+
+void AptSearchIndex::decode(const Entry *entry, std::vector<uint32_t> &ids) const
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(m_data) + entry->offset;
+    const unsigned char *end = reinterpret_cast<const unsigned char *>(m_data) + m_size;
+    uint32_t id = 0;
+
+    ids.clear();
+    ids.reserve(entry->count);
+    for (uint32_t i = 0; i < entry->count && p < end; ++i) {
+        uint32_t delta = 0;
+        for (int shift = 0; p < end && shift < 32; shift += 7) {
+            delta |= static_cast<uint32_t>(*p & 0x7f) << shift;
+            if ((*p++ & 0x80) == 0) {
+                break;
+            }
+        }
+        id += delta;
+        ids.push_back(id);
+    }
+}
+
+bool AptSearchIndex::lookup(const std::vector<std::string> &queries, bool details,
+                            std::vector<uint32_t> &ids) const
+{
+    std::vector<const Entry *> entries;
+    std::vector<uint32_t> found;
+    std::vector<uint32_t> matches;
+    std::vector<uint32_t> postings;
+    std::vector<uint32_t> common;
+
+    if (m_data == nullptr) {
+        return false;
+    }
+
+    ids.clear();
+    for (const std::string &query : queries) {
+        if (query.size() < 3) {
+            return false;
+        }
+
+        // a match has to contain every trigram of the query
+        found.clear();
+        trigrams(query.c_str(), query.size(), found);
+        entries.clear();
+        for (uint32_t trigram : found) {
+            const Entry *entry = find(details, trigram);
+            if (entry == nullptr) {
+                entries.clear();
+                break;
+            }
+            entries.push_back(entry);
+        }
+        if (entries.empty()) {
+            continue;
+        }
+
+        // starting with the rarest keeps the intersection small
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry *a, const Entry *b) { return a->count < b->count; });
+        decode(entries[0], matches);
+        for (size_t i = 1; i < entries.size() && !matches.empty(); ++i) {
+            decode(entries[i], postings);
+            common.clear();
+            std::set_intersection(matches.begin(), matches.end(),
+                                  postings.begin(), postings.end(),
+                                  std::back_inserter(common));
+            matches.swap(common);
+        }
+        ids.insert(ids.end(), matches.begin(), matches.end());
+    }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return true;
+}
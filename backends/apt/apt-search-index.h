@@ -0,0 +1,75 @@
+/* apt-search-index.h - Trigram index for package searches
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef APT_SEARCH_INDEX_H
+#define APT_SEARCH_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class AptCacheFile;
+
+/**
+ * An on-disk index of the three byte sequences in the package names and
+ * long descriptions, mapped to the IDs of the packages that contain them.
+ * It is only valid for the package cache and description languages it
+ * was built from, and only narrows a search down: every candidate still
+ * has to be matched.
+ */
+class AptSearchIndex
+{
+public:
+    struct Entry;
+
+    AptSearchIndex();
+    ~AptSearchIndex();
+
+    /**
+      * Writes the index for the given cache, replacing any older one
+      */
+    static bool build(AptCacheFile &cache);
+
+    /**
+      * Maps the index, returning false if there is none or it was built
+      * for a different cache or different description languages
+      */
+    bool open(AptCacheFile &cache);
+
+    /**
+      * Fills ids with the sorted IDs of the packages whose name, or also
+      * their long description if details is set, may contain any of the
+      * queries. Returns false if a query is too short to be looked up.
+      */
+    bool lookup(const std::vector<std::string> &queries, bool details,
+                std::vector<uint32_t> &ids) const;
+
+    /**
+      * Returns where the index is stored, next to the apt caches
+      */
+    static std::string path();
+
+private:
+    const Entry *find(bool details, uint32_t trigram) const;
+    void decode(const Entry *entry, std::vector<uint32_t> &ids) const;
+
+    const char *m_data;
+    size_t m_size;
+};
+
+#endif // APT_SEARCH_INDEX_H
@@ -59,6 +59,14 @@ pk_backend_supports_parallelization (PkBackend *backend)
     return FALSE;
 }
 
+gboolean
+pk_backend_supports_concurrent_reads (PkBackend *backend)
+{
+    // read-only jobs each open their own cache without the lock, and
+    // only the first of them sets the locale and environment
+    return TRUE;
+}
+
 void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
 {
     /* use logging */
@@ -85,11 +93,20 @@ void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
     if (!pkgInitSystem(*_config, _system)) {
         g_debug("ERROR initializing backend system");
     }
+
+    // default settings, set once as jobs may read the configuration
+    // concurrently
+    _config->CndSet("APT::Get::AutomaticRemove::Kernels", _config->FindB("APT::Get::AutomaticRemove", true));
+
+    // APT caches this on first use, which has to happen before
+    // read-only jobs run at the same time
+    APT::Configuration::getArchitectures(false);
 }
 
 void pk_backend_destroy(PkBackend *backend)
 {
     g_debug("APT backend being destroyed");
+    AptWarmCache::clear();
 }
 
 PkBitfield pk_backend_get_groups(PkBackend *backend)
@@ -412,7 +429,7 @@ static void backend_what_provides_thread(PkBackendJob *job, GVariant *params, gp
 
     pk_backend_job_set_status(job, PK_STATUS_ENUM_QUERY);
 
-    // We can handle libraries, mimetypes and codecs
+    // We can handle files, libraries, mimetypes and codecs
     if (!apt->init()) {
         g_debug("Failed to create apt cache");
         g_strfreev(values);
@@ -422,6 +439,7 @@ static void backend_what_provides_thread(PkBackendJob *job, GVariant *params, gp
     pk_backend_job_set_status(job, PK_STATUS_ENUM_QUERY);
 
     PkgList output;
+    apt->providesFile(output, values);
     apt->providesLibrary(output, values);
     apt->providesCodec(output, values);
     apt->providesMimeType(output, values);
@@ -625,20 +643,25 @@ static void pk_backend_search_files_thread(PkBackendJob *job, GVariant *params,
 
     pk_backend_job_set_allow_cancel(job, true);
 
-    // as we can only search for installed files lets avoid the opposite
-    if (!pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED)) {
-        if (!apt->init()) {
-            g_debug("Failed to create apt cache");
-            return;
-        }
+    if (!apt->init()) {
+        g_debug("Failed to create apt cache");
+        return;
+    }
 
-        pk_backend_job_set_status(job, PK_STATUS_ENUM_QUERY);
-        PkgList output;
-        output = apt->searchPackageFiles(search);
+    pk_backend_job_set_status(job, PK_STATUS_ENUM_QUERY);
+    PkgList output;
 
-        // It's faster to emit the packages here rather than in the matching part
-        apt->emitPackages(output, filters);
+    // dpkg knows the files of installed packages, the Contents files those of the others
+    if (!pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED)) {
+        output = apt->searchPackageFiles(search);
+    }
+    if (!pk_bitfield_contain(filters, PK_FILTER_ENUM_INSTALLED)) {
+        const PkgList available = apt->searchContentsFiles(search);
+        output.insert(output.end(), available.begin(), available.end());
     }
+
+    // It's faster to emit the packages here rather than in the matching part
+    apt->emitPackages(output, filters);
 }
 
 void pk_backend_search_files(PkBackend *backend, PkBackendJob *job, PkBitfield filters, gchar **values)
@@ -1,3 +1,21 @@
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/fileutl.h>
+#include <apt-pkg/indexfile.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/metaindex.h>
+#include <apt-pkg/pkgsystem.h>
+#include <apt-pkg/sourcelist.h>
+#include <glib/gstdio.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "apt-cache-file.h"
+#include "apt-file-index.h"
+#include "apt-search-index.h"
 #include "gst-matcher.h"
 
 const char *gst_plugins_bad_pkg = R"(Package: gstreamer1.0-plugins-bad
@@ -173,6 +191,421 @@ apt_test_gst_matcher_bad_caps (void)
     }
 }
 
+/* opens the cache of the system the tests run on, the way a job does but
+ * without one, or skips the test and returns nullptr */
+static AptCacheFile *
+apt_test_open_cache (void)
+{
+    if (!pkgInitConfig(*_config) || !pkgInitSystem(*_config, _system)) {
+        g_test_skip("apt is not configured");
+        return nullptr;
+    }
+    if (!g_file_test(_config->FindFile("Dir::State::status").c_str(), G_FILE_TEST_EXISTS)) {
+        g_test_skip("no dpkg status file");
+        return nullptr;
+    }
+
+    AptCacheFile *cache = new AptCacheFile(nullptr);
+    g_assert_true(cache->Open());
+    g_assert_nonnull(cache->GetDepCache());
+    return cache;
+}
+
+static void
+apt_test_warm_cache (void)
+{
+    AptCacheFile *cache;
+    pkgDepCache *depCache;
+
+    /* a cold start maps the cache and builds the depcache */
+    AptWarmCache::clear();
+    g_assert_null(AptWarmCache::take(nullptr));
+    cache = apt_test_open_cache();
+    if (cache == nullptr) {
+        return;
+    }
+    depCache = cache->GetDepCache();
+    g_assert_true(cache->isCurrent());
+    g_assert_true(cache->isClean());
+
+    /* the next job gets the same cache back, without building it again */
+    AptWarmCache::give(cache);
+    g_assert_true(AptWarmCache::take(nullptr) == cache);
+    g_assert_true(cache->GetDepCache() == depCache);
+
+    /* it can only be taken once */
+    g_assert_null(AptWarmCache::take(nullptr));
+
+    /* and is dropped once a job changes the system */
+    AptWarmCache::give(cache);
+    AptWarmCache::clear();
+    g_assert_null(AptWarmCache::take(nullptr));
+}
+
+static void
+apt_test_search (void)
+{
+    const std::vector<std::string> queries = { "Lib", "python" };
+    const std::atomic<bool> cancel(false);
+    g_autoptr(GTimer) timer = g_timer_new();
+
+    std::unique_ptr<AptCacheFile> cache(apt_test_open_cache());
+    if (!cache) {
+        return;
+    }
+    g_test_message("%u packages in the cache", cache->GetPkgCache()->Head().PackageCount);
+
+    /* every thread count has to find the same packages, in the same order */
+    for (bool details : { false, true }) {
+        PkgList single;
+        const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int threads = 1; threads <= cores; threads *= 2) {
+            g_timer_start(timer);
+            PkgList output = cache->searchPackages(queries, details, cancel, threads);
+            g_test_message("%s search with %u threads: %zu matches in %.1fms",
+                           details ? "details" : "name", threads, output.size(),
+                           g_timer_elapsed(timer, NULL) * 1000);
+            if (threads == 1) {
+                single = output;
+                continue;
+            }
+            g_assert_cmpuint(output.size(), ==, single.size());
+            for (size_t i = 0; i < output.size(); ++i)
+                g_assert_true(output[i].ver == single[i].ver);
+        }
+    }
+
+    /* a cancelled search stops without matching anything */
+    const std::atomic<bool> cancelled(true);
+    g_assert_true(cache->searchPackages(queries, true, cancelled).empty());
+}
+
+static void
+apt_test_search_index (void)
+{
+    const std::vector<std::string> queries = { "Lib", "python" };
+    const std::atomic<bool> cancel(false);
+    std::vector<uint32_t> ids;
+    g_autoptr(GTimer) timer = g_timer_new();
+    g_autofree gchar *dir = NULL;
+
+    std::unique_ptr<AptCacheFile> cache(apt_test_open_cache());
+    if (!cache) {
+        return;
+    }
+
+    /* the index goes next to the caches, which are already open; the
+     * settings changed here are put back for the tests that follow */
+    const std::string cacheDir = _config->Find("Dir::Cache");
+    const std::vector<std::string> languages = _config->FindVector("Acquire::Languages");
+    dir = g_dir_make_tmp("apt-tests-XXXXXX", NULL);
+    g_assert_nonnull(dir);
+    _config->Set("Dir::Cache", dir);
+
+    AptSearchIndex missing;
+    g_assert_false(missing.open(*cache));
+
+    g_timer_start(timer);
+    g_assert_true(AptSearchIndex::build(*cache));
+    g_test_message("built %s in %.1fms", AptSearchIndex::path().c_str(),
+                   g_timer_elapsed(timer, NULL) * 1000);
+
+    AptSearchIndex index;
+    g_assert_true(index.open(*cache));
+
+    /* the index finds the same packages as a full scan */
+    for (bool details : { false, true }) {
+        g_timer_start(timer);
+        PkgList scanned = cache->searchPackages(queries, details, cancel);
+        gdouble scan = g_timer_elapsed(timer, NULL);
+
+        g_timer_start(timer);
+        g_assert_true(index.lookup(queries, details, ids));
+        PkgList indexed = cache->searchCandidates(queries, details, cancel, ids);
+        g_test_message("%s search: %zu matches, scan %.1fms, index %.1fms (%zu candidates)",
+                       details ? "details" : "name", indexed.size(), scan * 1000,
+                       g_timer_elapsed(timer, NULL) * 1000, ids.size());
+
+        g_assert_cmpuint(indexed.size(), ==, scanned.size());
+        for (size_t i = 0; i < indexed.size(); ++i)
+            g_assert_true(indexed[i].ver == scanned[i].ver);
+    }
+
+    /* short queries can't be looked up */
+    g_assert_false(index.lookup({ "py" }, false, ids));
+
+    /* the descriptions are in other languages */
+    _config->Clear("Acquire::Languages");
+    _config->Set("Acquire::Languages", "pk-test");
+    APT::Configuration::getLanguages(false, false);
+    AptSearchIndex translated;
+    g_assert_false(translated.open(*cache));
+
+    g_unlink(AptSearchIndex::path().c_str());
+    g_rmdir(dir);
+
+    _config->Clear("Acquire::Languages");
+    for (const std::string &language : languages)
+        _config->Set("Acquire::Languages::", language);
+    APT::Configuration::getLanguages(false, false);
+    _config->Set("Dir::Cache", cacheDir);
+}
+
+static void
+apt_test_file_index (void)
+{
+    std::vector<std::string> packages;
+    g_autofree gchar *dir = NULL;
+    g_autofree gchar *info = NULL;
+    g_autofree gchar *status = NULL;
+    g_autofree gchar *bash = NULL;
+    g_autofree gchar *editor = NULL;
+    struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+    struct timeval future[2];
+
+    g_assert_true(pkgInitConfig(*_config));
+    g_assert_cmpint(gettimeofday(&future[0], NULL), ==, 0);
+    future[0].tv_sec += 3600;
+    future[1] = future[0];
+
+    /* a dpkg database with two packages sharing a directory */
+    dir = g_dir_make_tmp("apt-tests-XXXXXX", NULL);
+    g_assert_nonnull(dir);
+    info = g_build_filename(dir, "info", NULL);
+    status = g_build_filename(dir, "status", NULL);
+    bash = g_build_filename(info, "bash.list", NULL);
+    editor = g_build_filename(info, "editor:amd64.list", NULL);
+    g_assert_cmpint(g_mkdir(info, 0755), ==, 0);
+    g_assert_true(g_file_set_contents(bash, "/.\n/usr\n/usr/bin\n/usr/bin/bash\n", -1, NULL));
+    g_assert_true(g_file_set_contents(editor,
+                                      "/.\n/usr\n/usr/bin\n/usr/bin/edit\n"
+                                      "/usr/share/applications/editor.desktop\n", -1, NULL));
+    _config->Set("Dir::State::status", status);
+    _config->Set("Dir::Cache", dir);
+
+    {
+        DpkgFileIndex index;
+        g_assert_true(index.open());
+
+        index.find("/usr/bin/bash", false, packages);
+        g_assert_cmpuint(packages.size(), ==, 1);
+        g_assert_cmpstr(packages[0].c_str(), ==, "bash");
+
+        /* a path can belong to more than one package */
+        packages.clear();
+        index.find("/usr/bin", false, packages);
+        g_assert_cmpuint(packages.size(), ==, 2);
+
+        /* relative paths match the end of a path */
+        packages.clear();
+        index.find("bin/edit", true, packages);
+        g_assert_cmpuint(packages.size(), ==, 1);
+        g_assert_cmpstr(packages[0].c_str(), ==, "editor:amd64");
+        packages.clear();
+        index.find("bin/edit", false, packages);
+        g_assert_true(packages.empty());
+        index.find("/usr/bin/ba", false, packages);
+        g_assert_true(packages.empty());
+
+        g_assert_true(index.contains("editor:amd64"));
+        g_assert_false(index.contains("editor"));
+        g_assert_true(index.hasDesktopFile("editor:amd64"));
+        g_assert_false(index.hasDesktopFile("bash"));
+    }
+    g_assert_true(g_file_test(DpkgFileIndex::path().c_str(), G_FILE_TEST_EXISTS));
+
+    /* dpkg replaced a list, the next open reads it again */
+    g_assert_true(g_file_set_contents(bash, "/.\n/bin\n/bin/bash\n", -1, NULL));
+    g_assert_cmpint(utimes(info, times), ==, 0);
+    {
+        DpkgFileIndex index;
+        g_assert_true(index.open());
+
+        packages.clear();
+        index.find("/usr/bin/bash", false, packages);
+        g_assert_true(packages.empty());
+        index.find("/bin/bash", false, packages);
+        g_assert_cmpuint(packages.size(), ==, 1);
+        packages.clear();
+        index.find("/usr/bin/edit", false, packages);
+        g_assert_cmpuint(packages.size(), ==, 1);
+    }
+
+    /* a list dpkg replaced in the same tick as the index was written has
+     * the same mtime and size, so it is read again until the index is
+     * written after it */
+    g_assert_cmpint(utimes(bash, future), ==, 0);
+    g_assert_cmpint(utimes(info, future), ==, 0);
+    {
+        DpkgFileIndex index;
+        g_assert_true(index.open());
+    }
+    g_assert_true(g_file_set_contents(bash, "/.\n/bin\n/bin/dash\n", -1, NULL));
+    g_assert_cmpint(utimes(bash, future), ==, 0);
+    g_assert_cmpint(utimes(info, future), ==, 0);
+    {
+        DpkgFileIndex index;
+        g_assert_true(index.open());
+
+        packages.clear();
+        index.find("/bin/bash", false, packages);
+        g_assert_true(packages.empty());
+        index.find("/bin/dash", false, packages);
+        g_assert_cmpuint(packages.size(), ==, 1);
+    }
+
+    g_unlink(bash);
+    g_unlink(editor);
+    g_unlink(DpkgFileIndex::path().c_str());
+    g_rmdir(info);
+    g_rmdir(dir);
+}
+
+static void
+apt_test_contents_index (void)
+{
+    /* the last path is longer than a read of a line */
+    const std::string longPath = "usr/share/" + std::string(5000, 'x');
+    const std::string contents =
+        "This file maps each file available in the archive to the packages\n"
+        "\n"
+        "usr/bin/foo                                  utils/foo\n"
+        "usr/share/doc/common/README                  doc/foo,non-free/doc/bar\n"
+        "usr/share/foo data/file.txt                  misc/foo-data\n" +
+        longPath + "                  misc/foo-long\n";
+    std::vector<std::string> packages;
+    std::string arch;
+    guint written = 0;
+    g_autofree gchar *dir = NULL;
+    g_autofree gchar *lists = NULL;
+    g_autofree gchar *sourcelist = NULL;
+    g_autofree gchar *source = NULL;
+
+    g_assert_true(pkgInitConfig(*_config));
+
+    /* a local repository, with Contents files enabled as apt-file does */
+    dir = g_dir_make_tmp("apt-tests-XXXXXX", NULL);
+    g_assert_nonnull(dir);
+    lists = g_build_filename(dir, "lists", NULL);
+    sourcelist = g_build_filename(dir, "sources.list", NULL);
+    source = g_strdup_printf("deb [trusted=yes] file:%s/repo stable main\n", dir);
+    g_assert_cmpint(g_mkdir(lists, 0755), ==, 0);
+    g_assert_true(g_file_set_contents(sourcelist, source, -1, NULL));
+    _config->Set("Dir::Etc::sourcelist", sourcelist);
+    _config->Set("Dir::Etc::sourceparts", "/nonexistent");
+    _config->Set("Dir::State::lists", lists);
+    _config->Set("Dir::Cache", dir);
+    _config->Set("Acquire::IndexTargets::deb::Contents-deb::MetaKey", "$(COMPONENT)/Contents-$(ARCHITECTURE)");
+    _config->Set("Acquire::IndexTargets::deb::Contents-deb::ShortDescription", "Contents-$(ARCHITECTURE)");
+    _config->Set("Acquire::IndexTargets::deb::Contents-deb::Description", "$(RELEASE)/$(COMPONENT) $(ARCHITECTURE) Contents");
+
+    pkgSourceList sources;
+    g_assert_true(sources.ReadMainList());
+
+    /* no Contents files were downloaded yet */
+    g_assert_false(AptContentsIndex::build(sources));
+
+    /* put them where apt update would, compressed as it keeps them, for
+     * one architecture */
+    for (metaIndex *meta : sources) {
+        for (const IndexTarget &target : meta->GetIndexTargets()) {
+            if (target.Option(IndexTarget::CREATED_BY) != "Contents-deb" ||
+                    (!arch.empty() && target.Option(IndexTarget::ARCHITECTURE) != arch))
+                continue;
+            FileFd fd;
+            g_assert_true(fd.Open(target.Option(IndexTarget::FILENAME) + ".gz",
+                                  FileFd::WriteOnly | FileFd::Create | FileFd::Empty,
+                                  FileFd::Extension));
+            g_assert_true(fd.Write(contents.data(), contents.size()));
+            fd.Close();
+            arch = target.Option(IndexTarget::ARCHITECTURE);
+            written++;
+        }
+    }
+    g_assert_cmpuint(written, >, 0);
+    g_assert_true(AptContentsIndex::build(sources));
+
+    AptContentsIndex index;
+    g_assert_true(index.open());
+
+    index.find("/usr/bin/foo", false, packages);
+    g_assert_cmpuint(packages.size(), ==, 1);
+    g_assert_cmpstr(packages[0].c_str(), ==, ("foo:" + arch).c_str());
+
+    /* a file can be in more than one package, and paths can have spaces */
+    packages.clear();
+    index.find("README", true, packages);
+    std::sort(packages.begin(), packages.end());
+    packages.erase(std::unique(packages.begin(), packages.end()), packages.end());
+    g_assert_cmpuint(packages.size(), ==, 2);
+    g_assert_cmpstr(packages[0].c_str(), ==, ("bar:" + arch).c_str());
+    packages.clear();
+    index.find("/usr/share/foo data/file.txt", false, packages);
+    g_assert_cmpuint(packages.size(), ==, 1);
+    g_assert_cmpstr(packages[0].c_str(), ==, ("foo-data:" + arch).c_str());
+
+    /* the prose before the paths is not indexed */
+    packages.clear();
+    index.find("packages", true, packages);
+    g_assert_true(packages.empty());
+
+    packages.clear();
+    index.find("/" + longPath, false, packages);
+    g_assert_cmpuint(packages.size(), ==, 1);
+    g_assert_cmpstr(packages[0].c_str(), ==, ("foo-long:" + arch).c_str());
+    packages.clear();
+    index.find(std::string(4000, 'x'), true, packages);
+    g_assert_cmpuint(packages.size(), ==, 1);
+
+    for (metaIndex *meta : sources) {
+        for (const IndexTarget &target : meta->GetIndexTargets()) {
+            if (target.Option(IndexTarget::CREATED_BY) == "Contents-deb")
+                g_unlink((target.Option(IndexTarget::FILENAME) + ".gz").c_str());
+        }
+    }
+    g_unlink(AptContentsIndex::path().c_str());
+    g_unlink(sourcelist);
+    g_rmdir(lists);
+    g_rmdir(dir);
+}
+
+static void
+apt_test_path_index_runs (void)
+{
+    AptPathIndexWriter memory;
+    g_autofree gchar *dir = NULL;
+    g_autofree gchar *file = NULL;
+    g_autofree gchar *contents = NULL;
+    gsize length;
+
+    dir = g_dir_make_tmp("apt-tests-XXXXXX", NULL);
+    g_assert_nonnull(dir);
+    file = g_build_filename(dir, "index.bin", NULL);
+
+    /* sorted in runs of a few paths, it is the same as sorted at once */
+    AptPathIndexWriter runs(std::string(dir) + "/", 64);
+    for (const char *name : { "zeta", "alpha", "beta" }) {
+        memory.addPackage(name);
+        runs.addPackage(name);
+    }
+    for (guint i = 0; i < 1000; i++) {
+        const std::string path = "/usr/share/" + std::to_string(g_test_rand_int_range(0, 300)) +
+                                 std::string(g_test_rand_int_range(0, 20), 'a');
+        const guint32 package = g_test_rand_int_range(0, 3);
+        memory.addPath(path.data(), path.size(), package);
+        runs.addPath(path.data(), path.size(), package);
+    }
+    const std::string expected = memory.finish(1);
+    g_assert_true(runs.write(file, 1));
+    g_assert_true(g_file_get_contents(file, &contents, &length, NULL));
+    g_assert_cmpuint(length, ==, expected.size());
+    g_assert_true(memcmp(contents, expected.data(), length) == 0);
+
+    /* and the runs are gone */
+    g_assert_cmpint(g_unlink(file), ==, 0);
+    g_assert_cmpint(g_rmdir(dir), ==, 0);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -183,6 +616,12 @@ main (int argc, char **argv)
     g_test_add_func ("/apt/gst-matcher/with-caps", apt_test_gst_matcher_with_caps);
     g_test_add_func ("/apt/gst-matcher/without-caps", apt_test_gst_matcher_without_caps);
     g_test_add_func ("/apt/gst-matcher/bad-caps", apt_test_gst_matcher_bad_caps);
+    g_test_add_func ("/apt/warm-cache", apt_test_warm_cache);
+    g_test_add_func ("/apt/search", apt_test_search);
+    g_test_add_func ("/apt/search-index", apt_test_search_index);
+    g_test_add_func ("/apt/file-index", apt_test_file_index);
+    g_test_add_func ("/apt/contents-index", apt_test_contents_index);
+    g_test_add_func ("/apt/path-index-runs", apt_test_path_index_runs);
 
     return g_test_run();
 }
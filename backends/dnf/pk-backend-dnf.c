@@ -59,6 +59,8 @@ typedef struct {
 	DnfContext	*context;
 	GHashTable	*sack_cache;	/* of DnfSackCacheItem */
 	GMutex		 sack_mutex;
+	guint64		 sack_cache_hits;	/* protected by sack_mutex */
+	guint64		 sack_cache_misses;
 	GTimer		*repos_timer;
 	gchar		*release_ver;
 	guint		 sack_expire_id;
@@ -97,6 +99,21 @@ pk_backend_supports_parallelization (PkBackend *backend)
 	return FALSE;
 }
 
+GVariant *
+pk_backend_get_metrics (PkBackend *backend)
+{
+	PkBackendDnfPrivate *priv = pk_backend_get_user_data (backend);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->sack_mutex);
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+	g_variant_builder_add (&builder, "{st}", "sack_cache_hits", priv->sack_cache_hits);
+	g_variant_builder_add (&builder, "{st}", "sack_cache_misses", priv->sack_cache_misses);
+	g_variant_builder_add (&builder, "{st}", "sack_cache_entries",
+			       (guint64) g_hash_table_size (priv->sack_cache));
+	return g_variant_builder_end (&builder);
+}
+
 static gboolean
 pk_backend_check_sack_timer (gpointer key, gpointer value, gpointer user_data)
 {
@@ -676,8 +693,10 @@ dnf_utils_create_sack_for_filters (PkBackendJob *job,
 		if (cache_item != NULL && cache_item->sack != NULL) {
 			g_debug ("using cached sack %s", cache_key);
 			g_timer_start (cache_item->timer);
+			priv->sack_cache_hits++;
 			return g_object_ref (cache_item->sack);
 		}
+		priv->sack_cache_misses++;
 	}
 
 	/* update status */
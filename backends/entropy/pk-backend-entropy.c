@@ -46,6 +46,7 @@ pk_backend_initialize (GKeyFile *conf, PkBackend *backend)
 	pk_backend_spawn_set_name (spawn, "entropy");
 	/* allowing sigkill as long as no one complain */
 	pk_backend_spawn_set_allow_sigkill (spawn, TRUE);
+	pk_backend_spawn_set_dispatcher (spawn, BACKEND_FILE);
 }
 
 void
@@ -49,6 +49,7 @@ pk_backend_initialize (GKeyFile *conf, PkBackend *backend)
 
 	spawn = pk_backend_spawn_new (conf);
 	pk_backend_spawn_set_name (spawn, "pisi");
+	pk_backend_spawn_set_dispatcher (spawn, "pisiBackend.py");
 }
 
 void
@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+#
+# Licensed under the GNU General Public License Version 2
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+# a helper that takes requests, where the package version is the number
+# of requests served and the data is the process ID
+
+# output that doesn't belong to any request
+echo -e "status\tquery"
+
+served=0
+while IFS=$'\t' read -r -a args; do
+	case "${args[0]}" in
+	environment)
+		;;
+	request)
+		served=$((served + 1))
+		echo -e "request\t${args[1]}"
+		echo -e "package\tavailable\tserved;${served};noarch;$$\tRequest ${args[2]}"
+		echo -e "finished"
+		;;
+	exit)
+		exit 0
+		;;
+	esac
+done
+exit 0
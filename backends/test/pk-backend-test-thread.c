@@ -110,6 +110,25 @@ pk_backend_search_names (PkBackend *backend, PkBackendJob *job, PkBitfield filte
 				      NULL, NULL);
 }
 
+static void
+pk_backend_refresh_cache_thread (PkBackendJob *job, GVariant *params, gpointer user_data)
+{
+	pk_backend_job_set_status (job, PK_STATUS_ENUM_REFRESH_CACHE);
+	g_usleep (1000*100);
+}
+
+void
+pk_backend_refresh_cache (PkBackend *backend, PkBackendJob *job, gboolean force)
+{
+	pk_backend_job_thread_create (job, pk_backend_refresh_cache_thread, NULL, NULL);
+}
+
+gboolean
+pk_backend_supports_concurrent_reads (PkBackend *backend)
+{
+	return TRUE;
+}
+
 void
 pk_backend_cancel (PkBackend *backend, PkBackendJob *job)
 {
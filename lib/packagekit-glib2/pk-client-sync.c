@@ -709,6 +709,64 @@ pk_client_get_old_transactions (PkClient *client, guint number, GCancellable *ca
 	return results;
 }
 
+/**
+ * pk_client_get_old_transactions_paged:
+ * @client: a valid #PkClient instance
+ * @number: the number of past transactions to return, or 0 for all
+ * @offset: the number of the newest transactions to skip
+ * @since: (nullable): only return transactions after this ISO8601 time, or %NULL
+ * @cancellable: a #GCancellable or %NULL
+ * @progress_callback: (scope call): the function to run when the progress changes
+ * @progress_user_data: data to pass to @progress_callback
+ * @error: the #GError to store any failure, or %NULL
+ *
+ * Get one page of the old transaction list, oldest first.
+ *
+ * Warning: this function is synchronous, and may block. Do not use it in GUI
+ * applications.
+ *
+ * Return value: (transfer full): a #PkResults object, or %NULL for error
+ *
+ * Since: 1.3.2
+ **/
+PkResults *
+pk_client_get_old_transactions_paged (PkClient *client, guint number, guint offset,
+				      const gchar *since, GCancellable *cancellable,
+				      PkProgressCallback progress_callback, gpointer progress_user_data,
+				      GError **error)
+{
+	PkClientHelper helper;
+	PkResults *results;
+
+	g_return_val_if_fail (PK_IS_CLIENT (client), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	/* create temp object */
+	memset (&helper, 0, sizeof (PkClientHelper));
+	helper.context = g_main_context_new ();
+	helper.loop = g_main_loop_new (helper.context, FALSE);
+	helper.error = error;
+
+	g_main_context_push_thread_default (helper.context);
+
+	/* run async method */
+	pk_client_get_old_transactions_paged_async (client, number, offset, since, cancellable,
+						    progress_callback, progress_user_data,
+						    (GAsyncReadyCallback) pk_client_generic_finish_sync, &helper);
+
+	g_main_loop_run (helper.loop);
+
+	results = helper.results;
+
+	g_main_context_pop_thread_default (helper.context);
+
+	/* free temp object */
+	g_main_loop_unref (helper.loop);
+	g_main_context_unref (helper.context);
+
+	return results;
+}
+
 /**
  * pk_client_depends_on:
  * @client: a valid #PkClient instance
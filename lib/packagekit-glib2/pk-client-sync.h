@@ -119,6 +119,15 @@ PkResults	*pk_client_get_old_transactions		(PkClient		*client,
 							 gpointer		 progress_user_data,
 							 GError			**error);
 
+PkResults	*pk_client_get_old_transactions_paged	(PkClient		*client,
+							 guint			 number,
+							 guint			 offset,
+							 const gchar		*since,
+							 GCancellable		*cancellable,
+							 PkProgressCallback	 progress_callback,
+							 gpointer		 progress_user_data,
+							 GError			**error);
+
 PkResults	*pk_client_depends_on			(PkClient		*client,
 							 PkBitfield		 filters,
 							 gchar			**package_ids,
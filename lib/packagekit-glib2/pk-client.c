@@ -31,10 +31,15 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib-object.h>
 #include <locale.h>
 #include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include <packagekit-glib2/pk-client.h>
 #include <packagekit-glib2/pk-client-helper.h>
@@ -44,6 +49,7 @@
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-package-id.h>
 #include <packagekit-glib2/pk-package-ids.h>
+#include <packagekit-glib2/pk-results-memfd-private.h>
 
 static void     pk_client_finalize	(GObject     *object);
 
@@ -65,6 +71,7 @@ struct _PkClientPrivate
 	gboolean		 idle;
 	gboolean		 details_with_deps_size;
 	guint			 cache_age;
+	guint			 progress_rate;
 };
 
 enum {
@@ -75,6 +82,7 @@ enum {
 	PROP_IDLE,
 	PROP_CACHE_AGE,
 	PROP_DETAILS_WITH_DEPS_SIZE,
+	PROP_PROGRESS_RATE,
 	PROP_LAST
 };
 
@@ -158,6 +166,8 @@ struct _PkClientState
 	gpointer			 progress_user_data;
 	gpointer			 user_data;
 	guint				 number;
+	guint				 offset;
+	gchar				*since;
 	gulong				 cancellable_id;
 	GDBusProxy			*proxy;
 	GCancellable			*cancellable;
@@ -174,6 +184,13 @@ struct _PkClientState
 	gint				 remaining_files_to_copy;
 	PkClientHelper			*client_helper;
 	gboolean			 waiting_for_finished;
+	GDBusConnection			*results_connection;
+	guint				 results_pending;
+	guint				 results_subscription_id;
+	guint				 results_registration_id;
+	gboolean			 finished_pending;
+	PkExitEnum			 finished_exit;
+	guint				 finished_runtime;
 };
 
 G_DEFINE_TYPE (PkClientState, pk_client_state, G_TYPE_OBJECT)
@@ -195,6 +212,33 @@ pk_client_state_unset_proxy (PkClientState *state)
 	}
 }
 
+static void
+pk_client_results_closed_cb (GDBusConnection *connection,
+			     gboolean remote_peer_vanished,
+			     GError *error,
+			     gpointer user_data);
+
+static void
+pk_client_state_unset_results_connection (PkClientState *state)
+{
+	if (state->results_connection != NULL) {
+		g_dbus_connection_signal_unsubscribe (state->results_connection,
+						      state->results_subscription_id);
+		state->results_subscription_id = 0;
+		if (state->results_registration_id > 0) {
+			g_dbus_connection_unregister_object (state->results_connection,
+							     state->results_registration_id);
+			state->results_registration_id = 0;
+		}
+		g_signal_handlers_disconnect_matched (state->results_connection,
+						      G_SIGNAL_MATCH_FUNC, 0, 0, NULL,
+						      pk_client_results_closed_cb, NULL);
+		if (!g_dbus_connection_is_closed (state->results_connection))
+			g_dbus_connection_close (state->results_connection, NULL, NULL, NULL);
+		g_clear_object (&state->results_connection);
+	}
+}
+
 static void
 pk_client_state_remove (PkClient *client, PkClientState *state)
 {
@@ -236,6 +280,7 @@ pk_client_state_finish (PkClientState *state, GError *error)
 	}
 
 	pk_client_state_unset_proxy (state);
+	pk_client_state_unset_results_connection (state);
 
 	if (state->ret) {
 		g_task_return_pointer (state->res,
@@ -273,6 +318,7 @@ pk_client_state_dispose (GObject *object)
 	}
 	g_clear_object (&state->cancellable);
 	g_clear_object (&state->cancellable_client);
+	pk_client_state_unset_results_connection (state);
 
 	G_OBJECT_CLASS (pk_client_state_parent_class)->dispose (object);
 }
@@ -290,6 +336,7 @@ pk_client_state_finalize (GObject *object)
 	g_free (state->repo_id);
 	g_strfreev (state->search);
 	g_free (state->value);
+	g_free (state->since);
 	g_free (state->tid);
 	g_free (state->distro_id);
 	g_free (state->transaction_id);
@@ -449,6 +496,9 @@ pk_client_get_property (GObject *object, guint prop_id, GValue *value, GParamSpe
 	case PROP_DETAILS_WITH_DEPS_SIZE:
 		g_value_set_boolean (value, priv->details_with_deps_size);
 		break;
+	case PROP_PROGRESS_RATE:
+		g_value_set_uint (value, priv->progress_rate);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -481,6 +531,9 @@ pk_client_set_property (GObject *object, guint prop_id, const GValue *value, GPa
 	case PROP_DETAILS_WITH_DEPS_SIZE:
 		priv->details_with_deps_size = g_value_get_boolean (value);
 		break;
+	case PROP_PROGRESS_RATE:
+		priv->progress_rate = g_value_get_uint (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -1278,6 +1331,15 @@ pk_client_signal_cb (GDBusProxy *proxy,
 			       "(uu)",
 			       &tmp_uint2,
 			       &tmp_uint);
+
+		/* wait for the results still on the private connection */
+		if (state->results_connection != NULL) {
+			g_debug ("waiting for the results connection to close");
+			state->finished_pending = TRUE;
+			state->finished_exit = tmp_uint2;
+			state->finished_runtime = tmp_uint;
+			return;
+		}
 		pk_client_signal_finished (state,
 					   tmp_uint2,
 					   tmp_uint);
@@ -1722,6 +1784,10 @@ pk_client_set_role (PkClientState *state, PkRoleEnum role)
 	return;
 }
 
+static gboolean pk_client_role_has_bulk_results (PkRoleEnum role);
+static gboolean pk_client_open_results_socket (PkClientState *state);
+static void pk_client_call_role_method (PkClientState *state);
+
 /*
  * pk_client_set_hints_cb:
  **/
@@ -1752,6 +1818,20 @@ pk_client_set_hints_cb (GObject *source_object,
 		      "transaction-flags", state->transaction_flags,
 		      NULL);
 
+	/* receive large result sets directly from the daemon if possible */
+	if (pk_client_role_has_bulk_results (state->role) &&
+	    pk_client_open_results_socket (state))
+		return;
+
+	pk_client_call_role_method (state);
+}
+
+/*
+ * pk_client_call_role_method:
+ **/
+static void
+pk_client_call_role_method (PkClientState *state)
+{
 	/* do this async, although this should be pretty fast anyway */
 	if (state->role == PK_ROLE_ENUM_RESOLVE) {
 		g_dbus_proxy_call (state->proxy, "Resolve",
@@ -1854,6 +1934,18 @@ pk_client_set_hints_cb (GObject *source_object,
 		g_object_set (state->results,
 			      "inputs", g_strv_length (state->package_ids),
 			      NULL);
+	} else if (state->role == PK_ROLE_ENUM_GET_OLD_TRANSACTIONS &&
+		   (state->offset > 0 || state->since != NULL)) {
+		g_dbus_proxy_call (state->proxy, "GetOldTransactionsPaged",
+				   g_variant_new ("(uus)",
+						  state->number,
+						  state->offset,
+						  state->since != NULL ? state->since : ""),
+				   G_DBUS_CALL_FLAGS_NONE,
+				   PK_CLIENT_DBUS_METHOD_TIMEOUT,
+				   state->cancellable,
+				   pk_client_method_cb,
+				   g_object_ref (state));
 	} else if (state->role == PK_ROLE_ENUM_GET_OLD_TRANSACTIONS) {
 		g_dbus_proxy_call (state->proxy, "GetOldTransactions",
 				   g_variant_new ("(u)",
@@ -2275,6 +2367,302 @@ pk_client_create_helper_socket (PkClientState *state)
 	return g_strdup_printf ("frontend-socket=%s", socket_filename);
 }
 
+/*
+ * pk_client_results_signal_cb:
+ *
+ * Results sent on the private connection are handled just like the
+ * same signals on the system bus.
+ **/
+static void
+pk_client_results_signal_cb (GDBusConnection *connection,
+			     const gchar *sender_name,
+			     const gchar *object_path,
+			     const gchar *interface_name,
+			     const gchar *signal_name,
+			     GVariant *parameters,
+			     gpointer user_data)
+{
+	/* the daemon closes the connection rather than sending this */
+	if (g_strcmp0 (signal_name, "Finished") == 0)
+		return;
+	pk_client_signal_cb (NULL, sender_name, signal_name, parameters, user_data);
+}
+
+static void
+pk_client_results_closed_cb (GDBusConnection *connection,
+			     gboolean remote_peer_vanished,
+			     GError *error,
+			     gpointer user_data)
+{
+	GWeakRef *weak_ref = user_data;
+	g_autoptr(PkClientState) state = g_weak_ref_get (weak_ref);
+
+	if (state == NULL)
+		return;
+	pk_client_state_unset_results_connection (state);
+
+	/* all the results have been read, so we can finish now */
+	if (state->finished_pending) {
+		state->finished_pending = FALSE;
+		pk_client_signal_finished (state,
+					   state->finished_exit,
+					   state->finished_runtime);
+	}
+}
+
+/*
+ * pk_client_results_method_call_cb:
+ *
+ * Package and file lists in a sealed memfd are only mapped here, and
+ * parsed when the results are first used.
+ **/
+static void
+pk_client_results_method_call_cb (GDBusConnection *connection,
+				  const gchar *sender,
+				  const gchar *object_path,
+				  const gchar *interface_name,
+				  const gchar *method_name,
+				  GVariant *parameters,
+				  GDBusMethodInvocation *invocation,
+				  gpointer user_data)
+{
+	GWeakRef *weak_ref = user_data;
+	GUnixFDList *fd_list;
+	gint32 idx;
+	gint fd;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(PkClientState) state = g_weak_ref_get (weak_ref);
+
+	fd_list = g_dbus_message_get_unix_fd_list (g_dbus_method_invocation_get_message (invocation));
+	g_variant_get (parameters, "(h)", &idx);
+	if (state == NULL || fd_list == NULL) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_INVALID_ARGS,
+						       "no results memfd");
+		return;
+	}
+	fd = g_unix_fd_list_get (fd_list, idx, &error);
+	if (fd < 0) {
+		g_warning ("failed to get results memfd: %s", error->message);
+		g_dbus_method_invocation_return_gerror (invocation, error);
+		return;
+	}
+
+	if (g_strcmp0 (method_name, "Packages") == 0) {
+		if (!pk_results_add_packages_memfd (state->results, fd,
+						    state->transaction_id, &error))
+			g_warning ("failed to map packages: %s", error->message);
+	} else if (g_strcmp0 (method_name, "Files") == 0) {
+		g_autoptr(PkFiles) item = pk_files_new_from_memfd (fd, &error);
+		if (item != NULL) {
+			g_object_set (item,
+				      "role", state->role,
+				      "transaction-id", state->transaction_id,
+				      NULL);
+			pk_results_add_files (state->results, item);
+		} else {
+			g_warning ("failed to map files: %s", error->message);
+		}
+	}
+	close (fd);
+	g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static const gchar pk_client_results_introspection[] =
+	"<node>"
+	"  <interface name='" PK_RESULTS_MEMFD_INTERFACE "'>"
+	"    <method name='Packages'><arg type='h' name='data' direction='in'/></method>"
+	"    <method name='Files'><arg type='h' name='data' direction='in'/></method>"
+	"  </interface>"
+	"</node>";
+
+static GDBusInterfaceInfo *
+pk_client_results_get_interface_info (void)
+{
+	static GDBusNodeInfo *node_info = NULL;
+
+	if (g_once_init_enter (&node_info)) {
+		GDBusNodeInfo *tmp = g_dbus_node_info_new_for_xml (pk_client_results_introspection, NULL);
+		g_once_init_leave (&node_info, tmp);
+	}
+	return node_info->interfaces[0];
+}
+
+static const GDBusInterfaceVTable pk_client_results_vtable = {
+	pk_client_results_method_call_cb,
+	NULL,
+	NULL,
+	{ 0 }
+};
+
+/*
+ * pk_client_results_socket_ready:
+ **/
+static void
+pk_client_results_socket_ready (PkClientState *state)
+{
+	g_autoptr(GError) error = NULL;
+
+	/* wait for both the daemon and our end of the connection */
+	if (--state->results_pending > 0)
+		return;
+	if (g_cancellable_set_error_if_cancelled (state->cancellable, &error)) {
+		pk_client_state_finish (state, g_steal_pointer (&error));
+		return;
+	}
+	pk_client_call_role_method (state);
+}
+
+static void
+pk_client_results_connection_cb (GObject *source_object,
+				 GAsyncResult *res,
+				 gpointer user_data)
+{
+	g_autoptr(PkClientState) state = PK_CLIENT_STATE (g_steal_pointer (&user_data));
+	g_autoptr(GDBusConnection) connection = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* the daemon refused the socket, so results come on the bus */
+	connection = g_dbus_connection_new_finish (res, &error);
+	if (connection == NULL) {
+		g_debug ("no results connection for %s: %s", state->tid, error->message);
+		pk_client_results_socket_ready (state);
+		return;
+	}
+
+	g_debug ("daemon connected to send results of %s", state->tid);
+	state->results_connection = g_object_ref (connection);
+	state->results_subscription_id =
+		g_dbus_connection_signal_subscribe (connection,
+						    NULL,
+						    PK_DBUS_INTERFACE_TRANSACTION,
+						    NULL,
+						    state->tid,
+						    NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    pk_client_results_signal_cb,
+						    pk_client_weak_ref_new (state),
+						    pk_client_weak_ref_free);
+	state->results_registration_id =
+		g_dbus_connection_register_object (connection,
+						   state->tid,
+						   pk_client_results_get_interface_info (),
+						   &pk_client_results_vtable,
+						   pk_client_weak_ref_new (state),
+						   pk_client_weak_ref_free,
+						   NULL);
+	g_signal_connect_data (connection, "closed",
+			       G_CALLBACK (pk_client_results_closed_cb),
+			       pk_client_weak_ref_new (state), pk_client_weak_ref_free_gclosure, 0);
+	pk_client_results_socket_ready (state);
+}
+
+static void
+pk_client_set_results_socket_cb (GObject *source_object,
+				 GAsyncResult *res,
+				 gpointer user_data)
+{
+	GDBusProxy *proxy = G_DBUS_PROXY (source_object);
+	g_autoptr(PkClientState) state = PK_CLIENT_STATE (g_steal_pointer (&user_data));
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GVariant) value = NULL;
+
+	/* older daemons do not know the method, which is fine */
+	value = g_dbus_proxy_call_with_unix_fd_list_finish (proxy, NULL, res, &error);
+	if (value == NULL)
+		g_debug ("failed to set results socket: %s", error->message);
+	pk_client_results_socket_ready (state);
+}
+
+static gboolean
+pk_client_results_allow_mechanism_cb (GDBusAuthObserver *observer,
+				      const gchar *mechanism,
+				      gpointer user_data)
+{
+	/* we created the socket pair, so EXTERNAL would only ever see our
+	 * own uid rather than the daemon's; nobody else holds the other end */
+	return g_strcmp0 (mechanism, "ANONYMOUS") == 0;
+}
+
+/*
+ * pk_client_open_results_socket:
+ *
+ * Hands the daemon one end of a socket pair, so that large result sets
+ * do not have to be copied through the system bus daemon. The role method
+ * is called once the private connection has been set up or refused.
+ **/
+static gboolean
+pk_client_open_results_socket (PkClientState *state)
+{
+	gint sv[2];
+	g_autofree gchar *guid = NULL;
+	g_autoptr(GDBusAuthObserver) observer = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GSocket) socket = NULL;
+	g_autoptr(GSocketConnection) stream = NULL;
+	g_autoptr(GUnixFDList) fd_list = NULL;
+
+	if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+		g_debug ("failed to create results socket: %s", g_strerror (errno));
+		return FALSE;
+	}
+	socket = g_socket_new_from_fd (sv[0], &error);
+	if (socket == NULL) {
+		g_debug ("failed to create results socket: %s", error->message);
+		close (sv[0]);
+		close (sv[1]);
+		return FALSE;
+	}
+	fd_list = g_unix_fd_list_new_from_array (&sv[1], 1);
+	stream = g_socket_connection_factory_create_connection (socket);
+
+	observer = g_dbus_auth_observer_new ();
+	g_signal_connect (observer, "allow-mechanism",
+			  G_CALLBACK (pk_client_results_allow_mechanism_cb), NULL);
+	guid = g_dbus_generate_guid ();
+	state->results_pending = 2;
+	g_dbus_connection_new (G_IO_STREAM (stream),
+			       guid,
+			       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_SERVER |
+			       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_ALLOW_ANONYMOUS,
+			       observer,
+			       state->cancellable,
+			       pk_client_results_connection_cb,
+			       g_object_ref (state));
+	g_dbus_proxy_call_with_unix_fd_list (state->proxy, "SetResultsSocket",
+					     g_variant_new ("(h)", 0),
+					     G_DBUS_CALL_FLAGS_NONE,
+					     PK_CLIENT_DBUS_METHOD_TIMEOUT,
+					     fd_list,
+					     state->cancellable,
+					     pk_client_set_results_socket_cb,
+					     g_object_ref (state));
+	return TRUE;
+}
+
+/*
+ * pk_client_role_has_bulk_results:
+ **/
+static gboolean
+pk_client_role_has_bulk_results (PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
 /*
  * pk_client_get_proxy_cb:
  **/
@@ -2325,9 +2713,21 @@ pk_client_get_proxy_cb (GObject *object,
 		g_ptr_array_add (array, hint);
 	}
 
+	/* progress-rate */
+	if (priv->progress_rate > 0) {
+		hint = g_strdup_printf ("progress-rate=%u", priv->progress_rate);
+		g_ptr_array_add (array, hint);
+	}
+
 	/* Always set the supports-plural-signals hint to get higher performance signals */
 	g_ptr_array_add (array, g_strdup ("supports-plural-signals=true"));
 
+	/* large result sets are sent on a private connection, see SetResultsSocket,
+	 * but only if we can check the memfd can't change under us */
+	if (pk_client_role_has_bulk_results (state->role) &&
+	    pk_results_memfd_can_map ())
+		g_ptr_array_add (array, g_strdup ("supports-memfd-results=true"));
+
 	/* create socket for roles that need interaction */
 	if (state->role == PK_ROLE_ENUM_INSTALL_FILES ||
 	    state->role == PK_ROLE_ENUM_INSTALL_PACKAGES ||
@@ -3051,6 +3451,63 @@ pk_client_get_old_transactions_async (PkClient *client, guint number, GCancellab
 				  g_steal_pointer (&state));
 }
 
+/**
+ * pk_client_get_old_transactions_paged_async: (finish-func pk_client_generic_finish):
+ * @client: a valid #PkClient instance
+ * @number: the number of past transactions to return, or 0 for all
+ * @offset: the number of the newest transactions to skip
+ * @since: (nullable): only return transactions after this ISO8601 time, or %NULL
+ * @cancellable: a #GCancellable or %NULL
+ * @progress_callback: (scope notified): the function to run when the progress changes
+ * @progress_user_data: data to pass to @progress_callback
+ * @callback_ready: the function to run on completion
+ * @user_data: the data to pass to @callback_ready
+ *
+ * Get one page of the old transaction list, oldest first. The next page
+ * is got by adding @number to @offset.
+ *
+ * Since: 1.3.2
+ **/
+void
+pk_client_get_old_transactions_paged_async (PkClient *client, guint number, guint offset,
+					    const gchar *since, GCancellable *cancellable,
+					    PkProgressCallback progress_callback, gpointer progress_user_data,
+					    GAsyncReadyCallback callback_ready, gpointer user_data)
+{
+	PkClientPrivate *priv = pk_client_get_instance_private (client);
+	g_autoptr(PkClientState) state = NULL;
+	g_autoptr(GError) error = NULL;
+
+	g_return_if_fail (PK_IS_CLIENT (client));
+	g_return_if_fail (callback_ready != NULL);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	/* save state */
+	state = pk_client_state_new (client, callback_ready, user_data, pk_client_get_old_transactions_paged_async, PK_ROLE_ENUM_GET_OLD_TRANSACTIONS, cancellable);
+	state->number = number;
+	state->offset = offset;
+	state->since = g_strdup (since);
+	state->progress_callback = progress_callback;
+	state->progress_user_data = progress_user_data;
+	state->progress = pk_progress_new ();
+
+	/* check not already cancelled */
+	if (cancellable != NULL &&
+	    g_cancellable_set_error_if_cancelled (cancellable, &error)) {
+		pk_client_state_finish (state, g_steal_pointer (&error));
+		return;
+	}
+
+	/* identify */
+	pk_client_set_role (state, state->role);
+
+	/* get tid */
+	pk_control_get_tid_async (priv->control,
+				  cancellable,
+				  (GAsyncReadyCallback) pk_client_get_tid_cb,
+				  g_steal_pointer (&state));
+}
+
 /**
  * pk_client_depends_on_async: (finish-func pk_client_generic_finish):
  * @client: a valid #PkClient instance
@@ -4714,6 +5171,52 @@ pk_client_get_cache_age (PkClient *client)
 	return priv->cache_age;
 }
 
+/**
+ * pk_client_set_progress_rate:
+ * @client: a valid #PkClient instance
+ * @progress_rate: the number of progress updates per second, from 1 to
+ * 100, or 0 for the daemon default
+ *
+ * Sets how often the daemon sends progress for new transactions. Clients
+ * that do not show progress to a user can ask for fewer updates.
+ *
+ * Since: 1.3.2
+ **/
+void
+pk_client_set_progress_rate (PkClient *client, guint progress_rate)
+{
+	PkClientPrivate *priv = pk_client_get_instance_private (client);
+
+	g_return_if_fail (PK_IS_CLIENT (client));
+	g_return_if_fail (progress_rate <= 100);
+
+	if (priv->progress_rate == progress_rate)
+		return;
+
+	priv->progress_rate = progress_rate;
+	g_object_notify_by_pspec (G_OBJECT (client), obj_properties[PROP_PROGRESS_RATE]);
+}
+
+/**
+ * pk_client_get_progress_rate:
+ * @client: a valid #PkClient instance
+ *
+ * Gets how often the daemon is asked to send progress.
+ *
+ * Return value: The number of updates per second, or 0 for the daemon default
+ *
+ * Since: 1.3.2
+ **/
+guint
+pk_client_get_progress_rate (PkClient *client)
+{
+	PkClientPrivate *priv = pk_client_get_instance_private (client);
+
+	g_return_val_if_fail (PK_IS_CLIENT (client), 0);
+
+	return priv->progress_rate;
+}
+
 /**
  * pk_client_set_details_with_deps_size:
  * @client: a valid #PkClient instance
@@ -4836,6 +5339,19 @@ pk_client_class_init (PkClientClass *klass)
 				      FALSE,
 				      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * PkClient:progress-rate:
+	 *
+	 * The number of progress updates per second, where 0 means the
+	 * daemon default
+	 *
+	 * Since: 1.3.2
+	 */
+	obj_properties[PROP_PROGRESS_RATE] =
+		g_param_spec_uint ("progress-rate", NULL, NULL,
+				   0, 100, 0,
+				   G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, PROP_LAST, obj_properties);
 }
 
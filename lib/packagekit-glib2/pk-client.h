@@ -218,6 +218,16 @@ void		 pk_client_get_old_transactions_async	(PkClient		*client,
 							 GAsyncReadyCallback	 callback_ready,
 							 gpointer		 user_data);
 
+void		 pk_client_get_old_transactions_paged_async (PkClient		*client,
+							 guint			 number,
+							 guint			 offset,
+							 const gchar		*since,
+							 GCancellable		*cancellable,
+							 PkProgressCallback	 progress_callback,
+							 gpointer		 progress_user_data,
+							 GAsyncReadyCallback	 callback_ready,
+							 gpointer		 user_data);
+
 void		 pk_client_depends_on_async		(PkClient		*client,
 							 PkBitfield		 filters,
 							 gchar			**package_ids,
@@ -434,6 +444,9 @@ guint		 pk_client_get_cache_age		(PkClient		*client);
 void		 pk_client_set_details_with_deps_size	(PkClient		*client,
 							 gboolean		 details_with_deps_size);
 gboolean	 pk_client_get_details_with_deps_size	(PkClient		*client);
+void		 pk_client_set_progress_rate		(PkClient		*client,
+							 guint			 progress_rate);
+guint		 pk_client_get_progress_rate		(PkClient		*client);
 
 G_END_DECLS
 
@@ -30,9 +30,11 @@
 
 #include "config.h"
 
+#include <gio/gio.h>
 #include <glib-object.h>
 
 #include <packagekit-glib2/pk-files.h>
+#include <packagekit-glib2/pk-results-memfd-private.h>
 
 static void     pk_files_finalize	(GObject     *object);
 
@@ -47,6 +49,9 @@ struct _PkFilesPrivate
 {
 	gchar				*package_id;
 	gchar				**files;
+	GBytes				*mapped;
+	gsize				 mapped_offset;
+	guint				 mapped_n_files;
 };
 
 enum {
@@ -88,8 +93,39 @@ pk_files_get_package_id (PkFiles *files)
 gchar **
 pk_files_get_files (PkFiles *files)
 {
+	PkFilesPrivate *priv;
+	PkResultsMemfdReader reader;
+	guint i;
+
 	g_return_val_if_fail (PK_IS_FILES (files), NULL);
-	return files->priv->files;
+
+	/* only point into the mapped data when the list is first used */
+	priv = files->priv;
+	if (priv->files == NULL && priv->mapped != NULL) {
+		priv->files = g_new0 (gchar *, priv->mapped_n_files + 1);
+		pk_results_memfd_reader_init (&reader, priv->mapped, priv->mapped_offset);
+		for (i = 0; i < priv->mapped_n_files; i++)
+			priv->files[i] = (gchar *) pk_results_memfd_reader_string (&reader);
+	}
+	return priv->files;
+}
+
+/*
+ * pk_files_clear_files:
+ **/
+static void
+pk_files_clear_files (PkFiles *files)
+{
+	PkFilesPrivate *priv = files->priv;
+
+	/* the strings are owned by the mapping */
+	if (priv->mapped != NULL) {
+		g_free (priv->files);
+		g_clear_pointer (&priv->mapped, g_bytes_unref);
+	} else {
+		g_strfreev (priv->files);
+	}
+	priv->files = NULL;
 }
 
 /*
@@ -106,7 +142,7 @@ pk_files_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec
 		g_value_set_string (value, priv->package_id);
 		break;
 	case PROP_FILES:
-		g_value_set_boxed (value, priv->files);
+		g_value_set_boxed (value, pk_files_get_files (files));
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -129,7 +165,7 @@ pk_files_set_property (GObject *object, guint prop_id, const GValue *value, GPar
 		priv->package_id = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_FILES:
-		g_strfreev (priv->files);
+		pk_files_clear_files (files);
 		priv->files = g_strdupv (g_value_get_boxed (value));
 		break;
 	default:
@@ -194,7 +230,7 @@ pk_files_finalize (GObject *object)
 	PkFilesPrivate *priv = files->priv;
 
 	g_free (priv->package_id);
-	g_strfreev (priv->files);
+	pk_files_clear_files (files);
 
 	G_OBJECT_CLASS (pk_files_parent_class)->finalize (object);
 }
@@ -214,3 +250,54 @@ pk_files_new (void)
 	return PK_FILES (files);
 }
 
+/*
+ * pk_files_new_from_memfd:
+ * @fd: a sealed memfd of kind %PK_RESULTS_MEMFD_KIND_FILES
+ * @error: a #GError or %NULL
+ *
+ * Creates a files object that maps @fd rather than copying the file
+ * list. The fd can be closed when this returns.
+ *
+ * Return value: a new #PkFiles object, or %NULL with @error set
+ **/
+PkFiles *
+pk_files_new_from_memfd (gint fd, GError **error)
+{
+	const gchar *package_id;
+	const gchar *tmp;
+	guint32 n_records = 0;
+	guint32 n_files = 0;
+	guint i;
+	PkResultsMemfdReader reader;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(PkFiles) files = NULL;
+
+	bytes = pk_results_memfd_map (fd, PK_RESULTS_MEMFD_KIND_FILES, &n_records, error);
+	if (bytes == NULL)
+		return NULL;
+	pk_results_memfd_reader_init (&reader, bytes, 0);
+	package_id = pk_results_memfd_reader_string (&reader);
+	if (n_records != 1 ||
+	    package_id == NULL ||
+	    !pk_results_memfd_reader_uint32 (&reader, &n_files)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     "results memfd does not contain a file list");
+		return NULL;
+	}
+
+	/* check the list is complete now, so it can be used without checks later */
+	files = pk_files_new ();
+	files->priv->package_id = g_strdup (package_id);
+	files->priv->mapped_offset = reader.offset;
+	files->priv->mapped_n_files = n_files;
+	for (i = 0; i < n_files; i++) {
+		tmp = pk_results_memfd_reader_string (&reader);
+		if (tmp == NULL) {
+			g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     "results memfd is truncated after %u files", i);
+			return NULL;
+		}
+	}
+	files->priv->mapped = g_steal_pointer (&bytes);
+	return g_steal_pointer (&files);
+}
@@ -76,7 +76,8 @@ out:
 gboolean
 pk_package_id_check (const gchar *package_id)
 {
-	g_auto(GStrv) sections = NULL;
+	const gchar *tmp;
+	guint delimiters = 0;
 	gboolean ret;
 
 	/* NULL check */
@@ -88,11 +89,17 @@ pk_package_id_check (const gchar *package_id)
 	if (!ret)
 		return FALSE;
 
-	/* correct number of sections */
-	sections = pk_package_id_split (package_id);
-	if (sections == NULL)
+	/* name has to be valid, checked without splitting as this is
+	 * called for every package a backend emits */
+	if (package_id[0] == '\0' || package_id[0] == ';')
 		return FALSE;
-	return TRUE;
+
+	/* correct number of sections */
+	for (tmp = package_id; *tmp != '\0'; tmp++) {
+		if (*tmp == ';')
+			delimiters++;
+	}
+	return delimiters == 3;
 }
 
 /**
@@ -30,6 +30,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib-object.h>
 #include <gio/gio.h>
 
@@ -52,6 +54,7 @@ static void     pk_package_sack_finalize	(GObject     *object);
 struct _PkPackageSackPrivate
 {
 	GHashTable		*table;
+	GHashTable		*name_index;	/* name → GPtrArray of PkPackage */
 	GPtrArray		*array;
 	PkClient		*client;
 };
@@ -63,6 +66,56 @@ enum {
 
 G_DEFINE_TYPE (PkPackageSack, pk_package_sack, G_TYPE_OBJECT)
 
+/*
+ * pk_package_sack_index_add:
+ *
+ * Packages with the same name are kept in array order, so lookups by name
+ * return the same package a scan of the array would.
+ **/
+static void
+pk_package_sack_index_add (PkPackageSack *sack, PkPackage *package)
+{
+	const gchar *name = pk_package_get_name (package);
+	GPtrArray *bucket;
+
+	if (name == NULL)
+		return;
+	bucket = g_hash_table_lookup (sack->priv->name_index, name);
+	if (bucket == NULL) {
+		bucket = g_ptr_array_new ();
+		g_hash_table_insert (sack->priv->name_index,
+				     g_ref_string_new_intern (name),
+				     bucket);
+	}
+	g_ptr_array_add (bucket, package);
+}
+
+static void
+pk_package_sack_index_remove (PkPackageSack *sack, PkPackage *package)
+{
+	const gchar *name = pk_package_get_name (package);
+	GPtrArray *bucket;
+
+	if (name == NULL)
+		return;
+	bucket = g_hash_table_lookup (sack->priv->name_index, name);
+	if (bucket == NULL)
+		return;
+	g_ptr_array_remove (bucket, package);
+	if (bucket->len == 0)
+		g_hash_table_remove (sack->priv->name_index, name);
+}
+
+static void
+pk_package_sack_index_rebuild (PkPackageSack *sack)
+{
+	guint i;
+
+	g_hash_table_remove_all (sack->priv->name_index);
+	for (i = 0; i < sack->priv->array->len; i++)
+		pk_package_sack_index_add (sack, g_ptr_array_index (sack->priv->array, i));
+}
+
 /**
  * pk_package_sack_clear:
  * @sack: a valid #PkPackageSack instance
@@ -78,6 +131,7 @@ pk_package_sack_clear (PkPackageSack *sack)
 
 	g_ptr_array_set_size (sack->priv->array, 0);
 	g_hash_table_remove_all (sack->priv->table);
+	g_hash_table_remove_all (sack->priv->name_index);
 }
 
 /**
@@ -240,6 +294,7 @@ pk_package_sack_add_package (PkPackageSack *sack, PkPackage *package)
 	g_hash_table_insert (sack->priv->table,
 			     (gpointer) pk_package_get_id (package),
 			     (gpointer) package);
+	pk_package_sack_index_add (sack, package);
 
 	return TRUE;
 }
@@ -416,6 +471,7 @@ pk_package_sack_remove_package (PkPackageSack *sack, PkPackage *package)
 
 	/* remove from array */
 	g_hash_table_remove (sack->priv->table, pk_package_get_id (package));
+	pk_package_sack_index_remove (sack, package);
 	return g_ptr_array_remove (sack->priv->array, package);
 }
 
@@ -536,24 +592,51 @@ PkPackage *
 pk_package_sack_find_by_id_name_arch (PkPackageSack *sack, const gchar *package_id)
 {
 	PkPackage *pkg_tmp;
+	GPtrArray *bucket;
+	const gchar *arch;
+	const gchar *sep[3];
+	gchar name_buf[128];
+	gsize arch_len;
+	gsize name_len;
 	guint i;
-	g_auto(GStrv) split = NULL;
+	g_autofree gchar *name_tmp = NULL;
 
 	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), NULL);
 	g_return_val_if_fail (package_id != NULL, NULL);
 
+	/* find the sections without splitting, as this is called a lot */
+	sep[0] = strchr (package_id, ';');
+	sep[1] = sep[0] != NULL ? strchr (sep[0] + 1, ';') : NULL;
+	sep[2] = sep[1] != NULL ? strchr (sep[1] + 1, ';') : NULL;
+	if (sep[2] == NULL || strchr (sep[2] + 1, ';') != NULL)
+		return NULL;
+	name_len = sep[0] - package_id;
+	if (name_len == 0)
+		return NULL;
+	arch = sep[1] + 1;
+	arch_len = sep[2] - arch;
+
 	/* does the package name feature in the array */
-	split = pk_package_id_split (package_id);
-	if (split == NULL)
+	if (name_len < sizeof (name_buf)) {
+		memcpy (name_buf, package_id, name_len);
+		name_buf[name_len] = '\0';
+		bucket = g_hash_table_lookup (sack->priv->name_index, name_buf);
+	} else {
+		name_tmp = g_strndup (package_id, name_len);
+		bucket = g_hash_table_lookup (sack->priv->name_index, name_tmp);
+	}
+	if (bucket == NULL)
 		return NULL;
-	for (i = 0; i < sack->priv->array->len; i++) {
-		pkg_tmp = g_ptr_array_index (sack->priv->array, i);
-		if (g_strcmp0 (pk_package_get_name (pkg_tmp),
-			       split[PK_PACKAGE_ID_NAME]) == 0 &&
-		    g_strcmp0 (pk_package_get_arch (pkg_tmp),
-			       split[PK_PACKAGE_ID_ARCH]) == 0) {
+
+	/* only a few versions and arches of each name */
+	for (i = 0; i < bucket->len; i++) {
+		const gchar *arch_tmp;
+		pkg_tmp = g_ptr_array_index (bucket, i);
+		arch_tmp = pk_package_get_arch (pkg_tmp);
+		if (arch_tmp != NULL &&
+		    strncmp (arch_tmp, arch, arch_len) == 0 &&
+		    arch_tmp[arch_len] == '\0')
 			return g_object_ref (pkg_tmp);
-		}
 	}
 	return NULL;
 }
@@ -640,6 +723,9 @@ pk_package_sack_sort (PkPackageSack *sack, PkPackageSackSortType type)
 		g_ptr_array_sort (sack->priv->array, (GCompareFunc) pk_package_sack_sort_compare_summary_func);
 	else if (type == PK_PACKAGE_SACK_SORT_TYPE_INFO)
 		g_ptr_array_sort (sack->priv->array, (GCompareFunc) pk_package_sack_sort_compare_info_func);
+
+	/* keep the same order in the index */
+	pk_package_sack_index_rebuild (sack);
 }
 
 /**
@@ -1082,6 +1168,9 @@ pk_package_sack_init (PkPackageSack *sack)
 	priv = sack->priv;
 
 	priv->table = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->name_index = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  (GDestroyNotify) g_ref_string_release,
+						  (GDestroyNotify) g_ptr_array_unref);
 	priv->array = g_ptr_array_new_with_free_func (g_object_unref);
 	priv->client = pk_client_new ();
 }
@@ -1097,6 +1186,7 @@ pk_package_sack_finalize (GObject *object)
 
 	g_ptr_array_unref (priv->array);
 	g_hash_table_unref (priv->table);
+	g_hash_table_unref (priv->name_index);
 	g_object_unref (priv->client);
 
 	G_OBJECT_CLASS (pk_package_sack_parent_class)->finalize (object);
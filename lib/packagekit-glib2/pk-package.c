@@ -42,18 +42,14 @@ static void     pk_package_finalize	(GObject     *object);
 
 #define PK_PACKAGE_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_PACKAGE, PkPackagePrivate))
 
-/**
- * PkPackagePrivate:
+/*
+ * PkPackageExtra:
  *
- * Private #PkPackage data
+ * Details and update details, which are only set for a few packages of
+ * a large result set, so they are only allocated when first set.
  **/
-struct _PkPackagePrivate
+typedef struct
 {
-	PkInfoEnum		 info;
-	gchar			*package_id;
-	gchar			*package_id_data;
-	const gchar		*package_id_split[4];
-	gchar			*summary;
 	gchar			*license;
 	PkGroupEnum		 group;
 	gchar			*description;
@@ -70,7 +66,21 @@ struct _PkPackagePrivate
 	PkUpdateStateEnum	 update_state;
 	gchar			*update_issued;
 	gchar			*update_updated;
+} PkPackageExtra;
+
+/**
+ * PkPackagePrivate:
+ *
+ * Private #PkPackage data
+ **/
+struct _PkPackagePrivate
+{
+	PkInfoEnum		 info;
 	PkInfoEnum	 	 update_severity;
+	gchar			*package_id;		/* interned */
+	gchar			*package_id_split[4];	/* interned */
+	gchar			*summary;		/* interned */
+	PkPackageExtra		*extra;
 };
 
 enum {
@@ -107,6 +117,67 @@ static guint signals [SIGNAL_LAST] = { 0 };
 
 G_DEFINE_TYPE (PkPackage, pk_package, PK_TYPE_SOURCE)
 
+/*
+ * pk_package_intern:
+ *
+ * The arch, repo, name and version sections of package IDs, and often the
+ * summaries, are the same for many packages of a result set, so a single
+ * refcounted copy of each string is shared in the process.
+ **/
+static gchar *
+pk_package_intern (const gchar *str)
+{
+	if (str == NULL)
+		return NULL;
+	return g_ref_string_new_intern (str);
+}
+
+static void
+pk_package_unintern (gchar **str)
+{
+	if (*str == NULL)
+		return;
+	g_ref_string_release (*str);
+	*str = NULL;
+}
+
+static void
+pk_package_clear_id (PkPackage *package)
+{
+	PkPackagePrivate *priv = package->priv;
+	guint i;
+
+	pk_package_unintern (&priv->package_id);
+	for (i = 0; i < 4; i++)
+		pk_package_unintern (&priv->package_id_split[i]);
+}
+
+static PkPackageExtra *
+pk_package_get_extra (PkPackage *package)
+{
+	if (package->priv->extra == NULL)
+		package->priv->extra = g_new0 (PkPackageExtra, 1);
+	return package->priv->extra;
+}
+
+static void
+pk_package_extra_free (PkPackageExtra *extra)
+{
+	g_free (extra->license);
+	g_free (extra->description);
+	g_free (extra->url);
+	g_free (extra->update_updates);
+	g_free (extra->update_obsoletes);
+	g_strfreev (extra->update_vendor_urls);
+	g_strfreev (extra->update_bugzilla_urls);
+	g_strfreev (extra->update_cve_urls);
+	g_free (extra->update_text);
+	g_free (extra->update_changelog);
+	g_free (extra->update_issued);
+	g_free (extra->update_updated);
+	g_free (extra);
+}
+
 /**
  * pk_package_equal:
  * @package1: a valid #PkPackage instance
@@ -123,8 +194,10 @@ pk_package_equal (PkPackage *package1, PkPackage *package2)
 {
 	g_return_val_if_fail (PK_IS_PACKAGE (package1), FALSE);
 	g_return_val_if_fail (PK_IS_PACKAGE (package2), FALSE);
-	return (g_strcmp0 (package1->priv->summary, package2->priv->summary) == 0 &&
-	        g_strcmp0 (package1->priv->package_id, package2->priv->package_id) == 0 &&
+
+	/* interned, so the same string is the same pointer */
+	return (package1->priv->summary == package2->priv->summary &&
+	        package1->priv->package_id == package2->priv->package_id &&
 	        package1->priv->info == package2->priv->info);
 }
 
@@ -144,7 +217,7 @@ pk_package_equal_id (PkPackage *package1, PkPackage *package2)
 {
 	g_return_val_if_fail (PK_IS_PACKAGE (package1), FALSE);
 	g_return_val_if_fail (PK_IS_PACKAGE (package2), FALSE);
-	return (g_strcmp0 (package1->priv->package_id, package2->priv->package_id) == 0);
+	return package1->priv->package_id == package2->priv->package_id;
 }
 
 /**
@@ -166,27 +239,30 @@ pk_package_set_id (PkPackage *package, const gchar *package_id, GError **error)
 	gboolean ret;
 	guint cnt = 0;
 	guint i;
+	const gchar *sections[4] = { NULL, NULL, NULL, NULL };
+	g_autofree gchar *package_id_data = NULL;
 
 	g_return_val_if_fail (PK_IS_PACKAGE (package), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
 	/* free old data */
-	g_free (priv->package_id);
-	g_free (priv->package_id_data);
+	pk_package_clear_id (package);
 
 	/* copy the package-id into package_id_data, change the ';' into '\0'
-	 * and reference the pointers in the const gchar * array */
-	priv->package_id = g_strdup (package_id);
-	priv->package_id_data = g_strdup (package_id);
-	priv->package_id_split[0] = priv->package_id_data;
-	for (i = 0; priv->package_id_data[i] != '\0'; i++) {
+	 * and intern each of the sections */
+	priv->package_id = pk_package_intern (package_id);
+	package_id_data = g_strdup (package_id);
+	sections[0] = package_id_data;
+	for (i = 0; package_id_data[i] != '\0'; i++) {
 		if (package_id[i] == ';') {
 			if (++cnt > 3)
 				continue;
-			priv->package_id_split[cnt] = &priv->package_id_data[i+1];
-			priv->package_id_data[i] = '\0';
+			sections[cnt] = &package_id_data[i+1];
+			package_id_data[i] = '\0';
 		}
 	}
+	for (i = 0; i < 4; i++)
+		priv->package_id_split[i] = pk_package_intern (sections[i]);
 	if (cnt != 3) {
 		ret = FALSE;
 		g_set_error (error, 1, 0, "invalid number of sections %i", cnt);
@@ -234,8 +310,7 @@ pk_package_parse (PkPackage *package, const gchar *data, GError **error)
 	package->priv->info = pk_info_enum_from_string (sections[0]);
 	if (!pk_package_set_id (package, sections[1], error))
 		return FALSE;
-	g_free (package->priv->summary);
-	package->priv->summary = g_strdup (sections[2]);
+	pk_package_set_summary (package, sections[2]);
 	return TRUE;
 }
 
@@ -285,8 +360,8 @@ void
 pk_package_set_summary (PkPackage *package, const gchar *summary)
 {
 	g_return_if_fail (PK_IS_PACKAGE (package));
-	g_free (package->priv->summary);
-	package->priv->summary = g_strdup (summary);
+	pk_package_unintern (&package->priv->summary);
+	package->priv->summary = pk_package_intern (summary);
 }
 
 /**
@@ -422,6 +497,7 @@ pk_package_get_property (GObject *object, guint prop_id, GValue *value, GParamSp
 {
 	PkPackage *package = PK_PACKAGE (object);
 	PkPackagePrivate *priv = package->priv;
+	PkPackageExtra *extra = priv->extra;
 
 	switch (prop_id) {
 	case PROP_PACKAGE_ID:
@@ -434,52 +510,52 @@ pk_package_get_property (GObject *object, guint prop_id, GValue *value, GParamSp
 		g_value_set_enum (value, priv->info);
 		break;
 	case PROP_LICENSE:
-		g_value_set_string (value, priv->license);
+		g_value_set_string (value, extra != NULL ? extra->license : NULL);
 		break;
 	case PROP_GROUP:
-		g_value_set_enum (value, priv->group);
+		g_value_set_enum (value, extra != NULL ? extra->group : PK_GROUP_ENUM_UNKNOWN);
 		break;
 	case PROP_DESCRIPTION:
-		g_value_set_string (value, priv->description);
+		g_value_set_string (value, extra != NULL ? extra->description : NULL);
 		break;
 	case PROP_URL:
-		g_value_set_string (value, priv->url);
+		g_value_set_string (value, extra != NULL ? extra->url : NULL);
 		break;
 	case PROP_SIZE:
-		g_value_set_uint64 (value, priv->size);
+		g_value_set_uint64 (value, extra != NULL ? extra->size : 0);
 		break;
 	case PROP_UPDATE_UPDATES:
-		g_value_set_string (value, priv->update_updates);
+		g_value_set_string (value, extra != NULL ? extra->update_updates : NULL);
 		break;
 	case PROP_UPDATE_OBSOLETES:
-		g_value_set_string (value, priv->update_obsoletes);
+		g_value_set_string (value, extra != NULL ? extra->update_obsoletes : NULL);
 		break;
 	case PROP_UPDATE_VENDOR_URLS:
-		g_value_set_boxed (value, priv->update_vendor_urls);
+		g_value_set_boxed (value, extra != NULL ? extra->update_vendor_urls : NULL);
 		break;
 	case PROP_UPDATE_BUGZILLA_URLS:
-		g_value_set_boxed (value, priv->update_bugzilla_urls);
+		g_value_set_boxed (value, extra != NULL ? extra->update_bugzilla_urls : NULL);
 		break;
 	case PROP_UPDATE_CVE_URLS:
-		g_value_set_boxed (value, priv->update_cve_urls);
+		g_value_set_boxed (value, extra != NULL ? extra->update_cve_urls : NULL);
 		break;
 	case PROP_UPDATE_RESTART:
-		g_value_set_enum (value, priv->update_restart);
+		g_value_set_enum (value, extra != NULL ? extra->update_restart : PK_RESTART_ENUM_UNKNOWN);
 		break;
 	case PROP_UPDATE_UPDATE_TEXT:
-		g_value_set_string (value, priv->update_text);
+		g_value_set_string (value, extra != NULL ? extra->update_text : NULL);
 		break;
 	case PROP_UPDATE_CHANGELOG:
-		g_value_set_string (value, priv->update_changelog);
+		g_value_set_string (value, extra != NULL ? extra->update_changelog : NULL);
 		break;
 	case PROP_UPDATE_STATE:
-		g_value_set_enum (value, priv->update_state);
+		g_value_set_enum (value, extra != NULL ? extra->update_state : PK_UPDATE_STATE_ENUM_UNKNOWN);
 		break;
 	case PROP_UPDATE_ISSUED:
-		g_value_set_string (value, priv->update_issued);
+		g_value_set_string (value, extra != NULL ? extra->update_issued : NULL);
 		break;
 	case PROP_UPDATE_UPDATED:
-		g_value_set_string (value, priv->update_updated);
+		g_value_set_string (value, extra != NULL ? extra->update_updated : NULL);
 		break;
 	case PROP_UPDATE_SEVERITY:
 		g_value_set_enum (value, priv->update_severity);
@@ -497,7 +573,7 @@ static void
 pk_package_set_property (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
 {
 	PkPackage *package = PK_PACKAGE (object);
-	PkPackagePrivate *priv = package->priv;
+	PkPackageExtra *extra;
 
 	switch (prop_id) {
 	case PROP_INFO:
@@ -507,64 +583,76 @@ pk_package_set_property (GObject *object, guint prop_id, const GValue *value, GP
 		pk_package_set_summary (package, g_value_get_string (value));
 		break;
 	case PROP_LICENSE:
-		g_free (priv->license);
-		priv->license = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->license);
+		extra->license = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_GROUP:
-		priv->group = g_value_get_enum (value);
+		pk_package_get_extra (package)->group = g_value_get_enum (value);
 		break;
 	case PROP_DESCRIPTION:
-		g_free (priv->description);
-		priv->description = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->description);
+		extra->description = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_URL:
-		g_free (priv->url);
-		priv->url = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->url);
+		extra->url = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_SIZE:
-		priv->size = g_value_get_uint64 (value);
+		pk_package_get_extra (package)->size = g_value_get_uint64 (value);
 		break;
 	case PROP_UPDATE_UPDATES:
-		g_free (priv->update_updates);
-		priv->update_updates = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->update_updates);
+		extra->update_updates = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_UPDATE_OBSOLETES:
-		g_free (priv->update_obsoletes);
-		priv->update_obsoletes = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->update_obsoletes);
+		extra->update_obsoletes = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_UPDATE_VENDOR_URLS:
-		g_strfreev (priv->update_vendor_urls);
-		priv->update_vendor_urls = g_strdupv (g_value_get_boxed (value));
+		extra = pk_package_get_extra (package);
+		g_strfreev (extra->update_vendor_urls);
+		extra->update_vendor_urls = g_strdupv (g_value_get_boxed (value));
 		break;
 	case PROP_UPDATE_BUGZILLA_URLS:
-		g_strfreev (priv->update_bugzilla_urls);
-		priv->update_bugzilla_urls = g_strdupv (g_value_get_boxed (value));
+		extra = pk_package_get_extra (package);
+		g_strfreev (extra->update_bugzilla_urls);
+		extra->update_bugzilla_urls = g_strdupv (g_value_get_boxed (value));
 		break;
 	case PROP_UPDATE_CVE_URLS:
-		g_strfreev (priv->update_cve_urls);
-		priv->update_cve_urls = g_strdupv (g_value_get_boxed (value));
+		extra = pk_package_get_extra (package);
+		g_strfreev (extra->update_cve_urls);
+		extra->update_cve_urls = g_strdupv (g_value_get_boxed (value));
 		break;
 	case PROP_UPDATE_RESTART:
-		priv->update_restart = g_value_get_enum (value);
+		pk_package_get_extra (package)->update_restart = g_value_get_enum (value);
 		break;
 	case PROP_UPDATE_UPDATE_TEXT:
-		g_free (priv->update_text);
-		priv->update_text = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->update_text);
+		extra->update_text = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_UPDATE_CHANGELOG:
-		g_free (priv->update_changelog);
-		priv->update_changelog = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->update_changelog);
+		extra->update_changelog = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_UPDATE_STATE:
-		priv->update_state = g_value_get_enum (value);
+		pk_package_get_extra (package)->update_state = g_value_get_enum (value);
 		break;
 	case PROP_UPDATE_ISSUED:
-		g_free (priv->update_issued);
-		priv->update_issued = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->update_issued);
+		extra->update_issued = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_UPDATE_UPDATED:
-		g_free (priv->update_updated);
-		priv->update_updated = g_strdup (g_value_get_string (value));
+		extra = pk_package_get_extra (package);
+		g_free (extra->update_updated);
+		extra->update_updated = g_strdup (g_value_get_string (value));
 		break;
 	case PROP_UPDATE_SEVERITY:
 		pk_package_set_update_severity (package, g_value_get_enum (value));
@@ -836,10 +924,6 @@ static void
 pk_package_init (PkPackage *package)
 {
 	package->priv = PK_PACKAGE_GET_PRIVATE (package);
-	package->priv->package_id_split[PK_PACKAGE_ID_NAME] = NULL;
-	package->priv->package_id_split[PK_PACKAGE_ID_VERSION] = NULL;
-	package->priv->package_id_split[PK_PACKAGE_ID_ARCH] = NULL;
-	package->priv->package_id_split[PK_PACKAGE_ID_DATA] = NULL;
 }
 
 /*
@@ -852,21 +936,10 @@ pk_package_finalize (GObject *object)
 	PkPackage *package = PK_PACKAGE (object);
 	PkPackagePrivate *priv = package->priv;
 
-	g_free (priv->package_id);
-	g_free (priv->summary);
-	g_free (priv->license);
-	g_free (priv->description);
-	g_free (priv->url);
-	g_free (priv->update_updates);
-	g_free (priv->update_obsoletes);
-	g_strfreev (priv->update_vendor_urls);
-	g_strfreev (priv->update_bugzilla_urls);
-	g_strfreev (priv->update_cve_urls);
-	g_free (priv->update_text);
-	g_free (priv->update_changelog);
-	g_free (priv->update_issued);
-	g_free (priv->update_updated);
-	g_free (priv->package_id_data);
+	pk_package_clear_id (package);
+	pk_package_unintern (&priv->summary);
+	if (priv->extra != NULL)
+		pk_package_extra_free (priv->extra);
 
 	G_OBJECT_CLASS (pk_package_parent_class)->finalize (object);
 }
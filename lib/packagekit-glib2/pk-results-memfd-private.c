@@ -0,0 +1,261 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* for memfd_create() and the file sealing API */
+#define _GNU_SOURCE
+
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "pk-results-memfd-private.h"
+
+#ifdef F_GET_SEALS
+#define PK_RESULTS_MEMFD_REQUIRED_SEALS	(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+#endif
+
+/*
+ * pk_results_memfd_can_map:
+ *
+ * Without a way to check the seals the data could change or shrink under
+ * the client, so it has to ask for the results as D-Bus signals instead.
+ *
+ * Return value: %TRUE if pk_results_memfd_map() can be used
+ **/
+gboolean
+pk_results_memfd_can_map (void)
+{
+#ifdef F_GET_SEALS
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/*
+ * pk_results_memfd_builder_new:
+ * @kind: a #PkResultsMemfdKind
+ *
+ * Return value: a buffer with the header, free with g_byte_array_unref()
+ **/
+GByteArray *
+pk_results_memfd_builder_new (PkResultsMemfdKind kind)
+{
+	GByteArray *builder = g_byte_array_sized_new (64 * 1024);
+
+	g_byte_array_append (builder, (const guint8 *) PK_RESULTS_MEMFD_MAGIC, 8);
+	pk_results_memfd_builder_add_uint32 (builder, kind);
+	pk_results_memfd_builder_add_uint32 (builder, 0);
+	return builder;
+}
+
+void
+pk_results_memfd_builder_add_uint32 (GByteArray *builder, guint32 value)
+{
+	g_byte_array_append (builder, (const guint8 *) &value, sizeof (value));
+}
+
+void
+pk_results_memfd_builder_add_string (GByteArray *builder, const gchar *value)
+{
+	const guint8 padding[4] = { 0 };
+	gsize len = value != NULL ? strlen (value) : 0;
+
+	pk_results_memfd_builder_add_uint32 (builder, len);
+	if (len > 0)
+		g_byte_array_append (builder, (const guint8 *) value, len);
+
+	/* NUL terminator and alignment */
+	g_byte_array_append (builder, padding, 4 - (len % 4));
+}
+
+void
+pk_results_memfd_builder_set_n_records (GByteArray *builder, guint32 n_records)
+{
+	g_return_if_fail (builder->len >= PK_RESULTS_MEMFD_HEADER_SIZE);
+	memcpy (builder->data + 12, &n_records, sizeof (n_records));
+}
+
+/*
+ * pk_results_memfd_builder_seal:
+ * @builder: a buffer from pk_results_memfd_builder_new()
+ * @error: a #GError or %NULL
+ *
+ * Copies the buffer into a memfd that can no longer be modified.
+ *
+ * Return value: the file descriptor, or -1 with @error set
+ **/
+gint
+pk_results_memfd_builder_seal (GByteArray *builder, GError **error)
+{
+#if defined (MFD_ALLOW_SEALING) && defined (F_GET_SEALS)
+	gint fd;
+	gsize written = 0;
+
+	fd = memfd_create ("packagekit-results", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+			     "failed to create memfd: %s", g_strerror (errno));
+		return -1;
+	}
+	while (written < builder->len) {
+		gssize wrote = write (fd, builder->data + written, builder->len - written);
+		if (wrote < 0) {
+			if (errno == EINTR)
+				continue;
+			g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+				     "failed to write memfd: %s", g_strerror (errno));
+			close (fd);
+			return -1;
+		}
+		written += wrote;
+	}
+	if (fcntl (fd, F_ADD_SEALS, PK_RESULTS_MEMFD_REQUIRED_SEALS | F_SEAL_SEAL) < 0) {
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+			     "failed to seal memfd: %s", g_strerror (errno));
+		close (fd);
+		return -1;
+	}
+	return fd;
+#else
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			     "memfd is not supported");
+	return -1;
+#endif
+}
+
+/*
+ * pk_results_memfd_map:
+ * @fd: a sealed memfd
+ * @kind: the expected #PkResultsMemfdKind
+ * @n_records: (out): the number of records
+ * @error: a #GError or %NULL
+ *
+ * Maps the memfd read-only, which stays valid after @fd is closed.
+ *
+ * Return value: (transfer full): the mapped data, or %NULL with @error set
+ **/
+GBytes *
+pk_results_memfd_map (gint fd,
+		      PkResultsMemfdKind kind,
+		      guint32 *n_records,
+		      GError **error)
+{
+	const guint8 *data;
+	gsize len;
+	guint32 tmp;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GMappedFile) mapped = NULL;
+
+#ifdef F_GET_SEALS
+	/* a shrinking file would crash us with SIGBUS when parsing */
+	gint seals = fcntl (fd, F_GET_SEALS);
+	if (seals < 0 ||
+	    (seals & PK_RESULTS_MEMFD_REQUIRED_SEALS) != PK_RESULTS_MEMFD_REQUIRED_SEALS) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     "results memfd is not sealed");
+		return NULL;
+	}
+#else
+	/* never trust data we can't check is immutable */
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+			     "results memfd seals can not be checked");
+	return NULL;
+#endif
+	mapped = g_mapped_file_new_from_fd (fd, FALSE, error);
+	if (mapped == NULL)
+		return NULL;
+	bytes = g_mapped_file_get_bytes (mapped);
+
+	/* check header */
+	data = g_bytes_get_data (bytes, &len);
+	if (len < PK_RESULTS_MEMFD_HEADER_SIZE ||
+	    memcmp (data, PK_RESULTS_MEMFD_MAGIC, 8) != 0) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     "results memfd has an invalid header");
+		return NULL;
+	}
+	memcpy (&tmp, data + 8, sizeof (tmp));
+	if (tmp != kind) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "results memfd has kind %u, expected %u", tmp, kind);
+		return NULL;
+	}
+	if (n_records != NULL)
+		memcpy (n_records, data + 12, sizeof (guint32));
+	return g_steal_pointer (&bytes);
+}
+
+/*
+ * pk_results_memfd_reader_init:
+ * @reader: a #PkResultsMemfdReader
+ * @bytes: data from pk_results_memfd_map(), which has to outlive @reader
+ * @offset: where to start reading, or 0 for the first record
+ **/
+void
+pk_results_memfd_reader_init (PkResultsMemfdReader *reader,
+			      GBytes *bytes,
+			      gsize offset)
+{
+	reader->data = g_bytes_get_data (bytes, &reader->len);
+	reader->offset = MAX (offset, PK_RESULTS_MEMFD_HEADER_SIZE);
+}
+
+gboolean
+pk_results_memfd_reader_uint32 (PkResultsMemfdReader *reader, guint32 *value)
+{
+	if (reader->offset > reader->len ||
+	    reader->len - reader->offset < sizeof (guint32))
+		return FALSE;
+	memcpy (value, reader->data + reader->offset, sizeof (guint32));
+	reader->offset += sizeof (guint32);
+	return TRUE;
+}
+
+/*
+ * pk_results_memfd_reader_string:
+ * @reader: a #PkResultsMemfdReader
+ *
+ * Return value: a string pointing into the mapped data, or %NULL if truncated
+ **/
+const gchar *
+pk_results_memfd_reader_string (PkResultsMemfdReader *reader)
+{
+	const gchar *value;
+	gsize padded;
+	guint32 len;
+
+	if (!pk_results_memfd_reader_uint32 (reader, &len))
+		return NULL;
+	padded = (gsize) len + 4 - (len % 4);
+	if (reader->len - reader->offset < padded)
+		return NULL;
+	value = (const gchar *) reader->data + reader->offset;
+	if (value[len] != '\0')
+		return NULL;
+	reader->offset += padded;
+	return value;
+}
@@ -0,0 +1,108 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#if !defined (__PACKAGEKIT_H_INSIDE__) && !defined (PK_COMPILATION)
+#error "Only <packagekit.h> can be included directly."
+#endif
+
+#ifndef __PK_RESULTS_MEMFD_PRIVATE_H
+#define __PK_RESULTS_MEMFD_PRIVATE_H
+
+#include <glib.h>
+
+#include <packagekit-glib2/pk-files.h>
+#include <packagekit-glib2/pk-results.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Large results can be handed from the daemon to the client in a sealed
+ * memfd rather than as D-Bus strings. The daemon calls a method of
+ * PK_RESULTS_MEMFD_INTERFACE on the private results connection (see the
+ * SetResultsSocket method) with the fd as its only argument, and the client
+ * maps the fd read-only and parses it when the results are first used.
+ *
+ * All integers are in host byte order, as the data never leaves the host.
+ *
+ *   header:
+ *     guint8   magic[8]	"PKRESULT"
+ *     guint32  kind		a #PkResultsMemfdKind
+ *     guint32  n_records
+ *
+ *   PK_RESULTS_MEMFD_KIND_PACKAGES record, method "Packages":
+ *     guint32  info		info | (update_severity << 16), as ::Package
+ *     string   package_id
+ *     string   summary
+ *
+ *   PK_RESULTS_MEMFD_KIND_FILES record, method "Files":
+ *     string   package_id
+ *     guint32  n_files
+ *     string   files[n_files]
+ *
+ *   string:
+ *     guint32  length, not including the NUL
+ *     guint8   data[length], then a NUL and zero padding to 4 bytes
+ */
+#define PK_RESULTS_MEMFD_INTERFACE	"org.freedesktop.PackageKit.Transaction.Results"
+#define PK_RESULTS_MEMFD_MAGIC		"PKRESULT"
+#define PK_RESULTS_MEMFD_HEADER_SIZE	16
+
+typedef enum {
+	PK_RESULTS_MEMFD_KIND_PACKAGES = 1,
+	PK_RESULTS_MEMFD_KIND_FILES = 2
+} PkResultsMemfdKind;
+
+typedef struct {
+	const guint8	*data;
+	gsize		 len;
+	gsize		 offset;
+} PkResultsMemfdReader;
+
+gboolean	 pk_results_memfd_can_map		(void);
+GByteArray	*pk_results_memfd_builder_new		(PkResultsMemfdKind	 kind);
+void		 pk_results_memfd_builder_add_uint32	(GByteArray		*builder,
+							 guint32		 value);
+void		 pk_results_memfd_builder_add_string	(GByteArray		*builder,
+							 const gchar		*value);
+void		 pk_results_memfd_builder_set_n_records	(GByteArray		*builder,
+							 guint32		 n_records);
+gint		 pk_results_memfd_builder_seal		(GByteArray		*builder,
+							 GError			**error);
+
+GBytes		*pk_results_memfd_map			(gint			 fd,
+							 PkResultsMemfdKind	 kind,
+							 guint32		*n_records,
+							 GError			**error);
+void		 pk_results_memfd_reader_init		(PkResultsMemfdReader	*reader,
+							 GBytes			*bytes,
+							 gsize			 offset);
+gboolean	 pk_results_memfd_reader_uint32		(PkResultsMemfdReader	*reader,
+							 guint32		*value);
+const gchar	*pk_results_memfd_reader_string		(PkResultsMemfdReader	*reader);
+
+PkFiles		*pk_files_new_from_memfd		(gint			 fd,
+							 GError			**error);
+gboolean	 pk_results_add_packages_memfd		(PkResults		*results,
+							 gint			 fd,
+							 const gchar		*transaction_id,
+							 GError			**error);
+
+G_END_DECLS
+
+#endif /* __PK_RESULTS_MEMFD_PRIVATE_H */
@@ -31,11 +31,13 @@
 
 #include "config.h"
 
+#include <gio/gio.h>
 #include <glib-object.h>
 
 #include <packagekit-glib2/pk-results.h>
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-enum-types.h>
+#include <packagekit-glib2/pk-results-memfd-private.h>
 
 static void     pk_results_finalize	(GObject     *object);
 
@@ -66,8 +68,15 @@ struct _PkResultsPrivate
 	GPtrArray		*media_change_required_array;
 	GPtrArray		*repo_detail_array;
 	PkPackageSack		*package_sack;
+	GPtrArray		*packages_memfd;
 };
 
+typedef struct {
+	GBytes			*bytes;
+	guint32			 n_records;
+	gchar			*transaction_id;
+} PkResultsPackagesMemfd;
+
 enum {
 	PROP_0,
 	PROP_ROLE,
@@ -181,6 +190,101 @@ pk_results_set_exit_code (PkResults *results, PkExitEnum exit_enum)
 	return TRUE;
 }
 
+static void
+pk_results_packages_memfd_free (PkResultsPackagesMemfd *item)
+{
+	g_bytes_unref (item->bytes);
+	g_free (item->transaction_id);
+	g_free (item);
+}
+
+/*
+ * pk_results_load_packages_memfd:
+ *
+ * Creates the packages that were only mapped so far, in the order they
+ * were received.
+ **/
+static void
+pk_results_load_packages_memfd (PkResults *results)
+{
+	PkResultsPrivate *priv = results->priv;
+	PkResultsMemfdReader reader;
+	const gchar *package_id;
+	const gchar *summary;
+	guint32 info;
+	guint i, j;
+
+	if (priv->packages_memfd->len == 0)
+		return;
+
+	for (i = 0; i < priv->packages_memfd->len; i++) {
+		PkResultsPackagesMemfd *item = g_ptr_array_index (priv->packages_memfd, i);
+
+		pk_results_memfd_reader_init (&reader, item->bytes, 0);
+		for (j = 0; j < item->n_records; j++) {
+			g_autoptr(GError) error = NULL;
+			g_autoptr(PkPackage) package = NULL;
+
+			if (!pk_results_memfd_reader_uint32 (&reader, &info) ||
+			    (package_id = pk_results_memfd_reader_string (&reader)) == NULL ||
+			    (summary = pk_results_memfd_reader_string (&reader)) == NULL) {
+				g_warning ("results memfd is truncated after %u packages", j);
+				break;
+			}
+			package = pk_package_new ();
+			if (!pk_package_set_id (package, package_id, &error)) {
+				g_warning ("failed to set package id for %s", package_id);
+				continue;
+			}
+			g_object_set (package,
+				      "info", info & 0xFFFF,
+				      "update-severity", (info >> 16) & 0xFFFF,
+				      "summary", summary,
+				      "role", priv->role,
+				      "transaction-id", item->transaction_id,
+				      NULL);
+			pk_package_sack_add_package (priv->package_sack, package);
+		}
+	}
+	g_ptr_array_set_size (priv->packages_memfd, 0);
+}
+
+/*
+ * pk_results_add_packages_memfd:
+ * @results: a valid #PkResults instance
+ * @fd: a sealed memfd of kind %PK_RESULTS_MEMFD_KIND_PACKAGES
+ * @transaction_id: the transaction the packages are from
+ * @error: a #GError or %NULL
+ *
+ * Adds the packages in @fd to the results set. The memfd is only mapped
+ * here, and the #PkPackage objects are created when first asked for.
+ * The fd can be closed when this returns.
+ *
+ * Return value: %TRUE if the packages were added
+ **/
+gboolean
+pk_results_add_packages_memfd (PkResults *results,
+			       gint fd,
+			       const gchar *transaction_id,
+			       GError **error)
+{
+	PkResultsPackagesMemfd *item;
+	guint32 n_records = 0;
+	g_autoptr(GBytes) bytes = NULL;
+
+	g_return_val_if_fail (PK_IS_RESULTS (results), FALSE);
+
+	bytes = pk_results_memfd_map (fd, PK_RESULTS_MEMFD_KIND_PACKAGES, &n_records, error);
+	if (bytes == NULL)
+		return FALSE;
+	item = g_new0 (PkResultsPackagesMemfd, 1);
+	item->bytes = g_steal_pointer (&bytes);
+	item->n_records = n_records;
+	item->transaction_id = g_strdup (transaction_id);
+	g_ptr_array_add (results->priv->packages_memfd, item);
+	return TRUE;
+}
+
 /**
  * pk_results_add_package:
  * @results: a valid #PkResults instance
@@ -203,6 +307,7 @@ pk_results_add_package (PkResults *results, PkPackage *item)
 		g_warning ("Finished packages cannot be added to PkResults");
 		return FALSE;
 	}
+	pk_results_load_packages_memfd (results);
 	pk_package_sack_add_package (results->priv->package_sack, item);
 	return TRUE;
 }
@@ -578,6 +683,7 @@ GPtrArray *
 pk_results_get_package_array (PkResults *results)
 {
 	g_return_val_if_fail (PK_IS_RESULTS (results), NULL);
+	pk_results_load_packages_memfd (results);
 	return pk_package_sack_get_array (results->priv->package_sack);
 }
 
@@ -595,6 +701,7 @@ PkPackageSack *
 pk_results_get_package_sack (PkResults *results)
 {
 	g_return_val_if_fail (PK_IS_RESULTS (results), NULL);
+	pk_results_load_packages_memfd (results);
 	return g_object_ref (results->priv->package_sack);
 }
 
@@ -898,6 +1005,7 @@ pk_results_init (PkResults *results)
 	results->priv->progress = NULL;
 	results->priv->error_code = NULL;
 	results->priv->package_sack = pk_package_sack_new ();
+	results->priv->packages_memfd = g_ptr_array_new_with_free_func ((GDestroyNotify) pk_results_packages_memfd_free);
 	results->priv->details_array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	results->priv->update_detail_array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	results->priv->category_array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -932,6 +1040,7 @@ pk_results_finalize (GObject *object)
 	g_ptr_array_unref (priv->media_change_required_array);
 	g_ptr_array_unref (priv->repo_detail_array);
 	g_object_unref (priv->package_sack);
+	g_ptr_array_unref (priv->packages_memfd);
 	if (results->priv->progress != NULL)
 		g_object_unref (results->priv->progress);
 	if (results->priv->error_code != NULL)
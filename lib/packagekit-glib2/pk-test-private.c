@@ -22,7 +22,9 @@
 
 #include "config.h"
 
+#include <gio/gio.h>
 #include <glib-object.h>
+#include <unistd.h>
 
 #include "pk-common.h"
 #include "pk-debug.h"
@@ -32,8 +34,10 @@
 #include "pk-package.h"
 #include "pk-package-id.h"
 #include "pk-package-ids.h"
+#include "pk-package-sack.h"
 #include "pk-progress-bar.h"
 #include "pk-results.h"
+#include "pk-results-memfd-private.h"
 
 static void
 pk_test_bitfield_func (void)
@@ -536,11 +540,145 @@ pk_test_results_func (void)
 	g_object_unref (results);
 }
 
+static void
+pk_test_results_memfd_func (void)
+{
+	gint fd;
+	gchar **files;
+	PkPackage *item;
+	g_autoptr(GByteArray) builder = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) packages = NULL;
+	g_autoptr(PkFiles) files_item = NULL;
+	g_autoptr(PkResults) results = NULL;
+
+	/* files */
+	builder = pk_results_memfd_builder_new (PK_RESULTS_MEMFD_KIND_FILES);
+	pk_results_memfd_builder_add_string (builder, "texlive;2023;noarch;fedora");
+	pk_results_memfd_builder_add_uint32 (builder, 3);
+	pk_results_memfd_builder_add_string (builder, "/usr/bin/tex");
+	pk_results_memfd_builder_add_string (builder, "");
+	pk_results_memfd_builder_add_string (builder, "/usr/share/texlive/README");
+	pk_results_memfd_builder_set_n_records (builder, 1);
+	fd = pk_results_memfd_builder_seal (builder, &error);
+	if (fd < 0 && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+		g_test_skip ("memfd is not supported");
+		return;
+	}
+	g_assert_no_error (error);
+	files_item = pk_files_new_from_memfd (fd, &error);
+	close (fd);
+	g_assert_no_error (error);
+	g_assert_nonnull (files_item);
+	g_assert_cmpstr (pk_files_get_package_id (files_item), ==, "texlive;2023;noarch;fedora");
+	files = pk_files_get_files (files_item);
+	g_assert_cmpint (g_strv_length (files), ==, 3);
+	g_assert_cmpstr (files[0], ==, "/usr/bin/tex");
+	g_assert_cmpstr (files[1], ==, "");
+	g_assert_cmpstr (files[2], ==, "/usr/share/texlive/README");
+
+	/* packages are only created when asked for */
+	g_clear_pointer (&builder, g_byte_array_unref);
+	builder = pk_results_memfd_builder_new (PK_RESULTS_MEMFD_KIND_PACKAGES);
+	pk_results_memfd_builder_add_uint32 (builder, PK_INFO_ENUM_INSTALLED);
+	pk_results_memfd_builder_add_string (builder, "gnome-power-manager;0.1.2;i386;fedora");
+	pk_results_memfd_builder_add_string (builder, "Power manager for GNOME");
+	pk_results_memfd_builder_set_n_records (builder, 1);
+	fd = pk_results_memfd_builder_seal (builder, &error);
+	g_assert_no_error (error);
+	results = pk_results_new ();
+	g_assert_true (pk_results_add_packages_memfd (results, fd, "/1_abc", &error));
+	g_assert_no_error (error);
+
+	/* the wrong kind is rejected */
+	g_assert_null (pk_files_new_from_memfd (fd, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	close (fd);
+
+	packages = pk_results_get_package_array (results);
+	g_assert_cmpint (packages->len, ==, 1);
+	item = g_ptr_array_index (packages, 0);
+	g_assert_cmpint (pk_package_get_info (item), ==, PK_INFO_ENUM_INSTALLED);
+	g_assert_cmpstr (pk_package_get_id (item), ==, "gnome-power-manager;0.1.2;i386;fedora");
+	g_assert_cmpstr (pk_package_get_summary (item), ==, "Power manager for GNOME");
+}
+
+static PkPackage *
+pk_test_package_sack_find_linear (PkPackageSack *sack, const gchar *name, const gchar *arch)
+{
+	g_autoptr(GPtrArray) array = pk_package_sack_get_array (sack);
+
+	for (guint i = 0; i < array->len; i++) {
+		PkPackage *package = g_ptr_array_index (array, i);
+		if (g_strcmp0 (pk_package_get_name (package), name) == 0 &&
+		    g_strcmp0 (pk_package_get_arch (package), arch) == 0)
+			return g_object_ref (package);
+	}
+	return NULL;
+}
+
+static void
+pk_test_package_sack_index_func (void)
+{
+	const guint n_packages = 100000;
+	const guint n_linear = 200;
+	gdouble elapsed_index;
+	gdouble elapsed_linear;
+	guint i;
+	g_autoptr(GTimer) timer = NULL;
+	g_autoptr(PkPackageSack) sack = pk_package_sack_new ();
+
+	for (i = 0; i < n_packages; i++) {
+		g_autofree gchar *package_id = NULL;
+		package_id = g_strdup_printf ("package%u;1.%u;%s;fedora",
+					      i / 2, i, i % 2 == 0 ? "x86_64" : "i686");
+		g_assert_true (pk_package_sack_add_package_by_id (sack, package_id, NULL));
+	}
+
+	/* lookups by name and arch, which used to scan the whole sack */
+	timer = g_timer_new ();
+	for (i = 0; i < n_packages; i++) {
+		g_autofree gchar *package_id = NULL;
+		g_autoptr(PkPackage) package = NULL;
+		package_id = g_strdup_printf ("package%u;9.9;%s;installed",
+					      i / 2, i % 2 == 0 ? "x86_64" : "i686");
+		package = pk_package_sack_find_by_id_name_arch (sack, package_id);
+		g_assert_nonnull (package);
+		g_assert_cmpstr (pk_package_get_arch (package), ==, i % 2 == 0 ? "x86_64" : "i686");
+	}
+	elapsed_index = g_timer_elapsed (timer, NULL) / n_packages;
+
+	/* what a scan of the sack costs, on a sample of the worst case */
+	g_timer_start (timer);
+	for (i = 0; i < n_linear; i++) {
+		g_autoptr(PkPackage) package = NULL;
+		package = pk_test_package_sack_find_linear (sack, "package49999", "i686");
+		g_assert_nonnull (package);
+	}
+	elapsed_linear = g_timer_elapsed (timer, NULL) / n_linear;
+	g_test_message ("find_by_id_name_arch on %u packages: %.2f µs indexed, %.2f µs scanned",
+			n_packages, elapsed_index * G_USEC_PER_SEC, elapsed_linear * G_USEC_PER_SEC);
+
+	/* unknown names and arches, and invalid IDs */
+	g_assert_null (pk_package_sack_find_by_id_name_arch (sack, "package7;1;armv7;fedora"));
+	g_assert_null (pk_package_sack_find_by_id_name_arch (sack, "missing;1;i686;fedora"));
+	g_assert_null (pk_package_sack_find_by_id_name_arch (sack, "package7;1;i686"));
+	g_assert_null (pk_package_sack_find_by_id_name_arch (sack, ";1;i686;fedora"));
+
+	/* the index follows removals */
+	g_assert_true (pk_package_sack_remove_package_by_id (sack, "package7;1.15;i686;fedora"));
+	g_assert_null (pk_package_sack_find_by_id_name_arch (sack, "package7;1;i686;fedora"));
+	g_assert_cmpint (pk_package_sack_get_size (sack), ==, n_packages - 1);
+	pk_package_sack_clear (sack);
+	g_assert_null (pk_package_sack_find_by_id_name_arch (sack, "package8;1;i686;fedora"));
+}
+
 static void
 pk_test_package_func (void)
 {
 	gboolean ret;
 	PkPackage *package;
+	PkPackage *package2;
 	const gchar *id;
 	gchar *text;
 	GError *error = NULL;
@@ -596,6 +734,30 @@ pk_test_package_func (void)
 	g_assert_cmpstr (text, ==, "gnome-power-manager;0.1.2;i386;fedora");
 	g_free (text);
 
+	/* the sections are shared with other packages */
+	package2 = pk_package_new ();
+	ret = pk_package_set_id (package2, "gnome-session;3.0;i386;fedora", &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_cmpstr (pk_package_get_arch (package2), ==, "i386");
+	g_assert_true (pk_package_get_arch (package2) == pk_package_get_arch (package));
+	g_assert_true (pk_package_get_data (package2) == pk_package_get_data (package));
+	g_assert_false (pk_package_equal_id (package, package2));
+
+	/* details are still stored */
+	g_object_set (package2, "license", "GPLv2+", "size", (guint64) 1024, NULL);
+	g_object_get (package2, "license", &text, NULL);
+	g_assert_cmpstr (text, ==, "GPLv2+");
+	g_free (text);
+	g_object_get (package, "license", &text, NULL);
+	g_assert_null (text);
+
+	ret = pk_package_set_id (package2, "gnome-power-manager;0.1.2;i386;fedora", &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_true (pk_package_equal_id (package, package2));
+
+	g_object_unref (package2);
 	g_object_unref (package);
 }
 
@@ -929,7 +1091,9 @@ main (int argc, char **argv)
 	g_test_add_func ("/packagekit-glib2/package-ids", pk_test_package_ids_func);
 	g_test_add_func ("/packagekit-glib2/progress", pk_test_progress_func);
 	g_test_add_func ("/packagekit-glib2/results", pk_test_results_func);
+	g_test_add_func ("/packagekit-glib2/results-memfd", pk_test_results_memfd_func);
 	g_test_add_func ("/packagekit-glib2/package", pk_test_package_func);
+	g_test_add_func ("/packagekit-glib2/package-sack-index", pk_test_package_sack_index_func);
 	g_test_add_func ("/packagekit-glib2/progress-bar", pk_test_progress_bar);
 	g_test_add_func ("/packagekit-glib2/offline", pk_test_offline_func);
 	g_test_add_func ("/packagekit-glib2/offline-upgrade", pk_test_offline_upgrade_func);
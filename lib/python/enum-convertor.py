@@ -15,11 +15,25 @@ print("# This file was autogenerated from %s by enum-converter.py\n" % sys.argv[
 print("class PackageKitEnum:")
 for (name,data) in enum.findall(inp):
 	print("\t%s = ("%name, end=' ')
-	for (type,enum,string) in value.findall(data):
+	for (type,constant,string) in value.findall(data):
 		print("\"%s\","%string, end=' ')
-		names["%s_%s"%(type,enum)] = string
+		names["%s_%s"%(type,constant)] = string
 	print(")")
 
+# the numeric values, used by the binary helper protocol
+if len(sys.argv) > 2:
+	header = compile("/\*.*?\*/", DOTALL).sub("", open(sys.argv[2]).read())
+	numbers = {}
+	for body in compile("typedef enum {(.*?)}", DOTALL).findall(header):
+		for (i, item) in enumerate([x.strip() for x in body.split(",") if x.strip()]):
+			numbers[item] = i
+	print("\nclass PackageKitEnumValue:")
+	for (name,data) in enum.findall(inp):
+		print("\t%s = {"%name, end=' ')
+		for (type,constant,string) in value.findall(data):
+			print("\"%s\": %i,"%(string, numbers["PK_%s_ENUM_%s"%(type,constant)]), end=' ')
+		print("}")
+
 print("\n# Constants\n")
 
 for k in sorted(names.keys()):
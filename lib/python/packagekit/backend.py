@@ -25,6 +25,7 @@
 from __future__ import print_function
 
 import sys
+import struct
 import traceback
 import os.path
 
@@ -33,12 +34,30 @@ from .enums import *
 PACKAGE_IDS_DELIM = '&'
 FILENAME_DELIM = '|'
 
+# binary helper protocol, see src/pk-backend-spawn.h
+PROTOCOL_VERSION = 2
+RECORD_TEXT = 0
+RECORD_FINISHED = 1
+RECORD_PACKAGE = 2
+RECORD_DETAILS = 3
+RECORD_FILES = 4
+RECORD_PERCENTAGE = 5
+RECORD_ITEM_PROGRESS = 6
+RECORD_STATUS = 7
+RECORD_ERROR = 8
+RECORD_ALLOW_CANCEL = 9
+
 def _to_unicode(txt, encoding='utf-8'):
     if isinstance(txt, str):
         if not isinstance(txt, str):
             txt = str(txt, encoding, errors='replace')
     return txt
 
+def _record_string(txt):
+    if not isinstance(txt, bytes):
+        txt = str(txt).encode('utf-8', 'replace')
+    return struct.pack('=I', len(txt)) + txt + b'\0'
+
 def _to_utf8(txt, errors='replace'):
     if isinstance(txt, str):
         return txt
@@ -60,46 +79,55 @@ class PackageKitBaseBackend:
         installExceptionHandler(self)
         self.cmds = cmds
         self._locked = False
+        self.percentage_old = 0
+        self.records = False
+
+        self._environ = dict(os.environ)
+        self._read_environment()
+
+    def _read_environment(self):
+        '''
+        Read the transaction settings the daemon passes in the environment
+        '''
         self.lang = "C"
         self.has_network = False
         self.uid = 0
         self.background = False
         self.interactive = False
         self.cache_age = 0
-        self.percentage_old = 0
 
         # try to get LANG
         try:
             self.lang = os.environ['LANG']
         except KeyError as e:
-            print("Error: No LANG envp")
+            print("Error: No LANG envp", file=sys.stderr)
 
         # try to get NETWORK state
         try:
             if os.environ['NETWORK'] == 'TRUE':
                 self.has_network = True
         except KeyError as e:
-            print("Error: No NETWORK envp")
+            print("Error: No NETWORK envp", file=sys.stderr)
 
         # try to get UID of running user
         try:
             self.uid = int(os.environ['UID'])
         except KeyError as e:
-            print("Error: No UID envp")
+            print("Error: No UID envp", file=sys.stderr)
 
         # try to get BACKGROUND state
         try:
             if os.environ['BACKGROUND'] == 'TRUE':
                 self.background = True
         except KeyError as e:
-            print("Error: No BACKGROUND envp")
+            print("Error: No BACKGROUND envp", file=sys.stderr)
 
         # try to get INTERACTIVE state
         try:
             if os.environ['INTERACTIVE'] == 'TRUE':
                 self.interactive = True
         except KeyError as e:
-            print("Error: No INTERACTIVE envp")
+            print("Error: No INTERACTIVE envp", file=sys.stderr)
 
         # try to get CACHE_AGE state
         try:
@@ -107,6 +135,41 @@ class PackageKitBaseBackend:
         except KeyError as e:
             pass
 
+    def enable_records(self):
+        '''
+        Switch to the binary protocol if the daemon supports it, which is
+        much cheaper for the daemon to parse when emitting lots of packages
+        @return: True if records are now being used
+        '''
+        if self.records:
+            return True
+        try:
+            if int(os.environ['SPAWN_PROTOCOL']) < PROTOCOL_VERSION:
+                return False
+        except (KeyError, ValueError) as e:
+            return False
+        self._write("protocol\t%i\n" % PROTOCOL_VERSION)
+        self.records = True
+        return True
+
+    def _write(self, line):
+        '''
+        Write one line of the text protocol
+        '''
+        if self.records:
+            self._write_record(RECORD_TEXT, _record_string(line.rstrip('\n')))
+            return
+        sys.stdout.write(_to_utf8(line))
+        sys.stdout.flush()
+
+    def _write_record(self, command, payload=b''):
+        '''
+        Write one record of the binary protocol
+        '''
+        stream = getattr(sys.stdout, 'buffer', sys.stdout)
+        stream.write(struct.pack('=II', len(payload) + 4, command) + payload)
+        stream.flush()
+
     def doLock(self):
         ''' Generic locking, overide and extend in child class'''
         self._locked = True
@@ -124,19 +187,23 @@ class PackageKitBaseBackend:
         @param percent: Progress percentage (int preferred)
         '''
         if percent == None:
-            sys.stdout.write(_to_utf8("no-percentage-updates\n"))
+            if self.records:
+                self._write_record(RECORD_PERCENTAGE, struct.pack('=I', 101))
+            else:
+                self._write("no-percentage-updates\n")
         elif percent == 0 or percent > self.percentage_old:
-            sys.stdout.write(_to_utf8("percentage\t%i\n" % percent))
+            if self.records:
+                self._write_record(RECORD_PERCENTAGE, struct.pack('=I', int(percent)))
+            else:
+                self._write("percentage\t%i\n" % percent)
             self.percentage_old = percent
-        sys.stdout.flush()
 
     def speed(self, bps=0):
         '''
         Write progress speed
         @param bps: Progress speed (int, bytes per second)
         '''
-        sys.stdout.write(_to_utf8("speed\t%i\n" % bps))
-        sys.stdout.flush()
+        self._write("speed\t%i\n" % bps)
 
     def item_progress(self, package_id, status, percent=None):
         '''
@@ -144,8 +211,11 @@ class PackageKitBaseBackend:
         @param package_id: The package ID name, e.g. openoffice-clipart;2.6.22;ppc64;fedora
         @param percent: percentage of the current item (int preferred)
         '''
-        sys.stdout.write(_to_utf8("item-progress\t%s\t%s\t%i\n" % (package_id, status, percent)))
-        sys.stdout.flush()
+        if self.records:
+            self._write_record(RECORD_ITEM_PROGRESS, _record_string(package_id) +
+                               struct.pack('=II', PackageKitEnumValue.status[status], percent))
+            return
+        self._write("item-progress\t%s\t%s\t%i\n" % (package_id, status, percent))
 
     def error(self, err, description, exit=True):
         '''
@@ -159,8 +229,11 @@ class PackageKitBaseBackend:
             self.unLock()
 
         # this should be fast now
-        sys.stdout.write(_to_utf8("error\t%s\t%s\n" % (err, description)))
-        sys.stdout.flush()
+        if self.records:
+            self._write_record(RECORD_ERROR, struct.pack('=I', PackageKitEnumValue.error[err]) +
+                               _record_string(description))
+        else:
+            self._write("error\t%s\t%s\n" % (err, description))
         if exit:
             # Paradoxically, we don't want to print "finished" to stdout here.
             # Python takes an _enormous_ amount of time to exit, and leaves a
@@ -174,8 +247,7 @@ class PackageKitBaseBackend:
         send 'message' signal
         @param typ: MESSAGE_BROKEN_MIRROR
         '''
-        sys.stdout.write(_to_utf8("message\t%s\t%s\n" % (typ, msg)))
-        sys.stdout.flush()
+        self._write("message\t%s\t%s\n" % (typ, msg))
 
     def package(self, package_id, status, summary):
         '''
@@ -184,8 +256,11 @@ class PackageKitBaseBackend:
         @param package_id: The package ID name, e.g. openoffice-clipart;2.6.22;ppc64;fedora
         @param summary: The package Summary
         '''
-        sys.stdout.write(_to_utf8("package\t%s\t%s\t%s\n" % (status, package_id, summary)))
-        sys.stdout.flush()
+        if self.records:
+            self._write_record(RECORD_PACKAGE, struct.pack('=I', PackageKitEnumValue.info[status]) +
+                               _record_string(package_id) + _record_string(summary))
+            return
+        self._write("package\t%s\t%s\t%s\n" % (status, package_id, summary))
 
     def media_change_required(self, mtype, id, text):
         '''
@@ -194,8 +269,7 @@ class PackageKitBaseBackend:
         @param id: the localised label of the media
         @param text: the localised text describing the media
         '''
-        sys.stdout.write(_to_utf8("media-change-required\t%s\t%s\t%s\n" % (mtype, id, text)))
-        sys.stdout.flush()
+        self._write("media-change-required\t%s\t%s\t%s\n" % (mtype, id, text))
 
     def distro_upgrade(self, dtype, name, summary):
         '''
@@ -204,16 +278,17 @@ class PackageKitBaseBackend:
         @param name: The distro name, e.g. "fedora-9"
         @param summary: The localised distribution name and description
         '''
-        sys.stdout.write(_to_utf8("distro-upgrade\t%s\t%s\t%s\n" % (dtype, name, summary)))
-        sys.stdout.flush()
+        self._write("distro-upgrade\t%s\t%s\t%s\n" % (dtype, name, summary))
 
     def status(self, state):
         '''
         send 'status' signal
         @param state: STATUS_DOWNLOAD, STATUS_INSTALL, STATUS_UPDATE, STATUS_REMOVE, STATUS_WAIT
         '''
-        sys.stdout.write(_to_utf8("status\t%s\n" % state))
-        sys.stdout.flush()
+        if self.records:
+            self._write_record(RECORD_STATUS, struct.pack('=I', PackageKitEnumValue.status[state]))
+            return
+        self._write("status\t%s\n" % state)
 
     def repo_detail(self, repoid, name, state):
         '''
@@ -221,16 +296,14 @@ class PackageKitBaseBackend:
         @param repoid: The repo id tag
         @param state: false is repo is disabled else true.
         '''
-        sys.stdout.write(_to_utf8("repo-detail\t%s\t%s\t%s\n" % (repoid, name, _bool_to_string(state))))
-        sys.stdout.flush()
+        self._write("repo-detail\t%s\t%s\t%s\n" % (repoid, name, _bool_to_string(state)))
 
     def data(self, data):
         '''
         send 'data' signal:
         @param data:  The current worked on package
         '''
-        sys.stdout.write(_to_utf8("data\t%s\n" % data))
-        sys.stdout.flush()
+        self._write("data\t%s\n" % data)
 
     def details(self, package_id, summary, package_license, group, desc, url, bytes):
         '''
@@ -243,16 +316,28 @@ class PackageKitBaseBackend:
         @param url: The upstream project homepage
         @param bytes: The size of the package, in bytes
         '''
-        sys.stdout.write(_to_utf8("details\t%s\t%s\t%s\t%s\t%s\t%s\t%ld\n" % (package_id, summary, package_license, group, desc, url, bytes)))
-        sys.stdout.flush()
+        if self.records:
+            self._write_record(RECORD_DETAILS, _record_string(package_id) + _record_string(summary) +
+                               _record_string(package_license) +
+                               struct.pack('=I', PackageKitEnumValue.group[group]) +
+                               _record_string(desc.replace(';', '\n')) + _record_string(url) +
+                               struct.pack('=Q', bytes))
+            return
+        self._write("details\t%s\t%s\t%s\t%s\t%s\t%s\t%ld\n" % (package_id, summary, package_license, group, desc, url, bytes))
 
     def files(self, package_id, file_list):
         '''
         Send 'files' signal
         @param file_list: List of the files in the package, separated by ';'
         '''
-        sys.stdout.write(_to_utf8("files\t%s\t%s\n" % (package_id, file_list)))
-        sys.stdout.flush()
+        if self.records:
+            if not isinstance(file_list, list):
+                file_list = file_list.split(';')
+            self._write_record(RECORD_FILES, _record_string(package_id) +
+                               struct.pack('=I', len(file_list)) +
+                               b''.join([_record_string(f) for f in file_list]))
+            return
+        self._write("files\t%s\t%s\n" % (package_id, file_list))
 
     def category(self, parent_id, cat_id, name, summary, icon):
         '''
@@ -263,15 +348,16 @@ class PackageKitBaseBackend:
         summery   : a summary of the category in current locale.
         icon      : an icon name to represent the category
         '''
-        sys.stdout.write(_to_utf8("category\t%s\t%s\t%s\t%s\t%s\n" % (parent_id, cat_id, name, summary, icon)))
-        sys.stdout.flush()
+        self._write("category\t%s\t%s\t%s\t%s\t%s\n" % (parent_id, cat_id, name, summary, icon))
 
     def finished(self):
         '''
         Send 'finished' signal
         '''
-        sys.stdout.write(_to_utf8("finished\n"))
-        sys.stdout.flush()
+        if self.records:
+            self._write_record(RECORD_FINISHED)
+            return
+        self._write("finished\n")
 
     def update_detail(self, package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated):
         '''
@@ -289,8 +375,7 @@ class PackageKitBaseBackend:
         @param issued:
         @param updated:
         '''
-        sys.stdout.write(_to_utf8("updatedetail\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated)))
-        sys.stdout.flush()
+        self._write("updatedetail\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated))
 
     def require_restart(self, restart_type, details):
         '''
@@ -298,20 +383,21 @@ class PackageKitBaseBackend:
         @param restart_type: RESTART_SYSTEM, RESTART_APPLICATION, RESTART_SESSION
         @param details: Optional details about the restart
         '''
-        sys.stdout.write(_to_utf8("requirerestart\t%s\t%s\n" % (restart_type, details)))
-        sys.stdout.flush()
+        self._write("requirerestart\t%s\t%s\n" % (restart_type, details))
 
     def allow_cancel(self, allow):
         '''
         send 'allow-cancel' signal:
         @param allow:  Allow the current process to be aborted.
         '''
+        if self.records:
+            self._write_record(RECORD_ALLOW_CANCEL, struct.pack('=I', 1 if allow else 0))
+            return
         if allow:
             data = 'true'
         else:
             data = 'false'
-        sys.stdout.write(_to_utf8("allow-cancel\t%s\n" % data))
-        sys.stdout.flush()
+        self._write("allow-cancel\t%s\n" % data)
 
     def repo_signature_required(self, package_id, repo_name, key_url, key_userid, key_id, key_fingerprint, key_timestamp, sig_type):
         '''
@@ -325,10 +411,9 @@ class PackageKitBaseBackend:
         @param key_timestamp:   Key timestamp
         @param sig_type:        Key type (GPG)
         '''
-        sys.stdout.write(_to_utf8("repo-signature-required\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (
+        self._write("repo-signature-required\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (
             package_id, repo_name, key_url, key_userid, key_id, key_fingerprint, key_timestamp, sig_type
-            )))
-        sys.stdout.flush()
+            ))
 
     def eula_required(self, eula_id, package_id, vendor_name, license_agreement):
         '''
@@ -338,10 +423,9 @@ class PackageKitBaseBackend:
         @param vendor_name:     Name of the vendor that wrote the EULA
         @param license_agreement: The license text
         '''
-        sys.stdout.write(_to_utf8("eula-required\t%s\t%s\t%s\t%s\n" % (
+        self._write("eula-required\t%s\t%s\t%s\t%s\n" % (
             eula_id, package_id, vendor_name, license_agreement
-            )))
-        sys.stdout.flush()
+            ))
 
 #
 # Backend Action Methods
@@ -737,7 +821,21 @@ class PackageKitBaseBackend:
             if not line or line == 'exit':
                 break
             args = line.split('\t')
-            self.dispatch_command(args[0], args[1:])
+            if args[0] == 'environment':
+                # the settings of the next request, replacing the old ones
+                os.environ.clear()
+                os.environ.update(self._environ)
+                for item in args[1:]:
+                    key, sep, value = item.partition('=')
+                    if sep:
+                        os.environ[key] = value
+                self._read_environment()
+            elif args[0] == 'request':
+                # acknowledge so stale output can be told apart
+                self._write("request\t%s\n" % args[1])
+                self.dispatch_command(args[2], args[3:])
+            else:
+                self.dispatch_command(args[0], args[1:])
 
         # unlock backend and exit with success
         if self.isLocked():
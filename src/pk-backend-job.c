@@ -60,6 +60,22 @@
  */
 #define PK_BACKEND_CANCEL_ACTION_TIMEOUT	2000 /* ms */
 
+/**
+ * PK_BACKEND_JOB_PACKAGE_BATCH_SIZE:
+ *
+ * The number of packages from pk_backend_job_package() that are sent to the
+ * main thread in one go, rather than scheduling an idle for each one.
+ */
+#define PK_BACKEND_JOB_PACKAGE_BATCH_SIZE	256
+
+/**
+ * PK_BACKEND_JOB_PACKAGE_BATCH_TIMEOUT:
+ *
+ * The time in ms a partial batch of packages can be held back before being
+ * sent to the main thread anyway.
+ */
+#define PK_BACKEND_JOB_PACKAGE_BATCH_TIMEOUT	20 /* ms */
+
 typedef struct {
 	gboolean		 enabled;
 	PkBackendJobVFunc	 vfunc;
@@ -108,6 +124,11 @@ struct PkBackendJobPrivate
 	PkStatusEnum		 status;
 	GTimer			*timer;
 	gboolean		 started;
+	GPtrArray		*subscribers;
+	gboolean		 dispatched_results;
+	GMutex			 pending_mutex;
+	GPtrArray		*pending_packages;
+	gboolean		 pending_flush_scheduled;
 };
 
 G_DEFINE_TYPE (PkBackendJob, pk_backend_job, G_TYPE_OBJECT)
@@ -595,44 +616,146 @@ pk_backend_job_vfunc_event_free (PkBackendJobVFuncHelper *helper)
 	g_free (helper);
 }
 
+static gboolean
+pk_backend_job_signal_is_result (PkBackendJobSignal signal_kind)
+{
+	switch (signal_kind) {
+	case PK_BACKEND_SIGNAL_ALLOW_CANCEL:
+	case PK_BACKEND_SIGNAL_DOWNLOAD_SIZE_REMAINING:
+	case PK_BACKEND_SIGNAL_ITEM_PROGRESS:
+	case PK_BACKEND_SIGNAL_LOCKED_CHANGED:
+	case PK_BACKEND_SIGNAL_PERCENTAGE:
+	case PK_BACKEND_SIGNAL_SPEED:
+	case PK_BACKEND_SIGNAL_STATUS_CHANGED:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+static gboolean
+pk_backend_job_vfunc_is_connected (PkBackendJob *job, PkBackendJobSignal signal_kind)
+{
+	PkBackendJobVFuncItem *item = &job->priv->vfunc_items[signal_kind];
+
+	if (item->enabled && item->vfunc != NULL)
+		return TRUE;
+
+	/* batched packages can also go to a listener for single packages */
+	if (signal_kind == PK_BACKEND_SIGNAL_PACKAGES)
+		return pk_backend_job_vfunc_is_connected (job, PK_BACKEND_SIGNAL_PACKAGE);
+	return FALSE;
+}
+
+static gboolean
+pk_backend_job_call_vfunc_item (PkBackendJob *job,
+				PkBackendJobSignal signal_kind,
+				gpointer object)
+{
+	PkBackendJobVFuncItem *item = &job->priv->vfunc_items[signal_kind];
+	GPtrArray *packages;
+	guint i;
+
+	if (item->enabled && item->vfunc != NULL) {
+		item->vfunc (job, object, item->user_data);
+		return TRUE;
+	}
+
+	/* split the batch up for a listener for single packages */
+	if (signal_kind != PK_BACKEND_SIGNAL_PACKAGES)
+		return FALSE;
+	item = &job->priv->vfunc_items[PK_BACKEND_SIGNAL_PACKAGE];
+	if (!item->enabled || item->vfunc == NULL)
+		return FALSE;
+	packages = (GPtrArray *) object;
+	for (i = 0; i < packages->len; i++)
+		item->vfunc (job, g_ptr_array_index (packages, i), item->user_data);
+	return TRUE;
+}
+
 static gboolean
 pk_backend_job_call_vfunc_idle_cb (gpointer user_data)
 {
 	PkBackendJobVFuncHelper *helper = (PkBackendJobVFuncHelper *) user_data;
-	PkBackendJobVFuncItem *item;
+	PkBackendJob *job = helper->job;
+	g_autoptr(GPtrArray) subscribers = NULL;
+	guint i;
 
 	/* call transaction vfunc on main thread */
-	item = &helper->job->priv->vfunc_items[helper->signal_kind];
-	if (item != NULL && item->vfunc != NULL) {
-		item->vfunc (helper->job, helper->object, item->user_data);
-	} else {
+	if (!pk_backend_job_call_vfunc_item (job, helper->signal_kind, helper->object)) {
 		g_warning ("tried to do signal %s when no longer connected",
 			   pk_backend_job_signal_to_string (helper->signal_kind));
 	}
+
+	/* subscribers can no longer get the complete results */
+	if (pk_backend_job_signal_is_result (helper->signal_kind))
+		job->priv->dispatched_results = TRUE;
+
+	/* nothing more will be sent after ::Finished */
+	if (helper->signal_kind == PK_BACKEND_SIGNAL_FINISHED) {
+		subscribers = job->priv->subscribers;
+		job->priv->subscribers = g_ptr_array_new_with_free_func (g_object_unref);
+	} else {
+		subscribers = g_ptr_array_ref (job->priv->subscribers);
+	}
+
+	/* send the same thing to any identical jobs sharing this one */
+	for (i = 0; i < subscribers->len; i++) {
+		PkBackendJob *subscriber = g_ptr_array_index (subscribers, i);
+		pk_backend_job_call_vfunc_item (subscriber,
+						helper->signal_kind,
+						helper->object);
+	}
 	return FALSE;
 }
 
 /**
- * pk_backend_job_call_vfunc:
+ * pk_backend_job_add_subscriber:
+ * @job: A running or queued job
+ * @subscriber: An identical job that should not be run itself
  *
- * This method can be called in any thread, and the vfunc is guaranteed
- * to be called idle in the main thread.
+ * Shares the results of @job with @subscriber, so that the vfuncs of both
+ * are called for each signal the backend emits on @job.
+ *
+ * Return value: %FALSE if @job has already sent results
  **/
+gboolean
+pk_backend_job_add_subscriber (PkBackendJob *job, PkBackendJob *subscriber)
+{
+	g_return_val_if_fail (PK_IS_BACKEND_JOB (job), FALSE);
+	g_return_val_if_fail (PK_IS_BACKEND_JOB (subscriber), FALSE);
+	g_return_val_if_fail (pk_is_thread_default (), FALSE);
+
+	if (job->priv->finished || job->priv->dispatched_results)
+		return FALSE;
+	g_ptr_array_add (job->priv->subscribers, g_object_ref (subscriber));
+	return TRUE;
+}
+
+void
+pk_backend_job_remove_subscriber (PkBackendJob *job, PkBackendJob *subscriber)
+{
+	g_return_if_fail (PK_IS_BACKEND_JOB (job));
+	g_return_if_fail (pk_is_thread_default ());
+	g_ptr_array_remove (job->priv->subscribers, subscriber);
+}
+
 static void
-pk_backend_job_call_vfunc (PkBackendJob *job,
-			   PkBackendJobSignal signal_kind,
-			   gpointer object,
-			   GDestroyNotify destroy_func)
+pk_backend_job_queue_vfunc (PkBackendJob *job,
+			    PkBackendJobSignal signal_kind,
+			    gpointer object,
+			    GDestroyNotify destroy_func)
 {
 	PkBackendJobVFuncHelper *helper;
-	PkBackendJobVFuncItem *item;
 	guint priority = G_PRIORITY_DEFAULT_IDLE;
 	g_autoptr(GSource) source = NULL;
 
 	/* call transaction vfunc if not disabled and set */
-	item = &job->priv->vfunc_items[signal_kind];
-	if (!item->enabled || item->vfunc == NULL)
+	if (!pk_backend_job_vfunc_is_connected (job, signal_kind)) {
+		if (destroy_func != NULL)
+			destroy_func (object);
 		return;
+	}
 
 	/* order this last if others are still pending */
 	if (signal_kind == PK_BACKEND_SIGNAL_FINISHED)
@@ -654,6 +777,87 @@ pk_backend_job_call_vfunc (PkBackendJob *job,
 	g_source_attach (source, NULL);
 }
 
+/* must be called with pending_mutex held */
+static void
+pk_backend_job_flush_packages_unlocked (PkBackendJob *job)
+{
+	GPtrArray *packages;
+
+	if (job->priv->pending_packages->len == 0)
+		return;
+	packages = job->priv->pending_packages;
+	job->priv->pending_packages = g_ptr_array_new_with_free_func (g_object_unref);
+	pk_backend_job_queue_vfunc (job,
+				    PK_BACKEND_SIGNAL_PACKAGES,
+				    packages,
+				    (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void
+pk_backend_job_flush_packages (PkBackendJob *job)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	locker = g_mutex_locker_new (&job->priv->pending_mutex);
+	pk_backend_job_flush_packages_unlocked (job);
+}
+
+static gboolean
+pk_backend_job_flush_packages_cb (gpointer user_data)
+{
+	PkBackendJob *job = PK_BACKEND_JOB (user_data);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	locker = g_mutex_locker_new (&job->priv->pending_mutex);
+	job->priv->pending_flush_scheduled = FALSE;
+	pk_backend_job_flush_packages_unlocked (job);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+pk_backend_job_queue_package (PkBackendJob *job, PkPackage *item)
+{
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(GSource) source = NULL;
+
+	locker = g_mutex_locker_new (&job->priv->pending_mutex);
+	g_ptr_array_add (job->priv->pending_packages, g_object_ref (item));
+	if (job->priv->pending_packages->len >= PK_BACKEND_JOB_PACKAGE_BATCH_SIZE) {
+		pk_backend_job_flush_packages_unlocked (job);
+		return;
+	}
+
+	/* do not hold back a partial batch for long */
+	if (job->priv->pending_flush_scheduled)
+		return;
+	source = g_timeout_source_new (PK_BACKEND_JOB_PACKAGE_BATCH_TIMEOUT);
+	g_source_set_callback (source,
+			       pk_backend_job_flush_packages_cb,
+			       g_object_ref (job),
+			       (GDestroyNotify) g_object_unref);
+	g_source_set_name (source, "[PkBackendJob] flush packages");
+	g_source_attach (source, NULL);
+	job->priv->pending_flush_scheduled = TRUE;
+}
+
+/**
+ * pk_backend_job_call_vfunc:
+ *
+ * This method can be called in any thread, and the vfunc is guaranteed
+ * to be called idle in the main thread.
+ **/
+static void
+pk_backend_job_call_vfunc (PkBackendJob *job,
+			   PkBackendJobSignal signal_kind,
+			   gpointer object,
+			   GDestroyNotify destroy_func)
+{
+	/* results must not overtake any packages still being batched */
+	if (pk_backend_job_signal_is_result (signal_kind))
+		pk_backend_job_flush_packages (job);
+	pk_backend_job_queue_vfunc (job, signal_kind, object, destroy_func);
+}
+
 /**
  * pk_backend_job_set_vfunc:
  * @job: A valid PkBackendJob
@@ -738,18 +942,24 @@ pk_backend_job_thread_setup (gpointer thread_data)
 {
 	PkBackendJobThreadHelper *helper = (PkBackendJobThreadHelper *) thread_data;
 
+	/* set idle IO priority */
+#ifdef PK_BUILD_DAEMON
+	if (helper->job->priv->background == TRUE) {
+		g_debug ("setting ioprio class to idle");
+		pk_ioprio_set_idle (0);
+	}
+#endif
+
 	/* run original function with automatic locking */
 	pk_backend_thread_start (helper->backend, helper->job, helper->func);
 	helper->func (helper->job, helper->job->priv->params, helper->user_data);
 	pk_backend_job_finished (helper->job);
 	pk_backend_thread_stop (helper->backend, helper->job, helper->func);
 
-	/* set idle IO priority */
+	/* the worker thread is reused, so do not leak the priority */
 #ifdef PK_BUILD_DAEMON
-	if (helper->job->priv->background == TRUE) {
-		g_debug ("setting ioprio class to idle");
-		pk_ioprio_set_idle (0);
-	}
+	if (helper->job->priv->background == TRUE)
+		pk_ioprio_set_default (0);
 #endif
 
 	/* destroy helper */
@@ -773,6 +983,7 @@ pk_backend_job_thread_create (PkBackendJob *job,
 			      GDestroyNotify destroy_func)
 {
 	PkBackendJobThreadHelper *helper = NULL;
+	g_autoptr(GError) error = NULL;
 
 	g_return_val_if_fail (PK_IS_BACKEND_JOB (job), FALSE);
 	g_return_val_if_fail (func != NULL, FALSE);
@@ -785,11 +996,17 @@ pk_backend_job_thread_create (PkBackendJob *job,
 	helper->func = func;
 	helper->user_data = user_data;
 
-	/* create a thread and unref it immediately as we do not need to join()
-	 * this at any stage */
-	g_thread_unref (g_thread_new ("PK-Backend",
-	                              pk_backend_job_thread_setup,
-	                              helper));
+	/* run in a pooled worker thread, falling back to creating a thread
+	 * which is unref'd immediately as we do not need to join() it */
+	if (!pk_backend_thread_pool_push (helper->backend,
+					  pk_backend_job_thread_setup,
+					  helper,
+					  &error)) {
+		g_warning ("failed to use thread pool: %s", error->message);
+		g_thread_unref (g_thread_new ("PK-Backend",
+		                              pk_backend_job_thread_setup,
+		                              helper));
+	}
 	return TRUE;
 }
 
@@ -1043,11 +1260,8 @@ pk_backend_job_package_full (PkBackendJob *job,
 	/* we've sent a package for this transaction */
 	job->priv->has_sent_package = TRUE;
 
-	/* emit */
-	pk_backend_job_call_vfunc (job,
-				   PK_BACKEND_SIGNAL_PACKAGE,
-				   g_object_ref (item),
-				   g_object_unref);
+	/* emit in batches, as an idle per package is slow for large queries */
+	pk_backend_job_queue_package (job, item);
 }
 
 void
@@ -1731,6 +1945,9 @@ pk_backend_job_finished (PkBackendJob *job)
 	/* find out what we just did */
 	role_text = pk_role_enum_to_string (job->priv->role);
 
+	/* send any partial batch before the final status */
+	pk_backend_job_flush_packages (job);
+
 	/* ensure the same number of ::Files() were sent as packages for DownloadPackages */
 	if (!job->priv->set_error &&
 	    job->priv->role == PK_ROLE_ENUM_DOWNLOAD_PACKAGES &&
@@ -1789,6 +2006,9 @@ pk_backend_job_finalize (GObject *object)
 	g_free (job->priv->locale);
 	g_free (job->priv->frontend_socket);
 	g_hash_table_unref (job->priv->emitted);
+	g_ptr_array_unref (job->priv->subscribers);
+	g_ptr_array_unref (job->priv->pending_packages);
+	g_mutex_clear (&job->priv->pending_mutex);
 	if (job->priv->params != NULL)
 		g_variant_unref (job->priv->params);
 	g_timer_destroy (job->priv->timer);
@@ -1821,6 +2041,9 @@ pk_backend_job_init (PkBackendJob *job)
 	job->priv->status = PK_STATUS_ENUM_UNKNOWN;
 	job->priv->emitted = g_hash_table_new_full (g_str_hash, g_str_equal,
 	                                            g_free, (GDestroyNotify) g_object_unref);
+	job->priv->subscribers = g_ptr_array_new_with_free_func (g_object_unref);
+	job->priv->pending_packages = g_ptr_array_new_with_free_func (g_object_unref);
+	g_mutex_init (&job->priv->pending_mutex);
 }
 
 /**
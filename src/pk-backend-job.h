@@ -278,6 +278,10 @@ void		 pk_backend_job_set_download_size_remaining (PkBackendJob	*job,
 void		 pk_backend_job_set_started		(PkBackendJob *job,
 							 gboolean started);
 gboolean	 pk_backend_job_get_started		(PkBackendJob *job);
+gboolean	 pk_backend_job_add_subscriber		(PkBackendJob	*job,
+							 PkBackendJob	*subscriber);
+void		 pk_backend_job_remove_subscriber	(PkBackendJob	*job,
+							 PkBackendJob	*subscriber);
 
 G_END_DECLS
 
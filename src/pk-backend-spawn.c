@@ -63,10 +63,26 @@ struct PkBackendSpawnPrivate
 	gboolean		 finished;
 	gboolean		 allow_sigkill;
 	gboolean		 is_busy;
+	gchar			*dispatcher;
+	gboolean		 dispatcher_running;
+	guint			 dispatcher_requests;
+	gboolean		 persistent;
+	guint			 restart_id;
+	guint			 request_id;
+	gboolean		 request_acked;
+	gint64			 request_start;
+	guint64			 request_latency;
+	gchar			*request_command;
 	PkBackendSpawnFilterFunc stdout_func;
 	PkBackendSpawnFilterFunc stderr_func;
 };
 
+typedef struct {
+	guint8		*data;
+	gsize		 len;
+	gsize		 offset;
+} PkBackendSpawnRecordReader;
+
 G_DEFINE_TYPE (PkBackendSpawn, pk_backend_spawn, G_TYPE_OBJECT)
 
 gboolean
@@ -109,8 +125,16 @@ pk_backend_spawn_start_kill_timer (PkBackendSpawn *backend_spawn)
 	priv->finished = TRUE;
 	g_debug ("backend marked as finished, so starting kill timer");
 
-	if (priv->kill_id > 0)
+	if (priv->kill_id > 0) {
 		g_source_remove (priv->kill_id);
+		priv->kill_id = 0;
+	}
+
+	/* keep the dispatcher warm for the next transaction */
+	if (priv->persistent && priv->dispatcher_running) {
+		g_debug ("not starting kill timer for persistent %s", priv->dispatcher);
+		return;
+	}
 
 	/* get policy timeout */
 	timeout = g_key_file_get_integer (priv->conf, "Daemon", "BackendShutdownTimeout", NULL);
@@ -124,6 +148,27 @@ pk_backend_spawn_start_kill_timer (PkBackendSpawn *backend_spawn)
 	g_source_set_name_by_id (priv->kill_id, "[PkBackendSpawn] exit");
 }
 
+static void
+pk_backend_spawn_finished (PkBackendSpawn *backend_spawn, PkBackendJob *job)
+{
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+
+	pk_backend_job_finished (job);
+	priv->is_busy = FALSE;
+
+	/* time from sending the request to the dispatcher finishing it */
+	if (priv->request_acked) {
+		priv->request_latency = g_get_monotonic_time () - priv->request_start;
+		g_debug ("request %u (%s) took %" G_GUINT64_FORMAT "us",
+			 priv->request_id, priv->request_command,
+			 priv->request_latency);
+		priv->request_acked = FALSE;
+	}
+
+	/* from this point on, we can start the kill timer */
+	pk_backend_spawn_start_kill_timer (backend_spawn);
+}
+
 static gboolean
 pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			       PkBackendJob *job,
@@ -219,11 +264,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			return FALSE;
 		}
-		pk_backend_job_finished (job);
-		priv->is_busy = FALSE;
-
-		/* from this point on, we can start the kill timer */
-		pk_backend_spawn_start_kill_timer (backend_spawn);
+		pk_backend_spawn_finished (backend_spawn, job);
 
 	} else if (g_strcmp0 (command, "files") == 0) {
 		g_auto(GStrv) tmp = NULL;
@@ -544,6 +585,33 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			return FALSE;
 		}
 		pk_backend_job_category (job, sections[1], sections[2], sections[3], sections[4], sections[5]);
+	} else if (g_strcmp0 (command, "protocol") == 0) {
+		if (size != 2) {
+			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
+			return FALSE;
+		}
+		if (g_strcmp0 (sections[1], G_STRINGIFY (PK_BACKEND_SPAWN_PROTOCOL_VERSION)) != 0) {
+			g_set_error (error, 1, 0, "protocol '%s' not supported", sections[1]);
+			return FALSE;
+		}
+		g_debug ("helper switched to protocol %s", sections[1]);
+		pk_spawn_set_framing (priv->spawn, PK_SPAWN_FRAMING_RECORDS);
+	} else if (g_strcmp0 (command, "request") == 0) {
+		guint request_id;
+		if (size != 2) {
+			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
+			return FALSE;
+		}
+		if (!pk_strtouint (sections[1], &request_id)) {
+			g_set_error (error, 1, 0, "invalid request id '%s'", sections[1]);
+			return FALSE;
+		}
+		if (request_id != priv->request_id) {
+			g_debug ("ignoring ack for old request %u", request_id);
+			return TRUE;
+		}
+		priv->request_acked = TRUE;
+		priv->dispatcher_requests++;
 	} else {
 		g_set_error (error, 1, 0, "invalid command '%s'", command);
 		return FALSE;
@@ -551,14 +619,313 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 	return TRUE;
 }
 
+static gboolean
+pk_backend_spawn_record_uint32 (PkBackendSpawnRecordReader *reader, guint32 *value)
+{
+	if (reader->len - reader->offset < sizeof (guint32))
+		return FALSE;
+	memcpy (value, reader->data + reader->offset, sizeof (guint32));
+	reader->offset += sizeof (guint32);
+	return TRUE;
+}
+
+static gboolean
+pk_backend_spawn_record_uint64 (PkBackendSpawnRecordReader *reader, guint64 *value)
+{
+	if (reader->len - reader->offset < sizeof (guint64))
+		return FALSE;
+	memcpy (value, reader->data + reader->offset, sizeof (guint64));
+	reader->offset += sizeof (guint64);
+	return TRUE;
+}
+
+/* returns a string pointing into the record, or %NULL if truncated */
+static gchar *
+pk_backend_spawn_record_string (PkBackendSpawnRecordReader *reader)
+{
+	gchar *value;
+	guint32 len;
+
+	if (!pk_backend_spawn_record_uint32 (reader, &len))
+		return NULL;
+	if (reader->len - reader->offset <= len)
+		return NULL;
+	value = (gchar *) reader->data + reader->offset;
+	if (value[len] != '\0')
+		return NULL;
+	reader->offset += (gsize) len + 1;
+	return value;
+}
+
+/* returns an array of strings pointing into the record, free with g_free() */
+static gchar **
+pk_backend_spawn_record_strv (PkBackendSpawnRecordReader *reader)
+{
+	guint32 len;
+	g_autofree gchar **value = NULL;
+
+	if (!pk_backend_spawn_record_uint32 (reader, &len))
+		return NULL;
+
+	/* each string is at least five bytes */
+	if ((reader->len - reader->offset) / 5 < len)
+		return NULL;
+	value = g_new0 (gchar *, len + 1);
+	for (guint i = 0; i < len; i++) {
+		value[i] = pk_backend_spawn_record_string (reader);
+		if (value[i] == NULL)
+			return NULL;
+	}
+	return g_steal_pointer (&value);
+}
+
+static gboolean
+pk_backend_spawn_record_end (PkBackendSpawnRecordReader *reader, GError **error)
+{
+	if (reader->offset != reader->len) {
+		g_set_error (error, 1, 0, "record has %" G_GSIZE_FORMAT " trailing bytes",
+			     reader->len - reader->offset);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * pk_backend_spawn_inject_record:
+ * @data: the record after the length, which is modified
+ * @len: the length of @data
+ *
+ * Handles one record of the version 2 protocol. Filters set with
+ * pk_backend_spawn_set_filter_stdout() only see records of type
+ * %PK_BACKEND_SPAWN_RECORD_TEXT.
+ **/
+gboolean
+pk_backend_spawn_inject_record (PkBackendSpawn *backend_spawn,
+				PkBackendJob *job,
+				guint8 *data,
+				gsize len,
+				GError **error)
+{
+	guint32 command;
+	guint32 value;
+	guint32 value2;
+	guint64 size;
+	gchar *package_id;
+	gchar *text;
+	PkBackendSpawnRecordReader reader = { data, len, 0 };
+
+	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
+
+	if (!pk_backend_spawn_record_uint32 (&reader, &command)) {
+		g_set_error_literal (error, 1, 0, "record too short");
+		return FALSE;
+	}
+
+	switch (command) {
+	case PK_BACKEND_SPAWN_RECORD_TEXT:
+		text = pk_backend_spawn_record_string (&reader);
+		if (text == NULL)
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		return pk_backend_spawn_inject_data (backend_spawn, job, text, error);
+	case PK_BACKEND_SPAWN_RECORD_FINISHED:
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		pk_backend_spawn_finished (backend_spawn, job);
+		return TRUE;
+	case PK_BACKEND_SPAWN_RECORD_PACKAGE:
+		if (!pk_backend_spawn_record_uint32 (&reader, &value))
+			break;
+		package_id = pk_backend_spawn_record_string (&reader);
+		if (package_id == NULL)
+			break;
+		text = pk_backend_spawn_record_string (&reader);
+		if (text == NULL)
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		if (value == PK_INFO_ENUM_UNKNOWN || value >= PK_INFO_ENUM_LAST) {
+			g_set_error (error, 1, 0, "Info enum not recognised, and hence ignored: '%u'", value);
+			return FALSE;
+		}
+		if (!pk_package_id_check (package_id)) {
+			g_set_error_literal (error, 1, 0, "invalid package_id");
+			return FALSE;
+		}
+		if (!g_utf8_validate (text, -1, NULL)) {
+			g_set_error (error, 1, 0, "text '%s' was not valid UTF8!", text);
+			return FALSE;
+		}
+		pk_backend_job_package (job, value, package_id, text);
+		return TRUE;
+	case PK_BACKEND_SPAWN_RECORD_DETAILS:
+	{
+		gchar *summary;
+		gchar *license;
+		gchar *url;
+
+		package_id = pk_backend_spawn_record_string (&reader);
+		if (package_id == NULL)
+			break;
+		summary = pk_backend_spawn_record_string (&reader);
+		if (summary == NULL)
+			break;
+		license = pk_backend_spawn_record_string (&reader);
+		if (license == NULL)
+			break;
+		if (!pk_backend_spawn_record_uint32 (&reader, &value))
+			break;
+		text = pk_backend_spawn_record_string (&reader);
+		if (text == NULL)
+			break;
+		url = pk_backend_spawn_record_string (&reader);
+		if (url == NULL)
+			break;
+		if (!pk_backend_spawn_record_uint64 (&reader, &size))
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		if (value >= PK_GROUP_ENUM_LAST) {
+			g_set_error (error, 1, 0, "Group enum not recognised, and hence ignored: '%u'", value);
+			return FALSE;
+		}
+		if (size > 1073741824) {
+			g_set_error_literal (error, 1, 0,
+					     "package size cannot be that large");
+			return FALSE;
+		}
+		if (!g_utf8_validate (text, -1, NULL)) {
+			g_set_error (error, 1, 0, "text '%s' was not valid UTF8!", text);
+			return FALSE;
+		}
+		pk_backend_job_details (job, package_id, summary, license,
+					value, text, url, size);
+		return TRUE;
+	}
+	case PK_BACKEND_SPAWN_RECORD_FILES:
+	{
+		g_autofree gchar **files = NULL;
+
+		package_id = pk_backend_spawn_record_string (&reader);
+		if (package_id == NULL)
+			break;
+		files = pk_backend_spawn_record_strv (&reader);
+		if (files == NULL)
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		pk_backend_job_files (job, package_id, files);
+		return TRUE;
+	}
+	case PK_BACKEND_SPAWN_RECORD_PERCENTAGE:
+		if (!pk_backend_spawn_record_uint32 (&reader, &value))
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		if (value > PK_BACKEND_PERCENTAGE_INVALID) {
+			g_set_error (error, 1, 0, "invalid percentage value %u", value);
+			return FALSE;
+		}
+		pk_backend_job_set_percentage (job, value);
+		return TRUE;
+	case PK_BACKEND_SPAWN_RECORD_ITEM_PROGRESS:
+		package_id = pk_backend_spawn_record_string (&reader);
+		if (package_id == NULL)
+			break;
+		if (!pk_backend_spawn_record_uint32 (&reader, &value))
+			break;
+		if (!pk_backend_spawn_record_uint32 (&reader, &value2))
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		if (!pk_package_id_check (package_id)) {
+			g_set_error_literal (error, 1, 0, "invalid package_id");
+			return FALSE;
+		}
+		if (value == PK_STATUS_ENUM_UNKNOWN || value >= PK_STATUS_ENUM_LAST) {
+			g_set_error (error, 1, 0, "Status enum not recognised, and hence ignored: '%u'", value);
+			return FALSE;
+		}
+		if (value2 > 100) {
+			g_set_error (error, 1, 0, "invalid item-progress value %u", value2);
+			return FALSE;
+		}
+		pk_backend_job_set_item_progress (job, package_id, value, value2);
+		return TRUE;
+	case PK_BACKEND_SPAWN_RECORD_STATUS:
+		if (!pk_backend_spawn_record_uint32 (&reader, &value))
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		if (value == PK_STATUS_ENUM_UNKNOWN || value >= PK_STATUS_ENUM_LAST) {
+			g_set_error (error, 1, 0, "Status enum not recognised, and hence ignored: '%u'", value);
+			return FALSE;
+		}
+		pk_backend_job_set_status (job, value);
+		return TRUE;
+	case PK_BACKEND_SPAWN_RECORD_ERROR:
+		if (!pk_backend_spawn_record_uint32 (&reader, &value))
+			break;
+		text = pk_backend_spawn_record_string (&reader);
+		if (text == NULL)
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		if (value == PK_ERROR_ENUM_UNKNOWN || value >= PK_ERROR_ENUM_LAST) {
+			g_set_error (error, 1, 0, "Error enum not recognised, and hence ignored: '%u'", value);
+			return FALSE;
+		}
+		pk_backend_job_error_code (job, value, "%s", text);
+		return TRUE;
+	case PK_BACKEND_SPAWN_RECORD_ALLOW_CANCEL:
+		if (!pk_backend_spawn_record_uint32 (&reader, &value))
+			break;
+		if (!pk_backend_spawn_record_end (&reader, error))
+			return FALSE;
+		if (value > 1) {
+			g_set_error (error, 1, 0, "invalid allow-cancel value %u", value);
+			return FALSE;
+		}
+		pk_backend_job_set_allow_cancel (job, value);
+		return TRUE;
+	default:
+		g_set_error (error, 1, 0, "invalid record %u", command);
+		return FALSE;
+	}
+
+	/* one of the fields was cut short */
+	g_set_error (error, 1, 0, "record %u is truncated", command);
+	return FALSE;
+}
+
+static gboolean pk_backend_spawn_restart_cb (gpointer user_data);
+
 static void
 pk_backend_spawn_exit_cb (PkSpawn *spawn, PkSpawnExitType exit_enum, PkBackendSpawn *backend_spawn)
 {
 	gboolean ret;
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
 	g_return_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn));
 
 	/* reset the busy flag */
 	backend_spawn->priv->is_busy = FALSE;
+	priv->dispatcher_running = FALSE;
+	priv->request_acked = FALSE;
+
+	/* start a new dispatcher, but not from inside the exit handler and
+	 * not for a helper that crashed before serving anything */
+	if (priv->persistent && priv->dispatcher_requests > 0 &&
+	    priv->restart_id == 0 &&
+	    exit_enum != PK_SPAWN_EXIT_TYPE_DISPATCHER_EXIT &&
+	    exit_enum != PK_SPAWN_EXIT_TYPE_DISPATCHER_CHANGED) {
+		priv->restart_id = g_timeout_add_seconds (1, pk_backend_spawn_restart_cb, backend_spawn);
+		g_source_set_name_by_id (priv->restart_id, "[PkBackendSpawn] restart");
+	}
+
+	/* nothing to tidy up for a dispatcher that was never used */
+	if (priv->job == NULL)
+		return;
 
 	/* if we force killed the process, set an error */
 	if (exit_enum == PK_SPAWN_EXIT_TYPE_SIGKILL) {
@@ -604,11 +971,28 @@ pk_backend_spawn_inject_data (PkBackendSpawn *backend_spawn,
 	return pk_backend_spawn_parse_stdout (backend_spawn, job, line, error);
 }
 
+/* output of an earlier request, or of a dispatcher still starting up */
+static gboolean
+pk_backend_spawn_is_stale (PkBackendSpawn *backend_spawn, const gchar *line)
+{
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+	if (!priv->dispatcher_running || priv->request_acked)
+		return FALSE;
+	if (g_str_has_prefix (line, "request\t") ||
+	    g_str_has_prefix (line, "protocol\t"))
+		return FALSE;
+	return TRUE;
+}
+
 static void
 pk_backend_spawn_stdout_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendSpawn *backend_spawn)
 {
 	gboolean ret;
 	g_autoptr(GError) error = NULL;
+	if (pk_backend_spawn_is_stale (backend_spawn, line)) {
+		g_debug ("ignoring stale output: %s", line);
+		return;
+	}
 	ret = pk_backend_spawn_inject_data (backend_spawn,
 					    backend_spawn->priv->job,
 					    line,
@@ -617,6 +1001,33 @@ pk_backend_spawn_stdout_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendS
 		g_warning ("failed to parse: %s: %s", line, error->message);
 }
 
+static void
+pk_backend_spawn_record_cb (PkSpawn *spawn, guint8 *data, guint len, PkBackendSpawn *backend_spawn)
+{
+	g_autoptr(GError) error = NULL;
+
+	/* only text records can carry the ack */
+	if (backend_spawn->priv->dispatcher_running &&
+	    !backend_spawn->priv->request_acked) {
+		PkBackendSpawnRecordReader reader = { data, len, 0 };
+		guint32 command;
+		const gchar *line;
+
+		if (!pk_backend_spawn_record_uint32 (&reader, &command) ||
+		    command != PK_BACKEND_SPAWN_RECORD_TEXT ||
+		    (line = pk_backend_spawn_record_string (&reader)) == NULL ||
+		    pk_backend_spawn_is_stale (backend_spawn, line)) {
+			g_debug ("ignoring stale record");
+			return;
+		}
+	}
+	if (!pk_backend_spawn_inject_record (backend_spawn,
+					     backend_spawn->priv->job,
+					     data, len,
+					     &error))
+		g_warning ("failed to parse record: %s", error->message);
+}
+
 static void
 pk_backend_spawn_stderr_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendSpawn *backend_spawn)
 {
@@ -624,7 +1035,8 @@ pk_backend_spawn_stderr_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendS
 	g_return_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn));
 
 	/* do we ignore with a filter func ? */
-	if (backend_spawn->priv->stderr_func != NULL) {
+	if (backend_spawn->priv->stderr_func != NULL &&
+	    backend_spawn->priv->job != NULL) {
 		ret = backend_spawn->priv->stderr_func (backend_spawn->priv->job, line);
 		if (!ret)
 			return;
@@ -632,18 +1044,14 @@ pk_backend_spawn_stderr_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendS
 	g_warning ("STDERR: %s", line);
 }
 
-static gchar **
-pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
+/* @job can be %NULL for a dispatcher started before the first request */
+static GHashTable *
+pk_backend_spawn_get_env_table (PkBackendSpawn *backend_spawn, PkBackendJob *job)
 {
-	gchar **envp;
 	gchar **env_item;
 	gchar *uri;
 	const gchar *value;
-	guint i;
 	guint cache_age;
-	GHashTableIter env_iter;
-	gchar *env_key;
-	gchar *env_value;
 	gboolean ret;
 	PkBackendSpawnPrivate *priv = backend_spawn->priv;
 	gboolean keep_environment;
@@ -655,8 +1063,7 @@ pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
 	const gchar *proxy_http = NULL;
 	const gchar *proxy_https = NULL;
 	const gchar *proxy_socks = NULL;
-	g_autofree gchar *transaction_id = NULL;
-	g_autoptr(GHashTable) env_table = NULL;
+	GHashTable *env_table;
 
 	env_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
 	keep_environment = g_key_file_get_boolean (backend_spawn->priv->conf,
@@ -678,60 +1085,75 @@ pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
 		}
 	}
 
+	/* SPAWN_PROTOCOL */
+	g_hash_table_replace (env_table,
+			      g_strdup ("SPAWN_PROTOCOL"),
+			      g_strdup (G_STRINGIFY (PK_BACKEND_SPAWN_PROTOCOL_VERSION)));
+
+	/* the real values are sent with each request */
+	if (job == NULL) {
+		g_hash_table_replace (env_table, g_strdup ("LANG"), g_strdup ("C"));
+		g_hash_table_replace (env_table, g_strdup ("NETWORK"), g_strdup ("FALSE"));
+		g_hash_table_replace (env_table, g_strdup ("BACKGROUND"), g_strdup ("FALSE"));
+		g_hash_table_replace (env_table, g_strdup ("INTERACTIVE"), g_strdup ("FALSE"));
+		g_hash_table_replace (env_table, g_strdup ("UID"), g_strdup ("0"));
+		return env_table;
+	}
+
 	/* accepted eulas */
 	eulas = pk_backend_get_accepted_eula_string (priv->backend);
 	if (eulas != NULL)
 		g_hash_table_replace (env_table, g_strdup ("accepted_eulas"), g_strdup (eulas));
 
 	/* http_proxy */
-	proxy_http = pk_backend_job_get_proxy_http (priv->job);
+	proxy_http = pk_backend_job_get_proxy_http (job);
 	if (!pk_strzero (proxy_http)) {
 		uri = pk_backend_convert_uri (proxy_http);
 		g_hash_table_replace (env_table, g_strdup ("http_proxy"), uri);
 	}
 
 	/* https_proxy */
-	proxy_https = pk_backend_job_get_proxy_https (priv->job);
+	proxy_https = pk_backend_job_get_proxy_https (job);
 	if (!pk_strzero (proxy_https)) {
 		uri = pk_backend_convert_uri (proxy_https);
 		g_hash_table_replace (env_table, g_strdup ("https_proxy"), uri);
 	}
 
 	/* ftp_proxy */
-	proxy_ftp = pk_backend_job_get_proxy_ftp (priv->job);
+	proxy_ftp = pk_backend_job_get_proxy_ftp (job);
 	if (!pk_strzero (proxy_ftp)) {
 		uri = pk_backend_convert_uri (proxy_ftp);
 		g_hash_table_replace (env_table, g_strdup ("ftp_proxy"), uri);
 	}
 
 	/* socks_proxy */
-	proxy_socks = pk_backend_job_get_proxy_socks (priv->job);
+	proxy_socks = pk_backend_job_get_proxy_socks (job);
 	if (!pk_strzero (proxy_socks)) {
 		uri = pk_backend_convert_uri_socks (proxy_socks);
 		g_hash_table_replace (env_table, g_strdup ("all_proxy"), uri);
 	}
 
 	/* no_proxy */
-	no_proxy = pk_backend_job_get_no_proxy (priv->job);
+	no_proxy = pk_backend_job_get_no_proxy (job);
 	if (!pk_strzero (no_proxy)) {
 		g_hash_table_replace (env_table, g_strdup ("no_proxy"),
 		                      g_strdup (no_proxy));
 	}
 
 	/* pac */
-	pac = pk_backend_job_get_pac (priv->job);
+	pac = pk_backend_job_get_pac (job);
 	if (!pk_strzero (pac)) {
 		uri = pk_backend_convert_uri (pac);
 		g_hash_table_replace (env_table, g_strdup ("pac"), uri);
 	}
 
 	/* LANG */
-	locale = pk_backend_job_get_locale (priv->job);
+	locale = pk_backend_job_get_locale (job);
 	if (!pk_strzero (locale))
 		g_hash_table_replace (env_table, g_strdup ("LANG"), g_strdup (locale));
 
 	/* FRONTEND SOCKET */
-	value = pk_backend_job_get_frontend_socket (priv->job);
+	value = pk_backend_job_get_frontend_socket (job);
 	if (!pk_strzero (value))
 		g_hash_table_replace (env_table, g_strdup ("FRONTEND_SOCKET"), g_strdup (value));
 
@@ -740,20 +1162,20 @@ pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
 	g_hash_table_replace (env_table, g_strdup ("NETWORK"), g_strdup (ret ? "TRUE" : "FALSE"));
 
 	/* BACKGROUND */
-	ret = pk_backend_job_get_background (priv->job);
+	ret = pk_backend_job_get_background (job);
 	g_hash_table_replace (env_table, g_strdup ("BACKGROUND"), g_strdup (ret ? "TRUE" : "FALSE"));
 
 	/* INTERACTIVE */
-	ret = pk_backend_job_get_interactive (priv->job);
+	ret = pk_backend_job_get_interactive (job);
 	g_hash_table_replace (env_table, g_strdup ("INTERACTIVE"), g_strdup (ret ? "TRUE" : "FALSE"));
 
 	/* UID */
 	g_hash_table_replace (env_table,
 			      g_strdup ("UID"),
-			      g_strdup_printf ("%u", pk_backend_job_get_uid (priv->job)));
+			      g_strdup_printf ("%u", pk_backend_job_get_uid (job)));
 
 	/* CACHE_AGE */
-	cache_age = pk_backend_job_get_cache_age (priv->job);
+	cache_age = pk_backend_job_get_cache_age (job);
 	if (cache_age == G_MAXUINT) {
 		g_hash_table_replace (env_table,
 				      g_strdup ("CACHE_AGE"),
@@ -764,6 +1186,26 @@ pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
 				      g_strdup_printf ("%u", cache_age));
 	}
 
+	return env_table;
+}
+
+static gchar **
+pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn, PkBackendJob *job)
+{
+	gchar **envp;
+	guint i;
+	GHashTableIter env_iter;
+	gchar *env_key;
+	gchar *env_value;
+	gboolean keep_environment;
+	g_autoptr(GHashTable) env_table = NULL;
+
+	env_table = pk_backend_spawn_get_env_table (backend_spawn, job);
+	keep_environment = g_key_file_get_boolean (backend_spawn->priv->conf,
+						   "Daemon",
+						   "KeepEnvironment",
+						   NULL);
+
 	/* copy hashed environment key/value pairs to envp */
 	envp = g_new0 (gchar *, g_hash_table_size (env_table) + 1);
 	g_hash_table_iter_init (&env_iter, env_table);
@@ -834,57 +1276,179 @@ pk_backend_spawn_va_list_to_argv (const gchar *string_first, va_list *args)
 	return (gchar **) g_ptr_array_free (ptr_array, FALSE);
 }
 
-static gboolean
-pk_backend_spawn_helper_va_list (PkBackendSpawn *backend_spawn,
-				 PkBackendJob *job,
-				 const gchar *executable,
-				 va_list *args)
+static gchar *
+pk_backend_spawn_get_filename (PkBackendSpawn *backend_spawn, const gchar *executable)
 {
-	gboolean background;
 	PkBackendSpawnPrivate *priv = backend_spawn->priv;
-	PkSpawnArgvFlags flags = PK_SPAWN_ARGV_FLAGS_NONE;
+	gchar *filename;
 #ifdef SOURCEROOTDIR
 	const gchar *directory;
-#endif
-	g_autoptr(GError) error = NULL;
-	g_autofree gchar *filename = NULL;
-	g_auto(GStrv) argv = NULL;
-	g_auto(GStrv) envp = NULL;
-
-	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
 
-	/* convert to a argv */
-	argv = pk_backend_spawn_va_list_to_argv (executable, args);
-	if (argv == NULL) {
-		g_warning ("argv NULL");
-		return FALSE;
-	}
-
-#ifdef SOURCEROOTDIR
 	/* prefer the local version */
 	directory = priv->name;
 	if (g_str_has_prefix (directory, "test_"))
 		directory = "test";
 
 	filename = g_build_filename (SOURCEROOTDIR, "backends", directory, "helpers",
-				     argv[PK_BACKEND_SPAWN_ARGV0], NULL);
+				     executable, NULL);
 	if (g_file_test (filename, G_FILE_TEST_EXISTS) == FALSE) {
 		g_debug ("local helper not found '%s'", filename);
 		g_free (filename);
 		filename = g_build_filename (SOURCEROOTDIR, "backends", directory,
-					     argv[PK_BACKEND_SPAWN_ARGV0], NULL);
+					     executable, NULL);
 	}
 	if (g_file_test (filename, G_FILE_TEST_EXISTS) == FALSE) {
 		g_debug ("local helper not found '%s'", filename);
 		g_free (filename);
 		filename = g_build_filename (DATADIR, "PackageKit", "helpers",
-					     priv->name, argv[PK_BACKEND_SPAWN_ARGV0], NULL);
+					     priv->name, executable, NULL);
 	}
 #else
 	filename = g_build_filename (DATADIR, "PackageKit", "helpers",
-				     priv->name, argv[PK_BACKEND_SPAWN_ARGV0], NULL);
+				     priv->name, executable, NULL);
 #endif
 	g_debug ("using spawn filename %s", filename);
+	return filename;
+}
+
+static gboolean
+pk_backend_spawn_start_dispatcher (PkBackendSpawn *backend_spawn, GError **error)
+{
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+	gchar *argv[] = { NULL, NULL };
+	g_autofree gchar *filename = NULL;
+	g_auto(GStrv) envp = NULL;
+
+	if (priv->dispatcher_running)
+		return TRUE;
+	if (priv->restart_id != 0) {
+		g_source_remove (priv->restart_id);
+		priv->restart_id = 0;
+	}
+
+	/* any other helper that is still running gets replaced */
+	filename = pk_backend_spawn_get_filename (backend_spawn, priv->dispatcher);
+	argv[0] = filename;
+	envp = pk_backend_spawn_get_envp (backend_spawn, NULL);
+	g_object_set (priv->spawn, "background", FALSE, NULL);
+	if (!pk_spawn_argv (priv->spawn, argv, envp,
+			    PK_SPAWN_ARGV_FLAGS_NEVER_REUSE, error))
+		return FALSE;
+
+	/* nothing to emulate Finished() for until the first request */
+	priv->finished = TRUE;
+	priv->dispatcher_running = TRUE;
+	priv->dispatcher_requests = 0;
+	priv->request_acked = FALSE;
+	return TRUE;
+}
+
+static gboolean
+pk_backend_spawn_restart_cb (gpointer user_data)
+{
+	PkBackendSpawn *backend_spawn = PK_BACKEND_SPAWN (user_data);
+	g_autoptr(GError) error = NULL;
+
+	backend_spawn->priv->restart_id = 0;
+	g_debug ("restarting persistent %s", backend_spawn->priv->dispatcher);
+	if (!pk_backend_spawn_start_dispatcher (backend_spawn, &error))
+		g_warning ("failed to restart dispatcher: %s", error->message);
+	return G_SOURCE_REMOVE;
+}
+
+/* the per-job environment, sent to a dispatcher that is already running */
+static gchar *
+pk_backend_spawn_get_environment_line (PkBackendSpawn *backend_spawn, PkBackendJob *job)
+{
+	g_auto(GStrv) envp = NULL;
+	g_autofree gchar *joined = NULL;
+
+	envp = pk_backend_spawn_get_envp (backend_spawn, job);
+	for (guint i = 0; envp[i] != NULL; i++)
+		g_strdelimit (envp[i], "\t\n\r", ' ');
+	joined = g_strjoinv ("\t", envp);
+	return g_strdup_printf ("environment\t%s", joined);
+}
+
+static gboolean
+pk_backend_spawn_send_request (PkBackendSpawn *backend_spawn,
+			       PkBackendJob *job,
+			       gchar **argv)
+{
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *arguments = NULL;
+	g_autofree gchar *environment = NULL;
+	g_autofree gchar *request = NULL;
+
+	if (!pk_backend_spawn_start_dispatcher (backend_spawn, &error)) {
+		pk_backend_job_error_code (job,
+					   PK_ERROR_ENUM_INTERNAL_ERROR,
+					   "Spawn of helper '%s' failed: %s",
+					   priv->dispatcher,
+					   error->message);
+		pk_backend_job_finished (job);
+		return FALSE;
+	}
+
+	/* the dispatcher runs each job at the priority of that job */
+	g_object_set (priv->spawn,
+		      "background", pk_backend_job_get_background (job),
+		      NULL);
+
+	/* anything the dispatcher prints before the ack is ignored */
+	priv->finished = FALSE;
+	priv->request_id++;
+	priv->request_acked = FALSE;
+	priv->request_start = g_get_monotonic_time ();
+	g_free (priv->request_command);
+	priv->request_command = g_strdup (argv[1]);
+
+	environment = pk_backend_spawn_get_environment_line (backend_spawn, job);
+	arguments = g_strjoinv ("\t", &argv[1]);
+	request = g_strdup_printf ("request\t%u\t%s", priv->request_id, arguments);
+	if (!pk_spawn_send_stdin (priv->spawn, environment) ||
+	    !pk_spawn_send_stdin (priv->spawn, request)) {
+		pk_backend_job_error_code (job,
+					   PK_ERROR_ENUM_INTERNAL_ERROR,
+					   "Failed to send request to helper '%s'",
+					   priv->dispatcher);
+		pk_backend_job_finished (job);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+pk_backend_spawn_helper_va_list (PkBackendSpawn *backend_spawn,
+				 PkBackendJob *job,
+				 const gchar *executable,
+				 va_list *args)
+{
+	gboolean background;
+	PkBackendSpawnPrivate *priv = backend_spawn->priv;
+	PkSpawnArgvFlags flags = PK_SPAWN_ARGV_FLAGS_NONE;
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *filename = NULL;
+	g_auto(GStrv) argv = NULL;
+	g_auto(GStrv) envp = NULL;
+
+	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
+
+	/* convert to a argv */
+	argv = pk_backend_spawn_va_list_to_argv (executable, args);
+	if (argv == NULL) {
+		g_warning ("argv NULL");
+		return FALSE;
+	}
+
+#ifndef ENABLE_STRACE
+	/* a helper that takes requests doesn't need to be restarted */
+	if (argv[1] != NULL && g_strcmp0 (argv[0], priv->dispatcher) == 0)
+		return pk_backend_spawn_send_request (backend_spawn, job, argv);
+#endif
+
+	filename = pk_backend_spawn_get_filename (backend_spawn, argv[PK_BACKEND_SPAWN_ARGV0]);
 
 	/* replace the filename with the full path */
 	g_free (argv[PK_BACKEND_SPAWN_ARGV0]);
@@ -902,7 +1466,7 @@ pk_backend_spawn_helper_va_list (PkBackendSpawn *backend_spawn,
 #endif
 
 	priv->finished = FALSE;
-	envp = pk_backend_spawn_get_envp (backend_spawn);
+	envp = pk_backend_spawn_get_envp (backend_spawn, job);
 	if (!pk_spawn_argv (priv->spawn, argv, envp, flags, &error)) {
 		pk_backend_job_error_code (priv->job,
 					   PK_ERROR_ENUM_INTERNAL_ERROR,
@@ -933,6 +1497,51 @@ pk_backend_spawn_set_name (PkBackendSpawn *backend_spawn, const gchar *name)
 	return TRUE;
 }
 
+/**
+ * pk_backend_spawn_set_dispatcher:
+ * @backend_spawn: a #PkBackendSpawn
+ * @dispatcher: the helper filename, e.g. "entropyBackend.py"
+ *
+ * Marks @dispatcher as understanding the "environment" and "request"
+ * commands, so one running instance can serve jobs with different
+ * environments. With PersistentBackendHelpers set it is started now
+ * and kept running between transactions.
+ **/
+gboolean
+pk_backend_spawn_set_dispatcher (PkBackendSpawn *backend_spawn, const gchar *dispatcher)
+{
+	PkBackendSpawnPrivate *priv;
+	g_autoptr(GError) error = NULL;
+
+	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
+	g_return_val_if_fail (dispatcher != NULL, FALSE);
+	g_return_val_if_fail (backend_spawn->priv->name != NULL, FALSE);
+
+	priv = backend_spawn->priv;
+	g_free (priv->dispatcher);
+	priv->dispatcher = g_strdup (dispatcher);
+	if (!priv->persistent)
+		return TRUE;
+	if (!pk_backend_spawn_start_dispatcher (backend_spawn, &error)) {
+		g_warning ("failed to start %s: %s", dispatcher, error->message);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * pk_backend_spawn_get_request_latency:
+ * @backend_spawn: a #PkBackendSpawn
+ *
+ * Return value: how long the last request to the dispatcher took, in us
+ **/
+guint64
+pk_backend_spawn_get_request_latency (PkBackendSpawn *backend_spawn)
+{
+	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), 0);
+	return backend_spawn->priv->request_latency;
+}
+
 gboolean
 pk_backend_spawn_kill (PkBackendSpawn *backend_spawn)
 {
@@ -1012,8 +1621,12 @@ pk_backend_spawn_finalize (GObject *object)
 
 	if (backend_spawn->priv->kill_id > 0)
 		g_source_remove (backend_spawn->priv->kill_id);
+	if (backend_spawn->priv->restart_id > 0)
+		g_source_remove (backend_spawn->priv->restart_id);
 
 	g_free (backend_spawn->priv->name);
+	g_free (backend_spawn->priv->dispatcher);
+	g_free (backend_spawn->priv->request_command);
 	g_key_file_unref (backend_spawn->priv->conf);
 	g_object_unref (backend_spawn->priv->spawn);
 	if (backend_spawn->priv->backend != NULL)
@@ -1042,11 +1655,16 @@ pk_backend_spawn_new (GKeyFile *conf)
 	PkBackendSpawn *backend_spawn;
 	backend_spawn = g_object_new (PK_TYPE_BACKEND_SPAWN, NULL);
 	backend_spawn->priv->conf = g_key_file_ref (conf);
+	backend_spawn->priv->persistent = g_key_file_get_boolean (conf, "Daemon",
+								  "PersistentBackendHelpers",
+								  NULL);
 	backend_spawn->priv->spawn = pk_spawn_new (backend_spawn->priv->conf);
 	g_signal_connect (backend_spawn->priv->spawn, "exit",
 			  G_CALLBACK (pk_backend_spawn_exit_cb), backend_spawn);
 	g_signal_connect (backend_spawn->priv->spawn, "stdout",
 			  G_CALLBACK (pk_backend_spawn_stdout_cb), backend_spawn);
+	g_signal_connect (backend_spawn->priv->spawn, "record",
+			  G_CALLBACK (pk_backend_spawn_record_cb), backend_spawn);
 	g_signal_connect (backend_spawn->priv->spawn, "stderr",
 			  G_CALLBACK (pk_backend_spawn_stderr_cb), backend_spawn);
 	return PK_BACKEND_SPAWN (backend_spawn);
@@ -36,6 +36,44 @@ G_BEGIN_DECLS
 
 #define PK_BACKEND_SPAWN_FILENAME_DELIM	"|"
 
+/*
+ * Helpers are told the newest protocol the daemon understands in the
+ * SPAWN_PROTOCOL environment variable. A helper that wants version 2 writes
+ * the line "protocol\t2", and everything after it on standard out is a
+ * sequence of records in host byte order:
+ *
+ *   guint32  length of the rest of the record
+ *   guint32  a #PkBackendSpawnRecord
+ *   ...      the fields of that record, where a string is a guint32 length
+ *            followed by the bytes and a NUL, a string list is a guint32
+ *            count followed by the strings, and enums are their numeric value
+ *
+ * PK_BACKEND_SPAWN_RECORD_TEXT carries one line of the text protocol, so
+ * helpers only have to use records for the commands that matter to them.
+ *
+ * A helper registered with pk_backend_spawn_set_dispatcher() is started
+ * once and then sent, for each job, the line "environment\tKEY=VALUE\t..."
+ * followed by "request\t<id>\t<command>\t<args>...". It has to replace its
+ * environment, reply "request\t<id>" and then run the command as usual;
+ * output from before the reply is ignored.
+ */
+#define PK_BACKEND_SPAWN_PROTOCOL_VERSION	2
+
+typedef enum {
+	PK_BACKEND_SPAWN_RECORD_TEXT,		/* string line */
+	PK_BACKEND_SPAWN_RECORD_FINISHED,	/* no fields */
+	PK_BACKEND_SPAWN_RECORD_PACKAGE,	/* u32 info, string package_id, string summary */
+	PK_BACKEND_SPAWN_RECORD_DETAILS,	/* string package_id, string summary, string license,
+						 * u32 group, string description, string url, u64 size */
+	PK_BACKEND_SPAWN_RECORD_FILES,		/* string package_id, string list files */
+	PK_BACKEND_SPAWN_RECORD_PERCENTAGE,	/* u32 percentage, or 101 for no updates */
+	PK_BACKEND_SPAWN_RECORD_ITEM_PROGRESS,	/* string package_id, u32 status, u32 percentage */
+	PK_BACKEND_SPAWN_RECORD_STATUS,		/* u32 status */
+	PK_BACKEND_SPAWN_RECORD_ERROR,		/* u32 error, string details */
+	PK_BACKEND_SPAWN_RECORD_ALLOW_CANCEL,	/* u32 allow_cancel */
+	PK_BACKEND_SPAWN_RECORD_LAST
+} PkBackendSpawnRecord;
+
 typedef struct PkBackendSpawnPrivate PkBackendSpawnPrivate;
 
 typedef struct
@@ -64,10 +102,18 @@ gboolean	 pk_backend_spawn_set_name		(PkBackendSpawn	*backend_spawn,
 							 const gchar	*name);
 void		 pk_backend_spawn_set_allow_sigkill	(PkBackendSpawn	*backend_spawn,
 							 gboolean	 allow_sigkill);
+gboolean	 pk_backend_spawn_set_dispatcher	(PkBackendSpawn	*backend_spawn,
+							 const gchar	*dispatcher);
+guint64		 pk_backend_spawn_get_request_latency	(PkBackendSpawn	*backend_spawn);
 gboolean	 pk_backend_spawn_inject_data		(PkBackendSpawn *backend_spawn,
 							 PkBackendJob	*job,
 							 const gchar	*line,
 							 GError		**error);
+gboolean	 pk_backend_spawn_inject_record		(PkBackendSpawn *backend_spawn,
+							 PkBackendJob	*job,
+							 guint8		*data,
+							 gsize		 len,
+							 GError		**error);
 
 /* filtering */
 typedef gboolean (*PkBackendSpawnFilterFunc)		(PkBackendJob	*job,
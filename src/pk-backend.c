@@ -46,6 +46,13 @@
  */
 #define PK_BACKEND_PERCENTAGE_DEFAULT		102
 
+/**
+ * PK_BACKEND_MAX_THREADS_DEFAULT:
+ *
+ * The number of worker threads used for jobs if MaxBackendThreads is unset
+ */
+#define PK_BACKEND_MAX_THREADS_DEFAULT		8
+
 typedef struct {
 	const gchar	*description;
 	const gchar	*author;
@@ -58,6 +65,8 @@ typedef struct {
 	PkBitfield	(*get_provides)			(PkBackend	*backend);
 	gchar		**(*get_mime_types)		(PkBackend	*backend);
 	gboolean	(*supports_parallelization)	(PkBackend	*backend);
+	gboolean	(*supports_concurrent_reads)	(PkBackend	*backend);
+	GVariant	*(*get_metrics)			(PkBackend	*backend);
 	void		(*job_start)			(PkBackend	*backend,
 							 PkBackendJob	*job);
 	void		(*job_stop)			(PkBackend	*backend,
@@ -198,6 +207,12 @@ struct PkBackendPrivate
 	gpointer		 user_data;
 	GHashTable		*thread_hash;
 	GMutex			 thread_hash_mutex;
+	GThreadPool		*thread_pool;
+	GMutex			 thread_pool_mutex;
+	guint			 thread_pool_jobs;
+	guint64			 thread_pool_wait;	/* us */
+	guint64			 thread_pool_wait_max;	/* us */
+	guint64			 thread_pool_run;	/* us */
 	gboolean		 transaction_in_progress;
 	guint			 transaction_inhibit_end_idle_id;
 	guint			 repo_list_changed_id;
@@ -253,6 +268,75 @@ pk_backend_supports_parallelization (PkBackend	*backend)
 	return backend->priv->desc->supports_parallelization (backend);
 }
 
+/**
+ * pk_backend_supports_concurrent_reads:
+ *
+ * Read-only queries such as searches can run at the same time as each
+ * other if the backend can share a snapshot of the package database
+ * between threads, even if it does not support full parallelization.
+ **/
+gboolean
+pk_backend_supports_concurrent_reads (PkBackend *backend)
+{
+	g_return_val_if_fail (PK_IS_BACKEND (backend), FALSE);
+
+	/* parallel backends can always do this */
+	if (pk_backend_supports_parallelization (backend))
+		return TRUE;
+
+	/* not compulsory */
+	if (backend->priv->desc->supports_concurrent_reads == NULL)
+		return FALSE;
+	return backend->priv->desc->supports_concurrent_reads (backend);
+}
+
+/**
+ * pk_backend_role_is_read_only:
+ *
+ * Return value: %TRUE if the role only queries the package database, and so
+ * can share the backend with other read-only transactions if the backend
+ * supports concurrent reads.
+ **/
+gboolean
+pk_backend_role_is_read_only (PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_RESOLVE:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/**
+ * pk_backend_get_metrics:
+ *
+ * Backends can export counters of their own, for instance how often a
+ * cache was used, as a dictionary of names to values.
+ *
+ * Return value: a floating a{st} #GVariant, or %NULL if the backend
+ * has no counters
+ **/
+GVariant *
+pk_backend_get_metrics (PkBackend *backend)
+{
+	g_return_val_if_fail (PK_IS_BACKEND (backend), NULL);
+	g_return_val_if_fail (backend->priv->loaded, NULL);
+
+	/* not compulsory */
+	if (backend->priv->desc->get_metrics == NULL)
+		return NULL;
+	return backend->priv->desc->get_metrics (backend);
+}
+
 void
 pk_backend_thread_start (PkBackend *backend, PkBackendJob *job, gpointer func)
 {
@@ -285,6 +369,99 @@ pk_backend_thread_stop (PkBackend *backend, PkBackendJob *job, gpointer func)
 	g_mutex_unlock (mutex);
 }
 
+/* a job waiting in the thread pool queue */
+typedef struct {
+	GThreadFunc		 func;
+	gpointer		 data;
+	gint64			 queued;
+} PkBackendThreadPoolItem;
+
+static void
+pk_backend_thread_pool_cb (gpointer data, gpointer user_data)
+{
+	PkBackend *backend = PK_BACKEND (user_data);
+	PkBackendThreadPoolItem *item = (PkBackendThreadPoolItem *) data;
+	gint64 started;
+	gint64 wait;
+	gint64 run;
+
+	started = g_get_monotonic_time ();
+	item->func (item->data);
+	wait = started - item->queued;
+	run = g_get_monotonic_time () - started;
+
+	/* keep track of how long jobs are queued compared to running */
+	g_mutex_lock (&backend->priv->thread_pool_mutex);
+	backend->priv->thread_pool_jobs++;
+	backend->priv->thread_pool_wait += wait;
+	backend->priv->thread_pool_run += run;
+	if ((guint64) wait > backend->priv->thread_pool_wait_max)
+		backend->priv->thread_pool_wait_max = wait;
+	g_mutex_unlock (&backend->priv->thread_pool_mutex);
+	g_debug ("backend job waited %" G_GINT64_FORMAT "ms and ran for %" G_GINT64_FORMAT "ms",
+		 wait / 1000, run / 1000);
+
+	g_free (item);
+}
+
+/**
+ * pk_backend_thread_pool_push:
+ *
+ * Runs @func in one of the backend worker threads. If all the workers
+ * are busy the function is queued until one becomes available.
+ **/
+gboolean
+pk_backend_thread_pool_push (PkBackend *backend,
+			     GThreadFunc func,
+			     gpointer data,
+			     GError **error)
+{
+	PkBackendThreadPoolItem *item;
+
+	g_return_val_if_fail (PK_IS_BACKEND (backend), FALSE);
+	g_return_val_if_fail (func != NULL, FALSE);
+
+	item = g_new0 (PkBackendThreadPoolItem, 1);
+	item->func = func;
+	item->data = data;
+	item->queued = g_get_monotonic_time ();
+	if (!g_thread_pool_push (backend->priv->thread_pool, item, error)) {
+		g_free (item);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * pk_backend_get_thread_pool_stats:
+ * @jobs: (out) (optional): the number of jobs that have completed
+ * @wait: (out) (optional): the total time jobs spent queued, in us
+ * @wait_max: (out) (optional): the longest time a job spent queued, in us
+ * @run: (out) (optional): the total time jobs spent running, in us
+ *
+ * Gets the counters used to size the MaxBackendThreads config value.
+ **/
+void
+pk_backend_get_thread_pool_stats (PkBackend *backend,
+				  guint *jobs,
+				  guint64 *wait,
+				  guint64 *wait_max,
+				  guint64 *run)
+{
+	g_return_if_fail (PK_IS_BACKEND (backend));
+
+	g_mutex_lock (&backend->priv->thread_pool_mutex);
+	if (jobs != NULL)
+		*jobs = backend->priv->thread_pool_jobs;
+	if (wait != NULL)
+		*wait = backend->priv->thread_pool_wait;
+	if (wait_max != NULL)
+		*wait_max = backend->priv->thread_pool_wait_max;
+	if (run != NULL)
+		*run = backend->priv->thread_pool_run;
+	g_mutex_unlock (&backend->priv->thread_pool_mutex);
+}
+
 PkBitfield
 pk_backend_get_filters (PkBackend *backend)
 {
@@ -513,6 +690,8 @@ pk_backend_load (PkBackend *backend, GError **error)
 		g_module_symbol (handle, "pk_backend_get_groups", (gpointer *)&desc->get_groups);
 		g_module_symbol (handle, "pk_backend_get_mime_types", (gpointer *)&desc->get_mime_types);
 		g_module_symbol (handle, "pk_backend_supports_parallelization", (gpointer *)&desc->supports_parallelization);
+		g_module_symbol (handle, "pk_backend_supports_concurrent_reads", (gpointer *)&desc->supports_concurrent_reads);
+		g_module_symbol (handle, "pk_backend_get_metrics", (gpointer *)&desc->get_metrics);
 		g_module_symbol (handle, "pk_backend_get_packages", (gpointer *)&desc->get_packages);
 		g_module_symbol (handle, "pk_backend_get_repo_list", (gpointer *)&desc->get_repo_list);
 		g_module_symbol (handle, "pk_backend_required_by", (gpointer *)&desc->required_by);
@@ -1071,11 +1250,16 @@ pk_backend_finalize (GObject *object)
 
 	g_free (backend->priv->name);
 
+	/* let any queued jobs run to completion */
+	if (backend->priv->thread_pool != NULL)
+		g_thread_pool_free (backend->priv->thread_pool, FALSE, TRUE);
+
 	g_key_file_unref (backend->priv->conf);
 	g_hash_table_destroy (backend->priv->eulas);
 
 	g_mutex_clear (&backend->priv->eulas_mutex);
 	g_mutex_clear (&backend->priv->thread_hash_mutex);
+	g_mutex_clear (&backend->priv->thread_pool_mutex);
 	g_hash_table_unref (backend->priv->thread_hash);
 	g_free (backend->priv->desc);
 
@@ -1725,14 +1909,27 @@ pk_backend_init (PkBackend *backend)
 							    g_free);
 	g_mutex_init (&backend->priv->eulas_mutex);
 	g_mutex_init (&backend->priv->thread_hash_mutex);
+	g_mutex_init (&backend->priv->thread_pool_mutex);
 }
 
 PkBackend *
 pk_backend_new (GKeyFile *conf)
 {
 	PkBackend *backend;
+	gint max_threads;
+
 	backend = g_object_new (PK_TYPE_BACKEND, NULL);
 	backend->priv->conf = g_key_file_ref (conf);
+
+	/* reuse worker threads rather than creating one for each job */
+	max_threads = g_key_file_get_integer (conf, "Daemon", "MaxBackendThreads", NULL);
+	if (max_threads <= 0)
+		max_threads = PK_BACKEND_MAX_THREADS_DEFAULT;
+	backend->priv->thread_pool = g_thread_pool_new (pk_backend_thread_pool_cb,
+							backend,
+							max_threads,
+							FALSE,
+							NULL);
 	return PK_BACKEND (backend);
 }
 
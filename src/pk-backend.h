@@ -120,6 +120,9 @@ PkBitfield	 pk_backend_get_filters			(PkBackend	*backend);
 PkBitfield	 pk_backend_get_roles			(PkBackend	*backend);
 gchar		**pk_backend_get_mime_types		(PkBackend	*backend);
 gboolean	 pk_backend_supports_parallelization	(PkBackend	*backend);
+gboolean	 pk_backend_supports_concurrent_reads	(PkBackend	*backend);
+gboolean	 pk_backend_role_is_read_only		(PkRoleEnum	 role);
+GVariant	*pk_backend_get_metrics			(PkBackend	*backend);
 void		 pk_backend_initialize			(GKeyFile		*conf,
 							 PkBackend	*backend);
 void		 pk_backend_destroy			(PkBackend	*backend);
@@ -251,6 +254,15 @@ void		 pk_backend_thread_start		(PkBackend	*backend,
 void		 pk_backend_thread_stop			(PkBackend	*backend,
 							 PkBackendJob	*job,
 							 gpointer	 func);
+gboolean	 pk_backend_thread_pool_push		(PkBackend	*backend,
+							 GThreadFunc	 func,
+							 gpointer	 data,
+							 GError		**error);
+void		 pk_backend_get_thread_pool_stats	(PkBackend	*backend,
+							 guint		*jobs,
+							 guint64	*wait,
+							 guint64	*wait_max,
+							 guint64	*run);
 
 /* global backend state */
 void		 pk_backend_accept_eula			(PkBackend	*backend,
@@ -46,6 +46,7 @@
 #include "pk-backend.h"
 #include "pk-dbus.h"
 #include "pk-engine.h"
+#include "pk-result-cache.h"
 #include "pk-shared.h"
 #include "pk-transaction-db.h"
 #include "pk-transaction.h"
@@ -67,6 +68,10 @@ static void	pk_engine_set_locked (PkEngine *engine, gboolean is_locked);
 /* how long to wait after the computer has been resumed or any system event */
 #define PK_ENGINE_STATE_CHANGED_TIMEOUT_NORMAL		600 /* s */
 
+/* memory used for cached results if ResultCacheSize is unset; off, as
+ * most backends do not notice changes made without PackageKit */
+#define PK_ENGINE_RESULT_CACHE_SIZE_DEFAULT		0 /* MiB */
+
 struct PkEnginePrivate
 {
 	GTimer			*timer;
@@ -74,6 +79,7 @@ struct PkEnginePrivate
 	gboolean		 shutdown_as_soon_as_possible;
 	PkScheduler		*scheduler;
 	PkTransactionDb		*transaction_db;
+	PkResultCache		*result_cache;
 	PkBackend		*backend;
 	GNetworkMonitor		*network_monitor;
 	GKeyFile		*conf;
@@ -101,6 +107,11 @@ struct PkEnginePrivate
 	GDBusProxy		*logind_proxy;
 	gint			 logind_fd;
 	gboolean		 logind_tried;
+	gboolean		 metrics_enabled;
+	guint			 metrics_filter_id;
+	GMutex			 metrics_mutex;
+	guint64			 bus_messages_sent;	/* protected by metrics_mutex */
+	guint64			 bus_bytes_sent;
 };
 
 enum {
@@ -147,6 +158,347 @@ pk_engine_reset_timer (PkEngine *engine)
 
 static void pk_engine_inhibit (PkEngine *engine);
 static void pk_engine_uninhibit (PkEngine *engine);
+static void pk_engine_emit_property_changed (PkEngine *engine,
+					     const gchar *property_name,
+					     GVariant *property_value);
+
+static GVariant *
+pk_engine_get_queue_depth (PkEngine *engine)
+{
+	GVariantBuilder builder;
+	guint depth;
+	guint i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{su}"));
+	for (i = PK_ROLE_ENUM_UNKNOWN + 1; i < PK_ROLE_ENUM_LAST; i++) {
+		depth = pk_scheduler_get_queue_depth (engine->priv->scheduler, i);
+		if (depth == 0)
+			continue;
+		g_variant_builder_add (&builder, "{su}",
+				       pk_role_enum_to_string (i), depth);
+	}
+	return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+pk_engine_get_queue_wait_time (PkEngine *engine)
+{
+	GVariantBuilder builder;
+	guint wait;
+	guint i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{su}"));
+	for (i = PK_ROLE_ENUM_UNKNOWN + 1; i < PK_ROLE_ENUM_LAST; i++) {
+		wait = pk_scheduler_get_queue_wait (engine->priv->scheduler, i);
+		if (wait == 0)
+			continue;
+		g_variant_builder_add (&builder, "{su}",
+				       pk_role_enum_to_string (i), wait);
+	}
+	return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+pk_engine_get_phase_time_histograms (PkEngine *engine)
+{
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sau}}"));
+	for (guint i = PK_ROLE_ENUM_UNKNOWN + 1; i < PK_ROLE_ENUM_LAST; i++) {
+		GVariantBuilder intervals;
+		gboolean found = FALSE;
+
+		g_variant_builder_init (&intervals, G_VARIANT_TYPE ("a{sau}"));
+		for (guint j = 0; j < PK_SCHEDULER_INTERVAL_LAST; j++) {
+			const guint *histogram;
+			guint total = 0;
+
+			histogram = pk_scheduler_get_histogram (engine->priv->scheduler, i, j);
+			for (guint k = 0; k < PK_SCHEDULER_HISTOGRAM_BUCKETS; k++)
+				total += histogram[k];
+			if (total == 0)
+				continue;
+			g_variant_builder_add (&intervals, "{s@au}",
+					       pk_scheduler_interval_to_string (j),
+					       g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+									  histogram,
+									  PK_SCHEDULER_HISTOGRAM_BUCKETS,
+									  sizeof (guint32)));
+			found = TRUE;
+		}
+		if (!found) {
+			g_variant_builder_clear (&intervals);
+			continue;
+		}
+		g_variant_builder_add (&builder, "{sa{sau}}",
+				       pk_role_enum_to_string (i), &intervals);
+	}
+	return g_variant_builder_end (&builder);
+}
+
+static GVariant *
+pk_engine_get_result_cache_stats (PkEngine *engine)
+{
+	GVariantBuilder builder;
+	guint64 hits, misses, evictions, invalidations;
+	guint entries;
+	gsize size;
+
+	pk_result_cache_get_stats (engine->priv->result_cache,
+				   &hits, &misses, &evictions,
+				   &invalidations, &entries, &size);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+	g_variant_builder_add (&builder, "{st}", "hits", hits);
+	g_variant_builder_add (&builder, "{st}", "misses", misses);
+	g_variant_builder_add (&builder, "{st}", "evictions", evictions);
+	g_variant_builder_add (&builder, "{st}", "invalidations", invalidations);
+	g_variant_builder_add (&builder, "{st}", "entries", (guint64) entries);
+	g_variant_builder_add (&builder, "{st}", "size", (guint64) size);
+	return g_variant_builder_end (&builder);
+}
+
+static void
+pk_engine_metrics_add_header (GString *str,
+			      const gchar *name,
+			      const gchar *type,
+			      const gchar *help)
+{
+	g_string_append_printf (str, "# HELP packagekit_%s %s\n", name, help);
+	g_string_append_printf (str, "# TYPE packagekit_%s %s\n", name, type);
+}
+
+static void
+pk_engine_metrics_add_histograms (PkEngine *engine, GString *str)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	pk_engine_metrics_add_header (str, "transaction_phase_seconds", "histogram",
+				      "Time finished transactions spent between two phases.");
+	for (guint i = PK_ROLE_ENUM_UNKNOWN + 1; i < PK_ROLE_ENUM_LAST; i++) {
+		for (guint j = 0; j < PK_SCHEDULER_INTERVAL_LAST; j++) {
+			const guint *histogram;
+			g_autofree gchar *labels = NULL;
+			guint64 count = 0;
+
+			histogram = pk_scheduler_get_histogram (engine->priv->scheduler, i, j);
+			for (guint k = 0; k < PK_SCHEDULER_HISTOGRAM_BUCKETS; k++)
+				count += histogram[k];
+			if (count == 0)
+				continue;
+
+			/* the buckets are cumulative, and bucket k holds times
+			 * under 2^k ms */
+			labels = g_strdup_printf ("role=\"%s\",interval=\"%s\"",
+						  pk_role_enum_to_string (i),
+						  pk_scheduler_interval_to_string (j));
+			count = 0;
+			for (guint k = 0; k < PK_SCHEDULER_HISTOGRAM_BUCKETS - 1; k++) {
+				count += histogram[k];
+				g_ascii_formatd (buf, sizeof (buf), "%g", (gdouble) (1u << k) / 1000);
+				g_string_append_printf (str,
+							"packagekit_transaction_phase_seconds_bucket{%s,le=\"%s\"} %" G_GUINT64_FORMAT "\n",
+							labels, buf, count);
+			}
+			count += histogram[PK_SCHEDULER_HISTOGRAM_BUCKETS - 1];
+			g_string_append_printf (str,
+						"packagekit_transaction_phase_seconds_bucket{%s,le=\"+Inf\"} %" G_GUINT64_FORMAT "\n",
+						labels, count);
+			g_ascii_formatd (buf, sizeof (buf), "%.6f",
+					 (gdouble) pk_scheduler_get_histogram_sum (engine->priv->scheduler, i, j) / G_USEC_PER_SEC);
+			g_string_append_printf (str, "packagekit_transaction_phase_seconds_sum{%s} %s\n",
+						labels, buf);
+			g_string_append_printf (str, "packagekit_transaction_phase_seconds_count{%s} %" G_GUINT64_FORMAT "\n",
+						labels, count);
+		}
+	}
+}
+
+/* metric names may only use [a-zA-Z0-9_:] after the packagekit_ prefix */
+static gchar *
+pk_engine_metrics_sanitize_name (const gchar *name)
+{
+	gchar *tmp = g_strdup (name);
+	for (gchar *p = tmp; *p != '\0'; p++) {
+		if (!g_ascii_isalnum (*p) && *p != '_' && *p != ':')
+			*p = '_';
+	}
+	return tmp;
+}
+
+/* label values are quoted, so only the quote, backslash and newline are escaped */
+static void
+pk_engine_metrics_append_label_value (GString *str, const gchar *value)
+{
+	for (const gchar *p = value; *p != '\0'; p++) {
+		if (*p == '\\' || *p == '"')
+			g_string_append_c (str, '\\');
+		if (*p == '\n')
+			g_string_append (str, "\\n");
+		else
+			g_string_append_c (str, *p);
+	}
+}
+
+/**
+ * pk_engine_metrics_add_backend:
+ * @str: the metrics being built
+ * @backend_name: the name of the backend
+ * @metrics: the a{st} counters from pk_backend_get_metrics()
+ *
+ * Appends the counters of the backend, whose names are not trusted to be
+ * valid in the exposition format. Names that are the same once sanitized
+ * get a numbered suffix.
+ **/
+void
+pk_engine_metrics_add_backend (GString *str,
+			       const gchar *backend_name,
+			       GVariant *metrics)
+{
+	GVariantIter iter;
+	const gchar *name;
+	guint64 value;
+	g_autoptr(GHashTable) names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_variant_iter_init (&iter, metrics);
+	while (g_variant_iter_next (&iter, "{&st}", &name, &value)) {
+		g_autofree gchar *name_safe = NULL;
+
+		if (name[0] == '\0')
+			continue;
+		name_safe = pk_engine_metrics_sanitize_name (name);
+
+		/* names that only differ in the replaced characters would
+		 * otherwise give the same metric twice */
+		if (g_hash_table_contains (names, name_safe)) {
+			g_autofree gchar *base = g_steal_pointer (&name_safe);
+			for (guint i = 2; name_safe == NULL || g_hash_table_contains (names, name_safe); i++) {
+				g_free (name_safe);
+				name_safe = g_strdup_printf ("%s_%u", base, i);
+			}
+		}
+		g_hash_table_add (names, g_strdup (name_safe));
+		g_string_append_printf (str, "# TYPE packagekit_backend_%s untyped\n", name_safe);
+		g_string_append_printf (str, "packagekit_backend_%s{backend=\"", name_safe);
+		pk_engine_metrics_append_label_value (str, backend_name);
+		g_string_append_printf (str, "\"} %" G_GUINT64_FORMAT "\n", value);
+	}
+}
+
+/* counters and gauges in the Prometheus text exposition format */
+static gchar *
+pk_engine_get_metrics (PkEngine *engine)
+{
+	GString *str = g_string_new (NULL);
+	guint64 hits, misses, evictions, invalidations;
+	guint64 messages, bytes;
+	guint entries;
+	gsize size;
+	g_autoptr(GVariant) backend_metrics = NULL;
+
+	/* transactions */
+	pk_engine_metrics_add_header (str, "transactions_total", "counter",
+				      "Finished transactions by role and exit code.");
+	for (guint i = PK_ROLE_ENUM_UNKNOWN + 1; i < PK_ROLE_ENUM_LAST; i++) {
+		for (guint j = 0; j < PK_EXIT_ENUM_LAST; j++) {
+			guint finished = pk_scheduler_get_finished (engine->priv->scheduler, i, j);
+			if (finished == 0)
+				continue;
+			g_string_append_printf (str, "packagekit_transactions_total{role=\"%s\",exit=\"%s\"} %u\n",
+						pk_role_enum_to_string (i),
+						pk_exit_enum_to_string (j),
+						finished);
+		}
+	}
+	pk_engine_metrics_add_header (str, "packages_emitted_total", "counter",
+				      "Packages sent to clients by finished transactions.");
+	for (guint i = PK_ROLE_ENUM_UNKNOWN + 1; i < PK_ROLE_ENUM_LAST; i++) {
+		guint64 packages = pk_scheduler_get_packages_emitted (engine->priv->scheduler, i);
+		if (packages == 0)
+			continue;
+		g_string_append_printf (str, "packagekit_packages_emitted_total{role=\"%s\"} %" G_GUINT64_FORMAT "\n",
+					pk_role_enum_to_string (i), packages);
+	}
+	pk_engine_metrics_add_histograms (engine, str);
+
+	/* scheduler */
+	pk_engine_metrics_add_header (str, "transactions", "gauge",
+				      "Transactions known to the scheduler.");
+	g_string_append_printf (str, "packagekit_transactions %u\n",
+				pk_scheduler_get_size (engine->priv->scheduler));
+	pk_engine_metrics_add_header (str, "queue_depth", "gauge",
+				      "Transactions waiting to run by role.");
+	for (guint i = PK_ROLE_ENUM_UNKNOWN + 1; i < PK_ROLE_ENUM_LAST; i++) {
+		guint depth = pk_scheduler_get_queue_depth (engine->priv->scheduler, i);
+		if (depth == 0)
+			continue;
+		g_string_append_printf (str, "packagekit_queue_depth{role=\"%s\"} %u\n",
+					pk_role_enum_to_string (i), depth);
+	}
+
+	/* bus */
+	g_mutex_lock (&engine->priv->metrics_mutex);
+	messages = engine->priv->bus_messages_sent;
+	bytes = engine->priv->bus_bytes_sent;
+	g_mutex_unlock (&engine->priv->metrics_mutex);
+	pk_engine_metrics_add_header (str, "bus_messages_sent_total", "counter",
+				      "Messages sent on the system bus.");
+	g_string_append_printf (str, "packagekit_bus_messages_sent_total %" G_GUINT64_FORMAT "\n", messages);
+	pk_engine_metrics_add_header (str, "bus_bytes_sent_total", "counter",
+				      "Bytes of message bodies sent on the system bus.");
+	g_string_append_printf (str, "packagekit_bus_bytes_sent_total %" G_GUINT64_FORMAT "\n", bytes);
+
+	/* result cache */
+	pk_result_cache_get_stats (engine->priv->result_cache,
+				   &hits, &misses, &evictions,
+				   &invalidations, &entries, &size);
+	pk_engine_metrics_add_header (str, "result_cache_hits_total", "counter",
+				      "Queries answered from the result cache.");
+	g_string_append_printf (str, "packagekit_result_cache_hits_total %" G_GUINT64_FORMAT "\n", hits);
+	pk_engine_metrics_add_header (str, "result_cache_misses_total", "counter",
+				      "Cacheable queries that had to run in the backend.");
+	g_string_append_printf (str, "packagekit_result_cache_misses_total %" G_GUINT64_FORMAT "\n", misses);
+	pk_engine_metrics_add_header (str, "result_cache_evictions_total", "counter",
+				      "Results dropped to keep the cache under its size.");
+	g_string_append_printf (str, "packagekit_result_cache_evictions_total %" G_GUINT64_FORMAT "\n", evictions);
+	pk_engine_metrics_add_header (str, "result_cache_invalidations_total", "counter",
+				      "Times the cache was emptied as the packages changed.");
+	g_string_append_printf (str, "packagekit_result_cache_invalidations_total %" G_GUINT64_FORMAT "\n", invalidations);
+	pk_engine_metrics_add_header (str, "result_cache_entries", "gauge",
+				      "Results in the cache.");
+	g_string_append_printf (str, "packagekit_result_cache_entries %u\n", entries);
+	pk_engine_metrics_add_header (str, "result_cache_bytes", "gauge",
+				      "Memory used by the results in the cache.");
+	g_string_append_printf (str, "packagekit_result_cache_bytes %" G_GSIZE_FORMAT "\n", size);
+
+	/* anything the backend counts itself */
+	backend_metrics = pk_backend_get_metrics (engine->priv->backend);
+	if (backend_metrics != NULL) {
+		g_variant_ref_sink (backend_metrics);
+		pk_engine_metrics_add_backend (str, engine->priv->backend_name, backend_metrics);
+	}
+	return g_string_free (str, FALSE);
+}
+
+/* runs in the GDBus worker thread for every message */
+static GDBusMessage *
+pk_engine_metrics_filter_cb (GDBusConnection *connection,
+			     GDBusMessage *message,
+			     gboolean incoming,
+			     gpointer user_data)
+{
+	PkEngine *engine = PK_ENGINE (user_data);
+	GVariant *body;
+
+	if (incoming)
+		return message;
+	body = g_dbus_message_get_body (message);
+	g_mutex_lock (&engine->priv->metrics_mutex);
+	engine->priv->bus_messages_sent++;
+	if (body != NULL)
+		engine->priv->bus_bytes_sent += g_variant_get_size (body);
+	g_mutex_unlock (&engine->priv->metrics_mutex);
+	return message;
+}
 
 static void
 pk_engine_set_inhibited (PkEngine *engine, gboolean inhibited)
@@ -180,6 +532,12 @@ pk_engine_scheduler_changed_cb (PkScheduler *scheduler, PkEngine *engine)
 				       g_variant_new ("(^a&s)",
 						      transaction_list),
 				       NULL);
+	pk_engine_emit_property_changed (engine,
+					 "QueueDepth",
+					 pk_engine_get_queue_depth (engine));
+	pk_engine_emit_property_changed (engine,
+					 "QueueWaitTime",
+					 pk_engine_get_queue_wait_time (engine));
 	pk_engine_reset_timer (engine);
 }
 
@@ -328,6 +686,9 @@ pk_engine_backend_installed_changed_cb (PkBackend *backend, PkEngine *engine)
 {
 	g_return_if_fail (PK_IS_ENGINE (engine));
 
+	/* cached results may now be wrong */
+	pk_result_cache_invalidate (engine->priv->result_cache);
+
 	g_debug ("emitting InstalledChanged");
 	g_dbus_connection_emit_signal (engine->priv->connection,
 				       NULL,
@@ -343,6 +704,9 @@ pk_engine_backend_repo_list_changed_cb (PkBackend *backend, PkEngine *engine)
 {
 	g_return_if_fail (PK_IS_ENGINE (engine));
 
+	/* cached results may now be wrong */
+	pk_result_cache_invalidate (engine->priv->result_cache);
+
 	g_debug ("emitting RepoListChanged");
 	g_dbus_connection_emit_signal (engine->priv->connection,
 				       NULL,
@@ -358,6 +722,9 @@ pk_engine_backend_updates_changed_cb (PkBackend *backend, PkEngine *engine)
 {
 	g_return_if_fail (PK_IS_ENGINE (engine));
 
+	/* cached results may now be wrong */
+	pk_result_cache_invalidate (engine->priv->result_cache);
+
 	g_debug ("emitting UpdatesChanged");
 	g_dbus_connection_emit_signal (engine->priv->connection,
 				       NULL,
@@ -983,6 +1350,14 @@ pk_engine_setup_file_monitors (PkEngine *engine)
 			  G_CALLBACK (pk_engine_offline_upgrade_file_changed_cb), engine);
 }
 
+/* unset or negative values mean no limit */
+static guint
+pk_engine_get_conf_limit (PkEngine *engine, const gchar *key)
+{
+	gint value = g_key_file_get_integer (engine->priv->conf, "Daemon", key, NULL);
+	return (guint) MAX (value, 0);
+}
+
 gboolean
 pk_engine_load_backend (PkEngine *engine, GError **error)
 {
@@ -996,6 +1371,10 @@ pk_engine_load_backend (PkEngine *engine, GError **error)
 		return FALSE;
 	if (!pk_transaction_db_load (engine->priv->transaction_db, error))
 		return FALSE;
+	pk_transaction_db_set_retention (engine->priv->transaction_db,
+					 pk_engine_get_conf_limit (engine, "TransactionHistoryMaxAge"),
+					 pk_engine_get_conf_limit (engine, "TransactionHistoryMaxRows"),
+					 (guint64) pk_engine_get_conf_limit (engine, "TransactionHistoryMaxSize") * 1024 * 1024);
 
 	/* create a new backend so we can get the static stuff */
 	engine->priv->roles = pk_backend_get_roles (engine->priv->backend);
@@ -1115,6 +1494,24 @@ pk_engine_daemon_get_property (GDBusConnection *connection_, const gchar *sender
 		return g_variant_new_uint32 (engine->priv->network_state);
 	if (g_strcmp0 (property_name, "DistroId") == 0)
 		return _g_variant_new_maybe_string (engine->priv->distro_id);
+	if (g_strcmp0 (property_name, "QueueDepth") == 0)
+		return pk_engine_get_queue_depth (engine);
+	if (g_strcmp0 (property_name, "QueueWaitTime") == 0)
+		return pk_engine_get_queue_wait_time (engine);
+	if (g_strcmp0 (property_name, "ResultCacheStats") == 0)
+		return pk_engine_get_result_cache_stats (engine);
+	if (g_strcmp0 (property_name, "PhaseTimeHistograms") == 0) {
+		/* the same policy as GetMetrics, as both show the same times */
+		if (pk_dbus_get_uid (engine->priv->dbus, sender) != 0) {
+			g_set_error (error,
+				     PK_ENGINE_ERROR,
+				     PK_ENGINE_ERROR_REFUSED_BY_POLICY,
+				     "only root can get property '%s'",
+				     property_name);
+			return NULL;
+		}
+		return pk_engine_get_phase_time_histograms (engine);
+	}
 
 	/* return an error */
 	g_set_error (error,
@@ -1125,173 +1522,81 @@ pk_engine_daemon_get_property (GDBusConnection *connection_, const gchar *sender
 	return NULL;
 }
 
-static gboolean
-pk_engine_package_name_in_strv (gchar **strv, PkPackage *pkg)
-{
-	guint i;
-	for (i = 0; strv[i] != NULL; i++) {
-		if (g_strcmp0 (strv[i], pk_package_get_name (pkg)) == 0)
-			return TRUE;
-	}
-	return FALSE;
-}
-
 static GVariant *
-pk_engine_get_package_history_pkg (PkTransactionPast *item, PkPackage *pkg)
+pk_engine_get_package_history_pkg (PkTransactionDbHistoryItem *item)
 {
 	GVariantBuilder builder;
+	g_auto(GStrv) split = NULL;
+
+	split = pk_package_id_split (item->package_id);
+	if (split == NULL)
+		return NULL;
 	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
 	g_variant_builder_add (&builder, "{sv}", "info",
-			       g_variant_new_uint32 (pk_package_get_info (pkg)));
+			       g_variant_new_uint32 (item->info));
 	g_variant_builder_add (&builder, "{sv}", "source",
-			       g_variant_new_string (pk_package_get_data (pkg)));
+			       g_variant_new_string (split[PK_PACKAGE_ID_DATA]));
 	g_variant_builder_add (&builder, "{sv}", "version",
-			       g_variant_new_string (pk_package_get_version (pkg)));
+			       g_variant_new_string (split[PK_PACKAGE_ID_VERSION]));
 	g_variant_builder_add (&builder, "{sv}", "timestamp",
-			       g_variant_new_uint64 (pk_transaction_past_get_timestamp (item)));
+			       g_variant_new_uint64 (item->timestamp));
 	g_variant_builder_add (&builder, "{sv}", "user-id",
-			       g_variant_new_uint32 (pk_transaction_past_get_uid (item)));
+			       g_variant_new_uint32 (item->uid));
 	return g_variant_builder_end (&builder);
 }
 
-static gboolean
-pk_engine_is_package_history_interesing (PkPackage *package)
-{
-	gboolean ret;
-
-	switch (pk_package_get_info (package)) {
-	case PK_INFO_ENUM_INSTALLING:
-	case PK_INFO_ENUM_REMOVING:
-	case PK_INFO_ENUM_UPDATING:
-		ret = TRUE;
-		break;
-	default:
-		ret = FALSE;
-		break;
-	}
-	return ret;
-}
-
 static GVariant *
 pk_engine_get_package_history (PkEngine *engine,
 			       gchar **package_names,
 			       guint max_size,
 			       GError **error)
 {
-	const gchar *data;
-	const gchar *pkgname;
-	gboolean ret;
-	gchar *key;
-	gint64 timestamp;
-	GList *l;
-	GList *list;
-	GPtrArray *array = NULL;
-	guint i;
 	GVariantBuilder builder;
-	GVariant *value = NULL;
-	PkTransactionPast *item;
-	g_autoptr(GHashTable) deduplicate_hash = NULL;
 	g_autoptr(GHashTable) pkgname_hash = NULL;
-	g_autoptr(GList) keys = NULL;
-	g_autoptr(PkPackage) package_tmp = NULL;
-
-	list = pk_transaction_db_get_list (engine->priv->transaction_db, max_size);
-
-	/* simplify the loop */
-	if (max_size == 0)
-		max_size = G_MAXUINT;
 
-	pkgname_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
-	deduplicate_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	package_tmp = pk_package_new ();
-	for (l = list; l != NULL; l = l->next) {
-		g_auto(GStrv) package_lines = NULL;
-		item = PK_TRANSACTION_PAST (l->data);
-
-		/* ignore anything that failed */
-		if (!pk_transaction_past_get_succeeded (item))
-			continue;
+	/* each name is one indexed query */
+	pkgname_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{saa{sv}}"));
+	for (guint i = 0; package_names[i] != NULL; i++) {
+		gint64 timestamp_last = 0;
+		g_autoptr(GPtrArray) array = NULL;
+		g_autoptr(GPtrArray) values = NULL;
 
-		/* split up data */
-		data = pk_transaction_past_get_data (item);
-		if (data == NULL)
+		if (!g_hash_table_add (pkgname_hash, package_names[i]))
 			continue;
-		package_lines = g_strsplit (data, "\n", -1);
-		for (i = 0; package_lines[i] != NULL; i++) {
-			g_autoptr(GError) error_local = NULL;
-			ret = pk_package_parse (package_tmp,
-						package_lines[i],
-						&error_local);
-			if (!ret) {
-				g_warning ("Failed to parse package: '%s': %s",
-					   package_lines[i], error_local->message);
-				continue;
-			}
-
-			/* not the package we care about */
-			if (!pk_engine_package_name_in_strv (package_names, package_tmp))
-				continue;
-
-			/* not a state we care about */
-			if (!pk_engine_is_package_history_interesing (package_tmp))
-				continue;
+		array = pk_transaction_db_get_package_history (engine->priv->transaction_db,
+								package_names[i],
+								max_size);
+		values = g_ptr_array_new ();
+		for (guint j = 0; j < array->len; j++) {
+			PkTransactionDbHistoryItem *item = g_ptr_array_index (array, j);
+			GVariant *value;
 
 			/* transactions without a timestamp are not interesting */
-			timestamp = pk_transaction_past_get_timestamp (item);
-			if (timestamp == 0)
+			if (item->timestamp == 0)
 				continue;
 
 			/* de-duplicate the entry, in the case of multiarch */
-			key = g_strdup_printf ("%s-%" G_GINT64_FORMAT,
-					       pk_package_get_name (package_tmp),
-					       timestamp);
-			if (g_hash_table_lookup (deduplicate_hash, key) != NULL) {
-				g_free (key);
-				continue;
-			}
-			g_hash_table_insert (deduplicate_hash, key, package_lines[i]);
-
-			/* get the blob for this data item */
-			value = pk_engine_get_package_history_pkg (item, package_tmp);
-			if (value == NULL)
+			if (item->timestamp == timestamp_last)
 				continue;
+			timestamp_last = item->timestamp;
 
-			/* find the array */
-			pkgname = pk_package_get_name (package_tmp);
-			array = g_hash_table_lookup (pkgname_hash, pkgname);
-			if (array == NULL) {
-				array = g_ptr_array_new ();
-				g_hash_table_insert (pkgname_hash,
-						     g_strdup (pkgname),
-						     array);
-			}
-			g_ptr_array_add (array, value);
+			value = pk_engine_get_package_history_pkg (item);
+			if (value != NULL)
+				g_ptr_array_add (values, value);
 		}
-	}
-
-	/* no history returns an empty array */
-	if (g_hash_table_size (pkgname_hash) == 0) {
-		value = g_variant_new_array (G_VARIANT_TYPE ("{saa{sv}}"), NULL, 0);
-		goto out;
-	}
+		if (values->len == 0)
+			continue;
 
-	/* we have a hash of pkgname:GPtrArray where the GPtrArray is an array
-	 * of GVariants of type a{sv} */
-	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
-	keys = g_hash_table_get_keys (pkgname_hash);
-	for (l = keys; l != NULL; l = l->next) {
-		pkgname = l->data;
-		array = g_hash_table_lookup (pkgname_hash, pkgname);
 		/* create aa{sv} */
-		value = g_variant_new_array (NULL,
-					     (GVariant * const *) array->pdata,
-					     MIN (array->len, max_size));
-		g_variant_builder_add (&builder, "{s@aa{sv}}", pkgname, value);
+		g_variant_builder_add (&builder, "{s@aa{sv}}", package_names[i],
+				       g_variant_new_array (NULL,
+							    (GVariant * const *) values->pdata,
+							    values->len));
 	}
-	value = g_variant_builder_end (&builder);
-out:
-	g_list_free_full (list, (GDestroyNotify) g_object_unref);
-	return value;
+
+	/* no history returns an empty array */
+	return g_variant_builder_end (&builder);
 }
 
 static void
@@ -1336,6 +1641,29 @@ pk_engine_daemon_method_call (GDBusConnection *connection_, const gchar *sender,
 		return;
 	}
 
+	if (g_strcmp0 (method_name, "GetMetrics") == 0) {
+		if (!engine->priv->metrics_enabled) {
+			g_dbus_method_invocation_return_error (invocation,
+							       PK_ENGINE_ERROR,
+							       PK_ENGINE_ERROR_NOT_SUPPORTED,
+							       "metrics are not enabled in PackageKit.conf");
+			return;
+		}
+
+		/* the counters show what other users have been doing */
+		if (pk_dbus_get_uid (engine->priv->dbus, sender) != 0) {
+			g_dbus_method_invocation_return_error (invocation,
+							       PK_ENGINE_ERROR,
+							       PK_ENGINE_ERROR_REFUSED_BY_POLICY,
+							       "only root can get the metrics");
+			return;
+		}
+		data = pk_engine_get_metrics (engine);
+		value = g_variant_new ("(s)", data);
+		g_dbus_method_invocation_return_value (invocation, value);
+		return;
+	}
+
 	if (g_strcmp0 (method_name, "GetPackageHistory") == 0) {
 		g_autofree gchar **package_names = NULL;
 
@@ -1808,6 +2136,14 @@ pk_engine_on_bus_acquired_cb (GDBusConnection *connection,
 	/* save copy for emitting signals */
 	engine->priv->connection = g_object_ref (connection);
 
+	/* count what we send */
+	if (engine->priv->metrics_enabled) {
+		engine->priv->metrics_filter_id =
+			g_dbus_connection_add_filter (connection,
+						      pk_engine_metrics_filter_cb,
+						      engine, NULL);
+	}
+
 	/* connect to logind */
 	g_dbus_proxy_new (connection,
 			  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
@@ -1865,6 +2201,7 @@ pk_engine_init (PkEngine *engine)
 	g_autofree gchar *filename = NULL;
 
 	engine->priv = PK_ENGINE_GET_PRIVATE (engine);
+	g_mutex_init (&engine->priv->metrics_mutex);
 
 	/* load introspection */
 	engine->priv->introspection = pk_load_introspection (PK_DBUS_INTERFACE ".xml",
@@ -1905,6 +2242,9 @@ pk_engine_init (PkEngine *engine)
 	/* we use a trasaction db to store old transactions */
 	engine->priv->transaction_db = pk_transaction_db_new ();
 
+	/* shared with the transactions, and sized from the config file */
+	engine->priv->result_cache = pk_result_cache_new ();
+
 	/* own the object */
 	engine->priv->owner_id =
 		g_bus_own_name (G_BUS_TYPE_SYSTEM,
@@ -1949,6 +2289,9 @@ pk_engine_finalize (GObject *object)
 
 	if (engine->priv->introspection != NULL)
 		g_dbus_node_info_unref (engine->priv->introspection);
+	if (engine->priv->metrics_filter_id != 0)
+		g_dbus_connection_remove_filter (engine->priv->connection,
+						 engine->priv->metrics_filter_id);
 	if (engine->priv->connection != NULL)
 		g_object_unref (engine->priv->connection);
 
@@ -1966,6 +2309,7 @@ pk_engine_finalize (GObject *object)
 	g_object_unref (engine->priv->monitor_offline_upgrade);
 	g_object_unref (engine->priv->scheduler);
 	g_object_unref (engine->priv->transaction_db);
+	g_object_unref (engine->priv->result_cache);
 	if (engine->priv->authority != NULL)
 		g_object_unref (engine->priv->authority);
 	g_object_unref (engine->priv->backend);
@@ -1973,6 +2317,7 @@ pk_engine_finalize (GObject *object)
 	g_object_unref (engine->priv->dbus);
 	g_strfreev (engine->priv->mime_types);
 	g_free (engine->priv->distro_id);
+	g_mutex_clear (&engine->priv->metrics_mutex);
 
 	G_OBJECT_CLASS (pk_engine_parent_class)->finalize (object);
 }
@@ -1981,8 +2326,21 @@ PkEngine *
 pk_engine_new (GKeyFile *conf)
 {
 	PkEngine *engine;
+	gint cache_size;
+	g_autoptr(GError) error = NULL;
+
 	engine = g_object_new (PK_TYPE_ENGINE, NULL);
 	engine->priv->conf = g_key_file_ref (conf);
+	engine->priv->metrics_enabled = g_key_file_get_boolean (conf, "Daemon", "EnableMetrics", NULL);
+
+	/* how much memory can we use to answer repeated queries? */
+	cache_size = g_key_file_get_integer (conf, "Daemon", "ResultCacheSize", &error);
+	if (error != NULL)
+		cache_size = PK_ENGINE_RESULT_CACHE_SIZE_DEFAULT;
+	if (cache_size > 0) {
+		pk_result_cache_set_max_size (engine->priv->result_cache,
+					      (gsize) cache_size * 1024 * 1024);
+	}
 	engine->priv->backend = pk_backend_new (engine->priv->conf);
 	g_signal_connect (engine->priv->backend, "installed-changed",
 			  G_CALLBACK (pk_engine_backend_installed_changed_cb), engine);
@@ -77,5 +77,8 @@ PkEngine	*pk_engine_new				(GKeyFile		*conf);
 guint		 pk_engine_get_seconds_idle		(PkEngine	*engine);
 gboolean	 pk_engine_load_backend			(PkEngine	*engine,
 							 GError		**error);
+void		 pk_engine_metrics_add_backend		(GString	*str,
+							 const gchar	*backend_name,
+							 GVariant	*metrics);
 
 #endif /* __PK_ENGINE_H */
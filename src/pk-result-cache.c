@@ -0,0 +1,403 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <glib.h>
+#include <packagekit-glib2/pk-details.h>
+#include <packagekit-glib2/pk-files.h>
+#include <packagekit-glib2/pk-package.h>
+#include <packagekit-glib2/pk-update-detail.h>
+
+#include "pk-result-cache.h"
+
+#define PK_RESULT_CACHE_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_RESULT_CACHE, PkResultCachePrivate))
+
+/* the most result sets we keep, however small they are */
+#define PK_RESULT_CACHE_MAX_ENTRIES		256
+
+/* rough per-object overhead used when estimating memory use */
+#define PK_RESULT_CACHE_ITEM_OVERHEAD		128 /* bytes */
+
+typedef struct {
+	gchar		*key;
+	PkResults	*results;
+	gsize		 size;
+	GList		*link;
+} PkResultCacheItem;
+
+struct PkResultCachePrivate
+{
+	GHashTable		*hash;		/* key:PkResultCacheItem */
+	GQueue			*lru;		/* most recently used first */
+	gsize			 size;
+	gsize			 max_size;
+	guint			 generation;
+	guint64			 hits;
+	guint64			 misses;
+	guint64			 evictions;
+	guint64			 invalidations;
+};
+
+static gpointer pk_result_cache_object = NULL;
+
+G_DEFINE_TYPE (PkResultCache, pk_result_cache, G_TYPE_OBJECT)
+
+static void
+pk_result_cache_item_free (PkResultCacheItem *item)
+{
+	g_free (item->key);
+	g_object_unref (item->results);
+	g_free (item);
+}
+
+/**
+ * pk_result_cache_role_is_cacheable:
+ *
+ * Return value: %TRUE if the results of @role only depend on the package
+ * databases, and so can be kept until the backend reports they changed
+ **/
+gboolean
+pk_result_cache_role_is_cacheable (PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_CATEGORIES:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_REPO_LIST:
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+	case PK_ROLE_ENUM_RESOLVE:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static gsize
+pk_result_cache_estimate_size (PkResults *results)
+{
+	gsize size = PK_RESULT_CACHE_ITEM_OVERHEAD;
+	guint i;
+	g_autoptr(GPtrArray) packages = NULL;
+	g_autoptr(GPtrArray) details = NULL;
+	g_autoptr(GPtrArray) files = NULL;
+	g_autoptr(GPtrArray) update_details = NULL;
+	g_autoptr(GPtrArray) categories = NULL;
+	g_autoptr(GPtrArray) repo_details = NULL;
+
+	/* the strings dominate, so count those and guess the rest */
+	packages = pk_results_get_package_array (results);
+	for (i = 0; i < packages->len; i++) {
+		PkPackage *item = g_ptr_array_index (packages, i);
+		size += PK_RESULT_CACHE_ITEM_OVERHEAD;
+		size += strlen (pk_package_get_id (item));
+		if (pk_package_get_summary (item) != NULL)
+			size += strlen (pk_package_get_summary (item));
+	}
+	details = pk_results_get_details_array (results);
+	for (i = 0; i < details->len; i++) {
+		PkDetails *item = g_ptr_array_index (details, i);
+		size += PK_RESULT_CACHE_ITEM_OVERHEAD * 2;
+		if (pk_details_get_description (item) != NULL)
+			size += strlen (pk_details_get_description (item));
+	}
+	files = pk_results_get_files_array (results);
+	for (i = 0; i < files->len; i++) {
+		PkFiles *item = g_ptr_array_index (files, i);
+		gchar **filenames = pk_files_get_files (item);
+		size += PK_RESULT_CACHE_ITEM_OVERHEAD;
+		for (guint j = 0; filenames != NULL && filenames[j] != NULL; j++)
+			size += strlen (filenames[j]) + sizeof (gchar *);
+	}
+	update_details = pk_results_get_update_detail_array (results);
+	for (i = 0; i < update_details->len; i++) {
+		PkUpdateDetail *item = g_ptr_array_index (update_details, i);
+		size += PK_RESULT_CACHE_ITEM_OVERHEAD * 4;
+		if (pk_update_detail_get_update_text (item) != NULL)
+			size += strlen (pk_update_detail_get_update_text (item));
+	}
+	categories = pk_results_get_category_array (results);
+	size += categories->len * PK_RESULT_CACHE_ITEM_OVERHEAD * 2;
+	repo_details = pk_results_get_repo_detail_array (results);
+	size += repo_details->len * PK_RESULT_CACHE_ITEM_OVERHEAD * 2;
+	return size;
+}
+
+static void
+pk_result_cache_remove_item (PkResultCache *cache, PkResultCacheItem *item)
+{
+	PkResultCachePrivate *priv = cache->priv;
+
+	priv->size -= item->size;
+	g_queue_delete_link (priv->lru, item->link);
+
+	/* this frees the item */
+	g_hash_table_remove (priv->hash, item->key);
+}
+
+static void
+pk_result_cache_evict (PkResultCache *cache, gsize size_needed)
+{
+	PkResultCachePrivate *priv = cache->priv;
+
+	/* drop the least recently used until the new item fits */
+	while (priv->lru->length > 0 &&
+	       (priv->size + size_needed > priv->max_size ||
+		priv->lru->length >= PK_RESULT_CACHE_MAX_ENTRIES)) {
+		PkResultCacheItem *item = g_queue_peek_tail (priv->lru);
+		g_debug ("evicting cached results for %s", item->key);
+		pk_result_cache_remove_item (cache, item);
+		priv->evictions++;
+	}
+}
+
+/**
+ * pk_result_cache_set_max_size:
+ * @max_size: the memory limit in bytes, or 0 to disable the cache
+ **/
+void
+pk_result_cache_set_max_size (PkResultCache *cache, gsize max_size)
+{
+	g_return_if_fail (PK_IS_RESULT_CACHE (cache));
+
+	cache->priv->max_size = max_size;
+	pk_result_cache_evict (cache, 0);
+}
+
+/**
+ * pk_result_cache_get_generation:
+ *
+ * Gets a counter that is incremented each time the cache is invalidated.
+ * Callers should read this before starting the backend and pass it to
+ * pk_result_cache_insert() so results computed from an old database
+ * are never stored.
+ **/
+guint
+pk_result_cache_get_generation (PkResultCache *cache)
+{
+	g_return_val_if_fail (PK_IS_RESULT_CACHE (cache), 0);
+	return cache->priv->generation;
+}
+
+/**
+ * pk_result_cache_lookup:
+ * @key: a key from pk_transaction_get_coalesce_key()
+ *
+ * Return value: (transfer full): the cached results, or %NULL
+ **/
+PkResults *
+pk_result_cache_lookup (PkResultCache *cache, const gchar *key)
+{
+	PkResultCacheItem *item;
+	PkResultCachePrivate *priv;
+
+	g_return_val_if_fail (PK_IS_RESULT_CACHE (cache), NULL);
+	g_return_val_if_fail (key != NULL, NULL);
+
+	priv = cache->priv;
+	if (priv->max_size == 0)
+		return NULL;
+	item = g_hash_table_lookup (priv->hash, key);
+	if (item == NULL) {
+		priv->misses++;
+		return NULL;
+	}
+
+	/* move to the front */
+	g_queue_unlink (priv->lru, item->link);
+	g_queue_push_head_link (priv->lru, item->link);
+	priv->hits++;
+	return g_object_ref (item->results);
+}
+
+/**
+ * pk_result_cache_insert:
+ * @key: a key from pk_transaction_get_coalesce_key()
+ * @generation: the value of pk_result_cache_get_generation() when the
+ * backend was started
+ * @results: the results of a successful transaction
+ *
+ * Return value: %TRUE if the results were stored
+ **/
+gboolean
+pk_result_cache_insert (PkResultCache *cache,
+			const gchar *key,
+			guint generation,
+			PkResults *results)
+{
+	PkResultCacheItem *item;
+	PkResultCachePrivate *priv;
+	gsize size;
+
+	g_return_val_if_fail (PK_IS_RESULT_CACHE (cache), FALSE);
+	g_return_val_if_fail (key != NULL, FALSE);
+	g_return_val_if_fail (PK_IS_RESULTS (results), FALSE);
+
+	priv = cache->priv;
+	if (priv->max_size == 0)
+		return FALSE;
+
+	/* the database changed while the backend was running */
+	if (generation != priv->generation) {
+		g_debug ("not caching stale results for %s", key);
+		return FALSE;
+	}
+
+	/* never let one huge result flush everything else */
+	size = pk_result_cache_estimate_size (results);
+	if (size > priv->max_size / 2) {
+		g_debug ("not caching %" G_GSIZE_FORMAT " bytes for %s", size, key);
+		return FALSE;
+	}
+
+	/* replace any existing entry */
+	item = g_hash_table_lookup (priv->hash, key);
+	if (item != NULL)
+		pk_result_cache_remove_item (cache, item);
+	pk_result_cache_evict (cache, size);
+
+	item = g_new0 (PkResultCacheItem, 1);
+	item->key = g_strdup (key);
+	item->results = g_object_ref (results);
+	item->size = size;
+	g_queue_push_head (priv->lru, item);
+	item->link = priv->lru->head;
+	g_hash_table_insert (priv->hash, item->key, item);
+	priv->size += size;
+	return TRUE;
+}
+
+/**
+ * pk_result_cache_invalidate:
+ *
+ * Drops all cached results, and makes sure any results that are still being
+ * computed against the old package databases are not stored.
+ **/
+void
+pk_result_cache_invalidate (PkResultCache *cache)
+{
+	PkResultCachePrivate *priv;
+
+	g_return_if_fail (PK_IS_RESULT_CACHE (cache));
+
+	priv = cache->priv;
+	priv->generation++;
+	priv->invalidations++;
+	if (priv->lru->length == 0)
+		return;
+	g_debug ("invalidating %u cached results", priv->lru->length);
+	g_queue_clear (priv->lru);
+	g_hash_table_remove_all (priv->hash);
+	priv->size = 0;
+}
+
+/**
+ * pk_result_cache_get_stats:
+ *
+ * Gets the counters used to size the ResultCacheSize config value.
+ * Any of the out parameters may be %NULL.
+ **/
+void
+pk_result_cache_get_stats (PkResultCache *cache,
+			   guint64 *hits,
+			   guint64 *misses,
+			   guint64 *evictions,
+			   guint64 *invalidations,
+			   guint *entries,
+			   gsize *size)
+{
+	PkResultCachePrivate *priv;
+
+	g_return_if_fail (PK_IS_RESULT_CACHE (cache));
+
+	priv = cache->priv;
+	if (hits != NULL)
+		*hits = priv->hits;
+	if (misses != NULL)
+		*misses = priv->misses;
+	if (evictions != NULL)
+		*evictions = priv->evictions;
+	if (invalidations != NULL)
+		*invalidations = priv->invalidations;
+	if (entries != NULL)
+		*entries = priv->lru->length;
+	if (size != NULL)
+		*size = priv->size;
+}
+
+static void
+pk_result_cache_finalize (GObject *object)
+{
+	PkResultCache *cache;
+
+	g_return_if_fail (PK_IS_RESULT_CACHE (object));
+	cache = PK_RESULT_CACHE (object);
+
+	g_queue_free (cache->priv->lru);
+	g_hash_table_unref (cache->priv->hash);
+
+	G_OBJECT_CLASS (pk_result_cache_parent_class)->finalize (object);
+}
+
+static void
+pk_result_cache_class_init (PkResultCacheClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = pk_result_cache_finalize;
+
+	g_type_class_add_private (klass, sizeof (PkResultCachePrivate));
+}
+
+static void
+pk_result_cache_init (PkResultCache *cache)
+{
+	cache->priv = PK_RESULT_CACHE_GET_PRIVATE (cache);
+	cache->priv->hash = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   NULL,
+						   (GDestroyNotify) pk_result_cache_item_free);
+	cache->priv->lru = g_queue_new ();
+}
+
+/**
+ * pk_result_cache_new:
+ *
+ * Return value: the shared result cache, which is disabled until
+ * pk_result_cache_set_max_size() is called
+ **/
+PkResultCache *
+pk_result_cache_new (void)
+{
+	if (pk_result_cache_object != NULL) {
+		g_object_ref (pk_result_cache_object);
+	} else {
+		pk_result_cache_object = g_object_new (PK_TYPE_RESULT_CACHE, NULL);
+		g_object_add_weak_pointer (pk_result_cache_object, &pk_result_cache_object);
+	}
+	return PK_RESULT_CACHE (pk_result_cache_object);
+}
@@ -0,0 +1,76 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __PK_RESULT_CACHE_H
+#define __PK_RESULT_CACHE_H
+
+#include <glib-object.h>
+#include <packagekit-glib2/pk-enum.h>
+#include <packagekit-glib2/pk-results.h>
+
+G_BEGIN_DECLS
+
+#define PK_TYPE_RESULT_CACHE		(pk_result_cache_get_type ())
+#define PK_RESULT_CACHE(o)		(G_TYPE_CHECK_INSTANCE_CAST ((o), PK_TYPE_RESULT_CACHE, PkResultCache))
+#define PK_RESULT_CACHE_CLASS(k)	(G_TYPE_CHECK_CLASS_CAST((k), PK_TYPE_RESULT_CACHE, PkResultCacheClass))
+#define PK_IS_RESULT_CACHE(o)		(G_TYPE_CHECK_INSTANCE_TYPE ((o), PK_TYPE_RESULT_CACHE))
+#define PK_IS_RESULT_CACHE_CLASS(k)	(G_TYPE_CHECK_CLASS_TYPE ((k), PK_TYPE_RESULT_CACHE))
+#define PK_RESULT_CACHE_GET_CLASS(o)	(G_TYPE_INSTANCE_GET_CLASS ((o), PK_TYPE_RESULT_CACHE, PkResultCacheClass))
+
+typedef struct PkResultCachePrivate PkResultCachePrivate;
+
+typedef struct
+{
+	GObject			 parent;
+	PkResultCachePrivate	*priv;
+} PkResultCache;
+
+typedef struct
+{
+	GObjectClass		 parent_class;
+} PkResultCacheClass;
+
+#ifdef G_DEFINE_AUTOPTR_CLEANUP_FUNC
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(PkResultCache, g_object_unref)
+#endif
+
+GType		 pk_result_cache_get_type	(void);
+PkResultCache	*pk_result_cache_new		(void);
+gboolean	 pk_result_cache_role_is_cacheable (PkRoleEnum	 role);
+void		 pk_result_cache_set_max_size	(PkResultCache	*cache,
+						 gsize		 max_size);
+guint		 pk_result_cache_get_generation	(PkResultCache	*cache);
+PkResults	*pk_result_cache_lookup		(PkResultCache	*cache,
+						 const gchar	*key);
+gboolean	 pk_result_cache_insert		(PkResultCache	*cache,
+						 const gchar	*key,
+						 guint		 generation,
+						 PkResults	*results);
+void		 pk_result_cache_invalidate	(PkResultCache	*cache);
+void		 pk_result_cache_get_stats	(PkResultCache	*cache,
+						 guint64	*hits,
+						 guint64	*misses,
+						 guint64	*evictions,
+						 guint64	*invalidations,
+						 guint		*entries,
+						 gsize		*size);
+
+G_END_DECLS
+
+#endif /* __PK_RESULT_CACHE_H */
@@ -68,6 +68,8 @@
 #include "pk-scheduler.h"
 
 static void     pk_scheduler_finalize	(GObject	*object);
+static void     pk_scheduler_add_phase_times (PkScheduler *scheduler, PkTransaction *transaction);
+static void     pk_scheduler_add_totals	(PkScheduler *scheduler, PkTransaction *transaction);
 
 #define PK_SCHEDULER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_SCHEDULER, PkSchedulerPrivate))
 
@@ -93,6 +95,26 @@ struct PkSchedulerPrivate
 	GKeyFile		*conf;
 	PkBackend		*backend;
 	GDBusNodeInfo		*introspection;
+	guint64			 wait_total[PK_ROLE_ENUM_LAST];	/* us */
+	guint			 wait_count[PK_ROLE_ENUM_LAST];
+	guint			 histogram[PK_ROLE_ENUM_LAST][PK_SCHEDULER_INTERVAL_LAST][PK_SCHEDULER_HISTOGRAM_BUCKETS];
+	guint64			 histogram_sum[PK_ROLE_ENUM_LAST][PK_SCHEDULER_INTERVAL_LAST];	/* us */
+	guint			 finished[PK_ROLE_ENUM_LAST][PK_EXIT_ENUM_LAST];
+	guint64			 packages[PK_ROLE_ENUM_LAST];
+};
+
+/* the phases each interval is measured between */
+static const struct {
+	PkTransactionPhase	 start;
+	PkTransactionPhase	 end;
+} pk_scheduler_intervals[] = {
+	{ PK_TRANSACTION_PHASE_CREATED,		PK_TRANSACTION_PHASE_REQUESTED },
+	{ PK_TRANSACTION_PHASE_REQUESTED,	PK_TRANSACTION_PHASE_AUTHORIZED },
+	{ PK_TRANSACTION_PHASE_AUTHORIZED,	PK_TRANSACTION_PHASE_RUNNING },
+	{ PK_TRANSACTION_PHASE_RUNNING,		PK_TRANSACTION_PHASE_FIRST_RESULT },
+	{ PK_TRANSACTION_PHASE_RUNNING,		PK_TRANSACTION_PHASE_FINISHED },
+	{ PK_TRANSACTION_PHASE_FINISHED,	PK_TRANSACTION_PHASE_EMITTED },
+	{ PK_TRANSACTION_PHASE_CREATED,		PK_TRANSACTION_PHASE_EMITTED },
 };
 
 typedef struct {
@@ -107,6 +129,9 @@ typedef struct {
 	gulong			 allow_cancel_changed_id;
 	guint			 uid;
 	guint			 tries;
+	gint64			 ready_time;
+	gpointer		 primary;	/* PkSchedulerItem we share the job of */
+	gboolean		 released;	/* nothing may share our job any more */
 } PkSchedulerItem;
 
 enum {
@@ -216,6 +241,35 @@ pk_scheduler_item_free_cb (PkSchedulerItem *item, gpointer user_data)
 	pk_scheduler_item_free (item);
 }
 
+/**
+ * pk_scheduler_release_subscribers:
+ *
+ * Stops anything sharing the job of @item, queuing the transactions again
+ * if they are still waiting for results.
+ **/
+static void
+pk_scheduler_release_subscribers (PkScheduler *scheduler, PkSchedulerItem *item)
+{
+	guint i;
+	GPtrArray *array;
+	PkSchedulerItem *subscriber;
+
+	/* the subscribers are queued again, and must not pick this one */
+	item->released = TRUE;
+
+	array = scheduler->priv->array;
+	for (i = 0; i < array->len; i++) {
+		subscriber = (PkSchedulerItem *) g_ptr_array_index (array, i);
+		if (subscriber->primary != item)
+			continue;
+		subscriber->primary = NULL;
+		if (pk_transaction_get_state (subscriber->transaction) == PK_TRANSACTION_STATE_RUNNING) {
+			g_debug ("requeuing %s as %s will not run", subscriber->tid, item->tid);
+			pk_transaction_unsubscribe (subscriber->transaction);
+		}
+	}
+}
+
 static gboolean
 pk_scheduler_remove_internal (PkScheduler *scheduler, PkSchedulerItem *item)
 {
@@ -224,6 +278,9 @@ pk_scheduler_remove_internal (PkScheduler *scheduler, PkSchedulerItem *item)
 	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), FALSE);
 	g_return_val_if_fail (item != NULL, FALSE);
 
+	/* nothing can share this job any more */
+	pk_scheduler_release_subscribers (scheduler, item);
+
 	/* valid item */
 	ret = g_ptr_array_remove (scheduler->priv->array, item);
 	if (!ret) {
@@ -303,6 +360,15 @@ pk_scheduler_run_idle_cb (PkSchedulerItem *item)
 static void
 pk_scheduler_run_item (PkScheduler *scheduler, PkSchedulerItem *item)
 {
+	PkRoleEnum role;
+
+	/* save how long this was queued for */
+	role = pk_transaction_get_role (item->transaction);
+	if (item->ready_time > 0 && role < PK_ROLE_ENUM_LAST) {
+		scheduler->priv->wait_total[role] += g_get_monotonic_time () - item->ready_time;
+		scheduler->priv->wait_count[role]++;
+	}
+
 	/* we set this here so that we don't try starting more than one */
 	pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_RUNNING);
 
@@ -328,6 +394,10 @@ pk_scheduler_get_active_transactions (PkScheduler *scheduler)
 	array = scheduler->priv->array;
 	for (i = 0; i < array->len; i++) {
 		item = (PkSchedulerItem *) g_ptr_array_index (array, i);
+
+		/* sharing the job of another transaction is not using the backend */
+		if (item->primary != NULL)
+			continue;
 		if (pk_transaction_get_state (item->transaction) == PK_TRANSACTION_STATE_RUNNING)
 			g_ptr_array_add (res, item);
 	}
@@ -392,6 +462,50 @@ pk_scheduler_get_background_running (PkScheduler *scheduler)
 	return FALSE;
 }
 
+/**
+ * pk_scheduler_item_can_run:
+ *
+ * Exclusive transactions are writers and need the backend to themselves,
+ * unless the backend supports parallelization in which case they only
+ * exclude other writers. Non-exclusive transactions are readers, and can
+ * run alongside any number of other readers.
+ **/
+static gboolean
+pk_scheduler_item_can_run (PkSchedulerItem *item,
+			   gboolean parallel,
+			   guint exclusive_running,
+			   guint running)
+{
+	if (pk_transaction_is_exclusive (item->transaction)) {
+		if (exclusive_running > 0)
+			return FALSE;
+		return parallel || running == 0;
+	}
+	return parallel || exclusive_running == 0;
+}
+
+/**
+ * pk_scheduler_item_shares_locale:
+ *
+ * Backends set up the process locale for the first job that runs, so a
+ * reader can only join running transactions that use the same locale.
+ **/
+static gboolean
+pk_scheduler_item_shares_locale (PkSchedulerItem *item, GPtrArray *active)
+{
+	const gchar *locale;
+	PkSchedulerItem *running;
+	guint i;
+
+	locale = pk_backend_job_get_locale (pk_transaction_get_backend_job (item->transaction));
+	for (i = 0; i < active->len; i++) {
+		running = (PkSchedulerItem *) g_ptr_array_index (active, i);
+		if (g_strcmp0 (locale, pk_backend_job_get_locale (pk_transaction_get_backend_job (running->transaction))) != 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
 static PkSchedulerItem *
 pk_scheduler_get_next_item (PkScheduler *scheduler)
 {
@@ -399,43 +513,58 @@ pk_scheduler_get_next_item (PkScheduler *scheduler)
 	GPtrArray *array;
 	guint i;
 	PkTransactionState state;
-	gboolean exclusive_running;
+	guint exclusive_running;
+	gboolean parallel;
+	gboolean exclusive;
+	gboolean writer_waiting = FALSE;
+	g_autoptr(GPtrArray) active = NULL;
 
 	array = scheduler->priv->array;
 
 	/* check for running exclusive transaction */
-	exclusive_running = pk_scheduler_get_exclusive_running (scheduler) > 0;
+	exclusive_running = pk_scheduler_get_exclusive_running (scheduler);
+	active = pk_scheduler_get_active_transactions (scheduler);
+	parallel = pk_backend_supports_parallelization (scheduler->priv->backend);
 
 	/* first try the waiting non-background transactions */
 	for (i = 0; i < array->len; i++) {
 		item = (PkSchedulerItem *) g_ptr_array_index (array, i);
 		state = pk_transaction_get_state (item->transaction);
+		if (state != PK_TRANSACTION_STATE_READY)
+			continue;
+		if (pk_transaction_get_background (item->transaction))
+			continue;
 
-		if ((state == PK_TRANSACTION_STATE_READY) && (!pk_transaction_get_background (item->transaction))) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
+		/* check if we can run the transaction now or if we need to
+		 * wait for lock release; readers queued behind a waiting
+		 * writer also wait so that the writer is not starved */
+		exclusive = pk_transaction_is_exclusive (item->transaction);
+		if (!exclusive && writer_waiting)
+			continue;
+		if (pk_scheduler_item_can_run (item, parallel,
+					       exclusive_running, active->len) &&
+		    (parallel || pk_scheduler_item_shares_locale (item, active)))
+			goto out;
+		if (exclusive && !parallel)
+			writer_waiting = TRUE;
 	}
 
 	/* then try the other waiting transactions (background tasks) */
 	for (i = 0; i < array->len; i++) {
 		item = (PkSchedulerItem *) g_ptr_array_index (array, i);
 		state = pk_transaction_get_state (item->transaction);
+		if (state != PK_TRANSACTION_STATE_READY)
+			continue;
 
-		if (state == PK_TRANSACTION_STATE_READY) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
+		exclusive = pk_transaction_is_exclusive (item->transaction);
+		if (!exclusive && writer_waiting)
+			continue;
+		if (pk_scheduler_item_can_run (item, parallel,
+					       exclusive_running, active->len) &&
+		    (parallel || pk_scheduler_item_shares_locale (item, active)))
+			goto out;
+		if (exclusive && !parallel)
+			writer_waiting = TRUE;
 	}
 
 	/* nothing to run */
@@ -444,6 +573,87 @@ out:
 	return item;
 }
 
+/**
+ * pk_scheduler_role_can_coalesce:
+ *
+ * Return value: %TRUE if identical transactions of this role can share the
+ * results of a single backend job.
+ **/
+static gboolean
+pk_scheduler_role_can_coalesce (PkRoleEnum role)
+{
+	if (pk_backend_role_is_read_only (role))
+		return TRUE;
+
+	switch (role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_CATEGORIES:
+	case PK_ROLE_ENUM_GET_DISTRO_UPGRADES:
+	case PK_ROLE_ENUM_GET_REPO_LIST:
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_REFRESH_CACHE:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/**
+ * pk_scheduler_coalesce:
+ *
+ * Attaches @item to an identical transaction that is queued or running, so
+ * that the backend only does the work once for a burst of requests.
+ *
+ * Return value: %TRUE if @item is now sharing the job of another item
+ **/
+static gboolean
+pk_scheduler_coalesce (PkScheduler *scheduler, PkSchedulerItem *item)
+{
+	const gchar *key;
+	guint i;
+	GPtrArray *array;
+	PkSchedulerItem *primary;
+	PkTransactionState state;
+
+	if (!pk_scheduler_role_can_coalesce (pk_transaction_get_role (item->transaction)))
+		return FALSE;
+	key = pk_transaction_get_coalesce_key (item->transaction);
+	if (key == NULL)
+		return FALSE;
+
+	array = scheduler->priv->array;
+	for (i = 0; i < array->len; i++) {
+		primary = (PkSchedulerItem *) g_ptr_array_index (array, i);
+		if (primary == item || primary->primary != NULL || primary->released)
+			continue;
+		state = pk_transaction_get_state (primary->transaction);
+		if (state != PK_TRANSACTION_STATE_READY &&
+		    state != PK_TRANSACTION_STATE_RUNNING)
+			continue;
+		if (g_strcmp0 (pk_transaction_get_coalesce_key (primary->transaction), key) != 0)
+			continue;
+		if (!pk_transaction_subscribe (item->transaction, primary->transaction))
+			continue;
+		item->primary = primary;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+pk_scheduler_run_next_items (PkScheduler *scheduler)
+{
+	PkSchedulerItem *item;
+
+	/* start as many as we can, e.g. all the readers queued behind a writer */
+	while ((item = pk_scheduler_get_next_item (scheduler)) != NULL) {
+		g_debug ("running %s", item->tid);
+		pk_scheduler_run_item (scheduler, item);
+	}
+}
+
 static void
 pk_scheduler_commit (PkScheduler *scheduler, const gchar *tid)
 {
@@ -458,18 +668,27 @@ pk_scheduler_commit (PkScheduler *scheduler, const gchar *tid)
 		return;
 	}
 
-	/* treat all transactions as exclusive if backend does not support parallelization */
-	if (!pk_backend_supports_parallelization (scheduler->priv->backend))
-		pk_transaction_make_exclusive (item->transaction);
-
 	/* we've been 'used' */
 	if (item->commit_id != 0) {
 		g_source_remove (item->commit_id);
 		item->commit_id = 0;
 	}
 
-	/* we will changed what is running */
-	g_signal_emit (scheduler, signals [PK_SCHEDULER_CHANGED], 0);
+	/* treat all transactions as exclusive if backend does not support
+	 * parallelization, apart from read-only queries if the backend can
+	 * share its package database between them; this is decided before
+	 * coalescing, as a subscriber may have to run on its own later */
+	if (!pk_backend_supports_parallelization (scheduler->priv->backend) &&
+	    !(pk_backend_supports_concurrent_reads (scheduler->priv->backend) &&
+	      pk_backend_role_is_read_only (pk_transaction_get_role (item->transaction))))
+		pk_transaction_make_exclusive (item->transaction);
+
+	/* share the backend job of an identical transaction if possible */
+	if (pk_scheduler_coalesce (scheduler, item)) {
+		g_signal_emit (scheduler, signals [PK_SCHEDULER_CHANGED], 0);
+		return;
+	}
+	item->ready_time = g_get_monotonic_time ();
 
 	/* is one of the current running transactions background, and this new
 	 * transaction foreground? */
@@ -481,9 +700,10 @@ pk_scheduler_commit (PkScheduler *scheduler, const gchar *tid)
 	}
 
 	/* do the transaction now, if possible */
-	if (pk_transaction_is_exclusive (item->transaction) == FALSE ||
-	    pk_scheduler_get_exclusive_running (scheduler) == 0)
-		pk_scheduler_run_item (scheduler, item);
+	pk_scheduler_run_next_items (scheduler);
+
+	/* we have changed what is queued and running */
+	g_signal_emit (scheduler, signals [PK_SCHEDULER_CHANGED], 0);
 }
 
 static void
@@ -534,6 +754,14 @@ pk_scheduler_transaction_finished_cb (PkTransaction *transaction,
 		return;
 	}
 
+	/* we were only sharing the job of another transaction */
+	item->primary = NULL;
+
+	/* anything sharing a job that was never run has to be queued again */
+	job = pk_transaction_get_backend_job (item->transaction);
+	if (!pk_backend_job_get_is_finished (job))
+		pk_scheduler_release_subscribers (scheduler, item);
+
 	if (pk_transaction_is_finished_with_lock_required (item->transaction)) {
 		pk_transaction_reset_after_lock_error (item->transaction);
 
@@ -561,6 +789,8 @@ pk_scheduler_transaction_finished_cb (PkTransaction *transaction,
 			item->commit_id = 0;
 		}
 		pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_FINISHED);
+		pk_scheduler_add_phase_times (scheduler, item->transaction);
+		pk_scheduler_add_totals (scheduler, item->transaction);
 
 		/* give the client a few seconds to still query the runner */
 		item->remove_id = g_timeout_add_seconds (PK_TRANSACTION_KEEP_FINISHED_TIMOUT,
@@ -569,17 +799,50 @@ pk_scheduler_transaction_finished_cb (PkTransaction *transaction,
 		g_source_set_name_by_id (item->remove_id, "[PkScheduler] remove");
 	}
 
-	/* try to run the next transaction, if possible */
-	item = pk_scheduler_get_next_item (scheduler);
-	if (item != NULL) {
-		g_debug ("running %s as previous one finished", item->tid);
-		pk_scheduler_run_item (scheduler, item);
-	}
+	/* try to run the next transactions, if possible */
+	pk_scheduler_run_next_items (scheduler);
 
 	/* we have changed what is running */
 	g_signal_emit (scheduler, signals [PK_SCHEDULER_CHANGED], 0);
 }
 
+/* adds the time spent in each phase to the histograms for the role */
+static void
+pk_scheduler_add_phase_times (PkScheduler *scheduler, PkTransaction *transaction)
+{
+	PkRoleEnum role = pk_transaction_get_role (transaction);
+
+	if (role >= PK_ROLE_ENUM_LAST)
+		return;
+	for (guint i = 0; i < PK_SCHEDULER_INTERVAL_LAST; i++) {
+		gint64 start = pk_transaction_get_phase_time (transaction, pk_scheduler_intervals[i].start);
+		gint64 end = pk_transaction_get_phase_time (transaction, pk_scheduler_intervals[i].end);
+		guint64 ms;
+		guint bucket = 0;
+
+		if (start == 0 || end < start)
+			continue;
+		ms = (guint64) (end - start) / 1000;
+		if (ms > 0)
+			bucket = MIN (g_bit_storage (ms), PK_SCHEDULER_HISTOGRAM_BUCKETS - 1);
+		scheduler->priv->histogram[role][i][bucket]++;
+		scheduler->priv->histogram_sum[role][i] += end - start;
+	}
+}
+
+/* counts the finished transactions and the packages they sent for the role */
+static void
+pk_scheduler_add_totals (PkScheduler *scheduler, PkTransaction *transaction)
+{
+	PkRoleEnum role = pk_transaction_get_role (transaction);
+	PkExitEnum exit_enum = pk_transaction_get_exit (transaction);
+
+	if (role >= PK_ROLE_ENUM_LAST || exit_enum >= PK_EXIT_ENUM_LAST)
+		return;
+	scheduler->priv->finished[role][exit_enum]++;
+	scheduler->priv->packages[role] += pk_transaction_get_packages_emitted (transaction);
+}
+
 static gboolean
 pk_scheduler_no_commit_cb (gpointer user_data)
 {
@@ -850,6 +1113,139 @@ pk_scheduler_get_size (PkScheduler *scheduler)
 	return scheduler->priv->array->len;
 }
 
+/**
+ * pk_scheduler_get_queue_depth:
+ *
+ * Return value: the number of transactions of this role that are ready
+ * but waiting for another transaction to finish.
+ **/
+guint
+pk_scheduler_get_queue_depth (PkScheduler *scheduler, PkRoleEnum role)
+{
+	guint i;
+	guint count = 0;
+	GPtrArray *array;
+	PkSchedulerItem *item;
+
+	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), 0);
+	g_return_val_if_fail (pk_is_thread_default (), 0);
+
+	array = scheduler->priv->array;
+	for (i = 0; i < array->len; i++) {
+		item = (PkSchedulerItem *) g_ptr_array_index (array, i);
+		if (pk_transaction_get_state (item->transaction) != PK_TRANSACTION_STATE_READY)
+			continue;
+		if (pk_transaction_get_role (item->transaction) == role)
+			count++;
+	}
+	return count;
+}
+
+/**
+ * pk_scheduler_get_queue_wait:
+ *
+ * Return value: the average time in ms that transactions of this role
+ * waited between being ready and being run.
+ **/
+guint
+pk_scheduler_get_queue_wait (PkScheduler *scheduler, PkRoleEnum role)
+{
+	PkSchedulerPrivate *priv;
+
+	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), 0);
+	g_return_val_if_fail (role < PK_ROLE_ENUM_LAST, 0);
+
+	priv = scheduler->priv;
+	if (priv->wait_count[role] == 0)
+		return 0;
+	return priv->wait_total[role] / priv->wait_count[role] / 1000;
+}
+
+const gchar *
+pk_scheduler_interval_to_string (PkSchedulerInterval interval)
+{
+	if (interval == PK_SCHEDULER_INTERVAL_CLIENT)
+		return "client";
+	if (interval == PK_SCHEDULER_INTERVAL_AUTHORIZE)
+		return "authorize";
+	if (interval == PK_SCHEDULER_INTERVAL_QUEUE)
+		return "queue";
+	if (interval == PK_SCHEDULER_INTERVAL_FIRST_RESULT)
+		return "first-result";
+	if (interval == PK_SCHEDULER_INTERVAL_BACKEND)
+		return "backend";
+	if (interval == PK_SCHEDULER_INTERVAL_EMIT)
+		return "emit";
+	if (interval == PK_SCHEDULER_INTERVAL_TOTAL)
+		return "total";
+	return NULL;
+}
+
+/**
+ * pk_scheduler_get_histogram:
+ *
+ * Return value: the %PK_SCHEDULER_HISTOGRAM_BUCKETS counts of how long
+ * the finished transactions of this role took between two phases
+ **/
+const guint *
+pk_scheduler_get_histogram (PkScheduler *scheduler,
+			    PkRoleEnum role,
+			    PkSchedulerInterval interval)
+{
+	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), NULL);
+	g_return_val_if_fail (role < PK_ROLE_ENUM_LAST, NULL);
+	g_return_val_if_fail (interval < PK_SCHEDULER_INTERVAL_LAST, NULL);
+	return scheduler->priv->histogram[role][interval];
+}
+
+/**
+ * pk_scheduler_get_histogram_sum:
+ *
+ * Return value: the total time in us of all the times counted by
+ * pk_scheduler_get_histogram()
+ **/
+guint64
+pk_scheduler_get_histogram_sum (PkScheduler *scheduler,
+				PkRoleEnum role,
+				PkSchedulerInterval interval)
+{
+	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), 0);
+	g_return_val_if_fail (role < PK_ROLE_ENUM_LAST, 0);
+	g_return_val_if_fail (interval < PK_SCHEDULER_INTERVAL_LAST, 0);
+	return scheduler->priv->histogram_sum[role][interval];
+}
+
+/**
+ * pk_scheduler_get_finished:
+ *
+ * Return value: the number of transactions of this role that finished
+ * with this exit code
+ **/
+guint
+pk_scheduler_get_finished (PkScheduler *scheduler,
+			   PkRoleEnum role,
+			   PkExitEnum exit_enum)
+{
+	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), 0);
+	g_return_val_if_fail (role < PK_ROLE_ENUM_LAST, 0);
+	g_return_val_if_fail (exit_enum < PK_EXIT_ENUM_LAST, 0);
+	return scheduler->priv->finished[role][exit_enum];
+}
+
+/**
+ * pk_scheduler_get_packages_emitted:
+ *
+ * Return value: the number of packages sent to clients by the finished
+ * transactions of this role
+ **/
+guint64
+pk_scheduler_get_packages_emitted (PkScheduler *scheduler, PkRoleEnum role)
+{
+	g_return_val_if_fail (PK_IS_SCHEDULER (scheduler), 0);
+	g_return_val_if_fail (role < PK_ROLE_ENUM_LAST, 0);
+	return scheduler->priv->packages[role];
+}
+
 gchar *
 pk_scheduler_get_state (PkScheduler *scheduler)
 {
@@ -40,6 +40,23 @@ G_BEGIN_DECLS
 
 typedef struct PkSchedulerPrivate PkSchedulerPrivate;
 
+/* the time between two phases of a transaction */
+typedef enum {
+	PK_SCHEDULER_INTERVAL_CLIENT,		/* created to requested */
+	PK_SCHEDULER_INTERVAL_AUTHORIZE,	/* requested to authorized */
+	PK_SCHEDULER_INTERVAL_QUEUE,		/* authorized to running */
+	PK_SCHEDULER_INTERVAL_FIRST_RESULT,	/* running to first result */
+	PK_SCHEDULER_INTERVAL_BACKEND,		/* running to finished */
+	PK_SCHEDULER_INTERVAL_EMIT,		/* finished to emitted */
+	PK_SCHEDULER_INTERVAL_TOTAL,		/* created to emitted */
+	PK_SCHEDULER_INTERVAL_LAST
+} PkSchedulerInterval;
+
+/* bucket 0 counts times under 1ms, and each bucket after that times up to
+ * twice as long as the one before, with the last counting everything over
+ * 16s */
+#define PK_SCHEDULER_HISTOGRAM_BUCKETS	16
+
 typedef struct
 {
 	 GObject		 parent;
@@ -71,6 +88,22 @@ gchar		**pk_scheduler_get_array	(PkScheduler	*scheduler)
 gchar		*pk_scheduler_get_state		(PkScheduler	*scheduler)
 						 G_GNUC_WARN_UNUSED_RESULT;
 guint		 pk_scheduler_get_size		(PkScheduler	*scheduler);
+guint		 pk_scheduler_get_queue_depth	(PkScheduler	*scheduler,
+						 PkRoleEnum	 role);
+guint		 pk_scheduler_get_queue_wait	(PkScheduler	*scheduler,
+						 PkRoleEnum	 role);
+const guint	*pk_scheduler_get_histogram	(PkScheduler	*scheduler,
+						 PkRoleEnum	 role,
+						 PkSchedulerInterval interval);
+guint64		 pk_scheduler_get_histogram_sum	(PkScheduler	*scheduler,
+						 PkRoleEnum	 role,
+						 PkSchedulerInterval interval);
+guint		 pk_scheduler_get_finished	(PkScheduler	*scheduler,
+						 PkRoleEnum	 role,
+						 PkExitEnum	 exit_enum);
+guint64		 pk_scheduler_get_packages_emitted (PkScheduler	*scheduler,
+						 PkRoleEnum	 role);
+const gchar	*pk_scheduler_interval_to_string (PkSchedulerInterval interval);
 gboolean	 pk_scheduler_get_locked	(PkScheduler	*scheduler);
 gboolean	 pk_scheduler_get_inhibited	(PkScheduler	*scheduler);
 PkTransaction	*pk_scheduler_get_transaction	(PkScheduler	*scheduler,
@@ -22,6 +22,7 @@
 
 #include <config.h>
 
+#include <string.h>
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gstdio.h>
@@ -30,6 +31,7 @@
 #include "pk-backend-spawn.h"
 #include "pk-dbus.h"
 #include "pk-engine.h"
+#include "pk-result-cache.h"
 #include "pk-spawn.h"
 #include "pk-transaction-db.h"
 #include "pk-transaction.h"
@@ -96,6 +98,7 @@ _g_test_loop_quit (void)
 /**********************************************************************/
 
 static guint number_packages = 0;
+static guint number_package_batches = 0;
 
 static void
 pk_test_backend_finished_cb (PkBackend *backend, PkExitEnum exit, gpointer user_data)
@@ -126,6 +129,20 @@ pk_test_backend_func_true (PkBackendJob *job,
 				"The vips documentation package.");
 }
 
+static void
+pk_test_backend_func_many (PkBackendJob *job,
+			   GVariant *params,
+			   gpointer user_data)
+{
+	for (guint i = 0; i < 1000; i++) {
+		g_autofree gchar *package_id = NULL;
+		package_id = g_strdup_printf ("vips-doc-%u;7.12.4-2.fc8;noarch;linva", i);
+		pk_backend_job_package (job, PK_INFO_ENUM_AVAILABLE,
+					package_id,
+					"The vips documentation package.");
+	}
+}
+
 static void
 pk_test_backend_func_immediate_false (PkBackendJob *job,
 				      GVariant *params,
@@ -143,6 +160,7 @@ pk_test_backend_package_cb (PkBackend *backend, PkPackage *package, gpointer use
 static void
 pk_test_backend_packages_cb (PkBackend *backend, GPtrArray *package_array, gpointer user_data)
 {
+	number_package_batches++;
 	for (guint i = 0; i < package_array->len; i++) {
 		PkPackage *package = g_ptr_array_index (package_array, i);
 
@@ -161,6 +179,7 @@ pk_test_backend_func (void)
 	g_autoptr(GKeyFile) conf = NULL;
 	g_autoptr(PkBackend) backend = NULL;
 	g_autoptr(PkBackendJob) job = NULL;
+	g_autoptr(PkBackendJob) subscriber = NULL;
 
 	/* get an backend */
 	conf = g_key_file_new ();
@@ -275,6 +294,29 @@ pk_test_backend_func (void)
 	/* check duplicate filter */
 	g_assert_cmpint (number_packages, ==, 1);
 
+	/* packages are sent to the main thread in batches */
+	g_object_unref (job);
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_backend (job, backend);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_PACKAGES,
+				  PK_BACKEND_JOB_VFUNC (pk_test_backend_packages_cb),
+				  NULL);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_FINISHED,
+				  PK_BACKEND_JOB_VFUNC (pk_test_backend_finished_cb),
+				  NULL);
+	number_packages = 0;
+	number_package_batches = 0;
+	ret = pk_backend_job_thread_create (job,
+					    pk_test_backend_func_many,
+					    NULL,
+					    NULL);
+	g_assert_true (ret);
+	_g_test_loop_wait (2000);
+	g_assert_cmpint (number_packages, ==, 1000);
+	g_assert_cmpint (number_package_batches, <, 20);
+
 	/* reset */
 	g_object_unref (job);
 	job = pk_backend_job_new (conf);
@@ -290,6 +332,40 @@ pk_test_backend_func (void)
 	/* wait for Finished */
 	_g_test_loop_wait (10);
 
+	/* share the results of a job with an identical one */
+	g_object_unref (job);
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_backend (job, backend);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_PACKAGE,
+				  PK_BACKEND_JOB_VFUNC (pk_test_backend_package_cb),
+				  NULL);
+	pk_backend_job_set_vfunc (job,
+				  PK_BACKEND_SIGNAL_FINISHED,
+				  PK_BACKEND_JOB_VFUNC (pk_test_backend_finished_cb),
+				  NULL);
+	subscriber = pk_backend_job_new (conf);
+	pk_backend_job_set_vfunc (subscriber,
+				  PK_BACKEND_SIGNAL_PACKAGE,
+				  PK_BACKEND_JOB_VFUNC (pk_test_backend_package_cb),
+				  NULL);
+	ret = pk_backend_job_add_subscriber (job, subscriber);
+	g_assert_true (ret);
+	number_packages = 0;
+	ret = pk_backend_job_thread_create (job,
+					    pk_test_backend_func_true,
+					    GINT_TO_POINTER (999),
+					    NULL);
+	g_assert_true (ret);
+
+	/* wait for Finished */
+	_g_test_loop_wait (2000);
+	g_assert_cmpint (number_packages, ==, 2);
+
+	/* too late to share the results now */
+	ret = pk_backend_job_add_subscriber (job, subscriber);
+	g_assert_true (!ret);
+
 	/* reset */
 	g_object_unref (job);
 	job = pk_backend_job_new (conf);
@@ -482,6 +558,222 @@ pk_test_backend_spawn_func (void)
 	g_object_unref (backend_spawn);
 }
 
+static void
+pk_test_backend_spawn_record_add_uint32 (GByteArray *record, guint32 value)
+{
+	g_byte_array_append (record, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+pk_test_backend_spawn_record_add_string (GByteArray *record, const gchar *value)
+{
+	guint32 len = strlen (value);
+	pk_test_backend_spawn_record_add_uint32 (record, len);
+	g_byte_array_append (record, (const guint8 *) value, len + 1);
+}
+
+static GByteArray *
+pk_test_backend_spawn_record_new_package (PkInfoEnum info, const gchar *package_id)
+{
+	GByteArray *record = g_byte_array_new ();
+	pk_test_backend_spawn_record_add_uint32 (record, PK_BACKEND_SPAWN_RECORD_PACKAGE);
+	pk_test_backend_spawn_record_add_uint32 (record, info);
+	pk_test_backend_spawn_record_add_string (record, package_id);
+	pk_test_backend_spawn_record_add_string (record, "More useless software");
+	return record;
+}
+
+static void
+pk_test_backend_spawn_protocol_func (void)
+{
+	const guint n_packages = 20000;
+	gboolean ret;
+	gdouble elapsed_records;
+	gdouble elapsed_text;
+	g_autoptr(GByteArray) record = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GKeyFile) conf = NULL;
+	g_autoptr(GPtrArray) lines = NULL;
+	g_autoptr(GPtrArray) records = NULL;
+	g_autoptr(GTimer) timer = NULL;
+	g_autoptr(PkBackend) backend = NULL;
+	g_autoptr(PkBackendJob) job = NULL;
+	g_autoptr(PkBackendSpawn) backend_spawn = NULL;
+
+	conf = g_key_file_new ();
+	backend_spawn = pk_backend_spawn_new (conf);
+	backend = pk_backend_new (conf);
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_backend (job, backend);
+
+	/* switch to records */
+	ret = pk_backend_spawn_inject_data (backend_spawn, job, "protocol\t3", NULL);
+	g_assert_false (ret);
+	ret = pk_backend_spawn_inject_data (backend_spawn, job, "protocol\t2", &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* valid package */
+	record = pk_test_backend_spawn_record_new_package (PK_INFO_ENUM_INSTALLED,
+							   "gnome-power-manager;0.0.1;i386;data");
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* trailing data */
+	pk_test_backend_spawn_record_add_uint32 (record, 0);
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len, NULL);
+	g_assert_false (ret);
+
+	/* truncated */
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len - 5, NULL);
+	g_assert_false (ret);
+	g_byte_array_unref (record);
+
+	/* invalid info */
+	record = pk_test_backend_spawn_record_new_package (PK_INFO_ENUM_LAST,
+							   "gnome-power-manager;0.0.1;i386;data");
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len, NULL);
+	g_assert_false (ret);
+	g_byte_array_unref (record);
+
+	/* invalid package ID */
+	record = pk_test_backend_spawn_record_new_package (PK_INFO_ENUM_INSTALLED,
+							   "gnome-power-manager;0.0.1;i386");
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len, NULL);
+	g_assert_false (ret);
+	g_byte_array_unref (record);
+
+	/* files */
+	record = g_byte_array_new ();
+	pk_test_backend_spawn_record_add_uint32 (record, PK_BACKEND_SPAWN_RECORD_FILES);
+	pk_test_backend_spawn_record_add_string (record, "gnome-power-manager;0.0.1;i386;data");
+	pk_test_backend_spawn_record_add_uint32 (record, 2);
+	pk_test_backend_spawn_record_add_string (record, "/usr/bin/gnome-power-manager");
+	pk_test_backend_spawn_record_add_string (record, "/usr/share/man/man1/gnome-power-manager.1.gz");
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_byte_array_unref (record);
+
+	/* text protocol inside a record */
+	record = g_byte_array_new ();
+	pk_test_backend_spawn_record_add_uint32 (record, PK_BACKEND_SPAWN_RECORD_TEXT);
+	pk_test_backend_spawn_record_add_string (record, "percentage\t50");
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_byte_array_unref (record);
+
+	/* unknown record */
+	record = g_byte_array_new ();
+	pk_test_backend_spawn_record_add_uint32 (record, PK_BACKEND_SPAWN_RECORD_LAST);
+	ret = pk_backend_spawn_inject_record (backend_spawn, job, record->data, record->len, NULL);
+	g_assert_false (ret);
+	g_byte_array_unref (record);
+	record = NULL;
+
+	/* throughput of both protocols, using different IDs as the job
+	 * ignores packages it has already seen */
+	lines = g_ptr_array_new_with_free_func (g_free);
+	records = g_ptr_array_new_with_free_func ((GDestroyNotify) g_byte_array_unref);
+	for (guint i = 0; i < n_packages; i++) {
+		g_autofree gchar *package_id = NULL;
+		g_ptr_array_add (lines, g_strdup_printf ("package\tavailable\t"
+							 "text%u;0.0.1;i386;data\t"
+							 "More useless software", i));
+		package_id = g_strdup_printf ("record%u;0.0.1;i386;data", i);
+		g_ptr_array_add (records,
+				 pk_test_backend_spawn_record_new_package (PK_INFO_ENUM_AVAILABLE,
+									   package_id));
+	}
+	timer = g_timer_new ();
+	for (guint i = 0; i < lines->len; i++) {
+		ret = pk_backend_spawn_inject_data (backend_spawn, job,
+						    g_ptr_array_index (lines, i), &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+	}
+	elapsed_text = g_timer_elapsed (timer, NULL);
+	g_timer_reset (timer);
+	for (guint i = 0; i < records->len; i++) {
+		GByteArray *tmp = g_ptr_array_index (records, i);
+		ret = pk_backend_spawn_inject_record (backend_spawn, job,
+						      tmp->data, tmp->len, &error);
+		g_assert_no_error (error);
+		g_assert_true (ret);
+	}
+	elapsed_records = g_timer_elapsed (timer, NULL);
+	g_test_message ("%u packages: text %.1fms (%.0f/s), records %.1fms (%.0f/s)",
+			n_packages,
+			elapsed_text * 1000, n_packages / elapsed_text,
+			elapsed_records * 1000, n_packages / elapsed_records);
+}
+
+static gchar *_backend_spawn_package_id = NULL;
+
+static void
+pk_test_backend_spawn_dispatcher_package_cb (PkBackendJob *job,
+					     PkPackage *package,
+					     PkBackendSpawn *backend_spawn)
+{
+	g_free (_backend_spawn_package_id);
+	_backend_spawn_package_id = g_strdup (pk_package_get_id (package));
+}
+
+static void
+pk_test_backend_spawn_dispatcher_func (void)
+{
+	gboolean ret;
+	g_autofree gchar *pid = NULL;
+	g_autoptr(GKeyFile) conf = NULL;
+	g_autoptr(PkBackend) backend = NULL;
+	g_autoptr(PkBackendSpawn) backend_spawn = NULL;
+
+	conf = g_key_file_new ();
+	g_key_file_set_boolean (conf, "Daemon", "PersistentBackendHelpers", TRUE);
+	backend_spawn = pk_backend_spawn_new (conf);
+	backend = pk_backend_new (conf);
+	ret = pk_backend_spawn_set_name (backend_spawn, "test_spawn");
+	g_assert_true (ret);
+
+	/* started before the first request */
+	ret = pk_backend_spawn_set_dispatcher (backend_spawn, "dispatcher.sh");
+	g_assert_true (ret);
+
+	for (guint i = 1; i <= 2; i++) {
+		g_autofree gchar *served = g_strdup_printf ("%u", i);
+		g_autoptr(PkBackendJob) job = NULL;
+		g_auto(GStrv) split = NULL;
+
+		job = pk_backend_job_new (conf);
+		pk_backend_job_set_backend (job, backend);
+		pk_backend_job_set_vfunc (job,
+					  PK_BACKEND_SIGNAL_FINISHED,
+					  PK_BACKEND_JOB_VFUNC (pk_test_backend_spawn_finished_cb),
+					  backend_spawn);
+		pk_backend_job_set_vfunc (job,
+					  PK_BACKEND_SIGNAL_PACKAGE,
+					  PK_BACKEND_JOB_VFUNC (pk_test_backend_spawn_dispatcher_package_cb),
+					  backend_spawn);
+		ret = pk_backend_spawn_helper (backend_spawn, job, "dispatcher.sh",
+					       "search-name", "none", "bar", NULL);
+		g_assert_true (ret);
+		_g_test_loop_run_with_timeout (10000);
+
+		/* the same process serves both requests, and the output from
+		 * before the first request was ignored */
+		g_assert_nonnull (_backend_spawn_package_id);
+		split = pk_package_id_split (_backend_spawn_package_id);
+		g_assert_cmpstr (split[PK_PACKAGE_ID_VERSION], ==, served);
+		if (pid == NULL)
+			pid = g_strdup (split[PK_PACKAGE_ID_DATA]);
+		g_assert_cmpstr (split[PK_PACKAGE_ID_DATA], ==, pid);
+		g_assert_cmpint (pk_backend_spawn_get_request_latency (backend_spawn), >, 0);
+		g_clear_pointer (&_backend_spawn_package_id, g_free);
+	}
+}
+
 static void
 pk_test_dbus_func (void)
 {
@@ -491,6 +783,109 @@ pk_test_dbus_func (void)
 	g_assert_true (dbus != NULL);
 }
 
+static PkResults *
+pk_test_result_cache_results_new (const gchar *package_id)
+{
+	PkResults *results;
+	g_autoptr(PkPackage) item = NULL;
+
+	item = pk_package_new ();
+	g_assert_true (pk_package_set_id (item, package_id, NULL));
+	results = pk_results_new ();
+	pk_results_add_package (results, item);
+	return results;
+}
+
+static void
+pk_test_result_cache_func (void)
+{
+	guint generation;
+	guint64 hits, misses, evictions;
+	g_autoptr(PkResultCache) cache = NULL;
+	g_autoptr(PkResults) results1 = NULL;
+	g_autoptr(PkResults) results2 = NULL;
+	g_autoptr(PkResults) results3 = NULL;
+	g_autoptr(PkResults) tmp = NULL;
+
+	results1 = pk_test_result_cache_results_new ("hal;0.1;i386;fedora");
+	results2 = pk_test_result_cache_results_new ("gtk;0.2;i386;fedora");
+	results3 = pk_test_result_cache_results_new ("foo;0.3;i386;fedora");
+
+	/* disabled by default */
+	cache = pk_result_cache_new ();
+	generation = pk_result_cache_get_generation (cache);
+	g_assert_false (pk_result_cache_insert (cache, "one", generation, results1));
+
+	/* room for two entries */
+	pk_result_cache_set_max_size (cache, 600);
+	g_assert_true (pk_result_cache_insert (cache, "one", generation, results1));
+	g_assert_true (pk_result_cache_insert (cache, "two", generation, results2));
+	tmp = pk_result_cache_lookup (cache, "one");
+	g_assert_true (tmp == results1);
+	g_clear_object (&tmp);
+	tmp = pk_result_cache_lookup (cache, "three");
+	g_assert_null (tmp);
+
+	/* the least recently used entry is evicted */
+	g_assert_true (pk_result_cache_insert (cache, "three", generation, results3));
+	tmp = pk_result_cache_lookup (cache, "two");
+	g_assert_null (tmp);
+	tmp = pk_result_cache_lookup (cache, "one");
+	g_assert_true (tmp == results1);
+	g_clear_object (&tmp);
+	pk_result_cache_get_stats (cache, &hits, &misses, &evictions, NULL, NULL, NULL);
+	g_assert_cmpint (hits, ==, 2);
+	g_assert_cmpint (misses, ==, 2);
+	g_assert_cmpint (evictions, ==, 1);
+
+	/* results computed before an invalidation are not stored */
+	pk_result_cache_invalidate (cache);
+	tmp = pk_result_cache_lookup (cache, "one");
+	g_assert_null (tmp);
+	g_assert_false (pk_result_cache_insert (cache, "two", generation, results2));
+	generation = pk_result_cache_get_generation (cache);
+	g_assert_true (pk_result_cache_insert (cache, "two", generation, results2));
+}
+
+static void
+pk_test_metrics_func (void)
+{
+	GVariantBuilder builder;
+	g_autoptr(GRegex) regex = NULL;
+	g_autoptr(GString) str = g_string_new (NULL);
+	g_autoptr(GVariant) metrics = NULL;
+	g_auto(GStrv) lines = NULL;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+	g_variant_builder_add (&builder, "{st}", "cache_hits", (guint64) 3);
+	g_variant_builder_add (&builder, "{st}", "index:lookups", (guint64) 4);
+	g_variant_builder_add (&builder, "{st}", "bad name{x=\"1\"}\n9", (guint64) 5);
+	g_variant_builder_add (&builder, "{st}", "", (guint64) 6);
+	g_variant_builder_add (&builder, "{st}", "cache-hits", (guint64) 7);
+	metrics = g_variant_ref_sink (g_variant_builder_end (&builder));
+	pk_engine_metrics_add_backend (str, "te\"st\\", metrics);
+
+	/* every line is a comment or a valid sample */
+	regex = g_regex_new ("^(# TYPE [a-zA-Z_:][a-zA-Z0-9_:]* untyped|"
+			     "[a-zA-Z_:][a-zA-Z0-9_:]*\\{backend=\"([^\"\\\\\\n]|\\\\.)*\"\\} [0-9]+)$",
+			     0, 0, NULL);
+	g_assert_nonnull (regex);
+	lines = g_strsplit (str->str, "\n", -1);
+	g_assert_cmpint (g_strv_length (lines), ==, 9);
+	for (guint i = 0; lines[i] != NULL && lines[i][0] != '\0'; i++)
+		g_assert_true (g_regex_match (regex, lines[i], 0, NULL));
+
+	/* names are sanitized rather than dropped, and empty ones skipped */
+	g_assert_cmpstr (lines[1], ==, "packagekit_backend_cache_hits{backend=\"te\\\"st\\\\\"} 3");
+	g_assert_cmpstr (lines[3], ==, "packagekit_backend_index:lookups{backend=\"te\\\"st\\\\\"} 4");
+	g_assert_cmpstr (lines[4], ==, "# TYPE packagekit_backend_bad_name_x__1___9 untyped");
+
+	/* each metric is only declared once */
+	g_assert_cmpstr (lines[6], ==, "# TYPE packagekit_backend_cache_hits_2 untyped");
+	g_assert_cmpstr (lines[7], ==, "packagekit_backend_cache_hits_2{backend=\"te\\\"st\\\\\"} 7");
+	g_assert_cmpstr (lines[8], ==, "");
+}
+
 PkSpawnExitType mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
 guint stdout_count = 0;
 guint finished_count = 0;
@@ -542,6 +937,102 @@ idle_cb (gpointer user_data)
 	return FALSE;
 }
 
+static void
+pk_test_latency_stdout_cb (PkSpawn *spawn, const gchar *line, gpointer user_data)
+{
+	gint64 *first_line = (gint64 *) user_data;
+	if (*first_line == 0)
+		*first_line = g_get_monotonic_time ();
+}
+
+static void
+pk_test_spawn_latency_func (void)
+{
+	gboolean ret;
+	gint64 first_line = 0;
+	gint64 latency;
+	gint64 start;
+	gint64 exited;
+	const gchar *argv[] = { "/bin/sh", "-c", "echo ready; sleep 0.5", NULL };
+	g_autoptr(GError) error = NULL;
+	g_autoptr(PkSpawn) spawn = NULL;
+
+	new_spawn_object (&spawn);
+	g_signal_connect (spawn, "stdout",
+			  G_CALLBACK (pk_test_latency_stdout_cb), &first_line);
+
+	/* the line is written long before the helper exits */
+	mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	start = g_get_monotonic_time ();
+	ret = pk_spawn_argv (spawn, (gchar **) argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	_g_test_loop_run_with_timeout (5000);
+	exited = g_get_monotonic_time ();
+	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SUCCESS);
+	g_assert_cmpint (stdout_count, ==, 1);
+	g_assert_cmpint (first_line, >, 0);
+
+	/* it is seen as soon as it is written, sooner than the first tick
+	 * of the old 50ms poll, and not only when the helper exits */
+	latency = first_line - start;
+	g_test_message ("first line after %.1fms, helper exited after %.1fms",
+			(gdouble) latency / 1000.f, (gdouble) (exited - start) / 1000.f);
+	g_assert_cmpint (latency, <, 50 * 1000);
+	g_assert_cmpint (exited - first_line, >=, 400 * 1000);
+}
+
+static void
+pk_test_records_stdout_cb (PkSpawn *spawn, const gchar *line, gpointer user_data)
+{
+	if (g_strcmp0 (line, "protocol") == 0)
+		pk_spawn_set_framing (spawn, PK_SPAWN_FRAMING_RECORDS);
+}
+
+static void
+pk_test_records_record_cb (PkSpawn *spawn, const guint8 *data, guint len, gpointer user_data)
+{
+	GPtrArray *records = (GPtrArray *) user_data;
+	g_ptr_array_add (records, g_strndup ((const gchar *) data, len));
+}
+
+static void
+pk_test_spawn_records_func (void)
+{
+	gboolean ret;
+	const gchar *argv[] = { "/bin/sh", "-c", NULL, NULL };
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) records = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(PkSpawn) spawn = NULL;
+
+	/* the length prefix is in host byte order */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+	argv[2] = "printf 'protocol\\n\\005\\0\\0\\0hello\\0\\0\\0\\0'; "
+		  "sleep 0.1; printf '\\003\\0\\0\\0abc'";
+#else
+	argv[2] = "printf 'protocol\\n\\0\\0\\0\\005hello\\0\\0\\0\\0'; "
+		  "sleep 0.1; printf '\\0\\0\\0\\003abc'";
+#endif
+	new_spawn_object (&spawn);
+	g_signal_connect (spawn, "stdout",
+			  G_CALLBACK (pk_test_records_stdout_cb), NULL);
+	g_signal_connect (spawn, "record",
+			  G_CALLBACK (pk_test_records_record_cb), records);
+
+	/* the second record arrives in a separate read */
+	mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	ret = pk_spawn_argv (spawn, (gchar **) argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	_g_test_loop_run_with_timeout (5000);
+	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SUCCESS);
+	g_assert_cmpint (stdout_count, ==, 1);
+	g_assert_cmpint (records->len, ==, 3);
+	g_assert_cmpstr (g_ptr_array_index (records, 0), ==, "hello");
+	g_assert_cmpstr (g_ptr_array_index (records, 1), ==, "");
+	g_assert_cmpstr (g_ptr_array_index (records, 2), ==, "abc");
+}
+
 static void
 pk_test_spawn_func (void)
 {
@@ -761,6 +1252,14 @@ pk_test_transaction_db_func (void)
 	gchar *tid;
 	gboolean ret;
 	gdouble ms;
+	const guint n_transactions = 1000;
+	guint64 job_count;
+	guint64 rows_pruned = 0;
+	const gchar *since;
+	GList *transactions;
+	PkTransactionDbCursor *cursor;
+	GPtrArray *history;
+	PkTransactionDbHistoryItem *item;
 	GError *error = NULL;
 	g_autoptr(PkTransactionDb) db = NULL;
 	g_autofree gchar *proxy_http = NULL;
@@ -880,6 +1379,89 @@ pk_test_transaction_db_func (void)
 	g_assert_true (ret);
 	g_assert_cmpstr (proxy_http, ==, "127.0.0.1:80");
 	g_assert_cmpstr (proxy_ftp, ==, "127.0.0.1:21");
+
+	/* the database overhead of each transaction, committing each time */
+	g_test_timer_start ();
+	for (guint i = 0; i < n_transactions; i++) {
+		g_autofree gchar *tid_tmp = pk_transaction_db_generate_id (db);
+		pk_transaction_db_add (db, tid_tmp);
+		pk_transaction_db_set_role (db, tid_tmp, PK_ROLE_ENUM_INSTALL_PACKAGES);
+		pk_transaction_db_set_uid (db, tid_tmp, 500);
+		pk_transaction_db_set_cmdline (db, tid_tmp, "pkcon install gnome-power-manager");
+		pk_transaction_db_set_data (db, tid_tmp, "installing\tgnome-power-manager;0.0.1;i386;data");
+		pk_transaction_db_set_finished (db, tid_tmp, TRUE, 1000);
+		while (g_main_context_iteration (NULL, FALSE));
+	}
+	ms = g_test_timer_elapsed ();
+	g_test_message ("%u transactions: %.1fus each",
+			n_transactions, ms * 1000000 / n_transactions);
+	transactions = pk_transaction_db_get_list (db, 5);
+	g_assert_cmpint (g_list_length (transactions), ==, 5);
+	g_list_free_full (transactions, g_object_unref);
+
+	/* the history is indexed by package name */
+	history = pk_transaction_db_get_package_history (db, "gnome-power-manager", 5);
+	g_assert_cmpint (history->len, ==, 5);
+	item = g_ptr_array_index (history, 0);
+	g_assert_cmpint (item->info, ==, PK_INFO_ENUM_INSTALLING);
+	g_assert_cmpstr (item->package_id, ==, "gnome-power-manager;0.0.1;i386;data");
+	g_assert_cmpint (item->uid, ==, 500);
+	g_ptr_array_unref (history);
+	history = pk_transaction_db_get_package_history (db, "gnome-power", 0);
+	g_assert_cmpint (history->len, ==, 0);
+	g_ptr_array_unref (history);
+
+	/* only the newest transactions are kept, removed when idle */
+	pk_transaction_db_set_retention (db, 0, 10, 0);
+	while (g_main_context_iteration (NULL, FALSE));
+	transactions = pk_transaction_db_get_list (db, 0);
+	g_assert_cmpint (g_list_length (transactions), ==, 10);
+	g_list_free_full (transactions, g_object_unref);
+	history = pk_transaction_db_get_package_history (db, "gnome-power-manager", 0);
+	g_assert_cmpint (history->len, <=, 10);
+	g_ptr_array_unref (history);
+	pk_transaction_db_get_retention_stats (db, &rows_pruned, NULL);
+	g_assert_cmpint (rows_pruned, >=, n_transactions - 10);
+
+	/* pages are read oldest first, counted from the newest */
+	transactions = pk_transaction_db_get_list (db, 0);
+	cursor = pk_transaction_db_cursor_new (db, 3, 2, NULL);
+	g_assert_nonnull (cursor);
+	for (guint i = 5; i < 8; i++) {
+		g_autoptr(PkTransactionPast) past = pk_transaction_db_cursor_next (cursor);
+		PkTransactionPast *expected = g_list_nth_data (transactions, i);
+		g_assert_nonnull (past);
+		g_assert_cmpstr (pk_transaction_past_get_id (past), ==,
+				 pk_transaction_past_get_id (expected));
+		g_assert_cmpint (pk_transaction_past_get_uid (past), ==, 500);
+	}
+	g_assert_null (pk_transaction_db_cursor_next (cursor));
+	g_clear_pointer (&cursor, pk_transaction_db_cursor_free);
+	since = pk_transaction_past_get_timespec (g_list_nth_data (transactions, 7));
+	cursor = pk_transaction_db_cursor_new (db, 0, 0, since);
+	g_assert_nonnull (cursor);
+	for (value = 0;; value++) {
+		g_autoptr(PkTransactionPast) past = pk_transaction_db_cursor_next (cursor);
+		if (past == NULL)
+			break;
+		g_assert_cmpstr (pk_transaction_past_get_timespec (past), >, since);
+	}
+	g_assert_cmpint (value, <=, 2);
+	g_clear_pointer (&cursor, pk_transaction_db_cursor_free);
+	g_list_free_full (transactions, g_object_unref);
+
+	/* transaction IDs are never repeated after reopening */
+	tid = pk_transaction_db_generate_id (db);
+	job_count = g_ascii_strtoull (tid + 1, NULL, 10);
+	g_free (tid);
+	g_clear_object (&db);
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	tid = pk_transaction_db_generate_id (db);
+	g_assert_cmpint (g_ascii_strtoull (tid + 1, NULL, 10), >, job_count);
+	g_free (tid);
 }
 
 static PkTransactionDb *db = NULL;
@@ -914,6 +1496,8 @@ pk_test_scheduler_func (void)
 	gboolean ret;
 	gchar *tid;
 	guint size;
+	guint value;
+	const guint *histogram;
 	gchar **array;
 	PkTransaction *transaction;
 	GError *error = NULL;
@@ -1037,6 +1621,25 @@ pk_test_scheduler_func (void)
 	/* wait for Finished */
 	_g_test_loop_run_with_timeout (2000);
 
+	/* the time spent in each phase is recorded */
+	g_assert_cmpint (pk_transaction_get_phase_time (transaction, PK_TRANSACTION_PHASE_RUNNING), >=,
+			 pk_transaction_get_phase_time (transaction, PK_TRANSACTION_PHASE_AUTHORIZED));
+	g_assert_cmpint (pk_transaction_get_phase_time (transaction, PK_TRANSACTION_PHASE_EMITTED), >=,
+			 pk_transaction_get_phase_time (transaction, PK_TRANSACTION_PHASE_FINISHED));
+	g_assert_cmpint (pk_transaction_get_phase_time (transaction, PK_TRANSACTION_PHASE_AUTHORIZED), >, 0);
+	histogram = pk_scheduler_get_histogram (tlist, PK_ROLE_ENUM_GET_UPDATES, PK_SCHEDULER_INTERVAL_TOTAL);
+	value = 0;
+	for (guint i = 0; i < PK_SCHEDULER_HISTOGRAM_BUCKETS; i++)
+		value += histogram[i];
+	g_assert_cmpint (value, ==, 1);
+
+	/* and counted for the metrics */
+	g_assert_cmpint (pk_transaction_get_exit (transaction), !=, PK_EXIT_ENUM_UNKNOWN);
+	g_assert_cmpint (pk_scheduler_get_finished (tlist, PK_ROLE_ENUM_GET_UPDATES,
+						    pk_transaction_get_exit (transaction)), ==, 1);
+	g_assert_cmpint (pk_scheduler_get_packages_emitted (tlist, PK_ROLE_ENUM_GET_UPDATES), ==,
+			 pk_transaction_get_packages_emitted (transaction));
+
 	/* get size one we have in queue */
 	size = pk_scheduler_get_size (tlist);
 	g_assert_cmpint (size, ==, 1);
@@ -1149,6 +1752,10 @@ pk_test_scheduler_func (void)
 	transaction = pk_scheduler_get_transaction (tlist, tid_item3);
 	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
 
+	/* only the third action is queued */
+	g_assert_cmpint (pk_scheduler_get_queue_depth (tlist, PK_ROLE_ENUM_SEARCH_DETAILS), ==, 1);
+	g_assert_cmpint (pk_scheduler_get_queue_depth (tlist, PK_ROLE_ENUM_SEARCH_NAME), ==, 0);
+
 	/* wait for second action */
 	_g_test_loop_run_with_timeout (10000);
 
@@ -1423,6 +2030,445 @@ pk_test_scheduler_parallel_func (void)
 	g_object_unref (db);
 }
 
+static void
+pk_test_scheduler_wait_finished (PkScheduler *tlist, const gchar *tid)
+{
+	PkTransaction *transaction;
+
+	for (guint i = 0; i < 100; i++) {
+		transaction = pk_scheduler_get_transaction (tlist, tid);
+		g_assert_nonnull (transaction);
+		if (pk_transaction_get_state (transaction) == PK_TRANSACTION_STATE_FINISHED)
+			return;
+		_g_test_loop_run_with_timeout (10000);
+	}
+	g_assert_not_reached ();
+}
+
+static void
+pk_test_scheduler_search_names (PkScheduler *tlist, const gchar *tid, const gchar *value)
+{
+	PkTransaction *transaction;
+	g_auto(GStrv) array = g_strsplit (value, " ", -1);
+
+	transaction = pk_scheduler_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_scheduler_finished_cb), NULL);
+	pk_transaction_search_names (transaction,
+				     g_variant_new ("(t^as)",
+						    pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						    array),
+				     NULL);
+}
+
+static void
+pk_test_scheduler_concurrent_reads_func (void)
+{
+	gboolean ret;
+	PkTransaction *transaction;
+	GError *error = NULL;
+	g_autofree gchar *tid_reader1 = NULL;
+	g_autofree gchar *tid_reader2 = NULL;
+	g_autofree gchar *tid_reader3 = NULL;
+	g_autofree gchar *tid_reader4 = NULL;
+	g_autofree gchar *tid_writer = NULL;
+	g_autoptr(GKeyFile) conf = NULL;
+	g_autoptr(PkBackend) backend = NULL;
+	g_autoptr(PkScheduler) tlist = NULL;
+
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* a backend that can only share its database between readers */
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "MaximumPackagesToProcess", "1000");
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "test_thread");
+	backend = pk_backend_new (conf);
+	ret = pk_backend_load (backend, NULL);
+	g_assert_true (ret);
+	g_assert_false (pk_backend_supports_parallelization (backend));
+	g_assert_true (pk_backend_supports_concurrent_reads (backend));
+
+	tlist = pk_scheduler_new (conf);
+	pk_scheduler_set_backend (tlist, backend);
+	tid_reader1 = pk_test_scheduler_create_transaction (tlist);
+	tid_reader2 = pk_test_scheduler_create_transaction (tlist);
+	tid_writer = pk_test_scheduler_create_transaction (tlist);
+	tid_reader3 = pk_test_scheduler_create_transaction (tlist);
+	tid_reader4 = pk_test_scheduler_create_transaction (tlist);
+
+	/* two readers run at the same time */
+	pk_test_scheduler_search_names (tlist, tid_reader1, "dave");
+	pk_test_scheduler_search_names (tlist, tid_reader2, "paul");
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader1);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader2);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+
+	/* a reader for another locale can't join them */
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader4);
+	ret = pk_transaction_set_hint (transaction, "locale", "de_DE.UTF-8", &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	pk_test_scheduler_search_names (tlist, tid_reader4, "gnome");
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+
+	/* a writer waits for them */
+	transaction = pk_scheduler_get_transaction (tlist, tid_writer);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_scheduler_finished_cb), NULL);
+	pk_transaction_skip_auth_checks (transaction, TRUE);
+	pk_transaction_refresh_cache (transaction, g_variant_new ("(b)", FALSE), NULL);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+	g_assert_true (pk_transaction_is_exclusive (transaction));
+
+	/* and a reader queued after the writer does not starve it */
+	pk_test_scheduler_search_names (tlist, tid_reader3, "power");
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+	g_assert_cmpint (pk_scheduler_get_queue_depth (tlist, PK_ROLE_ENUM_REFRESH_CACHE), ==, 1);
+	g_assert_cmpint (pk_scheduler_get_queue_depth (tlist, PK_ROLE_ENUM_SEARCH_NAME), ==, 2);
+
+	/* the writer runs on its own once both readers are done */
+	pk_test_scheduler_wait_finished (tlist, tid_reader1);
+	pk_test_scheduler_wait_finished (tlist, tid_reader2);
+	transaction = pk_scheduler_get_transaction (tlist, tid_writer);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+
+	/* the writer waited for the readers, which take a second */
+	g_assert_cmpint (pk_scheduler_get_queue_wait (tlist, PK_ROLE_ENUM_REFRESH_CACHE), >=, 500);
+
+	/* and then the readers, one locale at a time */
+	pk_test_scheduler_wait_finished (tlist, tid_writer);
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader3);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader4);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+	pk_test_scheduler_wait_finished (tlist, tid_reader3);
+	transaction = pk_scheduler_get_transaction (tlist, tid_reader4);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	pk_test_scheduler_wait_finished (tlist, tid_reader4);
+
+	g_object_unref (db);
+}
+
+static void
+pk_test_scheduler_refresh_cache (PkScheduler *tlist, const gchar *tid)
+{
+	PkTransaction *transaction;
+
+	/* as called over D-Bus, so that it can be coalesced */
+	transaction = pk_scheduler_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_scheduler_finished_cb), NULL);
+	pk_transaction_skip_auth_checks (transaction, TRUE);
+	pk_transaction_method_call (NULL, ":org.freedesktop.PackageKit", NULL, NULL,
+				    "RefreshCache", g_variant_new ("(b)", FALSE),
+				    NULL, transaction);
+}
+
+static void
+pk_test_scheduler_coalesce_func (void)
+{
+	gboolean ret;
+	PkTransaction *primary;
+	PkTransaction *subscriber;
+	GError *error = NULL;
+	g_autofree gchar *tid_reader = NULL;
+	g_autofree gchar *tid_primary = NULL;
+	g_autofree gchar *tid_subscriber = NULL;
+	g_autoptr(GKeyFile) conf = NULL;
+	g_autoptr(PkBackend) backend = NULL;
+	g_autoptr(PkScheduler) tlist = NULL;
+
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "MaximumPackagesToProcess", "1000");
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "test_thread");
+	backend = pk_backend_new (conf);
+	ret = pk_backend_load (backend, NULL);
+	g_assert_true (ret);
+
+	tlist = pk_scheduler_new (conf);
+	pk_scheduler_set_backend (tlist, backend);
+	tid_reader = pk_test_scheduler_create_transaction (tlist);
+	tid_primary = pk_test_scheduler_create_transaction (tlist);
+	tid_subscriber = pk_test_scheduler_create_transaction (tlist);
+
+	/* keep the backend busy so that the refreshes are queued */
+	pk_test_scheduler_search_names (tlist, tid_reader, "dave");
+
+	/* the second refresh shares the job of the first */
+	pk_test_scheduler_refresh_cache (tlist, tid_primary);
+	pk_test_scheduler_refresh_cache (tlist, tid_subscriber);
+	primary = pk_scheduler_get_transaction (tlist, tid_primary);
+	subscriber = pk_scheduler_get_transaction (tlist, tid_subscriber);
+	g_assert_nonnull (pk_transaction_get_coalesce_key (subscriber));
+	g_assert_cmpint (pk_transaction_get_state (primary), ==, PK_TRANSACTION_STATE_READY);
+	g_assert_cmpint (pk_transaction_get_state (subscriber), ==, PK_TRANSACTION_STATE_RUNNING);
+	g_assert_cmpint (pk_scheduler_get_queue_depth (tlist, PK_ROLE_ENUM_REFRESH_CACHE), ==, 1);
+
+	/* it would still need the backend to itself if it ran on its own */
+	g_assert_true (pk_transaction_is_exclusive (subscriber));
+
+	/* cancelling the first queues the second again, behind the reader,
+	 * rather than sharing the cancelled job again */
+	pk_transaction_cancel_bg (primary);
+	g_assert_cmpint (pk_transaction_get_state (primary), ==, PK_TRANSACTION_STATE_FINISHED);
+	g_assert_cmpint (pk_transaction_get_exit (primary), ==, PK_EXIT_ENUM_CANCELLED);
+	g_assert_cmpint (pk_transaction_get_state (subscriber), ==, PK_TRANSACTION_STATE_READY);
+	g_assert_true (pk_transaction_is_exclusive (subscriber));
+
+	/* and it runs its own job once the reader is done */
+	pk_test_scheduler_wait_finished (tlist, tid_reader);
+	g_assert_cmpint (pk_transaction_get_state (subscriber), ==, PK_TRANSACTION_STATE_RUNNING);
+	pk_test_scheduler_wait_finished (tlist, tid_subscriber);
+	g_assert_cmpint (pk_transaction_get_exit (subscriber), ==, PK_EXIT_ENUM_SUCCESS);
+
+	g_object_unref (db);
+}
+
+static void
+pk_test_scheduler_search_names_cached (PkScheduler *tlist, const gchar *tid)
+{
+	PkTransaction *transaction;
+	const gchar *values[] = { "power", NULL };
+
+	/* as called over D-Bus, so that the results can be cached */
+	transaction = pk_scheduler_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_scheduler_finished_cb), NULL);
+	pk_transaction_method_call (NULL, ":org.freedesktop.PackageKit", NULL, NULL,
+				    "SearchNames",
+				    g_variant_new ("(t^as)",
+						   pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						   values),
+				    NULL, transaction);
+}
+
+static void
+pk_test_scheduler_result_cache_func (void)
+{
+	gboolean ret;
+	guint64 hits, misses;
+	guint64 hits_before, misses_before;
+	PkTransaction *transaction;
+	GError *error = NULL;
+	g_autofree gchar *tid_first = NULL;
+	g_autofree gchar *tid_cached = NULL;
+	g_autofree gchar *tid_writer = NULL;
+	g_autofree gchar *tid_after = NULL;
+	g_autoptr(GKeyFile) conf = NULL;
+	g_autoptr(PkBackend) backend = NULL;
+	g_autoptr(PkScheduler) tlist = NULL;
+	g_autoptr(PkResultCache) cache = NULL;
+
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "MaximumPackagesToProcess", "1000");
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "test_thread");
+	backend = pk_backend_new (conf);
+	ret = pk_backend_load (backend, NULL);
+	g_assert_true (ret);
+
+	cache = pk_result_cache_new ();
+	pk_result_cache_set_max_size (cache, 1024 * 1024);
+	pk_result_cache_get_stats (cache, &hits_before, &misses_before, NULL, NULL, NULL, NULL);
+
+	tlist = pk_scheduler_new (conf);
+	pk_scheduler_set_backend (tlist, backend);
+	tid_first = pk_test_scheduler_create_transaction (tlist);
+	tid_cached = pk_test_scheduler_create_transaction (tlist);
+	tid_writer = pk_test_scheduler_create_transaction (tlist);
+	tid_after = pk_test_scheduler_create_transaction (tlist);
+
+	/* the second query is answered from the cache */
+	pk_test_scheduler_search_names_cached (tlist, tid_first);
+	pk_test_scheduler_wait_finished (tlist, tid_first);
+	pk_test_scheduler_search_names_cached (tlist, tid_cached);
+	pk_test_scheduler_wait_finished (tlist, tid_cached);
+	pk_result_cache_get_stats (cache, &hits, &misses, NULL, NULL, NULL, NULL);
+	g_assert_cmpint (hits - hits_before, ==, 1);
+	g_assert_cmpint (misses - misses_before, ==, 1);
+
+	/* the same query queued behind a writer starts as soon as the writer
+	 * is done, and is not answered from before it */
+	pk_test_scheduler_refresh_cache (tlist, tid_writer);
+	pk_test_scheduler_search_names_cached (tlist, tid_after);
+	transaction = pk_scheduler_get_transaction (tlist, tid_after);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_READY);
+	pk_test_scheduler_wait_finished (tlist, tid_after);
+	pk_result_cache_get_stats (cache, &hits, &misses, NULL, NULL, NULL, NULL);
+	g_assert_cmpint (hits - hits_before, ==, 1);
+	g_assert_cmpint (misses - misses_before, ==, 2);
+
+	pk_result_cache_set_max_size (cache, 0);
+	g_object_unref (db);
+}
+
+static GMutex pk_test_progress_mutex;
+
+/* records the progress signals of one transaction as they are sent */
+static GDBusMessage *
+pk_test_progress_filter_cb (GDBusConnection *connection,
+			    GDBusMessage *message,
+			    gboolean incoming,
+			    gpointer user_data)
+{
+	GPtrArray *signals = user_data;
+	GVariant *body;
+	const gchar *member;
+	const gchar *package_id;
+	const gchar *tid;
+	guint status;
+	guint percentage;
+
+	if (incoming || g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_SIGNAL)
+		return message;
+	tid = g_object_get_data (G_OBJECT (connection), "pk-test-tid");
+	if (g_strcmp0 (g_dbus_message_get_path (message), tid) != 0)
+		return message;
+
+	g_mutex_lock (&pk_test_progress_mutex);
+	body = g_dbus_message_get_body (message);
+	member = g_dbus_message_get_member (message);
+	if (g_strcmp0 (member, "ItemProgress") == 0) {
+		g_variant_get (body, "(&suu)", &package_id, &status, &percentage);
+		g_ptr_array_add (signals, g_strdup_printf ("ItemProgress(%s,%s,%u)", package_id,
+							   pk_status_enum_to_string (status),
+							   percentage));
+	} else if (g_strcmp0 (member, "PropertiesChanged") == 0) {
+		g_autoptr(GVariant) changed = g_variant_get_child_value (body, 1);
+		if (g_variant_lookup (changed, "Percentage", "u", &percentage))
+			g_ptr_array_add (signals, g_strdup_printf ("Percentage(%u)", percentage));
+	} else if (g_strcmp0 (member, "Finished") == 0) {
+		g_ptr_array_add (signals, g_strdup ("Finished"));
+	}
+	g_mutex_unlock (&pk_test_progress_mutex);
+	return message;
+}
+
+static void
+pk_test_transaction_progress_func (void)
+{
+	gboolean ret;
+	guint filter_id;
+	PkBackendJob *job;
+	PkTransaction *transaction;
+	GError *error = NULL;
+	const gchar *pkg = "glib2;2.14.0;i386;fedora";
+	const gchar *invalid[] = { "0", "101", "-1", "fast", "", NULL };
+	gint idx_download = -1;
+	gint idx_install = -1;
+	g_autofree gchar *tid = NULL;
+	g_autoptr(GDBusConnection) connection = NULL;
+	g_autoptr(GKeyFile) conf = NULL;
+	g_autoptr(GPtrArray) signals = g_ptr_array_new_with_free_func (g_free);
+	g_autoptr(PkBackend) backend = NULL;
+	g_autoptr(PkScheduler) tlist = NULL;
+
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "MaximumPackagesToProcess", "1000");
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "test_thread");
+	backend = pk_backend_new (conf);
+	ret = pk_backend_load (backend, NULL);
+	g_assert_true (ret);
+
+	tlist = pk_scheduler_new (conf);
+	pk_scheduler_set_backend (tlist, backend);
+	tid = pk_test_scheduler_create_transaction (tlist);
+	transaction = pk_scheduler_get_transaction (tlist, tid);
+
+	/* the rate is a number of updates per second from 1 to 100 */
+	for (guint i = 0; invalid[i] != NULL; i++) {
+		ret = pk_transaction_set_hint (transaction, "progress-rate", invalid[i], &error);
+		g_assert_error (error, PK_TRANSACTION_ERROR, PK_TRANSACTION_ERROR_NOT_SUPPORTED);
+		g_assert_false (ret);
+		g_clear_error (&error);
+	}
+	ret = pk_transaction_set_hint (transaction, "progress-rate", "100", &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* once a second, so that the updates below are all still pending */
+	ret = pk_transaction_set_hint (transaction, "progress-rate", "1", &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+
+	/* watch what the transaction sends on the bus */
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+	g_assert_nonnull (connection);
+	g_object_set_data_full (G_OBJECT (connection), "pk-test-tid", g_strdup (tid), g_free);
+	filter_id = g_dbus_connection_add_filter (connection, pk_test_progress_filter_cb,
+						  signals, NULL);
+
+	pk_test_scheduler_search_names (tlist, tid, "power");
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+
+	/* repeated updates of one item are sent as the latest one, but a
+	 * change of status is kept */
+	job = pk_transaction_get_backend_job (transaction);
+	pk_backend_job_set_item_progress (job, pkg, PK_STATUS_ENUM_DOWNLOAD, 10);
+	pk_backend_job_set_item_progress (job, pkg, PK_STATUS_ENUM_DOWNLOAD, 20);
+	pk_backend_job_set_item_progress (job, pkg, PK_STATUS_ENUM_DOWNLOAD, 30);
+	pk_backend_job_set_item_progress (job, pkg, PK_STATUS_ENUM_INSTALL, 0);
+
+	/* a late update of the old status is sent after the new one */
+	pk_backend_job_set_item_progress (job, pkg, PK_STATUS_ENUM_DOWNLOAD, 100);
+	pk_test_scheduler_wait_finished (tlist, tid);
+	ret = g_dbus_connection_flush_sync (connection, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_dbus_connection_remove_filter (connection, filter_id);
+
+	/* nothing pending is lost or sent after ::Finished */
+	g_mutex_lock (&pk_test_progress_mutex);
+	g_ptr_array_add (signals, NULL);
+	{
+		g_autofree gchar *dbg = g_strjoinv (" ", (gchar **) signals->pdata);
+		g_debug ("sent %s", dbg);
+	}
+	g_assert_cmpuint (signals->len, >=, 5);
+	g_assert_cmpstr (g_ptr_array_index (signals, signals->len - 2), ==, "Finished");
+	g_assert_true (g_strv_contains ((const gchar * const *) signals->pdata,
+					"Percentage(100)"));
+	g_assert_false (g_strv_contains ((const gchar * const *) signals->pdata,
+					 "ItemProgress(glib2;2.14.0;i386;fedora,download,10)"));
+	g_assert_false (g_strv_contains ((const gchar * const *) signals->pdata,
+					 "ItemProgress(glib2;2.14.0;i386;fedora,download,20)"));
+	g_assert_false (g_strv_contains ((const gchar * const *) signals->pdata,
+					 "ItemProgress(glib2;2.14.0;i386;fedora,download,30)"));
+	for (guint i = 0; i < signals->len - 1; i++) {
+		const gchar *tmp = g_ptr_array_index (signals, i);
+		if (g_strcmp0 (tmp, "ItemProgress(glib2;2.14.0;i386;fedora,install,0)") == 0)
+			idx_install = i;
+		else if (g_strcmp0 (tmp, "ItemProgress(glib2;2.14.0;i386;fedora,download,100)") == 0)
+			idx_download = i;
+	}
+	g_assert_cmpint (idx_install, >=, 0);
+	g_assert_cmpint (idx_download, >, idx_install);
+	g_mutex_unlock (&pk_test_progress_mutex);
+
+	g_object_unref (db);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1440,14 +2486,24 @@ main (int argc, char **argv)
 	/* components */
 	g_test_add_func ("/packagekit/transaction", pk_test_transaction_func);
 	g_test_add_func ("/packagekit/dbus", pk_test_dbus_func);
+	g_test_add_func ("/packagekit/result-cache", pk_test_result_cache_func);
+	g_test_add_func ("/packagekit/metrics", pk_test_metrics_func);
 	g_test_add_func ("/packagekit/spawn", pk_test_spawn_func);
+	g_test_add_func ("/packagekit/spawn-latency", pk_test_spawn_latency_func);
+	g_test_add_func ("/packagekit/spawn-records", pk_test_spawn_records_func);
 	g_test_add_func ("/packagekit/scheduler", pk_test_scheduler_func);
 	g_test_add_func ("/packagekit/scheduler-parallel", pk_test_scheduler_parallel_func);
+	g_test_add_func ("/packagekit/scheduler-concurrent-reads", pk_test_scheduler_concurrent_reads_func);
+	g_test_add_func ("/packagekit/scheduler-coalesce", pk_test_scheduler_coalesce_func);
+	g_test_add_func ("/packagekit/scheduler-result-cache", pk_test_scheduler_result_cache_func);
+	g_test_add_func ("/packagekit/transaction-progress", pk_test_transaction_progress_func);
 	g_test_add_func ("/packagekit/transaction-db", pk_test_transaction_db_func);
 
 	/* backend stuff */
 	g_test_add_func ("/packagekit/backend", pk_test_backend_func);
 	g_test_add_func ("/packagekit/backend_spawn", pk_test_backend_spawn_func);
+	g_test_add_func ("/packagekit/backend_spawn-protocol", pk_test_backend_spawn_protocol_func);
+	g_test_add_func ("/packagekit/backend_spawn-dispatcher", pk_test_backend_spawn_dispatcher_func);
 
 	return g_test_run ();
 }
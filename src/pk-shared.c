@@ -390,27 +390,51 @@ pk_util_set_auto_backend (GKeyFile *conf, GError **error)
 	return TRUE;
 }
 
+#if defined(PK_BUILD_DAEMON) && defined(linux)
+enum {
+	IOPRIO_CLASS_NONE,
+	IOPRIO_CLASS_RT,
+	IOPRIO_CLASS_BE,
+	IOPRIO_CLASS_IDLE
+};
+
+enum {
+	IOPRIO_WHO_PROCESS = 1,
+	IOPRIO_WHO_PGRP,
+	IOPRIO_WHO_USER
+};
+#define IOPRIO_CLASS_SHIFT	13
+
+static gboolean
+pk_ioprio_set (GPid pid, gint class, gint prio)
+{
+	/* FIXME: glibc should have this function */
+	return syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, pid,
+			prio | (class << IOPRIO_CLASS_SHIFT)) == 0;
+}
+#endif
+
 gboolean
 pk_ioprio_set_idle (GPid pid)
 {
 #if defined(PK_BUILD_DAEMON) && defined(linux)
-	enum {
-		IOPRIO_CLASS_NONE,
-		IOPRIO_CLASS_RT,
-		IOPRIO_CLASS_BE,
-		IOPRIO_CLASS_IDLE
-	};
-
-	enum {
-		IOPRIO_WHO_PROCESS = 1,
-		IOPRIO_WHO_PGRP,
-		IOPRIO_WHO_USER
-	};
-	#define IOPRIO_CLASS_SHIFT	13
-	gint prio = 7;
-	gint class = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
-	/* FIXME: glibc should have this function */
-	return syscall (SYS_ioprio_set, IOPRIO_WHO_PROCESS, pid, prio | class) == 0;
+	return pk_ioprio_set (pid, IOPRIO_CLASS_IDLE, 7);
+#else
+	return TRUE;
+#endif
+}
+
+/**
+ * pk_ioprio_set_default:
+ *
+ * Resets the IO class so the priority is derived from the CPU nice value
+ * again, which is required when a thread is reused for another job.
+ **/
+gboolean
+pk_ioprio_set_default (GPid pid)
+{
+#if defined(PK_BUILD_DAEMON) && defined(linux)
+	return pk_ioprio_set (pid, IOPRIO_CLASS_NONE, 0);
 #else
 	return TRUE;
 #endif
@@ -36,9 +36,11 @@
 #endif /* HAVE_UNISTD_H */
 
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 
 #include <glib/gi18n.h>
+#include <glib-unix.h>
 
 #include "pk-spawn.h"
 #include "pk-shared.h"
@@ -46,8 +48,9 @@
 static void     pk_spawn_finalize	(GObject       *object);
 
 #define PK_SPAWN_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_SPAWN, PkSpawnPrivate))
-#define PK_SPAWN_POLL_DELAY	50 /* ms */
+#define PK_SPAWN_POLL_DELAY	50 /* ms, only used when pidfd_open() is unavailable */
 #define PK_SPAWN_SIGKILL_DELAY	2500 /* ms */
+#define PK_SPAWN_RECORD_MAX	(16 * 1024 * 1024) /* bytes */
 
 struct PkSpawnPrivate
 {
@@ -55,15 +58,22 @@ struct PkSpawnPrivate
 	gint			 stdin_fd;
 	gint			 stdout_fd;
 	gint			 stderr_fd;
+	gint			 pid_fd;
+	guint			 stdout_id;
+	guint			 stderr_id;
 	guint			 poll_id;
 	guint			 kill_id;
 	gboolean		 finished;
 	gboolean		 background;
 	gboolean		 is_sending_exit;
 	gboolean		 is_changing_dispatcher;
+	gboolean		 is_emitting_stdout;
+	PkSpawnFraming		 framing;
 	gboolean		 allow_sigkill;
 	PkSpawnExitType		 exit;
 	GString			*stdout_buf;
+	gsize			 stdout_consumed;
+	gsize			 stdout_scanned;
 	GString			*stderr_buf;
 	gchar			*last_argv0;
 	gchar			**last_envp;
@@ -74,6 +84,7 @@ enum {
 	SIGNAL_EXIT,
 	SIGNAL_STDOUT,
 	SIGNAL_STDERR,
+	SIGNAL_RECORD,
 	SIGNAL_LAST
 };
 
@@ -88,52 +99,143 @@ static guint signals [SIGNAL_LAST] = { 0 };
 
 G_DEFINE_TYPE (PkSpawn, pk_spawn, G_TYPE_OBJECT)
 
+/* returns FALSE when the other end has been closed */
 static gboolean
 pk_spawn_read_fd_into_buffer (gint fd, GString *string)
 {
-	gint bytes_read;
+	gssize bytes_read;
 	gchar buffer[BUFSIZ];
 
-	/* ITS4: ignore, we manually NULL terminate and GString cannot overflow */
-	while ((bytes_read = read (fd, buffer, BUFSIZ-1)) > 0) {
-		buffer[bytes_read] = '\0';
-		g_string_append (string, buffer);
-	}
+	while (TRUE) {
+		bytes_read = read (fd, buffer, sizeof (buffer));
+		if (bytes_read > 0) {
+			g_string_append_len (string, buffer, bytes_read);
+			continue;
+		}
+		if (bytes_read < 0 && errno == EINTR)
+			continue;
 
-	return TRUE;
+		/* nothing more to read for now */
+		if (bytes_read < 0 && errno == EAGAIN)
+			return TRUE;
+
+		/* end of file, or an error we can't do anything about */
+		return FALSE;
+	}
 }
 
 static gboolean
-pk_spawn_emit_whole_lines (PkSpawn *spawn, GString *string)
+pk_spawn_emit_record (PkSpawn *spawn)
 {
-	guint i;
-	guint size;
-	guint bytes_processed;
-	g_auto(GStrv) lines = NULL;
+	PkSpawnPrivate *priv = spawn->priv;
+	GString *string = priv->stdout_buf;
+	gsize offset = priv->stdout_consumed;
+	guint32 length;
 
-	/* if nothing then don't emit */
-	if (pk_strzero (string->str))
+	/* wait for the rest of the record */
+	if (string->len - offset < sizeof (length))
+		return FALSE;
+	memcpy (&length, string->str + offset, sizeof (length));
+	if (length > PK_SPAWN_RECORD_MAX) {
+		g_warning ("record of %u bytes is too large, discarding output", length);
+		priv->stdout_consumed = string->len;
+		return FALSE;
+	}
+	if (string->len - offset - sizeof (length) < length)
 		return FALSE;
 
-	/* split into lines - the last line may be incomplete */
-	lines = g_strsplit (string->str, "\n", 0);
-	if (lines == NULL)
+	/* the payload is only valid during the emission */
+	priv->stdout_consumed = offset + sizeof (length) + length;
+	priv->stdout_scanned = priv->stdout_consumed;
+	g_signal_emit (spawn, signals [SIGNAL_RECORD], 0,
+		       string->str + offset + sizeof (length), (guint) length);
+	return TRUE;
+}
+
+static gboolean
+pk_spawn_emit_line (PkSpawn *spawn)
+{
+	PkSpawnPrivate *priv = spawn->priv;
+	GString *string = priv->stdout_buf;
+	const gchar *eol;
+	gsize end;
+	g_autofree gchar *line = NULL;
+
+	/* only scan the data that arrived since the last time */
+	eol = memchr (string->str + priv->stdout_scanned, '\n',
+		      string->len - priv->stdout_scanned);
+	if (eol == NULL) {
+		priv->stdout_scanned = string->len;
 		return FALSE;
+	}
+	end = eol - string->str;
+	line = g_strndup (string->str + priv->stdout_consumed,
+			  end - priv->stdout_consumed);
+	priv->stdout_consumed = end + 1;
+	priv->stdout_scanned = end + 1;
+	g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, line);
+	return TRUE;
+}
+
+static void
+pk_spawn_emit_stdout (PkSpawn *spawn)
+{
+	PkSpawnPrivate *priv = spawn->priv;
+	gboolean ret;
 
-	/* find size */
-	size = g_strv_length (lines);
+	/* a handler caused the child to be checked, and the outer call
+	 * still has a pointer into the buffer */
+	if (priv->is_emitting_stdout)
+		return;
 
-	bytes_processed = 0;
-	/* we only emit n-1 strings */
-	for (i = 0; i < (size-1); i++) {
-		g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, lines[i]);
-		/* ITS4: ignore, g_strsplit always NULL terminates */
-		bytes_processed += strlen (lines[i]) + 1;
+	/* the framing can be changed by a handler of the previous line */
+	priv->is_emitting_stdout = TRUE;
+	do {
+		if (priv->framing == PK_SPAWN_FRAMING_RECORDS)
+			ret = pk_spawn_emit_record (spawn);
+		else
+			ret = pk_spawn_emit_line (spawn);
+	} while (ret);
+	priv->is_emitting_stdout = FALSE;
+
+	/* remove the data we've processed in one go */
+	if (priv->stdout_consumed > 0) {
+		g_string_erase (priv->stdout_buf, 0, priv->stdout_consumed);
+		priv->stdout_scanned -= priv->stdout_consumed;
+		priv->stdout_consumed = 0;
 	}
+}
 
-	/* remove the text we've processed */
-	g_string_erase (string, 0, bytes_processed);
-	return TRUE;
+static void
+pk_spawn_emit_stderr (PkSpawn *spawn)
+{
+	/* emit all lines on standard error in one callback, as it's all
+	 * probably related to the error that just happened */
+	if (spawn->priv->stderr_buf->len != 0) {
+		g_signal_emit (spawn, signals [SIGNAL_STDERR], 0, spawn->priv->stderr_buf->str);
+		g_string_set_size (spawn->priv->stderr_buf, 0);
+	}
+}
+
+static void
+pk_spawn_remove_watches (PkSpawn *spawn)
+{
+	if (spawn->priv->stdout_id != 0) {
+		g_source_remove (spawn->priv->stdout_id);
+		spawn->priv->stdout_id = 0;
+	}
+	if (spawn->priv->stderr_id != 0) {
+		g_source_remove (spawn->priv->stderr_id);
+		spawn->priv->stderr_id = 0;
+	}
+	if (spawn->priv->poll_id != 0) {
+		g_source_remove (spawn->priv->poll_id);
+		spawn->priv->poll_id = 0;
+	}
+	if (spawn->priv->pid_fd != -1) {
+		close (spawn->priv->pid_fd);
+		spawn->priv->pid_fd = -1;
+	}
 }
 
 static const gchar *
@@ -169,18 +271,14 @@ pk_spawn_check_child (PkSpawn *spawn)
 		return FALSE;
 	}
 
-	pk_spawn_read_fd_into_buffer (spawn->priv->stdout_fd, spawn->priv->stdout_buf);
+	/* pick up anything written just before the child exited */
+	if (!spawn->priv->is_emitting_stdout)
+		pk_spawn_read_fd_into_buffer (spawn->priv->stdout_fd, spawn->priv->stdout_buf);
 	pk_spawn_read_fd_into_buffer (spawn->priv->stderr_fd, spawn->priv->stderr_buf);
-
-	/* emit all lines on standard out in one callback, as it's all probably
-	* related to the error that just happened */
-	if (spawn->priv->stderr_buf->len != 0) {
-		g_signal_emit (spawn, signals [SIGNAL_STDERR], 0, spawn->priv->stderr_buf->str);
-		g_string_set_size (spawn->priv->stderr_buf, 0);
-	}
+	pk_spawn_emit_stderr (spawn);
 
 	/* all usual output goes on standard out, only bad libraries bitch to stderr */
-	pk_spawn_emit_whole_lines (spawn, spawn->priv->stdout_buf);
+	pk_spawn_emit_stdout (spawn);
 
 	/* Only print one in twenty times to avoid filling the screen */
 	if (limit_printing++ % 20 == 0)
@@ -202,11 +300,8 @@ pk_spawn_check_child (PkSpawn *spawn)
 		return TRUE;
 	}
 
-	/* disconnect the poll as there will be no more updates */
-	if (spawn->priv->poll_id > 0) {
-		g_source_remove (spawn->priv->poll_id);
-		spawn->priv->poll_id = 0;
-	}
+	/* disconnect the watches as there will be no more updates */
+	pk_spawn_remove_watches (spawn);
 
 	/* child exited, close resources */
 	close (spawn->priv->stdin_fd);
@@ -276,6 +371,73 @@ pk_spawn_check_child (PkSpawn *spawn)
 	return FALSE;
 }
 
+static gboolean
+pk_spawn_stdout_cb (gint fd, GIOCondition condition, gpointer user_data)
+{
+	PkSpawn *spawn = PK_SPAWN (user_data);
+	gboolean ret;
+
+	ret = pk_spawn_read_fd_into_buffer (fd, spawn->priv->stdout_buf);
+	pk_spawn_emit_stdout (spawn);
+
+	/* a signal handler made us exit or respawn the child */
+	if (g_source_is_destroyed (g_main_current_source ()))
+		return G_SOURCE_REMOVE;
+
+	/* the child exit is noticed using the pidfd or the poll */
+	if (!ret) {
+		spawn->priv->stdout_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+pk_spawn_stderr_cb (gint fd, GIOCondition condition, gpointer user_data)
+{
+	PkSpawn *spawn = PK_SPAWN (user_data);
+	gboolean ret;
+
+	ret = pk_spawn_read_fd_into_buffer (fd, spawn->priv->stderr_buf);
+	pk_spawn_emit_stderr (spawn);
+	if (g_source_is_destroyed (g_main_current_source ()))
+		return G_SOURCE_REMOVE;
+	if (!ret) {
+		spawn->priv->stderr_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+pk_spawn_pid_fd_cb (gint fd, GIOCondition condition, gpointer user_data)
+{
+	PkSpawn *spawn = PK_SPAWN (user_data);
+
+	if (!pk_spawn_check_child (spawn))
+		return G_SOURCE_REMOVE;
+
+	/* the pidfd stays readable, so don't spin if waitpid() disagrees */
+	g_warning ("child %ld exited but could not be reaped, polling",
+		   (long)spawn->priv->child_pid);
+	close (spawn->priv->pid_fd);
+	spawn->priv->pid_fd = -1;
+	spawn->priv->poll_id = g_timeout_add (PK_SPAWN_POLL_DELAY, (GSourceFunc) pk_spawn_check_child, spawn);
+	g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] exit poll");
+	return G_SOURCE_REMOVE;
+}
+
+static gint
+pk_spawn_pid_fd_open (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall (SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
 static gboolean
 pk_spawn_sigkill_cb (PkSpawn *spawn)
 {
@@ -305,6 +467,21 @@ out:
 	return FALSE;
 }
 
+/**
+ * pk_spawn_set_framing:
+ *
+ * Sets how standard out is split up. This can be called from a ::stdout
+ * handler, in which case the data following that line uses the new framing.
+ * A new instance always starts with %PK_SPAWN_FRAMING_LINES.
+ **/
+void
+pk_spawn_set_framing (PkSpawn *spawn, PkSpawnFraming framing)
+{
+	g_return_if_fail (PK_IS_SPAWN (spawn));
+	g_return_if_fail (framing < PK_SPAWN_FRAMING_LAST);
+	spawn->priv->framing = framing;
+}
+
 /**
  * pk_spawn_is_running:
  *
@@ -372,7 +549,7 @@ pk_spawn_kill (PkSpawn *spawn)
  * Send new comands to a running (but idle) dispatcher script
  *
  **/
-static gboolean
+gboolean
 pk_spawn_send_stdin (PkSpawn *spawn, const gchar *command)
 {
 	gint wrote;
@@ -489,6 +666,24 @@ pk_strvequal (gchar **id1, gchar **id2)
 	return TRUE;
 }
 
+/* a background child gets the CPU and disk when nothing else wants them */
+static void
+pk_spawn_set_child_priority (PkSpawn *spawn)
+{
+#if HAVE_SETPRIORITY
+	gint nice_value = spawn->priv->background ? 10 : 0;
+
+	g_debug ("renice to %i", nice_value);
+	setpriority (PRIO_PROCESS, spawn->priv->child_pid, nice_value);
+#endif
+	if (spawn->priv->background) {
+		g_debug ("setting ioprio class to idle");
+		pk_ioprio_set_idle (spawn->priv->child_pid);
+	} else {
+		pk_ioprio_set_default (spawn->priv->child_pid);
+	}
+}
+
 /**
  * pk_spawn_argv:
  * @argv: Can be generated using g_strsplit (command, " ", 0)
@@ -502,9 +697,6 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 	gboolean ret = TRUE;
 	guint i;
 	guint len;
-#if HAVE_SETPRIORITY
-	gint nice_value = 0;
-#endif
 	gint rc;
 	g_autoptr(GError) error_local = NULL;
 
@@ -559,17 +751,18 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 		ret = pk_spawn_exit (spawn);
 		if (!ret) {
 			g_warning ("failed to exit previous instance");
-			/* remove poll, as we can't reply on pk_spawn_check_child() */
-			if (spawn->priv->poll_id != 0) {
-				g_source_remove (spawn->priv->poll_id);
-				spawn->priv->poll_id = 0;
-			}
+			/* remove watches, as we can't reply on pk_spawn_check_child() */
+			pk_spawn_remove_watches (spawn);
 		}
 		spawn->priv->is_changing_dispatcher = FALSE;
 	}
 
 	/* create spawned object for tracking */
 	spawn->priv->finished = FALSE;
+	spawn->priv->framing = PK_SPAWN_FRAMING_LINES;
+	g_string_set_size (spawn->priv->stdout_buf, 0);
+	spawn->priv->stdout_consumed = 0;
+	spawn->priv->stdout_scanned = 0;
 	g_debug ("creating new instance of %s", argv[0]);
 	ret = g_spawn_async_with_pipes (NULL, argv, envp,
 				 G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
@@ -584,23 +777,9 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 		goto out;
 	}
 
-#if HAVE_SETPRIORITY
-	/* get the nice value and ensure we are in the valid range */
-	if (spawn->priv->background)
-		nice_value = 10;
-
 	/* don't completely bog the system down */
-	if (nice_value != 0) {
-		g_debug ("renice to %i", nice_value);
-		setpriority (PRIO_PROCESS, spawn->priv->child_pid, nice_value);
-	}
-#endif
-
-	/* set idle IO priority */
-	if (spawn->priv->background) {
-		g_debug ("setting ioprio class to idle");
-		pk_ioprio_set_idle (spawn->priv->child_pid);
-	}
+	if (spawn->priv->background)
+		pk_spawn_set_child_priority (spawn);
 
 	/* save this so we can check the dispatcher name */
 	g_free (spawn->priv->last_argv0);
@@ -625,14 +804,34 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 	}
 
 	/* sanity check */
-	if (spawn->priv->poll_id != 0) {
-		g_warning ("trying to set timeout when already set");
-		g_source_remove (spawn->priv->poll_id);
+	if (spawn->priv->stdout_id != 0 || spawn->priv->poll_id != 0) {
+		g_warning ("trying to add watches when already set");
+		pk_spawn_remove_watches (spawn);
+	}
+
+	/* emit output as soon as the child writes it */
+	spawn->priv->stdout_id = g_unix_fd_add (spawn->priv->stdout_fd,
+						G_IO_IN | G_IO_HUP | G_IO_ERR,
+						pk_spawn_stdout_cb, spawn);
+	g_source_set_name_by_id (spawn->priv->stdout_id, "[PkSpawn] stdout");
+	spawn->priv->stderr_id = g_unix_fd_add (spawn->priv->stderr_fd,
+						G_IO_IN | G_IO_HUP | G_IO_ERR,
+						pk_spawn_stderr_cb, spawn);
+	g_source_set_name_by_id (spawn->priv->stderr_id, "[PkSpawn] stderr");
+
+	/* we can't use a child watch as pk_spawn_exit() has to reap the child
+	 * without running the main loop, and the output pipes can be held open
+	 * by grandchildren, so watch a pidfd that does not reap the child */
+	spawn->priv->pid_fd = pk_spawn_pid_fd_open (spawn->priv->child_pid);
+	if (spawn->priv->pid_fd >= 0) {
+		spawn->priv->poll_id = g_unix_fd_add (spawn->priv->pid_fd, G_IO_IN,
+						      pk_spawn_pid_fd_cb, spawn);
+		g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] exit");
+	} else {
+		g_debug ("no pidfd support, polling for exit: %s", g_strerror (errno));
+		spawn->priv->poll_id = g_timeout_add (PK_SPAWN_POLL_DELAY, (GSourceFunc) pk_spawn_check_child, spawn);
+		g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] exit poll");
 	}
-
-	/* poll quickly */
-	spawn->priv->poll_id = g_timeout_add (PK_SPAWN_POLL_DELAY, (GSourceFunc) pk_spawn_check_child, spawn);
-	g_source_set_name_by_id (spawn->priv->poll_id, "[PkSpawn] main poll");
 out:
 	return ret;
 }
@@ -664,7 +863,12 @@ pk_spawn_set_property (GObject *object, guint prop_id, const GValue *value, GPar
 
 	switch (prop_id) {
 	case PROP_BACKGROUND:
-		priv->background = g_value_get_boolean (value);
+		/* a helper that is kept running takes on the new priority */
+		if (priv->background != g_value_get_boolean (value)) {
+			priv->background = g_value_get_boolean (value);
+			if (priv->child_pid != -1)
+				pk_spawn_set_child_priority (spawn);
+		}
 		break;
 	case PROP_ALLOW_SIGKILL:
 		priv->allow_sigkill = g_value_get_boolean (value);
@@ -719,6 +923,11 @@ pk_spawn_class_init (PkSpawnClass *klass)
 			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
 			      0, NULL, NULL, g_cclosure_marshal_VOID__STRING,
 			      G_TYPE_NONE, 1, G_TYPE_STRING);
+	signals [SIGNAL_RECORD] =
+		g_signal_new ("record",
+			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
+			      0, NULL, NULL, g_cclosure_marshal_generic,
+			      G_TYPE_NONE, 2, G_TYPE_POINTER, G_TYPE_UINT);
 
 	g_type_class_add_private (klass, sizeof (PkSpawnPrivate));
 }
@@ -732,6 +941,9 @@ pk_spawn_init (PkSpawn *spawn)
 	spawn->priv->stdout_fd = -1;
 	spawn->priv->stderr_fd = -1;
 	spawn->priv->stdin_fd = -1;
+	spawn->priv->pid_fd = -1;
+	spawn->priv->stdout_id = 0;
+	spawn->priv->stderr_id = 0;
 	spawn->priv->poll_id = 0;
 	spawn->priv->kill_id = 0;
 	spawn->priv->finished = FALSE;
@@ -742,6 +954,7 @@ pk_spawn_init (PkSpawn *spawn)
 	spawn->priv->last_envp = NULL;
 	spawn->priv->background = FALSE;
 	spawn->priv->exit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	spawn->priv->framing = PK_SPAWN_FRAMING_LINES;
 
 	spawn->priv->stdout_buf = g_string_new ("");
 	spawn->priv->stderr_buf = g_string_new ("");
@@ -759,11 +972,8 @@ pk_spawn_finalize (GObject *object)
 
 	g_return_if_fail (spawn->priv != NULL);
 
-	/* disconnect the poll in case we were cancelled before completion */
-	if (spawn->priv->poll_id != 0) {
-		g_source_remove (spawn->priv->poll_id);
-		spawn->priv->poll_id = 0;
-	}
+	/* disconnect the watches in case we were cancelled before completion */
+	pk_spawn_remove_watches (spawn);
 
 	/* disconnect the SIGKILL check */
 	if (spawn->priv->kill_id != 0) {
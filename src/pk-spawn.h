@@ -73,6 +73,17 @@ typedef enum {
 	PK_SPAWN_ARGV_FLAGS_LAST
 } PkSpawnArgvFlags;
 
+/**
+ * PkSpawnFraming:
+ *
+ * How standard out of the spawned file is split up
+ **/
+typedef enum {
+	PK_SPAWN_FRAMING_LINES,			/* newline terminated, emitted as ::stdout */
+	PK_SPAWN_FRAMING_RECORDS,		/* guint32 length prefixed, emitted as ::record */
+	PK_SPAWN_FRAMING_LAST
+} PkSpawnFraming;
+
 GType		 pk_spawn_get_type			(void);
 PkSpawn		*pk_spawn_new				(GKeyFile		*conf);
 
@@ -85,6 +96,10 @@ gboolean	 pk_spawn_argv				(PkSpawn	*spawn,
 gboolean	 pk_spawn_is_running			(PkSpawn	*spawn);
 gboolean	 pk_spawn_kill				(PkSpawn	*spawn);
 gboolean	 pk_spawn_exit				(PkSpawn	*spawn);
+gboolean	 pk_spawn_send_stdin			(PkSpawn	*spawn,
+							 const gchar	*command);
+void		 pk_spawn_set_framing			(PkSpawn	*spawn,
+							 PkSpawnFraming	 framing);
 
 G_END_DECLS
 
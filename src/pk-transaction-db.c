@@ -39,6 +39,7 @@
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-results.h>
 #include <packagekit-glib2/pk-common.h>
+#include <packagekit-glib2/pk-package-id.h>
 
 #include "pk-shared.h"
 
@@ -48,18 +49,137 @@ static void     pk_transaction_db_finalize	(GObject        *object);
 
 #define PK_TRANSACTION_DB_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_TRANSACTION_DB, PkTransactionDbPrivate))
 
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (sqlite3_stmt, sqlite3_finalize);
+/* how many transaction IDs are reserved with each synced write, so that an
+ * ID is never handed out twice even if the system crashes */
+#define PK_TRANSACTION_DB_JOB_COUNT_RESERVE	100
+
+/* the retention policy is enforced in small steps when the daemon is idle,
+ * so that removing a large backlog never blocks the main loop */
+#define PK_TRANSACTION_DB_PRUNE_BATCH		100	/* transactions */
+#define PK_TRANSACTION_DB_VACUUM_PAGES		256	/* pages */
+#define PK_TRANSACTION_DB_PRUNE_INTERVAL	3600	/* s */
+
+/* how often a COMMIT that found the database locked is tried again */
+#define PK_TRANSACTION_DB_COMMIT_RETRIES	5
+
+typedef enum {
+	PK_TRANSACTION_DB_STMT_ADD,
+	PK_TRANSACTION_DB_STMT_SET_ROLE,
+	PK_TRANSACTION_DB_STMT_SET_UID,
+	PK_TRANSACTION_DB_STMT_SET_CMDLINE,
+	PK_TRANSACTION_DB_STMT_SET_DATA,
+	PK_TRANSACTION_DB_STMT_SET_FINISHED,
+	PK_TRANSACTION_DB_STMT_GET_LIST,
+	PK_TRANSACTION_DB_STMT_GET_ACTION_TIME,
+	PK_TRANSACTION_DB_STMT_SET_ACTION_TIME,
+	PK_TRANSACTION_DB_STMT_GET_PROXY,
+	PK_TRANSACTION_DB_STMT_UPDATE_PROXY,
+	PK_TRANSACTION_DB_STMT_INSERT_PROXY,
+	PK_TRANSACTION_DB_STMT_SET_JOB_COUNT,
+	PK_TRANSACTION_DB_STMT_GET_TIMESPEC,
+	PK_TRANSACTION_DB_STMT_ADD_HISTORY,
+	PK_TRANSACTION_DB_STMT_GET_HISTORY,
+	PK_TRANSACTION_DB_STMT_COUNT,
+	PK_TRANSACTION_DB_STMT_GET_OLDEST,
+	PK_TRANSACTION_DB_STMT_GET_OLDER_THAN,
+	PK_TRANSACTION_DB_STMT_REMOVE,
+	PK_TRANSACTION_DB_STMT_REMOVE_HISTORY,
+	PK_TRANSACTION_DB_STMT_PAGE_COUNT,
+	PK_TRANSACTION_DB_STMT_FREELIST_COUNT,
+	PK_TRANSACTION_DB_STMT_COUNT_SINCE,
+	PK_TRANSACTION_DB_STMT_LAST
+} PkTransactionDbStmt;
+
+static const gchar *pk_transaction_db_stmt_sql[] = {
+	"INSERT INTO transactions (transaction_id, timespec) VALUES (?1, ?2)",
+	"UPDATE transactions SET role=?1 WHERE transaction_id=?2",
+	"UPDATE transactions SET uid=?1 WHERE transaction_id=?2",
+	"UPDATE transactions SET cmdline=?1 WHERE transaction_id=?2",
+	"UPDATE transactions SET data=?1 WHERE transaction_id=?2",
+	"UPDATE transactions SET succeeded=?1, duration=?2 WHERE transaction_id=?3",
+	"SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
+		"FROM transactions ORDER BY timespec DESC LIMIT ?1",
+	"SELECT timespec FROM last_action WHERE role = ?1",
+	"INSERT OR REPLACE INTO last_action (role, timespec) VALUES (?1, ?2)",
+	"SELECT proxy_http, proxy_https, proxy_ftp, proxy_socks, no_proxy, pac "
+		"FROM proxy WHERE uid = ?1 AND session IS ?2 LIMIT 1",
+	"UPDATE proxy SET proxy_http = ?1, proxy_https = ?2, proxy_ftp = ?3, "
+		"proxy_socks = ?4, no_proxy = ?5, pac = ?6 "
+		"WHERE uid = ?7 AND session IS ?8",
+	"INSERT INTO proxy (created, uid, session, proxy_http, proxy_https, "
+		"proxy_ftp, proxy_socks, no_proxy, pac) "
+		"VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)",
+	"UPDATE config SET value = ?1 WHERE key = 'job_count'",
+	"SELECT timespec FROM transactions WHERE transaction_id = ?1",
+	"INSERT INTO history (transaction_id, name, package_id, info, timestamp) "
+		"VALUES (?1, ?2, ?3, ?4, ?5)",
+	/* the newest entries, oldest first */
+	"SELECT info, package_id, timestamp, uid FROM ("
+		"SELECT h.info, h.package_id, h.timestamp, t.uid FROM history h "
+		"JOIN transactions t ON t.transaction_id = h.transaction_id "
+		"WHERE h.name = ?1 AND t.succeeded = 1 "
+		"ORDER BY h.timestamp DESC LIMIT ?2) "
+		"ORDER BY timestamp ASC",
+	"SELECT COUNT(*) FROM transactions",
+	"SELECT transaction_id FROM transactions ORDER BY timespec ASC LIMIT ?1",
+	"SELECT transaction_id FROM transactions WHERE timespec < ?1 "
+		"ORDER BY timespec ASC LIMIT ?2",
+	"DELETE FROM transactions WHERE transaction_id = ?1",
+	"DELETE FROM history WHERE transaction_id = ?1",
+	"PRAGMA page_count",
+	"PRAGMA freelist_count",
+	"SELECT COUNT(*) FROM transactions WHERE timespec > ?1",
+};
+
+/* not cached, as each cursor is stepped for as long as it is in use */
+#define PK_TRANSACTION_DB_CURSOR_SQL \
+	"SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline " \
+	"FROM transactions WHERE timespec > ?1 ORDER BY timespec ASC LIMIT ?2 OFFSET ?3"
+
+struct PkTransactionDbCursor
+{
+	PkTransactionDb		*tdb;
+	sqlite3_stmt		*statement;
+};
+
+/* a statement owned by the cache, which only has to be reset after use */
+typedef sqlite3_stmt PkTransactionDbStatement;
+
+static void
+pk_transaction_db_statement_release (PkTransactionDbStatement *statement)
+{
+	sqlite3_reset (statement);
+	sqlite3_clear_bindings (statement);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PkTransactionDbStatement, pk_transaction_db_statement_release);
 
 struct PkTransactionDbPrivate
 {
 	gboolean		 loaded;
 	sqlite3			*db;
 	guint			 job_count;
+	guint			 job_count_reserved;
 	guint			 database_save_id;
+	guint			 commit_retries;
+	sqlite3_stmt		*statements[PK_TRANSACTION_DB_STMT_LAST];
+	guint			 retention_max_age;
+	guint			 retention_max_rows;
+	guint64			 retention_max_size;
+	guint			 prune_id;
+	guint			 prune_timeout_id;
+	guint64			 page_size;
+	gboolean		 incremental_vacuum;
+	gboolean		 rebuild_failed;
+	guint64			 rows_pruned;
+	guint64			 bytes_reclaimed;
+	guint			 cursors;
 };
 
 G_DEFINE_TYPE (PkTransactionDb, pk_transaction_db, G_TYPE_OBJECT)
 
+static gpointer pk_transaction_db_object = NULL;
+
 typedef struct {
 	gchar		*proxy_http;
 	gchar		*proxy_https;
@@ -70,64 +190,6 @@ typedef struct {
 	gboolean	set;
 } PkTransactionDbProxyItem;
 
-static gint
-pk_transaction_db_add_transaction_cb (void *data,
-				      gint argc,
-				      gchar **argv,
-				      gchar **col_name)
-{
-	PkTransactionPast *item;
-	GList **list = (GList **) data;
-	gint i;
-	gchar *col;
-	gchar *value;
-	guint temp;
-
-	item = pk_transaction_past_new ();
-	for (i = 0; i < argc; i++) {
-		col = col_name[i];
-		value = argv[i];
-		if (g_strcmp0 (col, "succeeded") == 0) {
-			if (!pk_strtouint (value, &temp)) {
-				g_warning ("failed to parse succeeded: %s", value);
-				continue;
-			}
-			if (temp == 1)
-				g_object_set (item, "succeeded", TRUE, NULL);
-			else
-				g_object_set (item, "succeeded", FALSE, NULL);
-		} else if (g_strcmp0 (col, "role") == 0) {
-			if (value != NULL)
-				g_object_set (item, "role", pk_role_enum_from_string (value), NULL);
-		} else if (g_strcmp0 (col, "transaction_id") == 0) {
-			if (value != NULL)
-				g_object_set (item, "tid", value, NULL);
-		} else if (g_strcmp0 (col, "timespec") == 0) {
-			if (value != NULL)
-				g_object_set (item, "timespec", value, NULL);
-		} else if (g_strcmp0 (col, "cmdline") == 0) {
-			if (value != NULL)
-				g_object_set (item, "cmdline", value, NULL);
-		} else if (g_strcmp0 (col, "data") == 0) {
-			if (value != NULL)
-				g_object_set (item, "data", value, NULL);
-		} else if (g_strcmp0 (col, "uid") == 0) {
-			if (pk_strtouint (value, &temp))
-				g_object_set (item, "uid", temp, NULL);
-		} else if (g_strcmp0 (col, "duration") == 0) {
-			if (pk_strtouint (value, &temp))
-				g_object_set (item, "duration", temp, NULL);
-		} else {
-			g_warning ("%s = %s", col, value);
-		}
-	}
-
-	/* add to start of the list */
-	*list = g_list_prepend (*list, item);
-
-	return 0;
-}
-
 static gboolean
 pk_transaction_db_sql_statement (PkTransactionDb *tdb, const gchar *sql)
 {
@@ -147,23 +209,141 @@ pk_transaction_db_sql_statement (PkTransactionDb *tdb, const gchar *sql)
 	return TRUE;
 }
 
-static gint
-pk_time_action_sqlite_callback (void *data, gint argc, gchar **argv, gchar **col_name)
+static gboolean
+pk_transaction_db_prepare (PkTransactionDb *tdb, const gchar *sql, sqlite3_stmt **statement)
 {
-	gint i;
-	gchar *col;
-	gchar *value;
-	gchar **timespec = (gchar**) data;
+	gint rc = 0;
+	*statement = NULL;
 
-	for (i = 0; i < argc; i++) {
-		col = col_name[i];
-		value = argv[i];
-		if (g_strcmp0 (col, "timespec") == 0)
-			*timespec = g_strdup (value);
-		else
-			g_warning ("%s = %s", col, value);
+	if ((rc = sqlite3_prepare_v2 (tdb->priv->db,
+				      sql,
+				      -1,
+				      statement,
+				      NULL) != SQLITE_OK)) {
+		g_warning ("(%s) prepare error: %d: %s", sql, rc, sqlite3_errmsg (tdb->priv->db));
+		return FALSE;
 	}
-	return 0;
+
+	return TRUE;
+}
+
+/* returns a cached statement, release with pk_transaction_db_statement_release() */
+static PkTransactionDbStatement *
+pk_transaction_db_get_statement (PkTransactionDb *tdb, PkTransactionDbStmt id)
+{
+	sqlite3_stmt **statement = &tdb->priv->statements[id];
+	if (*statement == NULL &&
+	    !pk_transaction_db_prepare (tdb, pk_transaction_db_stmt_sql[id], statement))
+		return NULL;
+	return *statement;
+}
+
+static gboolean
+pk_transaction_db_step (sqlite3 *db, sqlite3_stmt *statement)
+{
+	gint rc = 0;
+
+	rc = sqlite3_step (statement);
+
+	if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+		g_warning ("SQL error: %d: %s", rc, sqlite3_errmsg (db));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* the connection must not be left inside a transaction that can't commit */
+static void
+pk_transaction_db_rollback (PkTransactionDb *tdb)
+{
+	g_warning ("failed to commit, discarding the deferred writes");
+	tdb->priv->commit_retries = 0;
+	if (sqlite3_get_autocommit (tdb->priv->db) == 0)
+		pk_transaction_db_sql_statement (tdb, "ROLLBACK");
+}
+
+static gboolean
+pk_transaction_db_commit_cb (gpointer user_data)
+{
+	PkTransactionDb *tdb = PK_TRANSACTION_DB (user_data);
+	gint rc;
+
+	tdb->priv->database_save_id = 0;
+	if (pk_transaction_db_sql_statement (tdb, "COMMIT")) {
+		tdb->priv->commit_retries = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	/* a lock held by another connection leaves the transaction open */
+	rc = sqlite3_errcode (tdb->priv->db);
+	if ((rc == SQLITE_BUSY || rc == SQLITE_LOCKED) &&
+	    sqlite3_get_autocommit (tdb->priv->db) == 0 &&
+	    tdb->priv->commit_retries++ < PK_TRANSACTION_DB_COMMIT_RETRIES) {
+		tdb->priv->database_save_id =
+			g_timeout_add_seconds_full (G_PRIORITY_LOW, 1,
+						    pk_transaction_db_commit_cb,
+						    tdb, NULL);
+		g_source_set_name_by_id (tdb->priv->database_save_id, "[PkTransactionDb] commit");
+		return G_SOURCE_REMOVE;
+	}
+	pk_transaction_db_rollback (tdb);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+pk_transaction_db_commit (PkTransactionDb *tdb)
+{
+	if (tdb->priv->database_save_id == 0)
+		return;
+	g_source_remove (tdb->priv->database_save_id);
+	tdb->priv->database_save_id = 0;
+
+	/* the caller needs the writes done now, so there is no retry */
+	if (!pk_transaction_db_sql_statement (tdb, "COMMIT")) {
+		pk_transaction_db_rollback (tdb);
+		return;
+	}
+	tdb->priv->commit_retries = 0;
+}
+
+/*
+ * All the writes made before the daemon is next idle are committed
+ * together, as each commit has to wait for the disk. Reads on the same
+ * connection already see the uncommitted data.
+ */
+static gboolean
+pk_transaction_db_begin_write (PkTransactionDb *tdb)
+{
+	if (tdb->priv->database_save_id != 0)
+		return TRUE;
+	if (!pk_transaction_db_sql_statement (tdb, "BEGIN"))
+		return FALSE;
+	tdb->priv->database_save_id =
+		g_idle_add_full (G_PRIORITY_LOW, pk_transaction_db_commit_cb, tdb, NULL);
+	g_source_set_name_by_id (tdb->priv->database_save_id, "[PkTransactionDb] commit");
+	return TRUE;
+}
+
+/* all the properties are set at once, as this is done for every row */
+static PkTransactionPast *
+pk_transaction_db_past_from_row (sqlite3_stmt *statement)
+{
+	const gchar *role = (const gchar *) sqlite3_column_text (statement, 4);
+	guint uid = G_MAXUINT;
+
+	if (sqlite3_column_type (statement, 6) != SQLITE_NULL)
+		uid = (guint) sqlite3_column_int (statement, 6);
+	return g_object_new (PK_TYPE_TRANSACTION_PAST,
+			     "tid", (const gchar *) sqlite3_column_text (statement, 0),
+			     "timespec", (const gchar *) sqlite3_column_text (statement, 1),
+			     "succeeded", sqlite3_column_int (statement, 2) == 1,
+			     "duration", (guint) sqlite3_column_int (statement, 3),
+			     "role", role != NULL ? pk_role_enum_from_string (role) : PK_ROLE_ENUM_UNKNOWN,
+			     "data", (const gchar *) sqlite3_column_text (statement, 5),
+			     "uid", uid,
+			     "cmdline", (const gchar *) sqlite3_column_text (statement, 7),
+			     NULL);
 }
 
 /**
@@ -199,25 +379,19 @@ pk_transaction_db_iso8601_difference (const gchar *isodate)
 guint
 pk_transaction_db_action_time_since (PkTransactionDb *tdb, PkRoleEnum role)
 {
-	gchar *error_msg = NULL;
-	gint rc;
-	const gchar *role_text;
-	g_autofree gchar *statement = NULL;
-	g_autofree gchar *timespec = NULL;
+	const gchar *timespec;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), 0);
 	g_return_val_if_fail (tdb->priv->db != NULL, 0);
 
-	role_text = pk_role_enum_to_string (role);
-
-	statement = g_strdup_printf ("SELECT timespec FROM last_action WHERE role = '%s'", role_text);
-	rc = sqlite3_exec (tdb->priv->db, statement,
-			   pk_time_action_sqlite_callback, &timespec, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_ACTION_TIME);
+	if (statement == NULL)
 		return G_MAXUINT;
-	}
+	sqlite3_bind_text (statement, 1, pk_role_enum_to_string (role), -1, SQLITE_STATIC);
+	if (sqlite3_step (statement) != SQLITE_ROW)
+		return G_MAXUINT;
+	timespec = (const gchar *) sqlite3_column_text (statement, 0);
 	if (timespec == NULL)
 		return G_MAXUINT;
 
@@ -228,114 +402,162 @@ pk_transaction_db_action_time_since (PkTransactionDb *tdb, PkRoleEnum role)
 gboolean
 pk_transaction_db_action_time_reset (PkTransactionDb *tdb, PkRoleEnum role)
 {
-	gchar *error_msg = NULL;
-	gint rc;
-	const gchar *role_text;
-	guint since;
-	g_autofree gchar *statement = NULL;
 	g_autofree gchar *timespec = NULL;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (tdb->priv->db != NULL, FALSE);
 
-	timespec = pk_iso8601_present ();
-	role_text = pk_role_enum_to_string (role);
-
-	/* get the previous entry */
-	since = pk_transaction_db_action_time_since (tdb, role);
-	if (since == G_MAXUINT) {
-		statement = g_strdup_printf ("INSERT INTO last_action (role, timespec) VALUES ('%s', '%s')", role_text, timespec);
-	} else {
-		statement = g_strdup_printf ("UPDATE last_action SET timespec = '%s' WHERE role = '%s'", timespec, role_text);
-	}
+	if (!pk_transaction_db_begin_write (tdb))
+		return FALSE;
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_SET_ACTION_TIME);
+	if (statement == NULL)
+		return FALSE;
 
 	/* update or insert the entry */
-	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
-		return FALSE;
-	}
-	return TRUE;
+	timespec = pk_iso8601_present ();
+	sqlite3_bind_text (statement, 1, pk_role_enum_to_string (role), -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, timespec, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb->priv->db, statement);
 }
 
 GList *
 pk_transaction_db_get_list (PkTransactionDb *tdb, guint limit)
 {
-	gchar *error_msg = NULL;
 	gint rc;
 	GList *list = NULL;
-	g_autofree gchar *statement = NULL;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), NULL);
 
-	if (limit == 0) {
-		statement = g_strdup ("SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
-				      "FROM transactions ORDER BY timespec DESC");
-	} else {
-		statement = g_strdup_printf ("SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
-					     "FROM transactions ORDER BY timespec DESC LIMIT %i", limit);
-	}
-	rc = sqlite3_exec (tdb->priv->db,
-			   statement,
-			   pk_transaction_db_add_transaction_cb,
-			   &list,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
-		goto out;
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_LIST);
+	if (statement == NULL)
+		return NULL;
+
+	/* a negative limit is no limit */
+	sqlite3_bind_int64 (statement, 1, limit == 0 ? -1 : (sqlite3_int64) limit);
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW) {
+		/* add to start of the list */
+		list = g_list_prepend (list, pk_transaction_db_past_from_row (statement));
 	}
-out:
+	if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %d: %s", rc, sqlite3_errmsg (tdb->priv->db));
 	return list;
 }
 
-static gboolean
-pk_transaction_db_prepare (PkTransactionDb *tdb, const gchar *sql, sqlite3_stmt **statement)
+/**
+ * pk_transaction_db_cursor_new:
+ * @tdb: the #PkTransactionDb instance
+ * @number: the number of transactions, or 0 for all
+ * @offset: the number of the newest transactions to skip
+ * @since: (nullable): only return transactions after this ISO8601 time
+ *
+ * Starts reading past transactions, oldest first, without loading them
+ * all into memory. The rows are read from the disk as the cursor is
+ * stepped, so this works for any length of history.
+ *
+ * Return value: (transfer full): a new cursor, or %NULL for error
+ **/
+PkTransactionDbCursor *
+pk_transaction_db_cursor_new (PkTransactionDb *tdb,
+			      guint number,
+			      guint offset,
+			      const gchar *since)
 {
-	gint rc = 0;
-	*statement = NULL;
+	PkTransactionDbCursor *cursor;
+	gint64 total;
+	gint64 available;
+	gint64 limit;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 
-	if ((rc = sqlite3_prepare_v2 (tdb->priv->db,
-				      sql,
-				      -1,
-				      statement,
-				      NULL) != SQLITE_OK)) {
-		g_warning ("(%s) prepare error: %d: %s", sql, rc, sqlite3_errmsg (tdb->priv->db));
-		return FALSE;
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), NULL);
+	g_return_val_if_fail (tdb->priv->db != NULL, NULL);
+
+	if (since == NULL)
+		since = "";
+
+	/* the window is counted from the newest transaction */
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_COUNT_SINCE);
+	if (statement == NULL)
+		return NULL;
+	sqlite3_bind_text (statement, 1, since, -1, SQLITE_STATIC);
+	if (sqlite3_step (statement) != SQLITE_ROW) {
+		g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
+		return NULL;
 	}
-
-	return TRUE;
+	total = sqlite3_column_int64 (statement, 0);
+	available = MAX (total - (gint64) offset, 0);
+	limit = number == 0 ? available : MIN ((gint64) number, available);
+
+	cursor = g_new0 (PkTransactionDbCursor, 1);
+	if (!pk_transaction_db_prepare (tdb, PK_TRANSACTION_DB_CURSOR_SQL, &cursor->statement)) {
+		g_free (cursor);
+		return NULL;
+	}
+	sqlite3_bind_text (cursor->statement, 1, since, -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int64 (cursor->statement, 2, limit);
+	sqlite3_bind_int64 (cursor->statement, 3, available - limit);
+	cursor->tdb = g_object_ref (tdb);
+	tdb->priv->cursors++;
+	return cursor;
 }
 
-static gboolean
-pk_transaction_db_step (sqlite3 *db, sqlite3_stmt *statement)
+/**
+ * pk_transaction_db_cursor_next:
+ * @cursor: a #PkTransactionDbCursor
+ *
+ * Return value: (transfer full): the next transaction, or %NULL at the end
+ **/
+PkTransactionPast *
+pk_transaction_db_cursor_next (PkTransactionDbCursor *cursor)
 {
-	gint rc = 0;
+	gint rc;
 
-	rc = sqlite3_step (statement);
+	g_return_val_if_fail (cursor != NULL, NULL);
+
+	if (cursor->statement == NULL)
+		return NULL;
+	rc = sqlite3_step (cursor->statement);
+	if (rc == SQLITE_ROW)
+		return pk_transaction_db_past_from_row (cursor->statement);
+	if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %d: %s", rc, sqlite3_errmsg (cursor->tdb->priv->db));
+
+	/* let the database be vacuumed again */
+	sqlite3_finalize (cursor->statement);
+	cursor->statement = NULL;
+	cursor->tdb->priv->cursors--;
+	return NULL;
+}
 
-	if (rc != SQLITE_OK && rc != SQLITE_DONE) {
-		g_warning ("SQL error: %d: %s", rc, sqlite3_errmsg (db));
-		return FALSE;
+void
+pk_transaction_db_cursor_free (PkTransactionDbCursor *cursor)
+{
+	if (cursor == NULL)
+		return;
+	if (cursor->statement != NULL) {
+		sqlite3_finalize (cursor->statement);
+		cursor->tdb->priv->cursors--;
 	}
-
-	return TRUE;
+	g_object_unref (cursor->tdb);
+	g_free (cursor);
 }
 
 static gboolean
-pk_transaction_db_set_strings (PkTransactionDb *tdb, const gchar *sql, const gchar *first, const gchar *second)
+pk_transaction_db_set_strings (PkTransactionDb *tdb, PkTransactionDbStmt id, const gchar *first, const gchar *second)
 {
-	g_autoptr (sqlite3_stmt) statement = NULL;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 	gint rc = 0;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (tdb->priv->db != NULL, FALSE);
-	g_return_val_if_fail (sql != NULL, FALSE);
 	g_return_val_if_fail (first != NULL, FALSE);
 	g_return_val_if_fail (second != NULL, FALSE);
 
-	if (!pk_transaction_db_prepare (tdb, sql, &statement))
+	if (!pk_transaction_db_begin_write (tdb))
+		return FALSE;
+	statement = pk_transaction_db_get_statement (tdb, id);
+	if (statement == NULL)
 		return FALSE;
 
 	if ((rc = sqlite3_bind_text (statement, 1, first, -1, SQLITE_STATIC)) != SQLITE_OK) {
@@ -358,7 +580,7 @@ pk_transaction_db_add (PkTransactionDb *tdb, const gchar *tid)
 	timespec = pk_iso8601_present ();
 
 	return pk_transaction_db_set_strings (tdb,
-					      "INSERT INTO transactions (transaction_id, timespec) VALUES (?1, ?2)",
+					      PK_TRANSACTION_DB_STMT_ADD,
 					      tid,
 					      timespec);
 }
@@ -370,7 +592,7 @@ pk_transaction_db_set_role (PkTransactionDb *tdb, const gchar *tid, PkRoleEnum r
 	role_text = pk_role_enum_to_string (role);
 
 	return pk_transaction_db_set_strings (tdb,
-					      "UPDATE transactions SET role=?1 WHERE transaction_id=?2",
+					      PK_TRANSACTION_DB_STMT_SET_ROLE,
 					      role_text,
 					      tid);
 }
@@ -378,14 +600,17 @@ pk_transaction_db_set_role (PkTransactionDb *tdb, const gchar *tid, PkRoleEnum r
 gboolean
 pk_transaction_db_set_uid (PkTransactionDb *tdb, const gchar *tid, guint uid)
 {
-	g_autoptr (sqlite3_stmt) statement = NULL;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 	gint rc = 0;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (tdb->priv->db != NULL, FALSE);
 	g_return_val_if_fail (tid != NULL, FALSE);
 
-	if (!pk_transaction_db_prepare (tdb, "UPDATE transactions SET uid=?1 WHERE transaction_id=?2", &statement))
+	if (!pk_transaction_db_begin_write (tdb))
+		return FALSE;
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_SET_UID);
+	if (statement == NULL)
 		return FALSE;
 
 	if ((rc = sqlite3_bind_int (statement, 1, uid)) != SQLITE_OK) {
@@ -405,32 +630,148 @@ gboolean
 pk_transaction_db_set_cmdline (PkTransactionDb *tdb, const gchar *tid, const gchar *cmdline)
 {
 	return pk_transaction_db_set_strings (tdb,
-					      "UPDATE transactions SET cmdline=?1 WHERE transaction_id=?2",
+					      PK_TRANSACTION_DB_STMT_SET_CMDLINE,
 					      cmdline,
 					      tid);
 }
 
+static gint64
+pk_transaction_db_iso8601_to_unix (const gchar *isodate)
+{
+	GTimeVal timeval;
+	if (isodate == NULL || !g_time_val_from_iso8601 (isodate, &timeval))
+		return 0;
+	return timeval.tv_sec;
+}
+
+/* only the packages that were changed are interesting for the history */
+static gboolean
+pk_transaction_db_add_history (PkTransactionDb *tdb,
+			       const gchar *tid,
+			       const gchar *data,
+			       gint64 timestamp)
+{
+	g_auto(GStrv) lines = NULL;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
+
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_ADD_HISTORY);
+	if (statement == NULL)
+		return FALSE;
+
+	/* each line is "info\tpackage_id\tsummary" */
+	lines = g_strsplit (data, "\n", -1);
+	for (guint i = 0; lines[i] != NULL; i++) {
+		PkInfoEnum info;
+		g_auto(GStrv) sections = g_strsplit (lines[i], "\t", 3);
+		g_auto(GStrv) split = NULL;
+
+		if (g_strv_length (sections) < 2)
+			continue;
+		info = pk_info_enum_from_string (sections[0]);
+		if (info != PK_INFO_ENUM_INSTALLING &&
+		    info != PK_INFO_ENUM_REMOVING &&
+		    info != PK_INFO_ENUM_UPDATING)
+			continue;
+		split = pk_package_id_split (sections[1]);
+		if (split == NULL) {
+			g_warning ("invalid package in %s: %s", tid, sections[1]);
+			continue;
+		}
+		sqlite3_bind_text (statement, 1, tid, -1, SQLITE_STATIC);
+		sqlite3_bind_text (statement, 2, split[PK_PACKAGE_ID_NAME], -1, SQLITE_STATIC);
+		sqlite3_bind_text (statement, 3, sections[1], -1, SQLITE_STATIC);
+		sqlite3_bind_int (statement, 4, info);
+		sqlite3_bind_int64 (statement, 5, timestamp);
+		if (!pk_transaction_db_step (tdb->priv->db, statement))
+			return FALSE;
+		sqlite3_reset (statement);
+	}
+	return TRUE;
+}
+
 gboolean
 pk_transaction_db_set_data (PkTransactionDb *tdb, const gchar *tid, const gchar *data)
 {
-	return pk_transaction_db_set_strings (tdb,
-					      "UPDATE transactions SET data=?1 WHERE transaction_id=?2",
-					      data,
-					      tid);
+	gint64 timestamp = 0;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
+
+	if (!pk_transaction_db_set_strings (tdb,
+					    PK_TRANSACTION_DB_STMT_SET_DATA,
+					    data,
+					    tid))
+		return FALSE;
+
+	/* the history uses the time the transaction was created */
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_TIMESPEC);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_text (statement, 1, tid, -1, SQLITE_STATIC);
+	if (sqlite3_step (statement) == SQLITE_ROW)
+		timestamp = pk_transaction_db_iso8601_to_unix ((const gchar *) sqlite3_column_text (statement, 0));
+	return pk_transaction_db_add_history (tdb, tid, data, timestamp);
+}
+
+/**
+ * pk_transaction_db_get_package_history:
+ * @tdb: the #PkTransactionDb instance
+ * @name: a package name
+ * @limit: the maximum number of entries, or 0 for all of them
+ *
+ * Gets the newest packages called @name that were installed, removed or
+ * updated by transactions that succeeded, oldest first.
+ *
+ * Return value: (transfer container): an array of #PkTransactionDbHistoryItem
+ **/
+GPtrArray *
+pk_transaction_db_get_package_history (PkTransactionDb *tdb, const gchar *name, guint limit)
+{
+	gint rc;
+	GPtrArray *array;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), NULL);
+	g_return_val_if_fail (name != NULL, NULL);
+
+	array = g_ptr_array_new_with_free_func ((GDestroyNotify) pk_transaction_db_history_item_free);
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_HISTORY);
+	if (statement == NULL)
+		return array;
+	sqlite3_bind_text (statement, 1, name, -1, SQLITE_STATIC);
+	sqlite3_bind_int64 (statement, 2, limit == 0 ? -1 : (sqlite3_int64) limit);
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW) {
+		PkTransactionDbHistoryItem *item = g_new0 (PkTransactionDbHistoryItem, 1);
+		item->info = sqlite3_column_int (statement, 0);
+		item->package_id = g_strdup ((const gchar *) sqlite3_column_text (statement, 1));
+		item->timestamp = sqlite3_column_int64 (statement, 2);
+		item->uid = sqlite3_column_int (statement, 3);
+		g_ptr_array_add (array, item);
+	}
+	if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %d: %s", rc, sqlite3_errmsg (tdb->priv->db));
+	return array;
+}
+
+void
+pk_transaction_db_history_item_free (PkTransactionDbHistoryItem *item)
+{
+	g_free (item->package_id);
+	g_free (item);
 }
 
 gboolean
 pk_transaction_db_set_finished (PkTransactionDb *tdb, const gchar *tid, gboolean success, guint runtime)
 {
-	g_autoptr (sqlite3_stmt) statement = NULL;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 	gint rc = 0;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (tdb->priv->db != NULL, FALSE);
 	g_return_val_if_fail (tid != NULL, FALSE);
 
-	if (!pk_transaction_db_prepare (tdb, "UPDATE transactions SET succeeded=?1, duration=?2 WHERE transaction_id=?3",
-					&statement))
+	if (!pk_transaction_db_begin_write (tdb))
+		return FALSE;
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_SET_FINISHED);
+	if (statement == NULL)
 		return FALSE;
 
 	if ((rc = sqlite3_bind_int (statement, 1, success)) != SQLITE_OK) {
@@ -510,37 +851,36 @@ pk_transaction_db_get_random_hex_string (guint length)
 	return string;
 }
 
+/*
+ * Saves an upper bound for the job count that is synced to disk before
+ * any ID below it is used, so we never repeat a number after a crash.
+ */
 static gboolean
-pk_transaction_db_defer_write_job_count_cb (PkTransactionDb *tdb)
+pk_transaction_db_reserve_job_count (PkTransactionDb *tdb)
 {
-	gchar *error_msg = NULL;
-	gint rc;
-	g_autofree gchar *statement = NULL;
-
-	/* not loaded! */
-	if (tdb->priv->db == NULL) {
-		g_warning ("PkTransactionDb not loaded");
-		goto out;
-	}
+	guint reserved = tdb->priv->job_count + PK_TRANSACTION_DB_JOB_COUNT_RESERVE;
+	gboolean ret;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 
-	/* force fsync as we don't want to repeat this number */
-	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=ON", NULL, NULL, NULL);
+	/* the reservation can't wait for the other writes */
+	pk_transaction_db_commit (tdb);
 
-	/* save the job count */
-	statement = g_strdup_printf ("UPDATE config SET value = '%i' WHERE key = 'job_count'",
-				     tdb->priv->job_count);
-	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("failed to set job id: %s", error_msg);
-		sqlite3_free (error_msg);
-		goto out;
-	}
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_SET_JOB_COUNT);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_int64 (statement, 1, reserved);
 
-	/* turn off fsync */
-	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
-out:
-	tdb->priv->database_save_id = 0;
-	return FALSE;
+	/* with no BEGIN the update is committed on its own, and in WAL mode
+	 * only synchronous=FULL syncs the log before the commit returns */
+	if (!pk_transaction_db_sql_statement (tdb, "PRAGMA synchronous=FULL"))
+		return FALSE;
+	ret = pk_transaction_db_step (tdb->priv->db, statement);
+	if (!pk_transaction_db_sql_statement (tdb, "PRAGMA synchronous=NORMAL"))
+		g_warning ("failed to restore synchronous=NORMAL");
+	if (!ret)
+		return FALSE;
+	tdb->priv->job_count_reserved = reserved;
+	return TRUE;
 }
 
 gchar *
@@ -553,14 +893,10 @@ pk_transaction_db_generate_id (PkTransactionDb *tdb)
 	tdb->priv->job_count++;
 	g_debug ("job count now %i", tdb->priv->job_count);
 
-	/* we don't need to wait for the database write, just do this the
-	 * next time we are idle (but ensure we do this on shutdown) */
-	if (tdb->priv->database_save_id == 0) {
-		tdb->priv->database_save_id =
-			g_idle_add_full (G_PRIORITY_LOW, (GSourceFunc)
-					 pk_transaction_db_defer_write_job_count_cb, tdb, NULL);
-		g_source_set_name_by_id (tdb->priv->database_save_id, "[PkTransactionDb] save");
-	}
+	/* only hit the disk once for each block of IDs */
+	if (tdb->priv->job_count > tdb->priv->job_count_reserved &&
+	    !pk_transaction_db_reserve_job_count (tdb))
+		g_warning ("job count %u may be used again", tdb->priv->job_count);
 
 	/* make the tid */
 	rand_str = pk_transaction_db_get_random_hex_string (8);
@@ -568,38 +904,35 @@ pk_transaction_db_generate_id (PkTransactionDb *tdb)
 	return tid;
 }
 
-static gint
-pk_transaction_sqlite_proxy_cb (void *data, gint argc, gchar **argv, gchar **col_name)
-{
-	PkTransactionDbProxyItem *item = (PkTransactionDbProxyItem *) data;
-	gint i;
-
-	g_return_val_if_fail (item != NULL, 0);
-
-	for (i = 0; i < argc; i++) {
-		if (g_strcmp0 (col_name[i], "proxy_http") == 0) {
-			item->proxy_http = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_https") == 0) {
-			item->proxy_https = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_ftp") == 0) {
-			item->proxy_ftp = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_socks") == 0) {
-			item->proxy_socks = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "no_proxy") == 0) {
-			item->no_proxy = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "pac") == 0) {
-			item->pac = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else {
-			g_warning ("%s = %s", col_name[i], argv[i]);
-		}
+static gboolean
+pk_transaction_db_get_proxy_item (PkTransactionDb *tdb,
+				  guint uid,
+				  const gchar *session,
+				  PkTransactionDbProxyItem *item)
+{
+	gint rc;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
+
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_PROXY);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_int (statement, 1, uid);
+	sqlite3_bind_text (statement, 2, session, -1, SQLITE_STATIC);
+	rc = sqlite3_step (statement);
+	if (rc == SQLITE_DONE)
+		return TRUE;
+	if (rc != SQLITE_ROW) {
+		g_warning ("SQL error: %d: %s", rc, sqlite3_errmsg (tdb->priv->db));
+		return FALSE;
 	}
-	return 0;
+	item->proxy_http = g_strdup ((const gchar *) sqlite3_column_text (statement, 0));
+	item->proxy_https = g_strdup ((const gchar *) sqlite3_column_text (statement, 1));
+	item->proxy_ftp = g_strdup ((const gchar *) sqlite3_column_text (statement, 2));
+	item->proxy_socks = g_strdup ((const gchar *) sqlite3_column_text (statement, 3));
+	item->no_proxy = g_strdup ((const gchar *) sqlite3_column_text (statement, 4));
+	item->pac = g_strdup ((const gchar *) sqlite3_column_text (statement, 5));
+	item->set = TRUE;
+	return TRUE;
 }
 
 static void
@@ -619,32 +952,15 @@ pk_transaction_db_proxy_item_free (PkTransactionDbProxyItem *item)
 static gboolean
 pk_transaction_db_is_proxy_set (PkTransactionDb *tdb, guint uid, const gchar *session)
 {
-	gchar *error_msg = NULL;
-	gboolean ret = FALSE;
-	gint rc;
+	gboolean ret;
 	PkTransactionDbProxyItem *item;
-	g_autofree gchar *statement = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (uid != G_MAXUINT, FALSE);
 
 	/* get existing data */
 	item = g_new0 (PkTransactionDbProxyItem, 1);
-	statement = g_strdup_printf ("SELECT proxy_http, proxy_https, proxy_ftp, proxy_socks, no_proxy, pac FROM proxy WHERE uid = '%i' AND session = '%s' LIMIT 1",
-				     uid, session);
-	rc = sqlite3_exec (tdb->priv->db, statement,
-			   pk_transaction_sqlite_proxy_cb,
-			   item,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
-		goto out;
-	}
-
-	ret = item->set;
-
-out:
+	ret = pk_transaction_db_get_proxy_item (tdb, uid, session, item) && item->set;
 	pk_transaction_db_proxy_item_free (item);
 	return ret;
 }
@@ -670,28 +986,16 @@ pk_transaction_db_get_proxy (PkTransactionDb *tdb, guint uid, const gchar *sessi
 			     gchar **no_proxy,
 			     gchar **pac)
 {
-	gchar *error_msg = NULL;
 	gboolean ret = FALSE;
-	gint rc;
 	PkTransactionDbProxyItem *item;
-	g_autofree gchar *statement = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (uid != G_MAXUINT, FALSE);
 
 	/* get existing data */
 	item = g_new0 (PkTransactionDbProxyItem, 1);
-	statement = g_strdup_printf ("SELECT proxy_http, proxy_https, proxy_ftp, proxy_socks, no_proxy, pac FROM proxy WHERE uid = '%i' AND session = '%s' LIMIT 1",
-				     uid, session);
-	rc = sqlite3_exec (tdb->priv->db, statement,
-			   pk_transaction_sqlite_proxy_cb,
-			   item,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
+	if (!pk_transaction_db_get_proxy_item (tdb, uid, session, item))
 		goto out;
-	}
 
 	/* success, even if we got no data */
 	ret = TRUE;
@@ -743,13 +1047,15 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 {
 	gboolean ret = FALSE;
 	gint rc;
-	sqlite3_stmt *statement = NULL;
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
 	g_autofree gchar *timespec = NULL;
-	g_autofree gchar *proxy_http_tmp = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (uid != G_MAXUINT, FALSE);
 
+	if (!pk_transaction_db_begin_write (tdb))
+		return FALSE;
+
 	/* check for previous entries */
 	ret = pk_transaction_db_is_proxy_set (tdb, uid, session);
 	if (ret) {
@@ -757,20 +1063,9 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 			 proxy_http, proxy_ftp, uid, session);
 
 		/* prepare statement */
-		rc = sqlite3_prepare_v2 (tdb->priv->db,
-					 "UPDATE proxy SET "
-					 "proxy_http = ?, "
-					 "proxy_https = ?, "
-					 "proxy_ftp = ?, "
-					 "proxy_socks = ?, "
-					 "no_proxy = ?, "
-					 "pac = ? "
-					 "WHERE uid = ? AND session = ?",
-					 -1, &statement, NULL);
-		if (rc != SQLITE_OK) {
-			g_warning ("failed to prepare statement: %s", sqlite3_errmsg (tdb->priv->db));
-			goto out;
-		}
+		statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_UPDATE_PROXY);
+		if (statement == NULL)
+			return FALSE;
 
 		/* bind data, so that the freeform proxy text cannot be used to inject SQL */
 		sqlite3_bind_text (statement, 1, proxy_http, -1, SQLITE_STATIC);
@@ -786,9 +1081,9 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 		rc = sqlite3_step (statement);
 		if (rc != SQLITE_DONE) {
 			g_warning ("failed to execute statement: %s", sqlite3_errmsg (tdb->priv->db));
-			goto out;
+			return FALSE;
 		}
-		goto out;
+		return TRUE;
 	}
 
 	/* insert new entry */
@@ -796,20 +1091,9 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 	g_debug ("set proxy %s, %s for uid:%i and session:%s", proxy_http, proxy_ftp, uid, session);
 
 	/* prepare statement */
-	rc = sqlite3_prepare_v2 (tdb->priv->db,
-				 "INSERT INTO proxy (created, uid, session, "
-				 "proxy_http, "
-				 "proxy_https, "
-				 "proxy_ftp, "
-				 "proxy_socks, "
-				 "no_proxy, "
-				 "pac) "
-				 "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
-				 -1, &statement, NULL);
-	if (rc != SQLITE_OK) {
-		g_warning ("failed to prepare statement: %s", sqlite3_errmsg (tdb->priv->db));
-		goto out;
-	}
+	statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_INSERT_PROXY);
+	if (statement == NULL)
+		return FALSE;
 
 	/* bind data, so that the freeform proxy text cannot be used to inject SQL */
 	sqlite3_bind_text (statement, 1, timespec, -1, SQLITE_STATIC);
@@ -826,14 +1110,307 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 	rc = sqlite3_step (statement);
 	if (rc != SQLITE_DONE) {
 		g_warning ("failed to execute statement: %s", sqlite3_errmsg (tdb->priv->db));
-		goto out;
+		return FALSE;
 	}
+	return TRUE;
+}
 
-	ret = TRUE;
-out:
-	if (statement != NULL)
-		sqlite3_finalize (statement);
-	return ret;
+static gint64
+pk_transaction_db_query_int64 (PkTransactionDb *tdb, const gchar *sql)
+{
+	gint64 value = -1;
+	sqlite3_stmt *statement = NULL;
+
+	if (!pk_transaction_db_prepare (tdb, sql, &statement))
+		return -1;
+	if (sqlite3_step (statement) == SQLITE_ROW)
+		value = sqlite3_column_int64 (statement, 0);
+	sqlite3_finalize (statement);
+	return value;
+}
+
+/* returns the single value of a cached statement such as a PRAGMA, or -1 */
+static gint64
+pk_transaction_db_get_int64 (PkTransactionDb *tdb, PkTransactionDbStmt id)
+{
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
+
+	statement = pk_transaction_db_get_statement (tdb, id);
+	if (statement == NULL)
+		return -1;
+	if (sqlite3_step (statement) != SQLITE_ROW) {
+		g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
+		return -1;
+	}
+	return sqlite3_column_int64 (statement, 0);
+}
+
+static void
+pk_transaction_db_add_ids (PkTransactionDb *tdb, PkTransactionDbStatement *statement, GPtrArray *tids)
+{
+	gint rc;
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW)
+		g_ptr_array_add (tids, g_strdup ((const gchar *) sqlite3_column_text (statement, 0)));
+	if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %d: %s", rc, sqlite3_errmsg (tdb->priv->db));
+}
+
+/* the next batch of transactions that break the retention policy, oldest first */
+static GPtrArray *
+pk_transaction_db_get_expired (PkTransactionDb *tdb)
+{
+	PkTransactionDbPrivate *priv = tdb->priv;
+	GPtrArray *tids = g_ptr_array_new_with_free_func (g_free);
+	gint64 count;
+	gint64 pages;
+	gint64 freelist;
+
+	/* too old */
+	if (priv->retention_max_age > 0) {
+		g_autoptr(GDateTime) now = g_date_time_new_now_utc ();
+		g_autoptr(GDateTime) cutoff = g_date_time_add_days (now, -(gint) priv->retention_max_age);
+		g_autofree gchar *timespec = g_date_time_format (cutoff, "%Y-%m-%dT%H:%M:%SZ");
+		g_autoptr(PkTransactionDbStatement) statement = NULL;
+
+		statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_OLDER_THAN);
+		if (statement != NULL) {
+			sqlite3_bind_text (statement, 1, timespec, -1, SQLITE_STATIC);
+			sqlite3_bind_int (statement, 2, PK_TRANSACTION_DB_PRUNE_BATCH);
+			pk_transaction_db_add_ids (tdb, statement, tids);
+		}
+		if (tids->len > 0)
+			return tids;
+	}
+
+	/* too many */
+	if (priv->retention_max_rows > 0) {
+		count = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_COUNT);
+		if (count > priv->retention_max_rows) {
+			g_autoptr(PkTransactionDbStatement) statement = NULL;
+			statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_OLDEST);
+			if (statement != NULL) {
+				sqlite3_bind_int64 (statement, 1, MIN (count - priv->retention_max_rows,
+								       PK_TRANSACTION_DB_PRUNE_BATCH));
+				pk_transaction_db_add_ids (tdb, statement, tids);
+			}
+			return tids;
+		}
+	}
+
+	/* too big, where the free pages are not counted as they get reused */
+	if (priv->retention_max_size > 0) {
+		pages = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_PAGE_COUNT);
+		freelist = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_FREELIST_COUNT);
+		if (pages > 0 && freelist >= 0 &&
+		    (guint64) (pages - freelist) * priv->page_size > priv->retention_max_size) {
+			g_autoptr(PkTransactionDbStatement) statement = NULL;
+			statement = pk_transaction_db_get_statement (tdb, PK_TRANSACTION_DB_STMT_GET_OLDEST);
+			if (statement != NULL) {
+				sqlite3_bind_int (statement, 1, PK_TRANSACTION_DB_PRUNE_BATCH);
+				pk_transaction_db_add_ids (tdb, statement, tids);
+			}
+		}
+	}
+	return tids;
+}
+
+static gboolean
+pk_transaction_db_remove_id (PkTransactionDb *tdb, PkTransactionDbStmt id, const gchar *tid)
+{
+	g_autoptr(PkTransactionDbStatement) statement = NULL;
+
+	statement = pk_transaction_db_get_statement (tdb, id);
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_text (statement, 1, tid, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb->priv->db, statement);
+}
+
+static gboolean
+pk_transaction_db_remove (PkTransactionDb *tdb, GPtrArray *tids)
+{
+	if (!pk_transaction_db_begin_write (tdb))
+		return FALSE;
+	for (guint i = 0; i < tids->len; i++) {
+		const gchar *tid = g_ptr_array_index (tids, i);
+		if (!pk_transaction_db_remove_id (tdb, PK_TRANSACTION_DB_STMT_REMOVE_HISTORY, tid))
+			return FALSE;
+		if (!pk_transaction_db_remove_id (tdb, PK_TRANSACTION_DB_STMT_REMOVE, tid))
+			return FALSE;
+	}
+	tdb->priv->rows_pruned += tids->len;
+	return TRUE;
+}
+
+/*
+ * Databases created before auto_vacuum was set have to be rebuilt once
+ * before pages can be given back incrementally. The whole file is copied
+ * while the main loop waits, so this is only done when history is being
+ * pruned anyway, and a rebuild that fails is not tried again.
+ */
+static void
+pk_transaction_db_rebuild (PkTransactionDb *tdb)
+{
+	PkTransactionDbPrivate *priv = tdb->priv;
+	gint64 pages_before;
+	gint64 pages_after;
+
+	/* VACUUM can't run inside the deferred write */
+	pk_transaction_db_commit (tdb);
+
+	pages_before = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_PAGE_COUNT);
+	g_debug ("rebuilding database of %" G_GINT64_FORMAT " pages", pages_before);
+	if (pk_transaction_db_sql_statement (tdb, "VACUUM"))
+		priv->incremental_vacuum = pk_transaction_db_query_int64 (tdb, "PRAGMA auto_vacuum") == 2;
+	if (!priv->incremental_vacuum) {
+		g_warning ("failed to rebuild database, not trying again");
+		priv->rebuild_failed = TRUE;
+		pk_transaction_db_sql_statement (tdb, "INSERT OR REPLACE INTO config (key, value) "
+						      "VALUES ('rebuild_failed', '1')");
+		return;
+	}
+
+	pages_after = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_PAGE_COUNT);
+	if (pages_before > 0 && pages_after >= 0 && pages_after < pages_before)
+		priv->bytes_reclaimed += (guint64) (pages_before - pages_after) * priv->page_size;
+}
+
+/* gives some free pages back to the filesystem, returning %TRUE if there are more */
+static gboolean
+pk_transaction_db_vacuum (PkTransactionDb *tdb)
+{
+	PkTransactionDbPrivate *priv = tdb->priv;
+	gint64 freelist;
+	gint64 pages_before;
+	gint64 pages_after;
+	g_autofree gchar *sql = NULL;
+
+	/* the file can't be rebuilt under an open cursor, so try again later */
+	if (priv->cursors > 0)
+		return FALSE;
+
+	/* the rebuild gives back every free page at once */
+	if (!priv->incremental_vacuum) {
+		if (!priv->rebuild_failed)
+			pk_transaction_db_rebuild (tdb);
+		return FALSE;
+	}
+
+	/* pages are only free once the deletions are committed */
+	pk_transaction_db_commit (tdb);
+	freelist = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_FREELIST_COUNT);
+	pages_before = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_PAGE_COUNT);
+	if (freelist <= 0 || pages_before <= 0)
+		return FALSE;
+
+	sql = g_strdup_printf ("PRAGMA incremental_vacuum(%i)",
+			       PK_TRANSACTION_DB_VACUUM_PAGES);
+	if (!pk_transaction_db_sql_statement (tdb, sql))
+		return FALSE;
+
+	pages_after = pk_transaction_db_get_int64 (tdb, PK_TRANSACTION_DB_STMT_PAGE_COUNT);
+	if (pages_after < 0 || pages_after >= pages_before)
+		return FALSE;
+	priv->bytes_reclaimed += (guint64) (pages_before - pages_after) * priv->page_size;
+	return TRUE;
+}
+
+static gboolean
+pk_transaction_db_prune_cb (gpointer user_data)
+{
+	PkTransactionDb *tdb = PK_TRANSACTION_DB (user_data);
+	g_autoptr(GPtrArray) tids = NULL;
+
+	tids = pk_transaction_db_get_expired (tdb);
+	if (tids->len > 0) {
+		if (pk_transaction_db_remove (tdb, tids))
+			return G_SOURCE_CONTINUE;
+	} else if (pk_transaction_db_vacuum (tdb)) {
+		return G_SOURCE_CONTINUE;
+	}
+
+	g_debug ("pruned %" G_GUINT64_FORMAT " transactions and reclaimed %"
+		 G_GUINT64_FORMAT " bytes since startup",
+		 tdb->priv->rows_pruned, tdb->priv->bytes_reclaimed);
+	tdb->priv->prune_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
+static void
+pk_transaction_db_prune (PkTransactionDb *tdb)
+{
+	if (tdb->priv->prune_id != 0)
+		return;
+	tdb->priv->prune_id =
+		g_idle_add_full (G_PRIORITY_LOW, pk_transaction_db_prune_cb, tdb, NULL);
+	g_source_set_name_by_id (tdb->priv->prune_id, "[PkTransactionDb] prune");
+}
+
+static gboolean
+pk_transaction_db_prune_timeout_cb (gpointer user_data)
+{
+	pk_transaction_db_prune (PK_TRANSACTION_DB (user_data));
+	return G_SOURCE_CONTINUE;
+}
+
+/**
+ * pk_transaction_db_set_retention:
+ * @tdb: the #PkTransactionDb instance
+ * @max_age: the age in days after which transactions are removed, or 0
+ * @max_rows: the number of transactions to keep, or 0
+ * @max_size: the size in bytes the database is kept under, or 0
+ *
+ * Sets how much history is kept. Old transactions are removed a batch at
+ * a time when the daemon is idle, now and then every hour.
+ **/
+void
+pk_transaction_db_set_retention (PkTransactionDb *tdb,
+				 guint max_age,
+				 guint max_rows,
+				 guint64 max_size)
+{
+	g_return_if_fail (PK_IS_TRANSACTION_DB (tdb));
+	g_return_if_fail (tdb->priv->db != NULL);
+
+	tdb->priv->retention_max_age = max_age;
+	tdb->priv->retention_max_rows = max_rows;
+	tdb->priv->retention_max_size = max_size;
+	if (tdb->priv->prune_timeout_id != 0) {
+		g_source_remove (tdb->priv->prune_timeout_id);
+		tdb->priv->prune_timeout_id = 0;
+	}
+
+	/* keep everything */
+	if (max_age == 0 && max_rows == 0 && max_size == 0)
+		return;
+
+	tdb->priv->prune_timeout_id =
+		g_timeout_add_seconds_full (G_PRIORITY_LOW,
+					    PK_TRANSACTION_DB_PRUNE_INTERVAL,
+					    pk_transaction_db_prune_timeout_cb,
+					    tdb, NULL);
+	g_source_set_name_by_id (tdb->priv->prune_timeout_id, "[PkTransactionDb] prune-timeout");
+	pk_transaction_db_prune (tdb);
+}
+
+/**
+ * pk_transaction_db_get_retention_stats:
+ * @tdb: the #PkTransactionDb instance
+ * @rows_pruned: (out) (optional): the number of transactions removed
+ * @bytes_reclaimed: (out) (optional): the bytes given back to the filesystem
+ *
+ * Gets what the retention policy has done since the database was loaded.
+ **/
+void
+pk_transaction_db_get_retention_stats (PkTransactionDb *tdb,
+				       guint64 *rows_pruned,
+				       guint64 *bytes_reclaimed)
+{
+	g_return_if_fail (PK_IS_TRANSACTION_DB (tdb));
+	if (rows_pruned != NULL)
+		*rows_pruned = tdb->priv->rows_pruned;
+	if (bytes_reclaimed != NULL)
+		*bytes_reclaimed = tdb->priv->bytes_reclaimed;
 }
 
 static void
@@ -874,6 +1451,47 @@ pk_transaction_db_execute (PkTransactionDb *tdb,
 	return ret;
 }
 
+/* fill the history table from the package lists of old transactions */
+static gboolean
+pk_transaction_db_migrate_history (PkTransactionDb *tdb, GError **error)
+{
+	GList *list;
+	guint cnt = 0;
+
+	if (!pk_transaction_db_execute (tdb, "BEGIN", error))
+		return FALSE;
+	if (!pk_transaction_db_execute (tdb,
+					"CREATE TABLE history (transaction_id TEXT, name TEXT, "
+					"package_id TEXT, info INTEGER, timestamp INTEGER);"
+					"CREATE INDEX history_name ON history (name, timestamp);",
+					error))
+		goto out;
+	list = pk_transaction_db_get_list (tdb, 0);
+	for (GList *l = list; l != NULL; l = l->next) {
+		PkTransactionPast *item = PK_TRANSACTION_PAST (l->data);
+		const gchar *data = pk_transaction_past_get_data (item);
+		if (data == NULL)
+			continue;
+		if (!pk_transaction_db_add_history (tdb,
+						    pk_transaction_past_get_id (item),
+						    data,
+						    pk_transaction_past_get_timestamp (item))) {
+			g_set_error_literal (error, 1, 0, "failed to migrate package history");
+			g_list_free_full (list, g_object_unref);
+			goto out;
+		}
+		cnt++;
+	}
+	g_list_free_full (list, g_object_unref);
+	g_debug ("added history of %u transactions", cnt);
+	if (pk_transaction_db_execute (tdb, "COMMIT", error))
+		return TRUE;
+out:
+	/* the history table is created again on the next start */
+	pk_transaction_db_execute (tdb, "ROLLBACK", NULL);
+	return FALSE;
+}
+
 gboolean
 pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 {
@@ -902,8 +1520,17 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 		return FALSE;
 	}
 
-	/* we don't need to keep doing fsync */
-	if (!pk_transaction_db_execute (tdb, "PRAGMA synchronous=OFF", error))
+	/* pages freed by pruning old transactions can be given back to the
+	 * filesystem a few at a time; older databases get this on the first
+	 * full VACUUM */
+	if (!pk_transaction_db_execute (tdb, "PRAGMA auto_vacuum=INCREMENTAL", error))
+		return FALSE;
+
+	/* a crash can only lose the last commits rather than corrupt the
+	 * database, and readers never wait for the writer */
+	if (!pk_transaction_db_execute (tdb, "PRAGMA journal_mode=WAL", error))
+		return FALSE;
+	if (!pk_transaction_db_execute (tdb, "PRAGMA synchronous=NORMAL", error))
 		return FALSE;
 
 	/* check transactions */
@@ -959,6 +1586,10 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 		}
 		g_debug ("job count is now at %i", tdb->priv->job_count);
 	}
+	if (!pk_transaction_db_reserve_job_count (tdb)) {
+		g_set_error_literal (error, 1, 0, "failed to save job count");
+		return FALSE;
+	}
 
 	/* session proxy saving (since 0.5.1) */
 	if (!pk_transaction_db_execute (tdb, "SELECT * FROM proxy LIMIT 1", &error_local)) {
@@ -969,6 +1600,24 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 			return FALSE;
 	}
 
+	/* package history (since 1.3.2) */
+	if (!pk_transaction_db_execute (tdb, "SELECT * FROM history LIMIT 1", &error_local)) {
+		g_debug ("adding table history: %s", error_local->message);
+		g_clear_error (&error_local);
+		if (!pk_transaction_db_migrate_history (tdb, error))
+			return FALSE;
+	}
+
+	/* removing old transactions (since 1.3.2) */
+	statement = "CREATE INDEX IF NOT EXISTS transactions_timespec ON transactions (timespec);"
+		    "CREATE INDEX IF NOT EXISTS history_transaction_id ON history (transaction_id);";
+	if (!pk_transaction_db_execute (tdb, statement, error))
+		return FALSE;
+	tdb->priv->page_size = (guint64) MAX (pk_transaction_db_query_int64 (tdb, "PRAGMA page_size"), 0);
+	tdb->priv->incremental_vacuum = pk_transaction_db_query_int64 (tdb, "PRAGMA auto_vacuum") == 2;
+	tdb->priv->rebuild_failed = pk_transaction_db_query_int64 (tdb, "SELECT value FROM config "
+									 "WHERE key = 'rebuild_failed'") > 0;
+
 	/* try to set correct permissions */
 	g_chmod (PK_DB_DIR "/transactions.db", 0644);
 
@@ -991,23 +1640,37 @@ pk_transaction_db_finalize (GObject *object)
 	tdb = PK_TRANSACTION_DB (object);
 	g_return_if_fail (tdb->priv != NULL);
 
+	if (tdb->priv->prune_id != 0)
+		g_source_remove (tdb->priv->prune_id);
+	if (tdb->priv->prune_timeout_id != 0)
+		g_source_remove (tdb->priv->prune_timeout_id);
+
 	/* if we shutdown with a deferred database write, then enforce it here */
-	if (tdb->priv->database_save_id != 0) {
-		pk_transaction_db_defer_write_job_count_cb (tdb);
-		g_source_remove (tdb->priv->database_save_id);
-	}
+	pk_transaction_db_commit (tdb);
 
 	/* close the database */
+	for (guint i = 0; i < PK_TRANSACTION_DB_STMT_LAST; i++)
+		sqlite3_finalize (tdb->priv->statements[i]);
 	sqlite3_close (tdb->priv->db);
 
 	G_OBJECT_CLASS (pk_transaction_db_parent_class)->finalize (object);
 }
 
+/**
+ * pk_transaction_db_new:
+ *
+ * Return value: the shared database, so all transactions use one
+ * connection and one set of prepared statements
+ **/
 PkTransactionDb *
 pk_transaction_db_new (void)
 {
-	PkTransactionDb *tdb;
-	tdb = g_object_new (PK_TYPE_TRANSACTION_DB, NULL);
-	return PK_TRANSACTION_DB (tdb);
+	if (pk_transaction_db_object != NULL) {
+		g_object_ref (pk_transaction_db_object);
+	} else {
+		pk_transaction_db_object = g_object_new (PK_TYPE_TRANSACTION_DB, NULL);
+		g_object_add_weak_pointer (pk_transaction_db_object, &pk_transaction_db_object);
+	}
+	return PK_TRANSACTION_DB (pk_transaction_db_object);
 }
 
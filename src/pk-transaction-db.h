@@ -24,6 +24,7 @@
 
 #include <glib-object.h>
 #include <packagekit-glib2/pk-enum.h>
+#include <packagekit-glib2/pk-transaction-past.h>
 
 G_BEGIN_DECLS
 
@@ -35,6 +36,15 @@ G_BEGIN_DECLS
 #define PK_TRANSACTION_DB_GET_CLASS(o)	(G_TYPE_INSTANCE_GET_CLASS ((o), PK_TYPE_TRANSACTION_DB, PkTransactionDbClass))
 
 typedef struct PkTransactionDbPrivate PkTransactionDbPrivate;
+typedef struct PkTransactionDbCursor PkTransactionDbCursor;
+
+typedef struct
+{
+	PkInfoEnum		 info;
+	gchar			*package_id;
+	gint64			 timestamp;
+	guint			 uid;
+} PkTransactionDbHistoryItem;
 
 typedef struct
 {
@@ -77,6 +87,23 @@ gboolean	 pk_transaction_db_set_data		(PkTransactionDb	*tdb,
 							 const gchar		*data);
 GList		*pk_transaction_db_get_list		(PkTransactionDb	*tdb,
 							 guint			 limit);
+PkTransactionDbCursor *pk_transaction_db_cursor_new	(PkTransactionDb	*tdb,
+							 guint			 number,
+							 guint			 offset,
+							 const gchar		*since);
+PkTransactionPast *pk_transaction_db_cursor_next	(PkTransactionDbCursor	*cursor);
+void		 pk_transaction_db_cursor_free		(PkTransactionDbCursor	*cursor);
+GPtrArray	*pk_transaction_db_get_package_history	(PkTransactionDb	*tdb,
+							 const gchar		*name,
+							 guint			 limit);
+void		 pk_transaction_db_history_item_free	(PkTransactionDbHistoryItem *item);
+void		 pk_transaction_db_set_retention	(PkTransactionDb	*tdb,
+							 guint			 max_age,
+							 guint			 max_rows,
+							 guint64		 max_size);
+void		 pk_transaction_db_get_retention_stats	(PkTransactionDb	*tdb,
+							 guint64		*rows_pruned,
+							 guint64		*bytes_reclaimed);
 gboolean	 pk_transaction_db_action_time_reset	(PkTransactionDb	*tdb,
 							 PkRoleEnum		 role);
 guint		 pk_transaction_db_action_time_since	(PkTransactionDb	*tdb,
@@ -102,6 +129,10 @@ gboolean	 pk_transaction_db_set_proxy		(PkTransactionDb	*tdb,
 							 const gchar		*no_proxy,
 							 const gchar		*pac);
 
+#ifdef G_DEFINE_AUTOPTR_CLEANUP_FUNC
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(PkTransactionDbCursor, pk_transaction_db_cursor_free)
+#endif
+
 G_END_DECLS
 
 #endif /* __PK_TRANSACTION_DB_H */
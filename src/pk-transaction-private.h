@@ -40,8 +40,23 @@ void	pk_transaction_search_names	(PkTransaction	*transaction,
 void	pk_transaction_install_packages (PkTransaction *transaction,
 					 GVariant *params,
 					 GDBusMethodInvocation *context);
+void	pk_transaction_refresh_cache	(PkTransaction	*transaction,
+					 GVariant	*params,
+					 GDBusMethodInvocation *context);
+void	pk_transaction_method_call	(GDBusConnection *connection_,
+					 const gchar	*sender,
+					 const gchar	*object_path,
+					 const gchar	*interface_name,
+					 const gchar	*method_name,
+					 GVariant	*parameters,
+					 GDBusMethodInvocation *invocation,
+					 gpointer	 user_data);
 gboolean	 pk_transaction_set_sender			(PkTransaction	*transaction,
 								 const gchar	*sender);
+gboolean	 pk_transaction_set_hint			(PkTransaction	*transaction,
+								 const gchar	*key,
+								 const gchar	*value,
+								 GError		**error);
 gboolean	 pk_transaction_filter_check			(const gchar	*filter,
 								 GError		**error);
 gboolean	 pk_transaction_strvalidate			(const gchar	*textr,
@@ -40,6 +40,7 @@
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <packagekit-glib2/pk-common.h>
 #include <packagekit-glib2/pk-common-private.h>
 #include <packagekit-glib2/pk-enum.h>
@@ -47,10 +48,12 @@
 #include <packagekit-glib2/pk-package-id.h>
 #include <packagekit-glib2/pk-package-ids.h>
 #include <packagekit-glib2/pk-results.h>
+#include <packagekit-glib2/pk-results-memfd-private.h>
 #include <polkit/polkit.h>
 
 #include "pk-backend.h"
 #include "pk-dbus.h"
+#include "pk-result-cache.h"
 #include "pk-shared.h"
 #include "pk-transaction-db.h"
 #include "pk-transaction.h"
@@ -66,6 +69,9 @@ static void     pk_transaction_dispose		(GObject	    *object);
 
 static gchar *pk_transaction_get_content_type_for_file (const gchar *filename, GError **error);
 static gboolean pk_transaction_is_supported_content_type (PkTransaction *transaction, const gchar *content_type);
+static void pk_transaction_set_phase (PkTransaction *transaction, PkTransactionPhase phase);
+static GVariant *pk_transaction_get_phase_times (PkTransaction *transaction);
+static void pk_transaction_dbus_return (GDBusMethodInvocation *context, const GError *error);
 
 #define PK_TRANSACTION_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_TRANSACTION, PkTransactionPrivate))
 #define PK_TRANSACTION_UPDATES_CHANGED_TIMEOUT	100 /* ms */
@@ -79,6 +85,19 @@ static gboolean pk_transaction_is_supported_content_type (PkTransaction *transac
 /* maximum number of items that can be resolved in one go */
 #define PK_TRANSACTION_MAX_ITEMS_TO_RESOLVE	10000
 
+/* approximate size of each Packages signal if PackagesChunkSize is unset */
+#define PK_TRANSACTION_PACKAGES_CHUNK_SIZE	(256 * 1024) /* bytes */
+
+/* how often progress is sent to the client unless it sets progress-rate */
+#define PK_TRANSACTION_PROGRESS_RATE_DEFAULT	10 /* Hz */
+#define PK_TRANSACTION_PROGRESS_RATE_MAX	100 /* Hz */
+
+/* how long a client not reading its results can delay Finished */
+#define PK_TRANSACTION_RESULTS_FLUSH_TIMEOUT	5 /* s */
+
+/* number of Transaction signals emitted in each main loop iteration */
+#define PK_TRANSACTION_OLD_TRANSACTIONS_BATCH	100
+
 struct PkTransactionPrivate
 {
 	PkRoleEnum		 role;
@@ -110,10 +129,19 @@ struct PkTransactionPrivate
 	GCancellable		*cancellable;
 	gboolean		 skip_auth_check;
 	gboolean		 client_supports_plural_signals;
+	GDBusConnection		*results_connection;
+	GDBusMethodInvocation	*results_socket_context;
+	gboolean		 results_connection_decided;
+	guint			 results_flush_id;
+	guint			 finished_time_ms;
+	gboolean		 client_supports_memfd_results;
+	gsize			 packages_chunk_size;
 
 	/* Rate limiting of progress reporting */
 	gboolean		 progress_changed;
+	GPtrArray		*item_progress;  /* (element-type PkItemProgress) pending ItemProgress */
 	GSource			*progress_timeout_source;  /* (nullable) (owned) */
+	guint			 progress_interval;  /* ms */
 
 	/* needed for gui coldplugging */
 	gchar			*last_package_id;
@@ -122,6 +150,16 @@ struct PkTransactionPrivate
 	gchar			*cmdline;
 	PkResults		*results;
 	PkTransactionDb		*transaction_db;
+	gchar			*coalesce_key;
+	PkBackendJob		*primary_job;
+	PkResultCache		*result_cache;
+	guint			 result_cache_generation;
+	gboolean		 from_result_cache;
+	PkTransactionDbCursor	*old_transactions;
+	guint			 old_transactions_id;
+	gint64			 phase_time[PK_TRANSACTION_PHASE_LAST];	/* monotonic, us */
+	PkExitEnum		 exit;
+	guint			 packages_emitted;
 
 	/* cached */
 	gboolean		 cached_force;
@@ -306,6 +344,24 @@ out:
 	return TRUE;
 }
 
+/* anything but a query may have changed the package databases, and the
+ * transactions queued behind it must not be answered from before that */
+static void
+pk_transaction_finish_invalidate_results (PkTransaction *transaction)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+
+	if (pk_backend_role_is_read_only (priv->role))
+		return;
+	if (pk_result_cache_role_is_cacheable (priv->role) &&
+	    pk_backend_job_get_cache_age (priv->job) == G_MAXUINT)
+		return;
+	if (pk_bitfield_contain (priv->cached_transaction_flags,
+				 PK_TRANSACTION_FLAG_ENUM_SIMULATE))
+		return;
+	pk_result_cache_invalidate (priv->result_cache);
+}
+
 static void pk_transaction_emit_properties_changed (PkTransaction *transaction,
                                                     const gchar   *first_property_name,
                                                     GVariant      *first_property_value,
@@ -362,9 +418,30 @@ pk_transaction_emit_property_changed (PkTransaction *transaction,
 						NULL);
 }
 
+static void
+pk_transaction_item_progress_emit (PkTransaction *transaction,
+				   PkItemProgress *item_progress)
+{
+	g_debug ("emitting item-progress %s, %s: %u",
+		 pk_item_progress_get_package_id (item_progress),
+		 pk_status_enum_to_string (pk_item_progress_get_status (item_progress)),
+		 pk_item_progress_get_percentage (item_progress));
+	g_dbus_connection_emit_signal (transaction->priv->connection,
+				       NULL,
+				       transaction->priv->tid,
+				       PK_DBUS_INTERFACE_TRANSACTION,
+				       "ItemProgress",
+				       g_variant_new ("(suu)",
+						      pk_item_progress_get_package_id (item_progress),
+						      pk_item_progress_get_status (item_progress),
+						      pk_item_progress_get_percentage (item_progress)),
+				       NULL);
+}
+
 /* If any progress-related properties have changed since the last
  * `PropertiesChanged` emission, immediately emit that D-Bus signal with the
- * latest values and clear the pending changes flag.
+ * latest values and clear the pending changes flag. Any pending
+ * `ItemProgress` signals are emitted afterwards.
  *
  * See schedule_progress_changed().
  */
@@ -373,19 +450,21 @@ flush_progress_changed (PkTransaction *transaction)
 {
 	PkTransactionPrivate *priv = transaction->priv;
 
-	if (!priv->progress_changed)
-		return;
-
 	/* Emit a D-Bus signal to notify of the progress changes. */
-	pk_transaction_emit_properties_changed (transaction,
-						"Percentage", g_variant_new_uint32 (priv->percentage),
-						"ElapsedTime", g_variant_new_uint32 (priv->elapsed_time),
-						"RemainingTime", g_variant_new_uint32 (priv->remaining_time),
-						"Speed", g_variant_new_uint32 (priv->speed),
-						"DownloadSizeRemaining", g_variant_new_uint64 (priv->download_size_remaining),
-						NULL);
-
-	priv->progress_changed = FALSE;
+	if (priv->progress_changed) {
+		pk_transaction_emit_properties_changed (transaction,
+							"Percentage", g_variant_new_uint32 (priv->percentage),
+							"ElapsedTime", g_variant_new_uint32 (priv->elapsed_time),
+							"RemainingTime", g_variant_new_uint32 (priv->remaining_time),
+							"Speed", g_variant_new_uint32 (priv->speed),
+							"DownloadSizeRemaining", g_variant_new_uint64 (priv->download_size_remaining),
+							NULL);
+		priv->progress_changed = FALSE;
+	}
+
+	for (guint i = 0; i < priv->item_progress->len; i++)
+		pk_transaction_item_progress_emit (transaction, g_ptr_array_index (priv->item_progress, i));
+	g_ptr_array_set_size (priv->item_progress, 0);
 }
 
 static gboolean
@@ -402,8 +481,9 @@ progress_timeout_cb (gpointer user_data)
  * doesn’t emit multiple D-Bus signals every millisecond for fast-progressing
  * operations (which are quite common).
  *
- * Instead, emit signals on a timer, set to 100ms (which should be fast enough
- * for users to not notice the quantisation).
+ * Instead, emit signals on a timer, set to 100ms by default (which should be
+ * fast enough for users to not notice the quantisation). Clients can ask for
+ * a different rate with the progress-rate hint.
  *
  * This significantly reduces the context switching overhead between
  * packagekitd, dbus-daemon, and the PackageKit clients.
@@ -414,14 +494,12 @@ progress_timeout_cb (gpointer user_data)
  * flush_progress_changed().
  */
 static void
-schedule_progress_changed (PkTransaction *transaction)
+schedule_progress_flush (PkTransaction *transaction)
 {
-	transaction->priv->progress_changed = TRUE;
-
 	if (transaction->priv->progress_timeout_source == NULL) {
 		g_autoptr(GSource) source = NULL;
 
-		source = g_timeout_source_new (100  /* ms */);
+		source = g_timeout_source_new (transaction->priv->progress_interval);
 		g_source_set_callback (source, G_SOURCE_FUNC (progress_timeout_cb), transaction, NULL);
 
 #if GLIB_CHECK_VERSION(2, 70, 0)
@@ -433,6 +511,13 @@ schedule_progress_changed (PkTransaction *transaction)
 	}
 }
 
+static void
+schedule_progress_changed (PkTransaction *transaction)
+{
+	transaction->priv->progress_changed = TRUE;
+	schedule_progress_flush (transaction);
+}
+
 /* Remove the @progress_timeout_source, if set. */
 static void
 unschedule_progress_changed (PkTransaction *transaction)
@@ -507,12 +592,127 @@ pk_transaction_status_changed_emit (PkTransaction *transaction, PkStatusEnum sta
 }
 
 static void
-pk_transaction_finished_emit (PkTransaction *transaction,
-			      PkExitEnum exit_enum,
-			      guint time_ms)
+pk_transaction_results_connection_cb (GObject *source_object,
+				      GAsyncResult *res,
+				      gpointer user_data)
 {
-	g_assert (!transaction->priv->emitted_finished);
-	transaction->priv->emitted_finished = TRUE;
+	g_autoptr(PkTransaction) transaction = PK_TRANSACTION (user_data);
+	GDBusMethodInvocation *context = g_steal_pointer (&transaction->priv->results_socket_context);
+	g_autoptr(GDBusConnection) connection = NULL;
+	g_autoptr(GError) error = NULL;
+
+	connection = g_dbus_connection_new_finish (res, &error);
+	if (connection == NULL) {
+		g_prefix_error (&error, "failed to set up results connection: ");
+		pk_transaction_dbus_return (context, error);
+		return;
+	}
+
+	/* too late, results are already being sent on the bus */
+	if (transaction->priv->results_connection_decided) {
+		g_dbus_connection_close (connection, NULL, NULL, NULL);
+		g_set_error (&error,
+			     PK_TRANSACTION_ERROR,
+			     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+			     "the transaction is already running");
+		pk_transaction_dbus_return (context, error);
+		return;
+	}
+	g_debug ("sending results of %s on a private connection",
+		 transaction->priv->tid);
+	transaction->priv->results_connection = g_steal_pointer (&connection);
+	pk_transaction_dbus_return (context, NULL);
+}
+
+/* Package, Packages, Details and Files go to the client directly if it asked */
+static GDBusConnection *
+pk_transaction_get_results_connection (PkTransaction *transaction)
+{
+	GDBusConnection *connection = transaction->priv->results_connection;
+
+	if (connection != NULL && !g_dbus_connection_is_closed (connection))
+		return connection;
+	return transaction->priv->connection;
+}
+
+static void
+pk_transaction_close_results_connection (PkTransaction *transaction)
+{
+	if (transaction->priv->results_connection == NULL)
+		return;
+
+	/* the client finishes once it has seen ::Finished and this has closed,
+	 * so all the results flushed before the close are read first */
+	g_dbus_connection_close (transaction->priv->results_connection,
+				 NULL, NULL, NULL);
+	g_clear_object (&transaction->priv->results_connection);
+}
+
+/* the client maps large results from a sealed memfd rather than copying strings */
+static gboolean
+pk_transaction_results_memfd_supported (PkTransaction *transaction)
+{
+	GDBusConnection *connection = transaction->priv->results_connection;
+
+	if (!transaction->priv->client_supports_memfd_results)
+		return FALSE;
+	if (connection == NULL || g_dbus_connection_is_closed (connection))
+		return FALSE;
+	return (g_dbus_connection_get_capabilities (connection) &
+		G_DBUS_CAPABILITY_FLAGS_UNIX_FD_PASSING) > 0;
+}
+
+/*
+ * pk_transaction_results_memfd_send:
+ *
+ * GDBus cannot hand the fds of a received signal to the client, so the
+ * memfd is sent as a method call without a reply instead, which is still
+ * ordered with the signals sent on the same connection.
+ **/
+static gboolean
+pk_transaction_results_memfd_send (PkTransaction *transaction,
+				   const gchar *method_name,
+				   GByteArray *builder)
+{
+	gint fd;
+	g_autoptr(GDBusMessage) message = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GUnixFDList) fd_list = NULL;
+
+	fd = pk_results_memfd_builder_seal (builder, &error);
+	if (fd < 0) {
+		g_warning ("failed to create results memfd: %s", error->message);
+		return FALSE;
+	}
+	fd_list = g_unix_fd_list_new_from_array (&fd, 1);
+	message = g_dbus_message_new_method_call (NULL,
+						  transaction->priv->tid,
+						  PK_RESULTS_MEMFD_INTERFACE,
+						  method_name);
+	g_dbus_message_set_flags (message, G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+	g_dbus_message_set_body (message, g_variant_new ("(h)", 0));
+	g_dbus_message_set_unix_fd_list (message, fd_list);
+	if (!g_dbus_connection_send_message (transaction->priv->results_connection,
+					     message,
+					     G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+					     NULL,
+					     &error)) {
+		g_warning ("failed to send results memfd: %s", error->message);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+pk_transaction_finished_emit_signals (PkTransaction *transaction)
+{
+	PkExitEnum exit_enum = transaction->priv->exit;
+	guint time_ms = transaction->priv->finished_time_ms;
+
+	/* clients drop the proxy on ::Finished, so they have to get this first */
+	pk_transaction_emit_property_changed (transaction,
+					      "PhaseTimes",
+					      pk_transaction_get_phase_times (transaction));
 
 	g_debug ("emitting finished '%s', %i",
 		 pk_exit_enum_to_string (exit_enum),
@@ -531,6 +731,75 @@ pk_transaction_finished_emit (PkTransaction *transaction,
 	g_signal_emit (transaction, signals[SIGNAL_FINISHED], 0);
 }
 
+static void
+pk_transaction_results_flushed (PkTransaction *transaction)
+{
+	/* the timeout got here first */
+	if (transaction->priv->results_flush_id == 0)
+		return;
+	g_source_remove (transaction->priv->results_flush_id);
+	transaction->priv->results_flush_id = 0;
+
+	pk_transaction_close_results_connection (transaction);
+	pk_transaction_finished_emit_signals (transaction);
+}
+
+static void
+pk_transaction_results_flush_cb (GObject *source_object,
+				 GAsyncResult *res,
+				 gpointer user_data)
+{
+	g_autoptr(PkTransaction) transaction = PK_TRANSACTION (user_data);
+	g_autoptr(GError) error = NULL;
+
+	if (!g_dbus_connection_flush_finish (G_DBUS_CONNECTION (source_object), res, &error))
+		g_debug ("failed to flush results of %s: %s",
+			 transaction->priv->tid, error->message);
+	pk_transaction_results_flushed (transaction);
+}
+
+static gboolean
+pk_transaction_results_flush_timeout_cb (gpointer user_data)
+{
+	PkTransaction *transaction = PK_TRANSACTION (user_data);
+
+	/* the pending flush holds a ref, so the transaction is still alive */
+	g_warning ("client is not reading the results of %s, dropping them",
+		   transaction->priv->tid);
+	transaction->priv->results_flush_id = 0;
+	pk_transaction_close_results_connection (transaction);
+	pk_transaction_finished_emit_signals (transaction);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+pk_transaction_finished_emit (PkTransaction *transaction,
+			      PkExitEnum exit_enum,
+			      guint time_ms)
+{
+	g_assert (!transaction->priv->emitted_finished);
+	transaction->priv->emitted_finished = TRUE;
+	transaction->priv->exit = exit_enum;
+	transaction->priv->finished_time_ms = time_ms;
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_EMITTED);
+
+	if (transaction->priv->results_connection == NULL) {
+		pk_transaction_finished_emit_signals (transaction);
+		return;
+	}
+
+	/* closing does not flush, so write out all the results first;
+	 * Finished is only emitted once they have all been sent */
+	transaction->priv->results_flush_id =
+		g_timeout_add_seconds (PK_TRANSACTION_RESULTS_FLUSH_TIMEOUT,
+				       pk_transaction_results_flush_timeout_cb,
+				       transaction);
+	g_dbus_connection_flush (transaction->priv->results_connection,
+				 NULL,
+				 pk_transaction_results_flush_cb,
+				 g_object_ref (transaction));
+}
+
 static void
 pk_transaction_error_code_emit (PkTransaction *transaction,
 				PkErrorEnum error_enum,
@@ -589,6 +858,7 @@ pk_transaction_details_cb (PkBackendJob *job,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* add to results */
 	pk_results_add_details (transaction->priv->results, item);
@@ -627,7 +897,7 @@ pk_transaction_details_cb (PkBackendJob *job,
 		g_variant_builder_add (&builder, "{sv}", "download-size",
 				       g_variant_new_uint64 (size));
 
-	g_dbus_connection_emit_signal (transaction->priv->connection,
+	g_dbus_connection_emit_signal (pk_transaction_get_results_connection (transaction),
 				       NULL,
 				       transaction->priv->tid,
 				       PK_DBUS_INTERFACE_TRANSACTION,
@@ -682,6 +952,7 @@ pk_transaction_files_cb (PkBackendJob *job,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* get data */
 	g_object_get (item,
@@ -704,9 +975,24 @@ pk_transaction_files_cb (PkBackendJob *job,
 	/* add to results */
 	pk_results_add_files (transaction->priv->results, item);
 
+	/* file lists can be huge, so avoid copying them into the message */
+	if (files != NULL && pk_transaction_results_memfd_supported (transaction)) {
+		g_autoptr(GByteArray) builder = NULL;
+
+		builder = pk_results_memfd_builder_new (PK_RESULTS_MEMFD_KIND_FILES);
+		pk_results_memfd_builder_add_string (builder, package_id);
+		pk_results_memfd_builder_add_uint32 (builder, g_strv_length (files));
+		for (i = 0; files[i] != NULL; i++)
+			pk_results_memfd_builder_add_string (builder, files[i]);
+		pk_results_memfd_builder_set_n_records (builder, 1);
+		g_debug ("sending files %s in a memfd", package_id);
+		if (pk_transaction_results_memfd_send (transaction, "Files", builder))
+			return;
+	}
+
 	/* emit */
 	g_debug ("emitting files %s", package_id);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
+	g_dbus_connection_emit_signal (pk_transaction_get_results_connection (transaction),
 				       NULL,
 				       transaction->priv->tid,
 				       PK_DBUS_INTERFACE_TRANSACTION,
@@ -730,6 +1016,7 @@ pk_transaction_category_cb (PkBackendJob *job,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* add to results */
 	pk_results_add_category (transaction->priv->results, item);
@@ -764,24 +1051,27 @@ pk_transaction_item_progress_cb (PkBackendJob *job,
 				 PkItemProgress *item_progress,
 				 PkTransaction *transaction)
 {
+	GPtrArray *pending;
+
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
 
-	/* emit */
-	g_debug ("emitting item-progress %s, %s: %u",
-		 pk_item_progress_get_package_id (item_progress),
-		 pk_status_enum_to_string (pk_item_progress_get_status (item_progress)),
-		 pk_item_progress_get_percentage (item_progress));
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "ItemProgress",
-				       g_variant_new ("(suu)",
-						      pk_item_progress_get_package_id (item_progress),
-						      pk_item_progress_get_status (item_progress),
-						      pk_item_progress_get_percentage (item_progress)),
-				       NULL);
+	pending = transaction->priv->item_progress;
+
+	/* only the latest percentage of each item is sent with the other
+	 * progress, but a change of status is never lost; the update goes to
+	 * the end so the item is never sent in a status it has already left */
+	for (guint i = 0; i < pending->len; i++) {
+		PkItemProgress *tmp = g_ptr_array_index (pending, i);
+		if (pk_item_progress_get_status (tmp) == pk_item_progress_get_status (item_progress) &&
+		    g_strcmp0 (pk_item_progress_get_package_id (tmp),
+			       pk_item_progress_get_package_id (item_progress)) == 0) {
+			g_ptr_array_remove_index (pending, i);
+			break;
+		}
+	}
+	g_ptr_array_add (pending, g_object_ref (item_progress));
+	schedule_progress_flush (transaction);
 }
 
 static void
@@ -795,6 +1085,7 @@ pk_transaction_distro_upgrade_cb (PkBackendJob *job,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* add to results */
 	pk_results_add_distro_upgrade (transaction->priv->results, item);
@@ -862,6 +1153,99 @@ pk_transaction_state_to_string (PkTransactionState state)
 	return NULL;
 }
 
+const gchar *
+pk_transaction_phase_to_string (PkTransactionPhase phase)
+{
+	if (phase == PK_TRANSACTION_PHASE_CREATED)
+		return "created";
+	if (phase == PK_TRANSACTION_PHASE_REQUESTED)
+		return "requested";
+	if (phase == PK_TRANSACTION_PHASE_AUTHORIZED)
+		return "authorized";
+	if (phase == PK_TRANSACTION_PHASE_RUNNING)
+		return "running";
+	if (phase == PK_TRANSACTION_PHASE_FIRST_RESULT)
+		return "first-result";
+	if (phase == PK_TRANSACTION_PHASE_FINISHED)
+		return "finished";
+	if (phase == PK_TRANSACTION_PHASE_EMITTED)
+		return "emitted";
+	return NULL;
+}
+
+/* only the first time each phase is reached is kept */
+static void
+pk_transaction_set_phase (PkTransaction *transaction, PkTransactionPhase phase)
+{
+	if (transaction->priv->phase_time[phase] == 0)
+		transaction->priv->phase_time[phase] = g_get_monotonic_time ();
+}
+
+/* the transaction goes back in the queue, so it will run again */
+static void
+pk_transaction_reset_phases (PkTransaction *transaction)
+{
+	for (guint i = PK_TRANSACTION_PHASE_RUNNING; i < PK_TRANSACTION_PHASE_LAST; i++)
+		transaction->priv->phase_time[i] = 0;
+}
+
+/**
+ * pk_transaction_get_phase_time:
+ *
+ * Return value: the monotonic time in microseconds when the phase was
+ * reached, or 0 if it has not been
+ **/
+gint64
+pk_transaction_get_phase_time (PkTransaction *transaction, PkTransactionPhase phase)
+{
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), 0);
+	g_return_val_if_fail (phase < PK_TRANSACTION_PHASE_LAST, 0);
+	return transaction->priv->phase_time[phase];
+}
+
+/**
+ * pk_transaction_get_exit:
+ *
+ * Return value: the exit code sent with ::Finished, or
+ * %PK_EXIT_ENUM_UNKNOWN if the transaction has not finished
+ **/
+PkExitEnum
+pk_transaction_get_exit (PkTransaction *transaction)
+{
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), PK_EXIT_ENUM_UNKNOWN);
+	return transaction->priv->exit;
+}
+
+/**
+ * pk_transaction_get_packages_emitted:
+ *
+ * Return value: the number of packages sent to the client so far
+ **/
+guint
+pk_transaction_get_packages_emitted (PkTransaction *transaction)
+{
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), 0);
+	return transaction->priv->packages_emitted;
+}
+
+/* each phase reached, in microseconds after the transaction was created */
+static GVariant *
+pk_transaction_get_phase_times (PkTransaction *transaction)
+{
+	GVariantBuilder builder;
+	gint64 *phase_time = transaction->priv->phase_time;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+	for (guint i = 0; i < PK_TRANSACTION_PHASE_LAST; i++) {
+		if (phase_time[i] == 0)
+			continue;
+		g_variant_builder_add (&builder, "{st}",
+				       pk_transaction_phase_to_string (i),
+				       (guint64) (phase_time[i] - phase_time[PK_TRANSACTION_PHASE_CREATED]));
+	}
+	return g_variant_builder_end (&builder);
+}
+
 /**
  * pk_transaction_set_state:
  *
@@ -898,6 +1282,10 @@ pk_transaction_set_state (PkTransaction *transaction, PkTransactionState state)
 
 	g_debug ("transaction now %s", pk_transaction_state_to_string (state));
 	priv->state = state;
+	if (state == PK_TRANSACTION_STATE_READY)
+		pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_AUTHORIZED);
+	else if (state == PK_TRANSACTION_STATE_RUNNING)
+		pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_RUNNING);
 	g_signal_emit (transaction, signals[SIGNAL_STATE_CHANGED], 0, state);
 
 	/* only get cmdline when it's going to be saved into the database */
@@ -1148,6 +1536,33 @@ pk_transaction_offline_finished (PkTransaction *transaction)
 	}
 }
 
+static void
+pk_transaction_finish_cache_results (PkTransaction *transaction)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+	g_autoptr(PkError) error_code = NULL;
+
+	/* we were answered from the cache or by another transaction */
+	if (priv->from_result_cache || priv->primary_job != NULL)
+		return;
+	if (priv->coalesce_key == NULL ||
+	    !pk_result_cache_role_is_cacheable (priv->role))
+		return;
+
+	/* the backend may have refreshed the metadata for us */
+	if (pk_backend_job_get_cache_age (priv->job) != G_MAXUINT)
+		return;
+	error_code = pk_results_get_error_code (priv->results);
+	if (error_code != NULL)
+		return;
+
+	if (pk_result_cache_insert (priv->result_cache,
+				    priv->coalesce_key,
+				    priv->result_cache_generation,
+				    priv->results))
+		g_debug ("cached results of %s", priv->tid);
+}
+
 static void
 pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransaction *transaction)
 {
@@ -1160,6 +1575,8 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
 
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FINISHED);
+
 	/* have we already been marked as finished? */
 	if (transaction->priv->finished) {
 		g_warning ("Already finished");
@@ -1203,6 +1620,10 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 	if (exit_enum == PK_EXIT_ENUM_SUCCESS)
 		pk_transaction_finish_invalidate_caches (transaction);
 
+	/* even a failed writer may have changed something, and this has to
+	 * happen before the scheduler starts the next transaction */
+	pk_transaction_finish_invalidate_results (transaction);
+
 	/* find the length of time we have been running */
 	time_ms = pk_transaction_get_runtime (transaction);
 	g_debug ("backend was running for %i ms", time_ms);
@@ -1280,8 +1701,14 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 	/* this disconnects any pending signals */
 	pk_backend_job_disconnect_vfuncs (transaction->priv->job);
 
-	/* destroy the job */
-	pk_backend_stop_job (transaction->priv->backend, transaction->priv->job);
+	/* keep the results for the next identical query */
+	if (exit_enum == PK_EXIT_ENUM_SUCCESS)
+		pk_transaction_finish_cache_results (transaction);
+
+	/* destroy the job, unless another transaction or the cache ran it for us */
+	if (pk_backend_job_get_started (transaction->priv->job))
+		pk_backend_stop_job (transaction->priv->backend, transaction->priv->job);
+	g_clear_object (&transaction->priv->primary_job);
 
 	/* we emit last, as other backends will be running very soon after us, and we don't want to be notified */
 	pk_transaction_finished_emit (transaction, exit_enum, time_ms);
@@ -1301,6 +1728,7 @@ pk_transaction_package_cb (PkBackend *backend,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* have we already been marked as finished? */
 	if (transaction->priv->finished) {
@@ -1347,6 +1775,7 @@ pk_transaction_package_cb (PkBackend *backend,
 		pk_results_add_package (transaction->priv->results, item);
 
 	/* emit */
+	transaction->priv->packages_emitted++;
 	package_id = pk_package_get_id (item);
 	g_free (transaction->priv->last_package_id);
 	transaction->priv->last_package_id = g_strdup (package_id);
@@ -1364,7 +1793,7 @@ pk_transaction_package_cb (PkBackend *backend,
 	update_severity = pk_package_get_update_severity (item);
 	encoded_value = info | (((guint32) update_severity) << 16);
 
-	g_dbus_connection_emit_signal (transaction->priv->connection,
+	g_dbus_connection_emit_signal (pk_transaction_get_results_connection (transaction),
 				       NULL,
 				       transaction->priv->tid,
 				       PK_DBUS_INTERFACE_TRANSACTION,
@@ -1376,18 +1805,91 @@ pk_transaction_package_cb (PkBackend *backend,
 				       NULL);
 }
 
+static void
+pk_transaction_packages_emit (PkTransaction *transaction,
+			      GVariant *package_array)
+{
+	g_autoptr(GVariant) package_array_variant = g_variant_ref_sink (package_array);
+	GDBusConnection *connection = pk_transaction_get_results_connection (transaction);
+	gboolean emitted = FALSE;
+
+	transaction->priv->packages_emitted += g_variant_n_children (package_array_variant);
+
+	/* hand the whole chunk over in one sealed memfd if possible */
+	if (pk_transaction_results_memfd_supported (transaction)) {
+		GVariantIter iter;
+		const gchar *package_id;
+		const gchar *summary;
+		guint32 info;
+		guint32 n_records = 0;
+		g_autoptr(GByteArray) builder = NULL;
+
+		builder = pk_results_memfd_builder_new (PK_RESULTS_MEMFD_KIND_PACKAGES);
+		g_variant_iter_init (&iter, package_array_variant);
+		while (g_variant_iter_next (&iter, "(u&s&s)", &info, &package_id, &summary)) {
+			pk_results_memfd_builder_add_uint32 (builder, info);
+			pk_results_memfd_builder_add_string (builder, package_id);
+			pk_results_memfd_builder_add_string (builder, summary);
+			n_records++;
+		}
+		pk_results_memfd_builder_set_n_records (builder, n_records);
+		if (pk_transaction_results_memfd_send (transaction, "Packages", builder))
+			return;
+	}
+
+	/* Emit the signal. Grouping multiple package details into a single
+	 * signal reduces the number of signals and hence the amount of context
+	 * switching between packagekitd, dbus-daemon and the client process.
+	 * This results in much improved performance compared to emitting one
+	 * signal per package.
+	 *
+	 * Large result sets are split into chunks of PackagesChunkSize bytes,
+	 * so that the first results arrive straight away and none of the
+	 * processes has to hold the whole list in one message. If emitting
+	 * still fails, we fall back below. */
+	if (transaction->priv->client_supports_plural_signals &&
+	    g_dbus_connection_emit_signal (connection,
+					   NULL,
+					   transaction->priv->tid,
+					   PK_DBUS_INTERFACE_TRANSACTION,
+					   "Packages",
+					   g_variant_new ("(@a(uss))",
+					                  package_array_variant),
+					   NULL))
+		emitted = TRUE;
+
+	if (!emitted) {
+		GVariantIter iter;
+		g_autoptr(GVariant) child = NULL;
+
+		/* Fall back to one signal per package. */
+		g_variant_iter_init (&iter, package_array_variant);
+
+		while ((child = g_variant_iter_next_value (&iter))) {
+			g_dbus_connection_emit_signal (connection,
+						       NULL,
+						       transaction->priv->tid,
+						       PK_DBUS_INTERFACE_TRANSACTION,
+						       "Package",
+						       child,
+						       NULL);
+			g_clear_pointer (&child, g_variant_unref);
+		}
+	}
+}
+
 static void
 pk_transaction_packages_cb (PkBackend *backend,
 			    GPtrArray *package_array,
 			    PkTransaction *transaction)
 {
 	g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT (G_VARIANT_TYPE ("a(uss)"));
-	g_autoptr(GVariant) package_array_variant = NULL;
 	guint n_added_packages = 0;
-	gboolean emitted = FALSE;
+	gsize chunk_size = 0;
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* have we already been marked as finished? */
 	if (transaction->priv->finished) {
@@ -1467,53 +1969,23 @@ pk_transaction_packages_cb (PkBackend *backend,
 				       package_id,
 				       summary ? summary : "");
 		n_added_packages++;
+
+		/* send what we have so far rather than one huge message */
+		chunk_size += strlen (package_id) + (summary != NULL ? strlen (summary) : 0) + 16;
+		if (chunk_size >= transaction->priv->packages_chunk_size) {
+			pk_transaction_packages_emit (transaction,
+						      g_variant_builder_end (&builder));
+			g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uss)"));
+			n_added_packages = 0;
+			chunk_size = 0;
+		}
 	}
 
 	if (n_added_packages == 0) {
 		g_debug ("Empty package array");
 		return;
 	}
-
-	package_array_variant = g_variant_ref_sink (g_variant_builder_end (&builder));
-
-	/* Emit the signal. Grouping multiple package details into a single
-	 * signal reduces the number of signals and hence the amount of context
-	 * switching between packagekitd, dbus-daemon and the client process.
-	 * This results in much improved performance compared to emitting one
-	 * signal per package.
-	 *
-	 * This should not hit the D-Bus limits (maximum array size of 64MB,
-	 * maximum message size of 128MB) until it’s listing on the order of
-	 * 100000 packages. If it does, we fall back below. */
-	if (transaction->priv->client_supports_plural_signals &&
-	    g_dbus_connection_emit_signal (transaction->priv->connection,
-					   NULL,
-					   transaction->priv->tid,
-					   PK_DBUS_INTERFACE_TRANSACTION,
-					   "Packages",
-					   g_variant_new ("(@a(uss))",
-					                  package_array_variant),
-					   NULL))
-		emitted = TRUE;
-
-	if (!emitted) {
-		GVariantIter iter;
-		g_autoptr(GVariant) child = NULL;
-
-		/* Fall back to one signal per package. */
-		g_variant_iter_init (&iter, package_array_variant);
-
-		while ((child = g_variant_iter_next_value (&iter))) {
-			g_dbus_connection_emit_signal (transaction->priv->connection,
-						       NULL,
-						       transaction->priv->tid,
-						       PK_DBUS_INTERFACE_TRANSACTION,
-						       "Package",
-						       child,
-						       NULL);
-			g_clear_pointer (&child, g_variant_unref);
-		}
-	}
+	pk_transaction_packages_emit (transaction, g_variant_builder_end (&builder));
 }
 
 static void
@@ -1527,6 +1999,7 @@ pk_transaction_repo_detail_cb (PkBackend *backend,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* add to results */
 	pk_results_add_repo_detail (transaction->priv->results, item);
@@ -1790,6 +2263,7 @@ pk_transaction_update_detail_cb (PkBackend *backend,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* add to results */
 	pk_results_add_update_detail (transaction->priv->results, item);
@@ -1839,6 +2313,7 @@ pk_transaction_update_details_cb (PkBackend *backend,
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_FIRST_RESULT);
 
 	/* Loop through the packages and build a signal emission. */
 	for (guint i = 0; i < update_details_array->len; i++) {
@@ -2032,58 +2507,10 @@ pk_transaction_percentage_cb (PkBackendJob *job,
 	schedule_progress_changed (transaction);
 }
 
-gboolean
-pk_transaction_run (PkTransaction *transaction)
+static void
+pk_transaction_connect_vfuncs (PkTransaction *transaction)
 {
-	GError *error = NULL;
-	PkExitEnum exit_status;
-	PkTransactionPrivate *priv = PK_TRANSACTION_GET_PRIVATE (transaction);
-
-	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), FALSE);
-	g_return_val_if_fail (priv->tid != NULL, FALSE);
-	g_return_val_if_fail (transaction->priv->backend != NULL, FALSE);
-
-	/* we are no longer waiting, we are setting up */
-	pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_SETUP);
-
-	/* set proxy */
-	if (!pk_transaction_set_session_state (transaction, &error)) {
-		g_debug ("failed to set the session state (non-fatal): %s",
-			 error->message);
-		g_clear_error (&error);
-	}
-
-	/* already cancelled? */
-	if (pk_backend_job_get_exit_code (priv->job) == PK_EXIT_ENUM_CANCELLED) {
-		exit_status = pk_backend_job_get_exit_code (priv->job);
-		pk_transaction_finished_emit (transaction, exit_status, 0);
-		return TRUE;
-	}
-
-	/* run the job */
-	pk_backend_start_job (priv->backend, priv->job);
-
-	/* is an error code set? */
-	if (pk_backend_job_get_is_error_set (priv->job)) {
-		exit_status = pk_backend_job_get_exit_code (priv->job);
-		pk_transaction_finished_emit (transaction, exit_status, 0);
-		/* do not fail the transaction */
-	}
-
-	/* check if we should skip this transaction */
-	if (pk_backend_job_get_exit_code (priv->job) == PK_EXIT_ENUM_SKIP_TRANSACTION) {
-		pk_transaction_finished_emit (transaction, PK_EXIT_ENUM_SUCCESS, 0);
-		/* do not fail the transaction */
-	}
-
-	/* set the role */
-	pk_backend_job_set_role (priv->job, priv->role);
-	g_debug ("setting role for %s to %s",
-		 priv->tid,
-		 pk_role_enum_to_string (priv->role));
-
-	/* reset after the pre-transaction checks */
-	pk_backend_job_set_percentage (priv->job, PK_BACKEND_PERCENTAGE_INVALID);
+	PkTransactionPrivate *priv = transaction->priv;
 
 	/* connect signal to receive backend lock changes */
 	pk_backend_job_set_vfunc (priv->job,
@@ -2174,6 +2601,124 @@ pk_transaction_run (PkTransaction *transaction)
 				  PK_BACKEND_SIGNAL_CATEGORY,
 				  PK_BACKEND_JOB_VFUNC (pk_transaction_category_cb),
 				  transaction);
+}
+
+static gboolean
+pk_transaction_run_from_result_cache (PkTransaction *transaction)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+	guint i;
+	g_autoptr(PkResults) results = NULL;
+	g_autoptr(GPtrArray) packages = NULL;
+	g_autoptr(GPtrArray) details = NULL;
+	g_autoptr(GPtrArray) files = NULL;
+	g_autoptr(GPtrArray) update_details = NULL;
+	g_autoptr(GPtrArray) categories = NULL;
+	g_autoptr(GPtrArray) repo_details = NULL;
+
+	if (priv->coalesce_key == NULL ||
+	    !pk_result_cache_role_is_cacheable (priv->role))
+		return FALSE;
+	results = pk_result_cache_lookup (priv->result_cache, priv->coalesce_key);
+	if (results == NULL)
+		return FALSE;
+
+	g_debug ("answering %s from the result cache", priv->tid);
+	priv->from_result_cache = TRUE;
+
+	/* replay through the same paths the backend results take */
+	packages = pk_results_get_package_array (results);
+	if (packages->len > 0)
+		pk_transaction_packages_cb (priv->backend, packages, transaction);
+	details = pk_results_get_details_array (results);
+	for (i = 0; i < details->len; i++)
+		pk_transaction_details_cb (priv->job, g_ptr_array_index (details, i), transaction);
+	files = pk_results_get_files_array (results);
+	for (i = 0; i < files->len; i++)
+		pk_transaction_files_cb (priv->job, g_ptr_array_index (files, i), transaction);
+	update_details = pk_results_get_update_detail_array (results);
+	if (update_details->len > 0)
+		pk_transaction_update_details_cb (priv->backend, update_details, transaction);
+	categories = pk_results_get_category_array (results);
+	for (i = 0; i < categories->len; i++)
+		pk_transaction_category_cb (priv->job, g_ptr_array_index (categories, i), transaction);
+	repo_details = pk_results_get_repo_detail_array (results);
+	for (i = 0; i < repo_details->len; i++)
+		pk_transaction_repo_detail_cb (priv->backend, g_ptr_array_index (repo_details, i), transaction);
+
+	pk_transaction_finished_cb (priv->job, PK_EXIT_ENUM_SUCCESS, transaction);
+	return TRUE;
+}
+
+gboolean
+pk_transaction_run (PkTransaction *transaction)
+{
+	GError *error = NULL;
+	PkExitEnum exit_status;
+	PkTransactionPrivate *priv = PK_TRANSACTION_GET_PRIVATE (transaction);
+
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), FALSE);
+	g_return_val_if_fail (priv->tid != NULL, FALSE);
+	g_return_val_if_fail (transaction->priv->backend != NULL, FALSE);
+
+	/* we are running the backend ourselves */
+	g_clear_object (&priv->primary_job);
+	priv->from_result_cache = FALSE;
+
+	/* all results go on one channel, so the client sees them in order */
+	priv->results_connection_decided = TRUE;
+
+	/* we are no longer waiting, we are setting up */
+	pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_SETUP);
+
+	/* set proxy */
+	if (!pk_transaction_set_session_state (transaction, &error)) {
+		g_debug ("failed to set the session state (non-fatal): %s",
+			 error->message);
+		g_clear_error (&error);
+	}
+
+	/* already cancelled? */
+	if (pk_backend_job_get_exit_code (priv->job) == PK_EXIT_ENUM_CANCELLED) {
+		exit_status = pk_backend_job_get_exit_code (priv->job);
+		pk_transaction_finished_emit (transaction, exit_status, 0);
+		return TRUE;
+	}
+
+	/* answer straight from memory if the databases have not changed */
+	if (pk_transaction_run_from_result_cache (transaction))
+		return TRUE;
+
+	/* results computed from here on are only valid for this generation */
+	priv->result_cache_generation = pk_result_cache_get_generation (priv->result_cache);
+
+	/* run the job */
+	pk_backend_start_job (priv->backend, priv->job);
+
+	/* is an error code set? */
+	if (pk_backend_job_get_is_error_set (priv->job)) {
+		exit_status = pk_backend_job_get_exit_code (priv->job);
+		pk_transaction_finished_emit (transaction, exit_status, 0);
+		/* do not fail the transaction */
+	}
+
+	/* check if we should skip this transaction */
+	if (pk_backend_job_get_exit_code (priv->job) == PK_EXIT_ENUM_SKIP_TRANSACTION) {
+		pk_transaction_finished_emit (transaction, PK_EXIT_ENUM_SUCCESS, 0);
+		/* do not fail the transaction */
+	}
+
+	/* set the role */
+	pk_backend_job_set_role (priv->job, priv->role);
+	g_debug ("setting role for %s to %s",
+		 priv->tid,
+		 pk_role_enum_to_string (priv->role));
+
+	/* reset after the pre-transaction checks */
+	pk_backend_job_set_percentage (priv->job, PK_BACKEND_PERCENTAGE_INVALID);
+
+	/* connect signals to receive the backend results */
+	pk_transaction_connect_vfuncs (transaction);
 
 	/* do the correct action with the cached parameters */
 	switch (priv->role) {
@@ -2366,6 +2911,98 @@ pk_transaction_run (PkTransaction *transaction)
 	return TRUE;
 }
 
+/**
+ * pk_transaction_subscribe:
+ * @transaction: A ready transaction
+ * @primary: A queued or running transaction with the same coalesce key
+ *
+ * Shares the backend job of @primary rather than running our own, so that
+ * @transaction gets exactly the same signals as @primary.
+ *
+ * Return value: %FALSE if @primary has already started sending results
+ **/
+gboolean
+pk_transaction_subscribe (PkTransaction *transaction, PkTransaction *primary)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), FALSE);
+	g_return_val_if_fail (PK_IS_TRANSACTION (primary), FALSE);
+
+	if (!pk_backend_job_add_subscriber (primary->priv->job, priv->job))
+		return FALSE;
+	g_set_object (&priv->primary_job, primary->priv->job);
+	priv->results_connection_decided = TRUE;
+
+	g_debug ("%s sharing the backend job of %s", priv->tid, primary->priv->tid);
+	pk_transaction_set_state (transaction, PK_TRANSACTION_STATE_RUNNING);
+	pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_SETUP);
+	pk_backend_job_set_role (priv->job, priv->role);
+	pk_transaction_connect_vfuncs (transaction);
+	return TRUE;
+}
+
+/**
+ * pk_transaction_unsubscribe:
+ *
+ * Stops sharing the backend job of another transaction and puts this one
+ * back in the queue, e.g. if the other transaction never got run.
+ **/
+void
+pk_transaction_unsubscribe (PkTransaction *transaction)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+
+	if (priv->primary_job == NULL)
+		return;
+	pk_backend_job_remove_subscriber (priv->primary_job, priv->job);
+	g_clear_object (&priv->primary_job);
+	pk_backend_job_disconnect_vfuncs (priv->job);
+	pk_transaction_reset_phases (transaction);
+
+	/* first set state manually, otherwise set_state will refuse to switch to an earlier stage */
+	priv->state = PK_TRANSACTION_STATE_READY;
+	pk_transaction_set_state (transaction, PK_TRANSACTION_STATE_READY);
+}
+
+/**
+ * pk_transaction_get_coalesce_key:
+ *
+ * Return value: a string that is identical for transactions that would
+ * produce identical results, or %NULL if the results can never be shared
+ **/
+const gchar *
+pk_transaction_get_coalesce_key (PkTransaction *transaction)
+{
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), NULL);
+	return transaction->priv->coalesce_key;
+}
+
+static gchar *
+pk_transaction_build_coalesce_key (PkTransaction *transaction,
+				   const gchar *method_name,
+				   GVariant *parameters)
+{
+	PkBackendJob *job = transaction->priv->job;
+	g_autofree gchar *params = NULL;
+
+	/* the client may be asked questions by the backend */
+	if (pk_backend_job_get_frontend_socket (job) != NULL)
+		return NULL;
+
+	params = g_variant_print (parameters, FALSE);
+	return g_strdup_printf ("%s%s;locale=%s;cache-age=%u;background=%i;"
+				"interactive=%i;details-with-deps-size=%i",
+				method_name, params,
+				pk_backend_job_get_locale (job),
+				pk_backend_job_get_cache_age (job),
+				pk_backend_job_get_background (job),
+				pk_backend_job_get_interactive (job),
+				pk_backend_job_get_details_with_deps_size (job));
+}
+
 const gchar *
 pk_transaction_get_tid (PkTransaction *transaction)
 {
@@ -2953,6 +3590,7 @@ static void
 pk_transaction_set_role (PkTransaction *transaction, PkRoleEnum role)
 {
 	transaction->priv->role = role;
+	pk_transaction_set_phase (transaction, PK_TRANSACTION_PHASE_REQUESTED);
 
 	/* always set transaction exclusive for some actions (improves performance) */
 	if (role == PK_ROLE_ENUM_INSTALL_FILES ||
@@ -3028,6 +3666,25 @@ out:
 	pk_transaction_dbus_return (context, error);
 }
 
+/**
+ * pk_transaction_cancel_subscribed:
+ *
+ * Cancels a transaction that is sharing the job of another one, without
+ * affecting the other transaction or any other subscribers.
+ **/
+static void
+pk_transaction_cancel_subscribed (PkTransaction *transaction, PkExitEnum exit_enum)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+
+	pk_backend_job_remove_subscriber (priv->primary_job, priv->job);
+	pk_backend_job_set_exit_code (priv->job, exit_enum);
+	pk_backend_job_error_code (priv->job,
+				   PK_ERROR_ENUM_TRANSACTION_CANCELLED,
+				   "The task was stopped successfully");
+	pk_backend_job_finished (priv->job);
+}
+
 void
 pk_transaction_cancel_bg (PkTransaction *transaction)
 {
@@ -3050,6 +3707,12 @@ pk_transaction_cancel_bg (PkTransaction *transaction)
 		return;
 	}
 
+	/* only stop sharing the job of another transaction */
+	if (transaction->priv->primary_job != NULL) {
+		pk_transaction_cancel_subscribed (transaction, PK_EXIT_ENUM_CANCELLED_PRIORITY);
+		return;
+	}
+
 	/* set the state, as cancelling might take a few seconds */
 	pk_backend_job_set_status (transaction->priv->job, PK_STATUS_ENUM_CANCEL);
 
@@ -3166,6 +3829,12 @@ skip_uid:
 		goto out;
 	}
 
+	/* only stop sharing the job of another transaction */
+	if (transaction->priv->primary_job != NULL) {
+		pk_transaction_cancel_subscribed (transaction, PK_EXIT_ENUM_CANCELLED);
+		goto out;
+	}
+
 	/* set the state, as cancelling might take a few seconds */
 	pk_backend_job_set_status (transaction->priv->job, PK_STATUS_ENUM_CANCEL);
 
@@ -3680,23 +4349,107 @@ out:
 }
 
 static void
-pk_transaction_get_old_transactions (PkTransaction *transaction,
-				     GVariant *params,
-				     GDBusMethodInvocation *context)
+pk_transaction_old_transaction_emit (PkTransaction *transaction, PkTransactionPast *item)
 {
 	const gchar *cmdline;
 	const gchar *data;
 	const gchar *modified;
 	const gchar *tid;
 	gboolean succeeded;
-	GList *l;
-	GList *transactions = NULL;
 	guint duration;
-	guint idle_id;
-	guint number;
 	guint uid;
 	PkRoleEnum role;
-	PkTransactionPast *item;
+
+	/* get data */
+	role = pk_transaction_past_get_role (item);
+	tid = pk_transaction_past_get_id (item);
+	modified = pk_transaction_past_get_timespec (item);
+	succeeded = pk_transaction_past_get_succeeded (item);
+	duration = pk_transaction_past_get_duration (item);
+	data = pk_transaction_past_get_data (item);
+	uid = pk_transaction_past_get_uid (item);
+	cmdline = pk_transaction_past_get_cmdline (item);
+
+	/* emit */
+	g_debug ("adding transaction %s, %s, %i, %s, %i, %s, %i, %s",
+		 tid, modified, succeeded,
+		 pk_role_enum_to_string (role),
+		 duration, data, uid, cmdline);
+	g_dbus_connection_emit_signal (transaction->priv->connection,
+				       NULL,
+				       transaction->priv->tid,
+				       PK_DBUS_INTERFACE_TRANSACTION,
+				       "Transaction",
+				       g_variant_new ("(osbuusus)",
+						      tid,
+						      modified,
+						      succeeded,
+						      role,
+						      duration,
+						      data != NULL ? data : "",
+						      uid,
+						      cmdline != NULL ? cmdline : ""),
+				       NULL);
+}
+
+/*
+ * Each idle callback emits one batch read from the database cursor, so
+ * the first results are sent straight away and the history is never all
+ * in memory. The items are not added to the results for the same reason.
+ */
+static gboolean
+pk_transaction_old_transactions_cb (gpointer user_data)
+{
+	PkTransaction *transaction = PK_TRANSACTION (user_data);
+	PkTransactionPrivate *priv = transaction->priv;
+
+	for (guint i = 0; i < PK_TRANSACTION_OLD_TRANSACTIONS_BATCH; i++) {
+		g_autoptr(PkTransactionPast) item = NULL;
+		item = pk_transaction_db_cursor_next (priv->old_transactions);
+		if (item == NULL) {
+			g_clear_pointer (&priv->old_transactions, pk_transaction_db_cursor_free);
+			priv->old_transactions_id = 0;
+			pk_transaction_finished_emit (transaction, PK_EXIT_ENUM_SUCCESS, 0);
+			return G_SOURCE_REMOVE;
+		}
+		pk_transaction_old_transaction_emit (transaction, item);
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+pk_transaction_old_transactions_start (PkTransaction *transaction,
+				       guint number,
+				       guint offset,
+				       const gchar *since,
+				       GDBusMethodInvocation *context)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+	g_autoptr(GError) error = NULL;
+
+	pk_transaction_set_role (transaction, PK_ROLE_ENUM_GET_OLD_TRANSACTIONS);
+	priv->old_transactions = pk_transaction_db_cursor_new (priv->transaction_db,
+							       number, offset, since);
+	if (priv->old_transactions == NULL) {
+		g_set_error_literal (&error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_INITIALIZE_FAILED,
+				     "Failed to read the transaction history");
+		pk_transaction_set_state (transaction, PK_TRANSACTION_STATE_ERROR);
+		goto out;
+	}
+	priv->old_transactions_id = g_idle_add (pk_transaction_old_transactions_cb, transaction);
+	g_source_set_name_by_id (priv->old_transactions_id, "[PkTransaction] old transactions");
+out:
+	pk_transaction_dbus_return (context, error);
+}
+
+static void
+pk_transaction_get_old_transactions (PkTransaction *transaction,
+				     GVariant *params,
+				     GDBusMethodInvocation *context)
+{
+	guint number;
 
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
@@ -3705,52 +4458,57 @@ pk_transaction_get_old_transactions (PkTransaction *transaction,
 		       &number);
 
 	g_debug ("GetOldTransactions method called");
+	pk_transaction_old_transactions_start (transaction, number, 0, NULL, context);
+}
 
-	pk_transaction_set_role (transaction, PK_ROLE_ENUM_GET_OLD_TRANSACTIONS);
-	transactions = pk_transaction_db_get_list (transaction->priv->transaction_db, number);
-	for (l = transactions; l != NULL; l = l->next) {
-		item = PK_TRANSACTION_PAST (l->data);
+static void
+pk_transaction_get_old_transactions_paged (PkTransaction *transaction,
+					   GVariant *params,
+					   GDBusMethodInvocation *context)
+{
+	const gchar *since;
+	gint usec;
+	guint number;
+	guint offset;
+	g_autofree gchar *since_utc = NULL;
+	g_autofree gchar *seconds = NULL;
+	g_autoptr(GDateTime) datetime = NULL;
+	g_autoptr(GDateTime) datetime_utc = NULL;
+	g_autoptr(GError) error = NULL;
 
-		/* add to results */
-		pk_results_add_transaction (transaction->priv->results, item);
-
-		/* get data */
-		role = pk_transaction_past_get_role (item);
-		tid = pk_transaction_past_get_id (item);
-		modified = pk_transaction_past_get_timespec (item);
-		succeeded = pk_transaction_past_get_succeeded (item);
-		duration = pk_transaction_past_get_duration (item);
-		data = pk_transaction_past_get_data (item);
-		uid = pk_transaction_past_get_uid (item);
-		cmdline = pk_transaction_past_get_cmdline (item);
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
 
-		/* emit */
-		g_debug ("adding transaction %s, %s, %i, %s, %i, %s, %i, %s",
-			 tid, modified, succeeded,
-			 pk_role_enum_to_string (role),
-			 duration, data, uid, cmdline);
-		g_dbus_connection_emit_signal (transaction->priv->connection,
-					       NULL,
-					       transaction->priv->tid,
-					       PK_DBUS_INTERFACE_TRANSACTION,
-					       "Transaction",
-					       g_variant_new ("(osbuusus)",
-							      tid,
-							      modified,
-							      succeeded,
-							      role,
-							      duration,
-							      data != NULL ? data : "",
-							      uid,
-							      cmdline != NULL ? cmdline : ""),
-					       NULL);
-	}
-	g_list_free_full (transactions, (GDestroyNotify) g_object_unref);
+	g_variant_get (params, "(uu&s)",
+		       &number,
+		       &offset,
+		       &since);
 
-	idle_id = g_idle_add ((GSourceFunc) pk_transaction_finished_idle_cb, transaction);
-	g_source_set_name_by_id (idle_id, "[PkTransaction] finished from get-old-transactions");
+	g_debug ("GetOldTransactionsPaged method called: %u, %u, %s",
+		 number, offset, since);
 
-	pk_transaction_dbus_return (context, NULL);
+	/* the database has UTC times in the g_time_val_to_iso8601() format,
+	 * which are compared as strings */
+	if (since[0] != '\0') {
+		datetime = pk_iso8601_to_datetime (since);
+		if (datetime == NULL) {
+			g_set_error (&error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_INPUT_INVALID,
+				     "Invalid ISO8601 time '%s'", since);
+			pk_transaction_set_state (transaction, PK_TRANSACTION_STATE_ERROR);
+			pk_transaction_dbus_return (context, error);
+			return;
+		}
+		datetime_utc = g_date_time_to_utc (datetime);
+		seconds = g_date_time_format (datetime_utc, "%Y-%m-%dT%H:%M:%S");
+		usec = g_date_time_get_microsecond (datetime_utc);
+		if (usec != 0)
+			since_utc = g_strdup_printf ("%s.%06iZ", seconds, usec);
+		else
+			since_utc = g_strdup_printf ("%sZ", seconds);
+	}
+	pk_transaction_old_transactions_start (transaction, number, offset, since_utc, context);
 }
 
 static void
@@ -4203,7 +4961,7 @@ out:
 	pk_transaction_dbus_return (context, error);
 }
 
-static void
+void
 pk_transaction_refresh_cache (PkTransaction *transaction,
 			      GVariant *params,
 			      GDBusMethodInvocation *context)
@@ -4780,7 +5538,7 @@ out:
 	pk_transaction_dbus_return (context, error);
 }
 
-static gboolean
+gboolean
 pk_transaction_set_hint (PkTransaction *transaction,
 			 const gchar *key,
 			 const gchar *value,
@@ -4861,6 +5619,25 @@ pk_transaction_set_hint (PkTransaction *transaction,
 		return TRUE;
 	}
 
+	/* progress-rate=<updates-per-second> */
+	if (g_strcmp0 (key, "progress-rate") == 0) {
+		guint rate;
+		if (!pk_strtouint (value, &rate) ||
+		    rate == 0 || rate > PK_TRANSACTION_PROGRESS_RATE_MAX) {
+			g_set_error (error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "progress rate must be 1 to %u, not %s",
+				     (guint) PK_TRANSACTION_PROGRESS_RATE_MAX, value);
+			return FALSE;
+		}
+		priv->progress_interval = 1000 / rate;
+
+		/* the timer is created again at the new rate when needed */
+		unschedule_progress_changed (transaction);
+		return TRUE;
+	}
+
 	/* cache-age=<time-in-seconds> */
 	if (g_strcmp0 (key, "cache-age") == 0) {
 		guint cache_age;
@@ -4914,6 +5691,19 @@ pk_transaction_set_hint (PkTransaction *transaction,
 		return TRUE;
 	}
 
+	/* can the client map results sent in a memfd? */
+	if (g_strcmp0 (key, "supports-memfd-results") == 0) {
+		if (g_strcmp0 (value, "true") != 0) {
+			g_set_error (error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "supports-memfd-results hint expects true only, not %s", value);
+			return FALSE;
+		}
+		priv->client_supports_memfd_results = TRUE;
+		return TRUE;
+	}
+
 	/* to preserve forwards and backwards compatibility, we ignore
 	 * extra options here */
 	g_warning ("unknown option: %s with value %s", key, value);
@@ -4960,6 +5750,96 @@ out:
 	pk_transaction_dbus_return (context, error);
 }
 
+/*
+ * pk_transaction_set_results_socket:
+ *
+ * The client hands us one end of a socket pair it made itself, so unlike
+ * an address there is nothing the daemon has to connect to. The method
+ * returns once the private connection is set up, so it is in place when
+ * the transaction runs.
+ **/
+static void
+pk_transaction_set_results_socket (PkTransaction *transaction,
+				   GVariant *params,
+				   GDBusMethodInvocation *context)
+{
+	gint fd;
+	gint32 idx;
+	GUnixFDList *fd_list;
+	g_autoptr(GCredentials) credentials = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GSocket) socket = NULL;
+	g_autoptr(GSocketConnection) stream = NULL;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	g_variant_get (params, "(h)", &idx);
+	g_debug ("SetResultsSocket method called: %i", idx);
+
+	/* only once, and before any results have been sent */
+	if (transaction->priv->results_connection != NULL ||
+	    transaction->priv->results_socket_context != NULL ||
+	    transaction->priv->results_connection_decided) {
+		g_set_error_literal (&error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "the results socket can only be set once before running");
+		goto out;
+	}
+
+	fd_list = g_dbus_message_get_unix_fd_list (g_dbus_method_invocation_get_message (context));
+	if (fd_list == NULL) {
+		g_set_error_literal (&error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "no file descriptor was passed");
+		goto out;
+	}
+	fd = g_unix_fd_list_get (fd_list, idx, &error);
+	if (fd < 0)
+		goto out;
+	socket = g_socket_new_from_fd (fd, &error);
+	if (socket == NULL) {
+		close (fd);
+		goto out;
+	}
+	if (g_socket_get_family (socket) != G_SOCKET_FAMILY_UNIX ||
+	    g_socket_get_socket_type (socket) != G_SOCKET_TYPE_STREAM) {
+		g_set_error_literal (&error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "the results socket has to be a unix stream socket");
+		goto out;
+	}
+
+	/* the peer of a socket pair is whoever created it */
+	credentials = g_socket_get_credentials (socket, &error);
+	if (credentials == NULL)
+		goto out;
+	if (g_credentials_get_unix_user (credentials, NULL) != transaction->priv->client_uid) {
+		g_set_error_literal (&error,
+				     PK_TRANSACTION_ERROR,
+				     PK_TRANSACTION_ERROR_REFUSED_BY_POLICY,
+				     "the results socket is not owned by the caller");
+		goto out;
+	}
+
+	/* the handshake needs the client, so do not block on it */
+	stream = g_socket_connection_factory_create_connection (socket);
+	transaction->priv->results_socket_context = context;
+	g_dbus_connection_new (G_IO_STREAM (stream),
+			       NULL,
+			       G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+			       NULL,
+			       transaction->priv->cancellable,
+			       pk_transaction_results_connection_cb,
+			       g_object_ref (transaction));
+	return;
+out:
+	pk_transaction_dbus_return (context, error);
+}
+
 static void
 pk_transaction_update_packages (PkTransaction *transaction,
 				GVariant *params,
@@ -5210,6 +6090,8 @@ pk_transaction_get_property (GDBusConnection *connection_, const gchar *sender,
 
 	if (g_strcmp0 (property_name, "Role") == 0)
 		return g_variant_new_uint32 (priv->role);
+	if (g_strcmp0 (property_name, "PhaseTimes") == 0)
+		return pk_transaction_get_phase_times (transaction);
 	if (g_strcmp0 (property_name, "Status") == 0)
 		return g_variant_new_uint32 (priv->status);
 	if (g_strcmp0 (property_name, "LastPackage") == 0)
@@ -5240,7 +6122,7 @@ pk_transaction_get_property (GDBusConnection *connection_, const gchar *sender,
 	return NULL;
 }
 
-static void
+void
 pk_transaction_method_call (GDBusConnection *connection_, const gchar *sender,
 			    const gchar *object_path, const gchar *interface_name,
 			    const gchar *method_name, GVariant *parameters,
@@ -5264,6 +6146,10 @@ pk_transaction_method_call (GDBusConnection *connection_, const gchar *sender,
 		pk_transaction_set_hints (transaction, parameters, invocation);
 		return;
 	}
+	if (g_strcmp0 (method_name, "SetResultsSocket") == 0) {
+		pk_transaction_set_results_socket (transaction, parameters, invocation);
+		return;
+	}
 	if (g_strcmp0 (method_name, "AcceptEula") == 0) {
 		pk_transaction_accept_eula (transaction, parameters, invocation);
 		return;
@@ -5272,6 +6158,12 @@ pk_transaction_method_call (GDBusConnection *connection_, const gchar *sender,
 		pk_transaction_cancel (transaction, parameters, invocation);
 		return;
 	}
+
+	/* used to share the backend work with identical transactions */
+	g_free (transaction->priv->coalesce_key);
+	transaction->priv->coalesce_key = pk_transaction_build_coalesce_key (transaction,
+									     method_name,
+									     parameters);
 	if (g_strcmp0 (method_name, "DownloadPackages") == 0) {
 		pk_transaction_download_packages (transaction, parameters, invocation);
 		return;
@@ -5304,6 +6196,10 @@ pk_transaction_method_call (GDBusConnection *connection_, const gchar *sender,
 		pk_transaction_get_old_transactions (transaction, parameters, invocation);
 		return;
 	}
+	if (g_strcmp0 (method_name, "GetOldTransactionsPaged") == 0) {
+		pk_transaction_get_old_transactions_paged (transaction, parameters, invocation);
+		return;
+	}
 	if (g_strcmp0 (method_name, "GetPackages") == 0) {
 		pk_transaction_get_packages (transaction, parameters, invocation);
 		return;
@@ -5444,6 +6340,7 @@ pk_transaction_reset_after_lock_error (PkTransaction *transaction)
 	/* clear results */
 	g_object_unref (priv->results);
 	priv->results = pk_results_new ();
+	pk_transaction_reset_phases (transaction);
 
 	/* reset transaction state */
 	/* first set state manually, otherwise set_state will refuse to switch to an earlier stage */
@@ -5494,8 +6391,13 @@ pk_transaction_init (PkTransaction *transaction)
 	transaction->priv->role = PK_ROLE_ENUM_UNKNOWN;
 	transaction->priv->status = PK_STATUS_ENUM_WAIT;
 	transaction->priv->percentage = PK_BACKEND_PERCENTAGE_INVALID;
+	transaction->priv->packages_chunk_size = PK_TRANSACTION_PACKAGES_CHUNK_SIZE;
+	transaction->priv->progress_interval = 1000 / PK_TRANSACTION_PROGRESS_RATE_DEFAULT;
+	transaction->priv->item_progress = g_ptr_array_new_with_free_func (g_object_unref);
 	transaction->priv->state = PK_TRANSACTION_STATE_UNKNOWN;
+	transaction->priv->phase_time[PK_TRANSACTION_PHASE_CREATED] = g_get_monotonic_time ();
 	transaction->priv->dbus = pk_dbus_new ();
+	transaction->priv->result_cache = pk_result_cache_new ();
 	transaction->priv->results = pk_results_new ();
 	transaction->priv->supported_content_types = g_ptr_array_new_with_free_func (g_free);
 	transaction->priv->cancellable = g_cancellable_new ();
@@ -5520,6 +6422,8 @@ pk_transaction_dispose (GObject *object)
 		g_cancellable_cancel (transaction->priv->cancellable);
 		/* emit an ::ErrorCode() and then ::Finished() */
 		pk_transaction_error_code_emit (transaction, PK_ERROR_ENUM_NOT_AUTHORIZED, "client did not authorize action");
+		/* nothing was sent on it, and we cannot wait for a flush here */
+		pk_transaction_close_results_connection (transaction);
 		pk_transaction_finished_emit (transaction, PK_EXIT_ENUM_FAILED, 0);
 	}
 
@@ -5537,6 +6441,13 @@ pk_transaction_dispose (GObject *object)
 
 	unschedule_progress_changed (transaction);
 
+	/* stop reading old transactions for a client that has gone */
+	if (transaction->priv->old_transactions_id != 0) {
+		g_source_remove (transaction->priv->old_transactions_id);
+		transaction->priv->old_transactions_id = 0;
+	}
+	g_clear_pointer (&transaction->priv->old_transactions, pk_transaction_db_cursor_free);
+
 	/* send signal to clients that we are about to be destroyed */
 	if (transaction->priv->connection != NULL) {
 		g_debug ("emitting destroy %s", transaction->priv->tid);
@@ -5578,7 +6489,9 @@ pk_transaction_finalize (GObject *object)
 	g_free (transaction->priv->tid);
 	g_free (transaction->priv->sender);
 	g_free (transaction->priv->cmdline);
+	g_free (transaction->priv->coalesce_key);
 	g_ptr_array_unref (transaction->priv->supported_content_types);
+	g_ptr_array_unref (transaction->priv->item_progress);
 
 	if (transaction->priv->connection != NULL)
 		g_object_unref (transaction->priv->connection);
@@ -5590,7 +6503,15 @@ pk_transaction_finalize (GObject *object)
 	if (transaction->priv->backend != NULL)
 		g_object_unref (transaction->priv->backend);
 	g_object_unref (transaction->priv->job);
+	if (transaction->priv->primary_job != NULL)
+		g_object_unref (transaction->priv->primary_job);
 	g_object_unref (transaction->priv->transaction_db);
+	g_object_unref (transaction->priv->result_cache);
+	if (transaction->priv->results_connection != NULL) {
+		g_dbus_connection_close (transaction->priv->results_connection,
+					 NULL, NULL, NULL);
+		g_object_unref (transaction->priv->results_connection);
+	}
 	g_object_unref (transaction->priv->results);
 	if (transaction->priv->authority != NULL)
 		g_object_unref (transaction->priv->authority);
@@ -5603,9 +6524,14 @@ PkTransaction *
 pk_transaction_new (GKeyFile *conf, GDBusNodeInfo *introspection)
 {
 	PkTransaction *transaction;
+	gint chunk_size;
+
 	transaction = g_object_new (PK_TYPE_TRANSACTION, NULL);
 	transaction->priv->conf = g_key_file_ref (conf);
 	transaction->priv->job = pk_backend_job_new (conf);
+	chunk_size = g_key_file_get_integer (conf, "Daemon", "PackagesChunkSize", NULL);
+	if (chunk_size > 0)
+		transaction->priv->packages_chunk_size = chunk_size;
 	transaction->priv->introspection = g_dbus_node_info_ref (introspection);
 	return PK_TRANSACTION (transaction);
 }
@@ -63,6 +63,18 @@ typedef enum {
 	PK_TRANSACTION_STATE_UNKNOWN
 } PkTransactionState;
 
+/* the points in the life of a transaction that are timed, in order */
+typedef enum {
+	PK_TRANSACTION_PHASE_CREATED,
+	PK_TRANSACTION_PHASE_REQUESTED,		/* role method called */
+	PK_TRANSACTION_PHASE_AUTHORIZED,	/* ready, so queued */
+	PK_TRANSACTION_PHASE_RUNNING,
+	PK_TRANSACTION_PHASE_FIRST_RESULT,
+	PK_TRANSACTION_PHASE_FINISHED,		/* by the backend */
+	PK_TRANSACTION_PHASE_EMITTED,		/* Finished sent to the client */
+	PK_TRANSACTION_PHASE_LAST
+} PkTransactionPhase;
+
 GQuark		 pk_transaction_error_quark			(void);
 GType		 pk_transaction_get_type			(void);
 PkTransaction	*pk_transaction_new				(GKeyFile		*conf,
@@ -83,11 +95,20 @@ PkTransactionState pk_transaction_get_state			(PkTransaction	*transaction);
 void		 pk_transaction_set_state			(PkTransaction	*transaction,
 								 PkTransactionState state);
 const gchar	*pk_transaction_state_to_string			(PkTransactionState state);
+const gchar	*pk_transaction_phase_to_string			(PkTransactionPhase phase);
+gint64		 pk_transaction_get_phase_time			(PkTransaction	*transaction,
+								 PkTransactionPhase phase);
+PkExitEnum	 pk_transaction_get_exit			(PkTransaction	*transaction);
+guint		 pk_transaction_get_packages_emitted		(PkTransaction	*transaction);
 const gchar	*pk_transaction_get_tid				(PkTransaction	*transaction);
 gboolean	 pk_transaction_is_exclusive			(PkTransaction	*transaction);
 gboolean	 pk_transaction_is_finished_with_lock_required	(PkTransaction *transaction);
 void		 pk_transaction_reset_after_lock_error		(PkTransaction *transaction);
 void		 pk_transaction_make_exclusive			(PkTransaction *transaction);
+gboolean	 pk_transaction_subscribe			(PkTransaction	*transaction,
+								 PkTransaction	*primary);
+void		 pk_transaction_unsubscribe			(PkTransaction	*transaction);
+const gchar	*pk_transaction_get_coalesce_key		(PkTransaction	*transaction);
 void		 pk_transaction_skip_auth_checks		(PkTransaction *transaction,
 								 gboolean skip_checks);
 